@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    This file contains a minimal harness for timing engine code.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include <iostream>
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    // Each measurement is the median over this many batches, and a batch
+    // repeats the function until it takes at least minBatchSeconds
+    constexpr int numBatches = 21;
+    constexpr double minBatchSeconds = 0.01;
+
+    double getSeconds (juce::int64 startTicks) noexcept
+    {
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    }
+
+    const void* volatile sink = nullptr;
+}
+
+//==============================================================================
+Benchmark::Benchmark (const char* nameIn, std::function<void()> runIn)
+    : name (nameIn), run (std::move (runIn))
+{
+    getAll().push_back (this);
+}
+
+std::vector<Benchmark*>& Benchmark::getAll()
+{
+    static std::vector<Benchmark*> benchmarks;
+    return benchmarks;
+}
+
+//==============================================================================
+double measure (const juce::String& label, const std::function<void()>& function, double itemsPerCall, const char* itemName)
+{
+    // Warm up caches and find how many calls fill a batch
+    int callsPerBatch = 1;
+
+    for (;;)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < callsPerBatch; ++i)
+            function();
+
+        if (getSeconds (start) >= minBatchSeconds || callsPerBatch >= (1 << 24))
+            break;
+
+        callsPerBatch *= 2;
+    }
+
+    std::vector<double> nanosecondsPerCall;
+
+    for (int batch = 0; batch < numBatches; ++batch)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < callsPerBatch; ++i)
+            function();
+
+        nanosecondsPerCall.push_back (getSeconds (start) * 1.0e9 / callsPerBatch);
+    }
+
+    std::nth_element (nanosecondsPerCall.begin(), nanosecondsPerCall.begin() + numBatches / 2, nanosecondsPerCall.end());
+    const auto median = nanosecondsPerCall[numBatches / 2];
+
+    auto line = label.paddedRight (' ', 48) + juce::String (median, 1).paddedLeft (' ', 12) + " ns";
+
+    if (itemsPerCall > 0.0)
+        line << juce::String (itemsPerCall * 1.0e3 / median, 1).paddedLeft (' ', 12) << " M" << itemName << "/s";
+
+    std::cout << line << std::endl;
+    return median;
+}
+
+void doNotOptimise (const void* data) noexcept
+{
+    sink = data;
+}
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,40 @@
+/*
+  ==============================================================================
+
+    This file contains a minimal harness for timing engine code.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune::benchmarks
+{
+
+//==============================================================================
+/**
+    A named benchmark. Source files register theirs with static instances, and
+    the benchmark executable runs every one whose name matches its arguments.
+*/
+struct Benchmark
+{
+    Benchmark (const char* name, std::function<void()> run);
+
+    static std::vector<Benchmark*>& getAll();
+
+    const char* name;
+    std::function<void()> run;
+};
+
+/** Calls a function repeatedly, then prints and returns the median time per call
+    in nanoseconds. With itemsPerCall, the throughput is printed as well.
+*/
+double measure (const juce::String& label, const std::function<void()>& function,
+                double itemsPerCall = 0.0, const char* itemName = "samples");
+
+/** Makes the compiler assume the memory is read, so work producing it isn't optimised away. */
+void doNotOptimise (const void*) noexcept;
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,35 @@
+/*
+  ==============================================================================
+
+    This file contains the entry point of the benchmark executable.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include <iostream>
+
+//==============================================================================
+/** Runs every benchmark, or only those whose names contain one of the arguments. */
+int main (int argc, char* argv[])
+{
+    juce::StringArray filters;
+
+    for (int i = 1; i < argc; ++i)
+        filters.add (argv[i]);
+
+    for (auto* benchmark : hifitune::benchmarks::Benchmark::getAll())
+    {
+        const juce::String name (benchmark->name);
+
+        if (! filters.isEmpty() && std::none_of (filters.begin(), filters.end(),
+                                                 [&name] (const juce::String& filter) { return name.containsIgnoreCase (filter); }))
+            continue;
+
+        std::cout << "\n" << name << std::endl;
+        benchmark->run();
+    }
+
+    return 0;
+}
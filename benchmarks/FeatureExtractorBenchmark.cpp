@@ -0,0 +1,55 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the feature extractor.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/FeatureExtractor.h"
+
+#include <iostream>
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    void benchmarkFeatureExtractor()
+    {
+        const FeatureConfig config;
+        FeatureExtractor extractor (config);
+
+        // A voiced frame, so that pitch estimation doesn't stop at the silence check
+        std::vector<float> frame ((size_t) config.fftSize);
+        juce::Random random (1);
+
+        for (size_t i = 0; i < frame.size(); ++i)
+            frame[i] = 0.5f * std::sin (juce::MathConstants<float>::twoPi * 220.0f * (float) i / (float) config.sampleRate)
+                     + 0.01f * (random.nextFloat() - 0.5f);
+
+        std::vector<float> mel ((size_t) config.numMelBins);
+        float f0 = 0.0f, voicing = 0.0f;
+
+        const auto nanosecondsPerFrame = measure ("processFrame", [&]
+        {
+            extractor.processFrame (frame.data(), f0, voicing, mel.data());
+            doNotOptimise (mel.data());
+        }, 1.0, "frames");
+
+        // Frames are analysed at the model rate, whatever the source rate
+        const auto framesPerHour = 3600.0 * config.sampleRate / config.hopSize;
+        const auto numThreads = juce::jmax (1, juce::SystemStats::getNumPhysicalCpus() - 1);
+
+        std::cout << "one hour of audio: " << juce::String (framesPerHour * nanosecondsPerFrame * 1.0e-9, 1) << " s on one thread, "
+                  << juce::String (framesPerHour * nanosecondsPerFrame * 1.0e-9 / numThreads, 1) << " s on "
+                  << numThreads << " analysis threads" << std::endl;
+    }
+
+    const Benchmark featureExtractor ("FeatureExtractor", benchmarkFeatureExtractor);
+}
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the instrumentation.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/Instrumentation.h"
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    void benchmarkInstrumentation()
+    {
+        // The cost every processBlock pays when nobody is looking
+        Instrumentation::setEnabled (false);
+
+        measure ("ScopedTimer (disabled)", []
+        {
+            const Instrumentation::ScopedTimer timer (Instrumentation::EventType::rendererBlock, 512);
+        });
+
+        Instrumentation::setEnabled (true);
+
+        measure ("ScopedTimer (enabled)", []
+        {
+            const Instrumentation::ScopedTimer timer (Instrumentation::EventType::rendererBlock, 512);
+        });
+
+        measure ("count (enabled)", []
+        {
+            Instrumentation::count (Instrumentation::EventType::renderAheadHit);
+        });
+
+        Instrumentation::setEnabled (false);
+    }
+
+    const Benchmark instrumentation ("Instrumentation", benchmarkInstrumentation);
+}
+
+} // namespace hifitune::benchmarks
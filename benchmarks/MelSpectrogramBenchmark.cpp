@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the mel spectrogram front end.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/MelSpectrogram.h"
+
+#include <iostream>
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    // A minute of singing at the model rate, and an edit of a tenth of a second in it
+    constexpr double lengthInSeconds = 60.0;
+    constexpr double editLengthInSeconds = 0.1;
+
+    /** One frame at a time, with the window computed on the fly and a dense
+        filterbank, kept as a baseline.
+    */
+    class NaiveMelSpectrogram
+    {
+    public:
+        explicit NaiveMelSpectrogram (const FeatureConfig& configIn)
+            : config (configIn),
+              fft (juce::roundToInt (std::log2 ((double) configIn.fftSize))),
+              numBins (configIn.fftSize / 2 + 1),
+              fftBuffer ((size_t) configIn.fftSize * 2),
+              filterbank ((size_t) configIn.numMelBins * (size_t) numBins)
+        {
+            const auto hzToMel = [] (float hz)
+            {
+                return hz < 1000.0f ? hz * 3.0f / 200.0f : 15.0f + std::log (hz / 1000.0f) * 27.0f / std::log (6.4f);
+            };
+
+            const auto melToHz = [] (float mel)
+            {
+                return mel < 15.0f ? mel * 200.0f / 3.0f : 1000.0f * std::exp ((mel - 15.0f) * std::log (6.4f) / 27.0f);
+            };
+
+            const auto minMel = hzToMel (config.melMinHz), maxMel = hzToMel (config.melMaxHz);
+            const auto edge = [&] (int i) { return melToHz (minMel + (maxMel - minMel) * (float) i / (float) (config.numMelBins + 1)); };
+
+            for (int m = 0; m < config.numMelBins; ++m)
+            {
+                const auto lower = edge (m), centre = edge (m + 1), upper = edge (m + 2);
+
+                for (int k = 0; k < numBins; ++k)
+                {
+                    const auto hz = (float) k * (float) config.sampleRate / (float) config.fftSize;
+                    const auto weight = juce::jmin ((hz - lower) / (centre - lower), (upper - hz) / (upper - centre));
+                    filterbank[(size_t) (m * numBins + k)] = juce::jmax (0.0f, weight) * 2.0f / (upper - lower);
+                }
+            }
+        }
+
+        void processFrame (const float* frame, float* melOut) noexcept
+        {
+            std::fill (fftBuffer.begin(), fftBuffer.end(), 0.0f);
+
+            for (int i = 0; i < config.fftSize; ++i)
+                fftBuffer[(size_t) i] = frame[i] * 0.5f * (1.0f - std::cos (juce::MathConstants<float>::twoPi * (float) i / (float) (config.fftSize - 1)));
+
+            fft.performFrequencyOnlyForwardTransform (fftBuffer.data(), true);
+
+            for (int m = 0; m < config.numMelBins; ++m)
+            {
+                float sum = 0.0f;
+
+                for (int k = 0; k < numBins; ++k)
+                    sum += filterbank[(size_t) (m * numBins + k)] * fftBuffer[(size_t) k];
+
+                melOut[m] = std::log (juce::jmax (FeatureConfig::melFloor, sum));
+            }
+        }
+
+    private:
+        FeatureConfig config;
+        juce::dsp::FFT fft;
+        int numBins;
+        std::vector<float> fftBuffer, filterbank;
+    };
+
+    //==============================================================================
+    void benchmarkMelSpectrogram()
+    {
+        const FeatureConfig config;
+        const auto numFrames = (int) (lengthInSeconds * config.sampleRate / config.hopSize);
+        const auto numBins = (size_t) config.numMelBins;
+
+        std::vector<float> signal ((size_t) (numFrames - 1) * (size_t) config.hopSize + (size_t) config.fftSize);
+        juce::Random random (1);
+
+        for (size_t i = 0; i < signal.size(); ++i)
+            signal[i] = 0.5f * std::sin (juce::MathConstants<float>::twoPi * 220.0f * (float) i / (float) config.sampleRate)
+                      + 0.01f * (random.nextFloat() - 0.5f);
+
+        std::vector<float> naiveMel ((size_t) numFrames * numBins), mel ((size_t) numFrames * numBins);
+        NaiveMelSpectrogram naive (config);
+        MelSpectrogram melSpectrogram (config);
+
+        measure ("naive, frame by frame", [&]
+        {
+            for (int frame = 0; frame < numFrames; ++frame)
+                naive.processFrame (signal.data() + (size_t) frame * (size_t) config.hopSize, naiveMel.data() + (size_t) frame * numBins);
+
+            doNotOptimise (naiveMel.data());
+        }, numFrames, "frames");
+
+        measure ("batched", [&]
+        {
+            melSpectrogram.process (signal.data(), numFrames, mel.data());
+            doNotOptimise (mel.data());
+        }, numFrames, "frames");
+
+        float maxDifference = 0.0f;
+
+        for (size_t i = 0; i < mel.size(); ++i)
+            maxDifference = juce::jmax (maxDifference, std::abs (mel[i] - naiveMel[i]));
+
+        std::cout << "largest difference from the naive version: " << maxDifference << std::endl;
+
+        // An edit in the middle only needs the frames around it recomputed
+        const auto editStart = (juce::int64) signal.size() / 2;
+        const auto editLength = (juce::int64) (editLengthInSeconds * config.sampleRate);
+        const auto frames = MelSpectrogram::getFramesOverlapping (config, { editStart - config.fftSize / 2, editStart - config.fftSize / 2 + editLength })
+                                .getIntersectionWith ({ 0, (juce::int64) numFrames });
+
+        measure ("update after a " + juce::String (editLengthInSeconds, 1) + " s edit", [&]
+        {
+            melSpectrogram.process (signal.data() + (size_t) frames.getStart() * (size_t) config.hopSize, (int) frames.getLength(),
+                                    mel.data() + (size_t) frames.getStart() * numBins);
+            doNotOptimise (mel.data());
+        }, (double) frames.getLength(), "frames");
+    }
+
+    const Benchmark melSpectrogram ("MelSpectrogram", benchmarkMelSpectrogram);
+}
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the mixing kernels.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/MixKernels.h"
+#include "engine/RenderTrack.h"
+
+#include <iostream>
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    // The per-sample loops the kernels replaced, kept as a baseline
+    void scalarMix (float* dest, const float* source, int numSamples, bool addToDest) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto sample = source != nullptr ? source[i] : 0.0f;
+
+            if (addToDest)
+                dest[i] += sample;
+            else
+                dest[i] = sample;
+        }
+    }
+
+    void scalarCrossfade (float* dest, const float* from, const float* to, int numSamples,
+                          float startGain, float endGain, bool addToDest) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto gain = startGain + (endGain - startGain) * (float) i / (float) numSamples;
+            const auto sample = (from != nullptr ? from[i] * (1.0f - gain) : 0.0f)
+                              + (to != nullptr ? to[i] * gain : 0.0f);
+
+            if (addToDest)
+                dest[i] += sample;
+            else
+                dest[i] = sample;
+        }
+    }
+
+    std::vector<float> makeNoise (size_t numSamples, int seed)
+    {
+        juce::Random random (seed);
+        std::vector<float> samples (numSamples);
+
+        for (auto& sample : samples)
+            sample = random.nextFloat() * 2.0f - 1.0f;
+
+        return samples;
+    }
+
+    //==============================================================================
+    void benchmarkKernels()
+    {
+        std::cout << "instruction set: " << MixKernels::getInstructionSetName() << std::endl;
+
+        for (const auto blockSize : { 64, 512, 4096 })
+        {
+            const auto a = makeNoise ((size_t) blockSize + 1, 1);
+            const auto b = makeNoise ((size_t) blockSize + 1, 2);
+            std::vector<float> dest ((size_t) blockSize + 1);
+
+            // Offset by one sample, as reads at arbitrary positions mostly are
+            const auto* from = a.data() + 1;
+            const auto* to = b.data() + 1;
+            auto* out = dest.data() + 1;
+            const auto suffix = " (" + juce::String (blockSize) + ")";
+
+            measure ("add, scalar" + suffix, [&] { scalarMix (out, from, blockSize, true); doNotOptimise (out); }, blockSize);
+            measure ("add, kernel" + suffix, [&] { MixKernels::mix (out, from, blockSize, true); doNotOptimise (out); }, blockSize);
+
+            measure ("fade, scalar" + suffix, [&] { scalarCrossfade (out, nullptr, to, blockSize, 0.0f, 1.0f, true); doNotOptimise (out); }, blockSize);
+            measure ("fade, kernel" + suffix, [&] { MixKernels::mixWithRamp (out, to, blockSize, 0.0f, 1.0f, true); doNotOptimise (out); }, blockSize);
+
+            measure ("crossfade, scalar" + suffix, [&] { scalarCrossfade (out, from, to, blockSize, 0.0f, 1.0f, true); doNotOptimise (out); }, blockSize);
+            measure ("crossfade, kernel" + suffix, [&] { MixKernels::mixCrossfade (out, from, to, blockSize, 0.0f, 1.0f, true); doNotOptimise (out); }, blockSize);
+        }
+    }
+
+    //==============================================================================
+    // Many regions overlapping one stereo block, as in a dense session
+    void benchmarkRenderTrackRead()
+    {
+        constexpr int numRegions = 64, numChannels = 2, blockSize = 512;
+        constexpr int segmentLength = RenderTrack::defaultSegmentLength;
+        constexpr juce::int64 trackLength = 4 * segmentLength;
+
+        RenderTrack track (trackLength, numChannels);
+
+        for (int index = 0; index < track.getNumSegments(); ++index)
+        {
+            auto audio = std::make_shared<juce::AudioBuffer<float>> (numChannels, segmentLength + RenderTrack::crossfadeLength);
+
+            for (int c = 0; c < numChannels; ++c)
+            {
+                const auto noise = makeNoise ((size_t) audio->getNumSamples(), index * numChannels + c);
+                audio->copyFrom (c, 0, noise.data(), audio->getNumSamples());
+            }
+
+            auto segment = std::make_unique<RenderedSegment>();
+            segment->audio = std::move (audio);
+            segment->quality = RenderedSegment::Quality::neural;
+            segment->key = (juce::uint64) index + 1;
+
+            if (track.tryClaim (index, segment->key))
+                track.publish (index, std::move (segment));
+        }
+
+        juce::AudioBuffer<float> output (numChannels, blockSize);
+
+        for (const auto position : { (juce::int64) segmentLength / 2, (juce::int64) segmentLength })
+        {
+            const auto label = juce::String (numRegions) + " regions, " + (position == segmentLength ? "at a segment start" : "mid-segment");
+
+            measure (label, [&]
+            {
+                for (int region = 0; region < numRegions; ++region)
+                    track.read (output, 0, position, blockSize, region > 0);
+
+                doNotOptimise (output.getReadPointer (0));
+            }, (double) numRegions * numChannels * blockSize);
+        }
+    }
+
+    const Benchmark kernels ("MixKernels", benchmarkKernels);
+    const Benchmark renderTrackRead ("RenderTrack read", benchmarkRenderTrackRead);
+}
+
+} // namespace hifitune::benchmarks
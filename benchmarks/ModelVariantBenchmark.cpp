@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks comparing the precisions of the vocoder.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/FeatureExtractor.h"
+#include "engine/InferenceScheduler.h"
+
+#include <iostream>
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    const char* getName (ModelPrecision precision)
+    {
+        switch (precision)
+        {
+            case ModelPrecision::fp32:  return "fp32";
+            case ModelPrecision::fp16:  return "fp16";
+            case ModelPrecision::int8:  return "int8";
+        }
+
+        return "unknown";
+    }
+
+    // Features of a gliding, slightly noisy tone, about as hard on the model as singing
+    void makeFeatures (const FeatureConfig& config, int numFrames, std::vector<float>& mel, std::vector<float>& f0)
+    {
+        FeatureExtractor extractor (config);
+        juce::Random random (1);
+
+        std::vector<float> signal ((size_t) (numFrames * config.hopSize + config.fftSize));
+        double phase = 0.0;
+
+        for (size_t i = 0; i < signal.size(); ++i)
+        {
+            const auto frequency = 180.0 + 120.0 * (double) i / (double) signal.size();
+            phase += juce::MathConstants<double>::twoPi * frequency / config.sampleRate;
+            signal[i] = 0.5f * (float) std::sin (phase) + 0.01f * (random.nextFloat() - 0.5f);
+        }
+
+        mel.resize ((size_t) numFrames * (size_t) config.numMelBins);
+        f0.resize ((size_t) numFrames);
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            float voicing = 0.0f;
+            extractor.processFrame (signal.data() + (size_t) frame * (size_t) config.hopSize, f0[(size_t) frame], voicing,
+                                    mel.data() + (size_t) frame * (size_t) config.numMelBins);
+        }
+    }
+
+    //==============================================================================
+    // Throughput of each precision that's installed, and how far its output is
+    // from the full-precision model's
+    void benchmarkModelVariants()
+    {
+        constexpr int numFrames = 256;
+
+        const FeatureConfig config;
+        const auto options = InferenceScheduler::getDefaultOptions().inference;
+        const auto& cpu = CpuFeatures::get();
+
+        std::cout << "CPU features: " << cpu.getDescription() << std::endl;
+
+        for (const auto quality : { ModelQuality::best, ModelQuality::balanced, ModelQuality::fastest })
+        {
+            juce::StringArray names;
+
+            for (const auto precision : Vocoder::getPreferredPrecisions (quality, cpu))
+                names.add (getName (precision));
+
+            std::cout << (quality == ModelQuality::best ? "best" : quality == ModelQuality::balanced ? "balanced" : "fastest")
+                      << " quality tries: " << names.joinIntoString (", ") << std::endl;
+        }
+
+        std::vector<float> mel, f0;
+        makeFeatures (config, numFrames, mel, f0);
+
+        const auto numSamples = (size_t) numFrames * (size_t) config.hopSize;
+        std::vector<float> reference;
+
+        for (const auto precision : { ModelPrecision::fp32, ModelPrecision::fp16, ModelPrecision::int8 })
+        {
+            const juce::String name (getName (precision));
+            const auto vocoder = Vocoder::create ("vocoder", precision, config, options);
+
+            if (vocoder == nullptr)
+            {
+                std::cout << name << ": no model" << std::endl;
+                continue;
+            }
+
+            std::vector<float> output (numSamples);
+
+            // Also warms the session up before timing it
+            if (! vocoder->render (mel.data(), f0.data(), numFrames, output.data()))
+            {
+                std::cout << name << ": inference failed" << std::endl;
+                continue;
+            }
+
+            measure (name, [&]
+            {
+                vocoder->render (mel.data(), f0.data(), numFrames, output.data());
+                doNotOptimise (output.data());
+            }, (double) numSamples);
+
+            if (precision == ModelPrecision::fp32)
+            {
+                reference = output;
+                continue;
+            }
+
+            if (reference.empty())
+                continue;
+
+            double maxError = 0.0, errorEnergy = 0.0, signalEnergy = 0.0;
+
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const auto error = (double) output[i] - (double) reference[i];
+                maxError = juce::jmax (maxError, std::abs (error));
+                errorEnergy += error * error;
+                signalEnergy += (double) reference[i] * (double) reference[i];
+            }
+
+            std::cout << name << " vs fp32: max error " << juce::String (maxError, 5)
+                      << ", RMS error " << juce::String (std::sqrt (errorEnergy / (double) numSamples), 5)
+                      << ", SNR " << juce::String (10.0 * std::log10 (juce::jmax (1.0e-20, signalEnergy) / juce::jmax (1.0e-20, errorEnergy)), 1)
+                      << " dB" << std::endl;
+        }
+    }
+
+    const Benchmark modelVariants ("Model variants", benchmarkModelVariants);
+}
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the pitch curve.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/PitchCurve.h"
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    // An hour-long take with a point every 5 ms, as dense drawn automation leaves
+    constexpr double takeLength = 3600.0;
+    constexpr double pointInterval = 0.005;
+
+    // An editor showing the whole take
+    constexpr int numPixelColumns = 2000;
+
+    std::shared_ptr<const PitchCurve> makeDenseCurve()
+    {
+        juce::Random random (1);
+        PitchCurve::Points points { ArenaAllocator<PitchCurve::Point> (std::make_shared<DocumentArena>()) };
+        points.reserve ((size_t) (takeLength / pointInterval));
+
+        for (double time = 0.0; time < takeLength; time += pointInterval)
+        {
+            const auto flags = (juce::uint8) (random.nextInt (200) == 0 ? PitchCurve::phraseEnd : 0);
+            points.push_back ({ time, random.nextFloat() * 4.0f - 2.0f, flags });
+        }
+
+        return PitchCurve::create (std::move (points));
+    }
+
+    // Every point in the range, one at a time, kept as a baseline
+    juce::Range<float> scanMinMax (const PitchCurve& curve, juce::Range<double> timeRange)
+    {
+        auto minValue = std::numeric_limits<float>::max(), maxValue = std::numeric_limits<float>::lowest();
+
+        curve.forEachRun (curve.getPointsIn (timeRange), [&] (const double*, const float* values, const juce::uint8*, int num)
+        {
+            for (int i = 0; i < num; ++i)
+            {
+                minValue = juce::jmin (minValue, values[i]);
+                maxValue = juce::jmax (maxValue, values[i]);
+            }
+        });
+
+        return { minValue, maxValue };
+    }
+
+    //==============================================================================
+    void benchmarkPitchCurve()
+    {
+        const auto curve = makeDenseCurve();
+        const auto columnLength = takeLength / numPixelColumns;
+
+        float result = 0.0f;
+
+        measure ("draw whole take, scan", [&]
+        {
+            for (int column = 0; column < numPixelColumns; ++column)
+                result += scanMinMax (*curve, { column * columnLength, (column + 1) * columnLength }).getLength();
+
+            doNotOptimise (&result);
+        }, numPixelColumns, "columns");
+
+        measure ("draw whole take, summary tree", [&]
+        {
+            for (int column = 0; column < numPixelColumns; ++column)
+                result += curve->getMinMax ({ column * columnLength, (column + 1) * columnLength }).getLength();
+
+            doNotOptimise (&result);
+        }, numPixelColumns, "columns");
+
+        juce::Random random (2);
+
+        measure ("point lookups", [&]
+        {
+            for (int i = 0; i < 1000; ++i)
+                result += curve->getSemitonesAt (random.nextDouble() * takeLength);
+
+            doNotOptimise (&result);
+        }, 1000, "lookups");
+
+        // A render segment's worth of F0 frames
+        std::vector<float> f0 (1024, 220.0f);
+
+        measure ("apply to F0", [&]
+        {
+            std::fill (f0.begin(), f0.end(), 220.0f);
+            curve->applyToF0 (f0.data(), (int) f0.size(), random.nextDouble() * (takeLength - 10.0), 512.0 / 44100.0);
+            doNotOptimise (f0.data());
+        }, (double) f0.size(), "frames");
+
+        // Redrawing a second of the take, as a mouse drag does
+        std::vector<PitchCurve::Point> replacement;
+
+        for (double time = 0.0; time < 1.0; time += pointInterval)
+            replacement.push_back ({ time, 1.0f });
+
+        measure ("edit one second", [&]
+        {
+            const auto start = std::floor (random.nextDouble() * (takeLength - 1.0));
+            auto points = replacement;
+
+            for (auto& point : points)
+                point.time += start;
+
+            const auto edited = curve->withPointsReplaced ({ start, start + 1.0 }, points);
+            doNotOptimise (edited.get());
+        });
+    }
+
+    const Benchmark pitchCurve ("PitchCurve", benchmarkPitchCurve);
+}
+
+} // namespace hifitune::benchmarks
@@ -0,0 +1,645 @@
+/*
+  ==============================================================================
+
+    This file contains a headless harness that drives the render pipeline the
+    way a session of many tracks would, and reports how it keeps up.
+
+  ==============================================================================
+*/
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "engine/AnalysisEngine.h"
+#include "engine/InferenceScheduler.h"
+#include "engine/MixKernels.h"
+#include "engine/RenderTrack.h"
+#include "engine/SegmentCache.h"
+#include "engine/SegmentSynthesiser.h"
+
+#include <iostream>
+#include <numeric>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+ #pragma comment (lib, "psapi.lib")
+#else
+ #include <sys/resource.h>
+#endif
+
+namespace hifitune::harness
+{
+
+namespace
+{
+    //==============================================================================
+    struct Settings
+    {
+        juce::File input;                   // synthetic audio if not set
+        double seconds = 60.0;              // length of synthetic sources
+        int numTracks = 60;
+        int numChannels = 2;
+        double sampleRate = 48000.0;
+        std::vector<int> blockSizes { 64, 128, 256, 512, 1024, 2048 };
+        double playbackSeconds = 10.0;      // timeline played per block size
+        juce::String modelName = "vocoder";
+        juce::File output, baseline;
+        double tolerance = 0.1;             // allowed regression against the baseline
+    };
+
+    // Segments rendered per call, as in the plug-in's offline path
+    constexpr int offlineBatchSegments = 8;
+
+    // Tracks rendered a second time as playback would, to compare with the bounce
+    constexpr size_t numConsistencyTracks = 4;
+
+    double getSecondsSince (juce::int64 startTicks) noexcept
+    {
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    }
+
+    juce::int64 getPeakMemoryBytes()
+    {
+       #if JUCE_WINDOWS
+        PROCESS_MEMORY_COUNTERS counters;
+
+        if (GetProcessMemoryInfo (GetCurrentProcess(), &counters, sizeof (counters)))
+            return (juce::int64) counters.PeakWorkingSetSize;
+
+        return 0;
+       #else
+        rusage usage;
+
+        if (getrusage (RUSAGE_SELF, &usage) != 0)
+            return 0;
+
+        #if JUCE_MAC || JUCE_IOS
+         return (juce::int64) usage.ru_maxrss;
+        #else
+         return (juce::int64) usage.ru_maxrss * 1024;
+        #endif
+       #endif
+    }
+
+    //==============================================================================
+    /** Something like a sung line: phrases of gliding notes with vibrato and
+        decaying harmonics, separated by rests.
+    */
+    juce::AudioBuffer<float> makeSyntheticVocal (int numChannels, double sampleRate, double seconds)
+    {
+        constexpr double phraseSeconds = 4.0, restSeconds = 1.0, noteSeconds = 0.5;
+        constexpr float scale[] = { 0.0f, 2.0f, 4.0f, 5.0f, 7.0f, 9.0f, 11.0f, 12.0f };
+
+        juce::AudioBuffer<float> audio (numChannels, (int) (seconds * sampleRate));
+        juce::Random random (42);
+
+        double phase = 0.0;
+        float semitones = 0.0f;
+
+        for (int i = 0; i < audio.getNumSamples(); ++i)
+        {
+            const auto time = i / sampleRate;
+            const auto timeInPhrase = std::fmod (time, phraseSeconds + restSeconds);
+
+            if (std::fmod (time, noteSeconds) < 1.0 / sampleRate)
+                semitones = scale[random.nextInt ((int) std::size (scale))];
+
+            const auto vibrato = 0.3 * std::sin (juce::MathConstants<double>::twoPi * 5.5 * time);
+            const auto hz = 196.0 * std::pow (2.0, (semitones + vibrato) / 12.0);
+            phase += juce::MathConstants<double>::twoPi * hz / sampleRate;
+
+            const auto envelope = timeInPhrase < phraseSeconds
+                                      ? juce::jmin (1.0, timeInPhrase * 20.0, (phraseSeconds - timeInPhrase) * 20.0)
+                                      : 0.0;
+            double sample = 0.0;
+
+            for (int harmonic = 1; harmonic * hz < sampleRate * 0.45 && harmonic <= 24; ++harmonic)
+                sample += std::sin (phase * harmonic) / harmonic;
+
+            const auto value = (float) (0.2 * envelope * sample) + 0.002f * (random.nextFloat() - 0.5f);
+
+            for (int c = 0; c < numChannels; ++c)
+                audio.setSample (c, i, value);
+        }
+
+        return audio;
+    }
+
+    //==============================================================================
+    /** Reads a shared buffer, rotated so that every track gets different audio
+        (and so different cache keys) without needing memory of its own.
+    */
+    class BufferReader  : public juce::AudioFormatReader
+    {
+    public:
+        BufferReader (std::shared_ptr<const juce::AudioBuffer<float>> audioIn, double rate, juce::int64 rotationIn)
+            : juce::AudioFormatReader (nullptr, "HiFiTune harness"),
+              audio (std::move (audioIn)), rotation (rotationIn)
+        {
+            sampleRate = rate;
+            bitsPerSample = 32;
+            usesFloatingPointData = true;
+            lengthInSamples = audio->getNumSamples();
+            numChannels = (unsigned int) audio->getNumChannels();
+        }
+
+        bool readSamples (int* const* destChannels, int numDestChannels, int startOffsetInDestBuffer,
+                          juce::int64 startSampleInFile, int numSamples) override
+        {
+            for (int c = 0; c < numDestChannels; ++c)
+            {
+                if (destChannels[c] == nullptr)
+                    continue;
+
+                auto* dest = reinterpret_cast<float*> (destChannels[c]) + startOffsetInDestBuffer;
+                const auto* source = audio->getReadPointer (juce::jmin (c, audio->getNumChannels() - 1));
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    const auto position = startSampleInFile + i;
+                    dest[i] = juce::isPositiveAndBelow (position, lengthInSamples)
+                                  ? source[(position + rotation) % lengthInSamples]
+                                  : 0.0f;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        std::shared_ptr<const juce::AudioBuffer<float>> audio;
+        const juce::int64 rotation;
+    };
+
+    //==============================================================================
+    /** What the document controller and a playback renderer keep for one track. */
+    struct Track
+    {
+        std::unique_ptr<SourceStream> stream;                  // for dry rendering
+        std::shared_ptr<const SourceAnalysis> analysis;
+        std::unique_ptr<RenderTrack> renderTrack;
+    };
+
+    class AnalysisWaiter  : public AnalysisEngine::Listener
+    {
+    public:
+        void analysisFinished (AnalysisEngine::SourceKey, const std::shared_ptr<const SourceAnalysis>& result) override
+        {
+            numFailed += result == nullptr ? 1 : 0;
+            ++numFinished;
+            finished.signal();
+        }
+
+        std::atomic<int> numFinished { 0 }, numFailed { 0 };
+        juce::WaitableEvent finished;
+    };
+
+    //==============================================================================
+    juce::var runAnalysis (std::vector<std::unique_ptr<Track>>& tracks,
+                           const std::shared_ptr<const juce::AudioBuffer<float>>& audio, const Settings& settings)
+    {
+        AnalysisWaiter waiter;
+        AnalysisEngine engine (waiter);
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (size_t i = 0; i < tracks.size(); ++i)
+            engine.startAnalysis (tracks[i].get(), std::make_unique<BufferReader> (audio, settings.sampleRate, (juce::int64) i * 7919));
+
+        while (waiter.numFinished.load() < (int) tracks.size())
+            waiter.finished.wait (100);
+
+        const auto seconds = getSecondsSince (start);
+
+        for (auto& track : tracks)
+            track->analysis = engine.getAnalysis (track.get());
+
+        const auto audioSeconds = (double) tracks.size() * audio->getNumSamples() / settings.sampleRate;
+        const auto numFrames = tracks.front()->analysis != nullptr ? tracks.front()->analysis->numFrames : 0;
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("seconds", seconds);
+        result->setProperty ("realtimeFactor", audioSeconds / seconds);
+        result->setProperty ("framesPerSecond", (double) numFrames * (double) tracks.size() / seconds);
+        result->setProperty ("numFailed", waiter.numFailed.load());
+        return result;
+    }
+
+    // Renders every segment of every track, one track per thread like a host
+    // bouncing tracks in parallel, and returns the wall-clock time taken
+    double renderAllTracks (std::vector<std::unique_ptr<Track>>& tracks, Vocoder* vocoder,
+                            SegmentCache& cache, InferenceScheduler& scheduler, const Settings& settings)
+    {
+        juce::ThreadPool pool (juce::ThreadPoolOptions{}.withThreadName ("HiFiTune Harness")
+                                                        .withNumberOfThreads (juce::SystemStats::getNumPhysicalCpus()));
+
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (auto& trackPointer : tracks)
+        {
+            pool.addJob ([&track = *trackPointer, vocoder, &cache, &scheduler, &settings]
+            {
+                track.renderTrack = std::make_unique<RenderTrack> (track.stream->getLengthInSamples(), settings.numChannels);
+
+                SegmentSynthesiser synthesiser (vocoder, &cache, &scheduler);
+                SegmentSynthesiser::Source source;
+                source.sampleRate = settings.sampleRate;
+                source.stream = track.stream.get();
+                source.analysis = track.analysis;
+
+                auto& renderTrack = *track.renderTrack;
+
+                for (int first = 0; first < renderTrack.getNumSegments(); first += offlineBatchSegments)
+                {
+                    const auto numSegments = juce::jmin (offlineBatchSegments, renderTrack.getNumSegments() - first);
+                    std::vector<juce::Range<juce::int64>> ranges;
+
+                    for (int i = first; i < first + numSegments; ++i)
+                        ranges.push_back (renderTrack.getSegmentRange (i));
+
+                    auto segments = synthesiser.render (source, ranges, settings.numChannels);
+
+                    for (int i = 0; i < numSegments; ++i)
+                        if (segments[(size_t) i] != nullptr && renderTrack.tryClaim (first + i, segments[(size_t) i]->key))
+                            renderTrack.publish (first + i, std::move (segments[(size_t) i]));
+                }
+            });
+        }
+
+        while (pool.getNumJobs() > 0)
+            juce::Thread::sleep (5);
+
+        return getSecondsSince (start);
+    }
+
+    // Renders the first few tracks again the way the playback workers do, one
+    // segment per call from half the cores, most urgent first and without the
+    // offline inference threads, and compares the result sample for sample with
+    // the offline render. A bounce has to sound exactly like playback.
+    juce::var runConsistencyCheck (std::vector<std::unique_ptr<Track>>& tracks, Vocoder* vocoder,
+                                   InferenceScheduler& scheduler, const Settings& settings)
+    {
+        const auto numTracks = juce::jmin (numConsistencyTracks, tracks.size());
+        std::vector<std::unique_ptr<RenderTrack>> playbackTracks;
+
+        {
+            juce::ThreadPool pool (juce::ThreadPoolOptions{}.withThreadName ("HiFiTune Harness Playback")
+                                                            .withNumberOfThreads (juce::jmax (1, juce::SystemStats::getNumPhysicalCpus() / 2)));
+
+            for (size_t t = 0; t < numTracks; ++t)
+            {
+                auto& track = *tracks[t];
+                playbackTracks.push_back (std::make_unique<RenderTrack> (track.renderTrack->getLengthInSamples(), settings.numChannels));
+                auto& playbackTrack = *playbackTracks.back();
+
+                for (int i = 0; i < playbackTrack.getNumSegments(); ++i)
+                {
+                    pool.addJob ([&track, &playbackTrack, i, vocoder, &scheduler, &settings]
+                    {
+                        SegmentSynthesiser synthesiser (vocoder, nullptr, &scheduler);
+                        SegmentSynthesiser::Source source;
+                        source.sampleRate = settings.sampleRate;
+                        source.stream = track.stream.get();
+                        source.analysis = track.analysis;
+
+                        const auto range = playbackTrack.getSegmentRange (i);
+                        auto segments = synthesiser.render (source, { range }, settings.numChannels, range.getStart());
+
+                        if (segments.front() != nullptr && playbackTrack.tryClaim (i, segments.front()->key))
+                            playbackTrack.publish (i, std::move (segments.front()));
+                    });
+                }
+            }
+
+            while (pool.getNumJobs() > 0)
+                juce::Thread::sleep (5);
+        }
+
+        constexpr int blockLength = 4096;
+        juce::AudioBuffer<float> bounced (settings.numChannels, blockLength), played (settings.numChannels, blockLength);
+        juce::int64 numMismatched = 0, numMissing = 0;
+
+        for (size_t t = 0; t < numTracks; ++t)
+        {
+            const auto& bounceTrack = *tracks[t]->renderTrack;
+            const auto& playbackTrack = *playbackTracks[t];
+
+            for (juce::int64 position = 0; position < bounceTrack.getLengthInSamples(); position += blockLength)
+            {
+                const auto numSamples = (int) juce::jmin ((juce::int64) blockLength, bounceTrack.getLengthInSamples() - position);
+
+                numMissing += bounceTrack.read (bounced, 0, position, numSamples, false).numMissing;
+                numMissing += playbackTrack.read (played, 0, position, numSamples, false).numMissing;
+
+                for (int c = 0; c < settings.numChannels; ++c)
+                    for (int i = 0; i < numSamples; ++i)
+                        if (! juce::exactlyEqual (bounced.getSample (c, i), played.getSample (c, i)))
+                            ++numMismatched;
+            }
+        }
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("tracks", (int) numTracks);
+        result->setProperty ("mismatchedSamples", numMismatched);
+        result->setProperty ("missingSamples", numMissing);
+        result->setProperty ("matches", numMismatched == 0 && numMissing == 0);
+        return result;
+    }
+
+    juce::var runOfflineRender (std::vector<std::unique_ptr<Track>>& tracks, const Settings& settings)
+    {
+        InferenceScheduler scheduler;
+        const auto vocoder = scheduler.waitForVocoder (settings.modelName);
+
+        SegmentCache cache;
+        cache.setSpillDirectory (juce::File::getSpecialLocation (juce::File::tempDirectory)
+                                     .getChildFile ("HiFiTune")
+                                     .getChildFile ("HarnessCache-" + juce::Uuid().toString()));
+
+        const auto audioSeconds = (double) tracks.size() * (double) tracks.front()->stream->getLengthInSamples() / settings.sampleRate;
+
+        // The first pass renders everything, like a bounce; the second one should
+        // come entirely from the cache, as after an edit that changed nothing audible
+        scheduler.beginOfflineRendering();
+        const auto firstSeconds = renderAllTracks (tracks, vocoder.get(), cache, scheduler, settings);
+        scheduler.endOfflineRendering();
+
+        const auto firstStats = cache.getStatistics();
+        const auto secondSeconds = renderAllTracks (tracks, vocoder.get(), cache, scheduler, settings);
+        const auto stats = cache.getStatistics();
+
+        const auto hits = stats.hits - firstStats.hits;
+        const auto diskHits = stats.diskHits - firstStats.diskHits;
+        const auto misses = stats.misses - firstStats.misses;
+        const auto lookups = hits + diskHits + misses;
+
+        auto* render = new juce::DynamicObject();
+        render->setProperty ("quality", vocoder != nullptr ? "neural" : "dry");
+        render->setProperty ("seconds", firstSeconds);
+        render->setProperty ("realtimeFactor", audioSeconds / firstSeconds);
+
+        auto* cached = new juce::DynamicObject();
+        cached->setProperty ("seconds", secondSeconds);
+        cached->setProperty ("realtimeFactor", audioSeconds / secondSeconds);
+        cached->setProperty ("hits", (juce::int64) hits);
+        cached->setProperty ("diskHits", (juce::int64) diskHits);
+        cached->setProperty ("misses", (juce::int64) misses);
+        cached->setProperty ("hitRate", lookups > 0 ? (double) (hits + diskHits) / (double) lookups : 0.0);
+        cached->setProperty ("memoryBytes", (juce::int64) stats.memoryBytes);
+        cached->setProperty ("diskBytes", (juce::int64) stats.diskBytes);
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty ("offlineRender", render);
+        result->setProperty ("cachedRender", cached);
+        result->setProperty ("bounceConsistency", runConsistencyCheck (tracks, vocoder.get(), scheduler, settings));
+        return result;
+    }
+
+    // Mixes every track into one buffer block by block, as processBlock does,
+    // and times each block
+    juce::var runPlayback (std::vector<std::unique_ptr<Track>>& tracks, const Settings& settings)
+    {
+        juce::Array<juce::var> results;
+
+        for (const auto blockSize : settings.blockSizes)
+        {
+            juce::AudioBuffer<float> buffer (settings.numChannels, blockSize);
+            const auto length = juce::jmin ((juce::int64) (settings.playbackSeconds * settings.sampleRate),
+                                            tracks.front()->renderTrack->getLengthInSamples());
+
+            std::vector<double> microseconds;
+
+            for (juce::int64 position = 0; position + blockSize <= length; position += blockSize)
+            {
+                const auto start = juce::Time::getHighResolutionTicks();
+
+                for (size_t i = 0; i < tracks.size(); ++i)
+                    tracks[i]->renderTrack->read (buffer, 0, position, blockSize, i > 0);
+
+                microseconds.push_back (getSecondsSince (start) * 1.0e6);
+            }
+
+            if (microseconds.empty())
+                continue;
+
+            std::sort (microseconds.begin(), microseconds.end());
+            const auto mean = std::accumulate (microseconds.begin(), microseconds.end(), 0.0) / (double) microseconds.size();
+            const auto blockMicroseconds = blockSize * 1.0e6 / settings.sampleRate;
+
+            auto* result = new juce::DynamicObject();
+            result->setProperty ("blockSize", blockSize);
+            result->setProperty ("meanMicroseconds", mean);
+            result->setProperty ("p99Microseconds", microseconds[(size_t) ((double) (microseconds.size() - 1) * 0.99)]);
+            result->setProperty ("maxMicroseconds", microseconds.back());
+            result->setProperty ("load", mean / blockMicroseconds);
+            results.add (result);
+        }
+
+        return results;
+    }
+
+    //==============================================================================
+    /** Compares against an earlier run. Returns a description of every metric that
+        got worse by more than the tolerance.
+    */
+    juce::StringArray findRegressions (const juce::var& results, const juce::var& baseline, double tolerance)
+    {
+        juce::StringArray regressions;
+
+        auto check = [&] (const juce::String& name, const juce::var& value, const juce::var& reference, bool higherIsBetter)
+        {
+            if (value.isVoid() || reference.isVoid() || (double) reference <= 0.0)
+                return;
+
+            const auto ratio = (double) value / (double) reference;
+
+            if (higherIsBetter ? ratio < 1.0 - tolerance : ratio > 1.0 + tolerance)
+                regressions.add (name + ": " + juce::String ((double) value, 3) + " vs " + juce::String ((double) reference, 3));
+        };
+
+        check ("analysis.realtimeFactor", results["analysis"]["realtimeFactor"], baseline["analysis"]["realtimeFactor"], true);
+        check ("offlineRender.realtimeFactor", results["offlineRender"]["realtimeFactor"], baseline["offlineRender"]["realtimeFactor"], true);
+        check ("cachedRender.hitRate", results["cachedRender"]["hitRate"], baseline["cachedRender"]["hitRate"], true);
+        check ("peakMemoryBytes", results["peakMemoryBytes"], baseline["peakMemoryBytes"], false);
+
+        if (const auto* blocks = results["playback"].getArray())
+            if (const auto* referenceBlocks = baseline["playback"].getArray())
+                for (const auto& block : *blocks)
+                    for (const auto& reference : *referenceBlocks)
+                        if (block["blockSize"] == reference["blockSize"])
+                            check ("playback[" + block["blockSize"].toString() + "].meanMicroseconds",
+                                   block["meanMicroseconds"], reference["meanMicroseconds"], false);
+
+        return regressions;
+    }
+
+    Settings parseSettings (const juce::ArgumentList& args)
+    {
+        Settings settings;
+
+        if (args.containsOption ("--input"))
+            settings.input = args.getExistingFileForOption ("--input");
+
+        if (args.containsOption ("--seconds"))
+            settings.seconds = args.getValueForOption ("--seconds").getDoubleValue();
+
+        if (args.containsOption ("--tracks"))
+            settings.numTracks = juce::jmax (1, args.getValueForOption ("--tracks").getIntValue());
+
+        if (args.containsOption ("--sample-rate"))
+            settings.sampleRate = args.getValueForOption ("--sample-rate").getDoubleValue();
+
+        if (args.containsOption ("--playback-seconds"))
+            settings.playbackSeconds = args.getValueForOption ("--playback-seconds").getDoubleValue();
+
+        if (args.containsOption ("--model"))
+            settings.modelName = args.getValueForOption ("--model");
+
+        if (args.containsOption ("--block-sizes"))
+        {
+            settings.blockSizes.clear();
+
+            for (const auto& size : juce::StringArray::fromTokens (args.getValueForOption ("--block-sizes"), ",", {}))
+                if (size.getIntValue() > 0)
+                    settings.blockSizes.push_back (size.getIntValue());
+        }
+
+        if (args.containsOption ("--output"))
+            settings.output = args.getFileForOption ("--output");
+
+        if (args.containsOption ("--baseline"))
+            settings.baseline = args.getExistingFileForOption ("--baseline");
+
+        if (args.containsOption ("--tolerance"))
+            settings.tolerance = args.getValueForOption ("--tolerance").getDoubleValue();
+
+        return settings;
+    }
+
+    //==============================================================================
+    int run (const juce::ArgumentList& args)
+    {
+        const auto settings = parseSettings (args);
+
+        // Every track plays the same audio, rotated by a different amount
+        auto audio = std::make_shared<juce::AudioBuffer<float>>();
+        auto sampleRate = settings.sampleRate;
+
+        if (settings.input != juce::File())
+        {
+            juce::AudioFormatManager formats;
+            formats.registerBasicFormats();
+            std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (settings.input));
+
+            if (reader == nullptr)
+            {
+                std::cerr << "Can't read " << settings.input.getFullPathName() << std::endl;
+                return 1;
+            }
+
+            sampleRate = reader->sampleRate;
+            audio->setSize (settings.numChannels, (int) reader->lengthInSamples);
+            reader->read (audio.get(), 0, audio->getNumSamples(), 0, true, settings.numChannels > 1);
+        }
+        else
+        {
+            *audio = makeSyntheticVocal (settings.numChannels, sampleRate, settings.seconds);
+        }
+
+        auto effectiveSettings = settings;
+        effectiveSettings.sampleRate = sampleRate;
+
+        std::vector<std::unique_ptr<Track>> tracks;
+
+        for (int i = 0; i < settings.numTracks; ++i)
+        {
+            auto track = std::make_unique<Track>();
+            track->stream = std::make_unique<SourceStream> (std::make_unique<BufferReader> (audio, sampleRate, (juce::int64) i * 7919));
+            tracks.push_back (std::move (track));
+        }
+
+        auto* settingsObject = new juce::DynamicObject();
+        settingsObject->setProperty ("tracks", settings.numTracks);
+        settingsObject->setProperty ("secondsPerTrack", audio->getNumSamples() / sampleRate);
+        settingsObject->setProperty ("sampleRate", sampleRate);
+        settingsObject->setProperty ("channels", settings.numChannels);
+        settingsObject->setProperty ("input", settings.input != juce::File() ? settings.input.getFileName() : "synthetic");
+        settingsObject->setProperty ("instructionSet", MixKernels::getInstructionSetName());
+        settingsObject->setProperty ("physicalCpus", juce::SystemStats::getNumPhysicalCpus());
+
+        auto* results = new juce::DynamicObject();
+        const juce::var resultsVar (results);
+        results->setProperty ("settings", settingsObject);
+
+        std::cerr << "Analysing " << settings.numTracks << " tracks..." << std::endl;
+        results->setProperty ("analysis", runAnalysis (tracks, audio, effectiveSettings));
+
+        std::cerr << "Rendering..." << std::endl;
+        const auto render = runOfflineRender (tracks, effectiveSettings);
+        results->setProperty ("offlineRender", render["offlineRender"]);
+        results->setProperty ("cachedRender", render["cachedRender"]);
+        results->setProperty ("bounceConsistency", render["bounceConsistency"]);
+
+        std::cerr << "Playing back..." << std::endl;
+        results->setProperty ("playback", runPlayback (tracks, effectiveSettings));
+        results->setProperty ("peakMemoryBytes", getPeakMemoryBytes());
+
+        const auto json = juce::JSON::toString (resultsVar);
+
+        if (settings.output != juce::File())
+        {
+            if (! settings.output.replaceWithText (json))
+            {
+                std::cerr << "Can't write " << settings.output.getFullPathName() << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cout << json << std::endl;
+        }
+
+        if (! (bool) render["bounceConsistency"]["matches"])
+        {
+            std::cerr << "Bounced audio differs from playback in " << render["bounceConsistency"]["mismatchedSamples"].toString()
+                      << " samples, with " << render["bounceConsistency"]["missingSamples"].toString() << " missing" << std::endl;
+            return 3;
+        }
+
+        if (settings.baseline != juce::File())
+        {
+            const auto regressions = findRegressions (resultsVar, juce::JSON::parse (settings.baseline), settings.tolerance);
+
+            for (const auto& regression : regressions)
+                std::cerr << "Regression: " << regression << std::endl;
+
+            if (! regressions.isEmpty())
+                return 2;
+        }
+
+        return 0;
+    }
+}
+
+} // namespace hifitune::harness
+
+//==============================================================================
+/** Options:
+        --input <file>              audio to use instead of a synthetic vocal
+        --seconds <n>               length of the synthetic vocal (60)
+        --tracks <n>                number of tracks (60)
+        --sample-rate <hz>          rate of the synthetic vocal (48000)
+        --block-sizes <a,b,...>     processBlock sizes to time (64 to 2048)
+        --playback-seconds <n>      timeline played per block size (10)
+        --model <name>              vocoder model in the model directory ("vocoder")
+        --output <file>             where to write the JSON results (stdout)
+        --baseline <file>           earlier results to compare with
+        --tolerance <fraction>      allowed regression against the baseline (0.1)
+
+    Exits with 2 if any metric regressed against the baseline, or with 3 if
+    rendering as a bounce and as playback produced different audio.
+*/
+int main (int argc, char* argv[])
+{
+    return hifitune::harness::run (juce::ArgumentList (argc, argv));
+}
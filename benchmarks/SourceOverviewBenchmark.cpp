@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    This file contains the benchmarks for the source overview.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+
+#include "engine/SourceOverview.h"
+
+namespace hifitune::benchmarks
+{
+
+namespace
+{
+    //==============================================================================
+    // An hour at 48 kHz, drawn into an editor 2000 pixels wide
+    constexpr double sampleRate = 48000.0;
+    constexpr double lengthInSeconds = 3600.0;
+    constexpr int numColumns = 2000;
+
+    void benchmarkSourceOverview()
+    {
+        const auto numSamples = (juce::int64) (sampleRate * lengthInSeconds);
+        const auto samplesPerFrame = 512.0 * sampleRate / 44100.0;
+
+        juce::Random random (1);
+        std::vector<SourceOverview::Peak> peaks ((size_t) ((numSamples + SourceOverview::samplesPerPeak - 1) / SourceOverview::samplesPerPeak));
+
+        for (auto& peak : peaks)
+        {
+            const auto level = (juce::int16) random.nextInt (32767);
+            peak = { (juce::int16) -level, level, (juce::int16) (level / 2) };
+        }
+
+        std::vector<float> f0 ((size_t) ((double) numSamples / samplesPerFrame));
+
+        for (auto& value : f0)
+            value = random.nextInt (4) == 0 ? 0.0f : 100.0f + random.nextFloat() * 400.0f;
+
+        SourceOverview overview (std::move (peaks), SourceOverview::computePitch (f0.data(), (int) f0.size()), samplesPerFrame);
+
+        std::vector<SourceOverview::Peak> peakColumns (numColumns);
+        std::vector<SourceOverview::PitchRange> pitchColumns (numColumns);
+
+        for (const auto secondsShown : { lengthInSeconds, 60.0, 1.0 })
+        {
+            const auto samplesPerColumn = secondsShown * sampleRate / numColumns;
+            const auto label = juce::String (secondsShown, 0) + " s shown";
+
+            measure (label, [&]
+            {
+                // Scrolling: a different place every time
+                const auto firstSample = random.nextDouble() * juce::jmax (0.0, (double) numSamples - secondsShown * sampleRate);
+
+                overview.getPeaks (peakColumns.data(), numColumns, firstSample, samplesPerColumn);
+                overview.getPitch (pitchColumns.data(), numColumns, firstSample, samplesPerColumn);
+                doNotOptimise (peakColumns.data());
+                doNotOptimise (pitchColumns.data());
+            }, numColumns, "columns");
+        }
+    }
+
+    const Benchmark sourceOverview ("SourceOverview", benchmarkSourceOverview);
+}
+
+} // namespace hifitune::benchmarks
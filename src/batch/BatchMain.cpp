@@ -0,0 +1,295 @@
+/*
+  ==============================================================================
+
+    This file contains the command line of the headless batch processor.
+
+  ==============================================================================
+*/
+
+#include "BatchProcessor.h"
+
+#include <iostream>
+#include <set>
+
+namespace hifitune::batch
+{
+
+namespace
+{
+    //==============================================================================
+    void printUsage()
+    {
+        std::cerr << "Usage: HiFiTuneBatch [options] <inputs...>\n"
+                     "\n"
+                     "Inputs are audio files, pitch-edit projects (.json) or directories, which are\n"
+                     "searched for both. Audio files that a project among the inputs uses are only\n"
+                     "rendered through the project, and no two inputs may write the same output.\n"
+                     "\n"
+                     "    --output <dir>              where the results go, mirroring the input directories\n"
+                     "                                (needed unless every project names its own output)\n"
+                     "    --list <file>               read more inputs from a file, one per line\n"
+                     "    --threads <n>               render and analysis threads (physical CPUs)\n"
+                     "    --files-in-flight <n>       files analysed or rendered at once (twice the threads)\n"
+                     "    --model <name>              vocoder model in the model directory (vocoder)\n"
+                     "    --quality <q>               best, balanced or fastest model precision\n"
+                     "    --bits <n>                  16, 24 or 32 bits per output sample (24)\n"
+                     "    --no-analysis-store         always analyse, and don't keep the results\n"
+                     "    --allow-dry                 write the dry audio if the model can't be loaded\n"
+                     "    --quiet                     only report failures and the summary\n";
+    }
+
+    std::optional<ModelQuality> parseQuality (const juce::String& text)
+    {
+        if (text == "best")        return ModelQuality::best;
+        if (text == "balanced")    return ModelQuality::balanced;
+        if (text == "fastest")     return ModelQuality::fastest;
+
+        return {};
+    }
+
+    //==============================================================================
+    /** Turns the inputs into items, reporting the ones that can't be used. */
+    class ItemCollector
+    {
+    public:
+        ItemCollector (const juce::File& outputDirectoryIn, const juce::String& audioWildcard)
+            : outputDirectory (outputDirectoryIn),
+              wildcard (audioWildcard + ";*.json")
+        {
+        }
+
+        void addInput (const juce::File& input)
+        {
+            if (input.isDirectory())
+            {
+                for (const auto& entry : juce::RangedDirectoryIterator (input, true, wildcard, juce::File::findFiles))
+                    addFile (entry.getFile(), entry.getFile().getRelativePathFrom (input));
+            }
+            else if (input.existsAsFile())
+            {
+                addFile (input, input.getFileName());
+            }
+            else
+            {
+                reportError (input, "No such file or directory");
+            }
+        }
+
+        /** Drops the audio files that a project renders anyway, and reports items
+            that would write the same output, keeping the first of them.
+        */
+        void finish()
+        {
+            std::set<juce::File> projectAudio;
+
+            for (const auto& item : items)
+                if (item.input != item.audioFile)
+                    projectAudio.insert (item.audioFile);
+
+            std::map<juce::File, juce::File> outputs;     // output, and the input writing it
+            std::vector<BatchItem> kept;
+
+            for (auto& item : items)
+            {
+                if (item.input == item.audioFile && projectAudio.count (item.audioFile) > 0)
+                    continue;
+
+                if (const auto [existing, added] = outputs.emplace (item.outputFile, item.input); ! added)
+                {
+                    // The same file reached through two inputs is only processed once
+                    if (existing->second == item.input)
+                        continue;
+
+                    reportError (item.input, "Would write the same output as " + existing->second.getFullPathName()
+                                               + " (" + item.outputFile.getFullPathName() + ")");
+                    continue;
+                }
+
+                kept.push_back (std::move (item));
+            }
+
+            items = std::move (kept);
+        }
+
+        std::vector<BatchItem> items;
+        int numErrors = 0;
+
+    private:
+        void addFile (const juce::File& file, const juce::String& relativePath)
+        {
+            BatchItem item;
+            item.input = file;
+            item.audioFile = file;
+
+            if (file.hasFileExtension ("json"))
+            {
+                if (const auto loaded = BatchItem::loadProject (file, item); loaded.failed())
+                {
+                    reportError (file, loaded.getErrorMessage());
+                    return;
+                }
+            }
+
+            // Results are always WAV files, named after their input
+            if (item.outputFile == juce::File() && outputDirectory != juce::File())
+                item.outputFile = outputDirectory.getChildFile (relativePath).withFileExtension ("wav");
+
+            if (item.outputFile == juce::File())
+                reportError (file, "No output directory given");
+            else if (item.outputFile == item.audioFile)
+                reportError (file, "The result would replace the input");
+            else
+                items.push_back (std::move (item));
+        }
+
+        void reportError (const juce::File& file, const juce::String& message)
+        {
+            std::cerr << "Skipping " << file.getFullPathName() << ": " << message << std::endl;
+            ++numErrors;
+        }
+
+        const juce::File outputDirectory;
+        const juce::String wildcard;
+    };
+
+    //==============================================================================
+    int run (juce::ArgumentList args)
+    {
+        if (args.size() == 0 || args.removeOptionIfFound ("--help|-h"))
+        {
+            printUsage();
+            return args.size() == 0 ? 1 : 0;
+        }
+
+        BatchProcessor::Options options;
+        juce::File outputDirectory, listFile;
+
+        if (args.containsOption ("--output"))
+            outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile (args.removeValueForOption ("--output"));
+
+        if (args.containsOption ("--list"))
+            listFile = juce::File::getCurrentWorkingDirectory().getChildFile (args.removeValueForOption ("--list"));
+
+        if (args.containsOption ("--threads"))
+            options.numThreads = juce::jmax (1, args.removeValueForOption ("--threads").getIntValue());
+
+        if (args.containsOption ("--files-in-flight"))
+            options.maxFilesInFlight = juce::jmax (1, args.removeValueForOption ("--files-in-flight").getIntValue());
+
+        if (args.containsOption ("--model"))
+            options.modelName = args.removeValueForOption ("--model");
+
+        if (args.containsOption ("--quality"))
+        {
+            const auto text = args.removeValueForOption ("--quality");
+            options.quality = parseQuality (text);
+
+            if (! options.quality.has_value())
+            {
+                std::cerr << "Unknown quality: " << text << std::endl;
+                return 1;
+            }
+        }
+
+        if (args.containsOption ("--bits"))
+            options.bitsPerSample = args.removeValueForOption ("--bits").getIntValue();
+
+        options.useAnalysisStore = ! args.removeOptionIfFound ("--no-analysis-store");
+        const auto allowDry = args.removeOptionIfFound ("--allow-dry");
+        const auto quiet = args.removeOptionIfFound ("--quiet");
+
+        juce::StringArray inputs;
+
+        for (const auto& argument : args.arguments)
+        {
+            if (argument.isOption())
+            {
+                std::cerr << "Unknown option: " << argument.text << std::endl;
+                printUsage();
+                return 1;
+            }
+
+            inputs.add (argument.text);
+        }
+
+        if (listFile != juce::File())
+        {
+            if (! listFile.existsAsFile())
+            {
+                std::cerr << "Can't read " << listFile.getFullPathName() << std::endl;
+                return 1;
+            }
+
+            juce::StringArray lines;
+            listFile.readLines (lines);
+
+            for (const auto& line : lines)
+                if (line.trim().isNotEmpty())
+                    inputs.add (line.trim());
+        }
+
+        juce::AudioFormatManager formats;
+        formats.registerBasicFormats();
+        ItemCollector collector (outputDirectory, formats.getWildcardForAllFormats());
+
+        for (const auto& input : inputs)
+            collector.addInput (juce::File::getCurrentWorkingDirectory().getChildFile (input));
+
+        collector.finish();
+
+        if (collector.items.empty())
+        {
+            std::cerr << "Nothing to process" << std::endl;
+            return 1;
+        }
+
+        BatchProcessor processor (options);
+
+        std::cerr << "Loading the " << options.modelName << " model..." << std::endl;
+
+        if (processor.waitForVocoder() == nullptr && ! allowDry)
+        {
+            std::cerr << "Can't load the " << options.modelName << " model; use --allow-dry to write the dry audio instead" << std::endl;
+            return 1;
+        }
+
+        std::cerr << "Processing " << collector.items.size() << " files on " << options.numThreads << " threads..." << std::endl;
+
+        const auto summary = processor.process (collector.items, [quiet] (const BatchProcessor::FileResult& result)
+        {
+            const auto path = result.item->input.getFullPathName();
+
+            if (! result.succeeded())
+                std::cerr << "FAILED  " << path << ": " << result.error << std::endl;
+            else if (! quiet)
+                std::cout << "ok      " << path << "  (" << juce::String (result.audioSeconds, 1) << " s of audio in "
+                          << juce::String (result.seconds, 1) << " s)" << std::endl;
+        });
+
+        const auto numFailed = summary.numFailed + collector.numErrors;
+
+        std::cout << "\n"
+                  << summary.numSucceeded << " files done, " << numFailed << " failed or skipped\n"
+                  << juce::String (summary.audioSeconds / 60.0, 1) << " min of audio in " << juce::String (summary.seconds, 1) << " s\n"
+                  << "realtime factor:  " << juce::String (summary.getRealtimeFactor(), 1) << "x\n"
+                  << "throughput:       " << juce::String ((double) summary.numSucceeded / juce::jmax (1.0e-9, summary.seconds), 2)
+                  << " files/s, " << juce::String ((double) summary.numSegments / juce::jmax (1.0e-9, summary.seconds), 1) << " segments/s\n"
+                  << "tasks:            " << (juce::int64) summary.pool.numRun << " run, "
+                  << (juce::int64) summary.pool.numStolen << " stolen" << std::endl;
+
+        return numFailed > 0 ? 1 : 0;
+    }
+}
+
+} // namespace hifitune::batch
+
+//==============================================================================
+/** Renders audio files and pitch-edit projects without a host. Run without
+    arguments for the options.
+
+    Exits with 1 if anything couldn't be processed.
+*/
+int main (int argc, char* argv[])
+{
+    return hifitune::batch::run (juce::ArgumentList (argc, argv));
+}
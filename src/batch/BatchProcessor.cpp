@@ -0,0 +1,452 @@
+/*
+  ==============================================================================
+
+    This file contains the headless batch processor behind the command-line tool.
+
+  ==============================================================================
+*/
+
+#include "BatchProcessor.h"
+
+#include "engine/MixKernels.h"
+#include "engine/SegmentSynthesiser.h"
+#include "engine/SourceStream.h"
+
+namespace hifitune::batch
+{
+
+namespace
+{
+    double getSecondsSince (juce::int64 startTicks) noexcept
+    {
+        return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    }
+
+    // Rendering reads each part of the source once, in order, so chunks aren't
+    // worth keeping after the segments that needed them are done
+    SourceStream::Options getStreamOptions()
+    {
+        SourceStream::Options streamOptions;
+        streamOptions.cacheBudget = 0;
+        return streamOptions;
+    }
+
+    // How long the calling thread of process() waits for a file to finish
+    // before checking whether more can be started
+    constexpr int pollIntervalMs = 100;
+}
+
+//==============================================================================
+juce::Result BatchItem::loadProject (const juce::File& projectFile, BatchItem& item)
+{
+    juce::var project;
+    const auto parsed = juce::JSON::parse (projectFile.loadFileAsString(), project);
+
+    if (parsed.failed())
+        return parsed;
+
+    if (! project.isObject() || ! project["audio"].isString())
+        return juce::Result::fail ("No \"audio\" file in the project");
+
+    const auto directory = projectFile.getParentDirectory();
+    item.input = projectFile;
+    item.audioFile = directory.getChildFile (project["audio"].toString());
+
+    if (project["output"].isString())
+        item.outputFile = directory.getChildFile (project["output"].toString());
+
+    item.pitchCurve = nullptr;
+
+    if (const auto* points = project["pitchCurve"].getArray())
+    {
+        PitchCurve::Points curve;
+        curve.reserve ((size_t) points->size());
+
+        for (const auto& point : *points)
+        {
+            if (! point.isObject())
+                return juce::Result::fail ("Pitch curve points must be objects");
+
+            curve.push_back ({ (double) point["time"], (float) point["semitones"], (juce::uint8) (int) point["flags"] });
+        }
+
+        std::stable_sort (curve.begin(), curve.end(), [] (const auto& a, const auto& b) { return a.time < b.time; });
+
+        if (! curve.empty())
+            item.pitchCurve = PitchCurve::create (std::move (curve));
+    }
+
+    return juce::Result::ok();
+}
+
+//==============================================================================
+/** The state of one file from the start of its analysis until process() picks
+    up its result.
+*/
+struct BatchProcessor::FileJob
+{
+    const BatchItem* item = nullptr;
+    juce::int64 sequence = 0;               // the item's position, used as the inference priority
+    juce::int64 startTicks = 0;
+
+    double sampleRate = 44100.0;
+    juce::int64 lengthInSamples = 0;
+    int numChannels = 1;
+    int numSegments = 0, numTasks = 0;
+
+    std::unique_ptr<SourceStream> stream;
+    std::shared_ptr<const SourceAnalysis> analysis;
+
+    std::unique_ptr<juce::TemporaryFile> temporaryFile;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+
+    // Everything below is guarded by the lock
+    juce::CriticalSection lock;
+    int nextToStart = 0, nextToWrite = 0, numRunning = 0;
+    std::map<int, std::vector<std::unique_ptr<RenderedSegment>>> finishedTasks;   // waiting for earlier tasks
+    std::shared_ptr<const juce::AudioBuffer<float>> previousAudio;                  // of the last segment written
+    juce::AudioBuffer<float> writeBuffer;
+    juce::String error;
+
+    FileResult result;
+};
+
+//==============================================================================
+BatchProcessor::BatchProcessor (const Options& optionsIn)
+    : options (optionsIn)
+{
+    formatManager.registerBasicFormats();
+
+    if (options.quality.has_value())
+        scheduler.setModelQuality (*options.quality);
+
+    scheduler.preloadVocoder (options.modelName);
+
+    // Nothing here plays in realtime, so inference may use every core
+    scheduler.beginOfflineRendering();
+
+    analysisEngine = std::make_unique<AnalysisEngine> (*this, FeatureConfig{}, juce::jmax (1, options.numThreads),
+                                                       options.useAnalysisStore ? &analysisStore.get() : nullptr);
+    pool = std::make_unique<WorkStealingPool> (options.numThreads);
+}
+
+BatchProcessor::~BatchProcessor()
+{
+    // Both call back into this object, so they go before anything else does
+    pool.reset();
+    analysisEngine.reset();
+
+    scheduler.endOfflineRendering();
+}
+
+Vocoder* BatchProcessor::waitForVocoder()
+{
+    vocoder = scheduler.waitForVocoder (options.modelName);
+    return vocoder.get();
+}
+
+//==============================================================================
+BatchProcessor::Summary BatchProcessor::process (const std::vector<BatchItem>& items,
+                                                 const std::function<void (const FileResult&)>& onFileFinished)
+{
+    waitForVocoder();
+
+    Summary summary;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const auto firstSegmentCount = numSegments.load();
+    const auto maxFilesInFlight = options.maxFilesInFlight > 0 ? options.maxFilesInFlight : 2 * pool->getNumThreads();
+
+    size_t next = 0;
+    int numInFlight = 0;
+
+    while (next < items.size() || numInFlight > 0)
+    {
+        for (; numInFlight < maxFilesInFlight && next < items.size(); ++next, ++numInFlight)
+            startFile (items[next], (juce::int64) next);
+
+        jobFinished.wait (pollIntervalMs);
+
+        std::vector<FileJob*> finished;
+
+        {
+            const juce::ScopedLock sl (finishedLock);
+            std::swap (finished, finishedJobs);
+        }
+
+        for (auto* job : finished)
+        {
+            // Also waits for the analysis job to let go of its reader
+            analysisEngine->removeSource (job);
+
+            const auto& result = job->result;
+
+            if (result.succeeded())
+            {
+                ++summary.numSucceeded;
+                summary.audioSeconds += result.audioSeconds;
+            }
+            else
+            {
+                ++summary.numFailed;
+            }
+
+            onFileFinished (result);
+
+            std::unique_ptr<FileJob> toDelete;
+
+            {
+                const juce::ScopedLock sl (jobsLock);
+                const auto it = jobs.find (job);
+                toDelete = std::move (it->second);
+                jobs.erase (it);
+            }
+
+            --numInFlight;
+        }
+    }
+
+    summary.seconds = getSecondsSince (startTicks);
+    summary.numSegments = numSegments.load() - firstSegmentCount;
+    summary.pool = pool->getStatistics();
+    return summary;
+}
+
+void BatchProcessor::startFile (const BatchItem& item, juce::int64 sequence)
+{
+    auto job = std::make_unique<FileJob>();
+    auto& jobRef = *job;
+    job->item = &item;
+    job->sequence = sequence;
+    job->startTicks = juce::Time::getHighResolutionTicks();
+    job->result.item = &item;
+
+    {
+        const juce::ScopedLock sl (jobsLock);
+        jobs[&jobRef] = std::move (job);
+    }
+
+    // One reader for the analysis and one for the dry audio, as both may read at once
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (item.audioFile));
+    std::unique_ptr<juce::AudioFormatReader> streamReader (formatManager.createReaderFor (item.audioFile));
+
+    if (reader == nullptr || streamReader == nullptr)
+    {
+        finish (jobRef, "Can't read " + item.audioFile.getFullPathName());
+        return;
+    }
+
+    jobRef.sampleRate = reader->sampleRate;
+    jobRef.lengthInSamples = reader->lengthInSamples;
+    jobRef.numChannels = juce::jmax (1, (int) reader->numChannels);
+    jobRef.stream = std::make_unique<SourceStream> (std::move (streamReader), getStreamOptions());
+
+    analysisEngine->startAnalysis (&jobRef, std::move (reader), item.audioFile.getFullPathName());
+}
+
+void BatchProcessor::analysisFinished (AnalysisEngine::SourceKey key, const std::shared_ptr<const SourceAnalysis>& result)
+{
+    FileJob* job = nullptr;
+
+    {
+        const juce::ScopedLock sl (jobsLock);
+
+        if (const auto it = jobs.find (key); it != jobs.end())
+            job = it->second.get();
+    }
+
+    if (job == nullptr)
+        return;
+
+    if (result == nullptr)
+    {
+        finish (*job, "Analysis failed");
+        return;
+    }
+
+    job->analysis = result;
+    pool->submit ([this, job] { startRendering (*job); });
+}
+
+//==============================================================================
+void BatchProcessor::startRendering (FileJob& job)
+{
+    const auto& outputFile = job.item->outputFile;
+
+    if (const auto created = outputFile.getParentDirectory().createDirectory(); created.failed())
+    {
+        finish (job, created.getErrorMessage());
+        return;
+    }
+
+    job.temporaryFile = std::make_unique<juce::TemporaryFile> (outputFile);
+    auto fileStream = std::make_unique<juce::FileOutputStream> (job.temporaryFile->getFile());
+
+    if (! fileStream->openedOk())
+    {
+        finish (job, "Can't write " + job.temporaryFile->getFile().getFullPathName());
+        return;
+    }
+
+    std::unique_ptr<juce::OutputStream> outputStream (std::move (fileStream));
+    job.writer = wavFormat.createWriterFor (outputStream, juce::AudioFormatWriterOptions{}.withSampleRate (job.sampleRate)
+                                                                                          .withNumChannels (job.numChannels)
+                                                                                          .withBitsPerSample (options.bitsPerSample));
+
+    if (job.writer == nullptr)
+    {
+        finish (job, "Can't write a " + juce::String (options.bitsPerSample) + "-bit WAV file with "
+                         + juce::String (job.numChannels) + " channels at " + juce::String (job.sampleRate) + " Hz");
+        return;
+    }
+
+    const auto segmentLength = (juce::int64) RenderTrack::defaultSegmentLength;
+    job.numSegments = (int) ((job.lengthInSamples + segmentLength - 1) / segmentLength);
+    job.numTasks = (job.numSegments + segmentsPerTask - 1) / segmentsPerTask;
+
+    if (job.numTasks == 0)
+    {
+        finish (job);
+        return;
+    }
+
+    const juce::ScopedLock sl (job.lock);
+    startTasks (job);
+}
+
+void BatchProcessor::startTasks (FileJob& job)
+{
+    // Called with the job's lock held. Keeps a window of tasks going, so that a
+    // long file is rendered by several threads without getting far ahead of
+    // what has been written.
+    while (job.error.isEmpty() && job.nextToStart < job.numTasks && job.nextToStart - job.nextToWrite < maxTasksAheadPerFile)
+    {
+        const auto task = job.nextToStart++;
+        ++job.numRunning;
+        pool->submit ([this, &job, task] { renderTask (job, task); });
+    }
+}
+
+void BatchProcessor::renderTask (FileJob& job, int task)
+{
+    const auto segmentLength = (juce::int64) RenderTrack::defaultSegmentLength;
+    const auto firstSegment = task * segmentsPerTask;
+    const auto endSegment = juce::jmin (firstSegment + segmentsPerTask, job.numSegments);
+
+    std::vector<juce::Range<juce::int64>> ranges;
+
+    for (int i = firstSegment; i < endSegment; ++i)
+        ranges.push_back (juce::Range<juce::int64> (i * segmentLength, (i + 1) * segmentLength)
+                              .getIntersectionWith ({ 0, job.lengthInSamples }));
+
+    SegmentSynthesiser::Source source;
+    source.sampleRate = job.sampleRate;
+    source.stream = job.stream.get();
+    source.analysis = job.analysis;
+    source.pitchCurve = job.item->pitchCurve;
+
+    SegmentSynthesiser synthesiser (vocoder.get(), nullptr, &scheduler, arena.get());
+    auto segments = synthesiser.render (source, ranges, job.numChannels, job.sequence);
+    numSegments += (juce::int64) segments.size();
+
+    bool isDone = false;
+    juce::String error;
+
+    {
+        const juce::ScopedLock sl (job.lock);
+
+        job.finishedTasks[task] = std::move (segments);
+        --job.numRunning;
+
+        writeFinishedTasks (job);
+        startTasks (job);
+
+        isDone = job.numRunning == 0 && (job.nextToWrite == job.numTasks || job.error.isNotEmpty());
+        error = job.error;
+    }
+
+    // The job may be deleted as soon as it's finished, so nothing can touch it after this
+    if (isDone)
+        finish (job, error);
+}
+
+void BatchProcessor::writeFinishedTasks (FileJob& job)
+{
+    // Called with the job's lock held, by whichever thread finished the task
+    // that was next in line
+    const auto segmentLength = RenderTrack::defaultSegmentLength;
+    constexpr auto crossfadeLength = RenderTrack::crossfadeLength;
+
+    for (auto it = job.finishedTasks.find (job.nextToWrite); it != job.finishedTasks.end() && job.error.isEmpty();
+         it = job.finishedTasks.find (job.nextToWrite))
+    {
+        const auto firstSegment = it->first * segmentsPerTask;
+
+        for (size_t i = 0; i < it->second.size() && job.error.isEmpty(); ++i)
+        {
+            const auto index = firstSegment + (int) i;
+            const auto& segment = it->second[i];
+
+            if (segment == nullptr)
+            {
+                job.error = "Rendering failed at " + juce::String ((double) index * segmentLength / job.sampleRate, 1) + " s";
+                break;
+            }
+
+            const auto numSamples = (int) juce::jmin ((juce::int64) segmentLength, job.lengthInSamples - (juce::int64) index * segmentLength);
+            const auto& audio = *segment->audio;
+            job.writeBuffer.setSize (job.numChannels, numSamples, false, false, true);
+
+            // Fade in from the previous segment's tail, as RenderTrack::read() does
+            const auto& previous = job.previousAudio;
+            const auto numToCrossfade = previous != nullptr && previous->getNumSamples() >= segmentLength + crossfadeLength
+                                            ? juce::jmin (crossfadeLength, numSamples)
+                                            : 0;
+
+            for (int c = 0; c < job.numChannels; ++c)
+            {
+                auto* dest = job.writeBuffer.getWritePointer (c);
+                const auto* data = audio.getReadPointer (c % audio.getNumChannels());
+
+                if (numToCrossfade > 0)
+                    MixKernels::mixCrossfade (dest, previous->getReadPointer (c % previous->getNumChannels(), segmentLength),
+                                              data, numToCrossfade, 0.0f, (float) numToCrossfade / crossfadeLength, false);
+
+                juce::FloatVectorOperations::copy (dest + numToCrossfade, data + numToCrossfade, numSamples - numToCrossfade);
+            }
+
+            if (! job.writer->writeFromAudioSampleBuffer (job.writeBuffer, 0, numSamples))
+                job.error = "Can't write " + job.temporaryFile->getFile().getFullPathName();
+
+            job.previousAudio = segment->audio;
+        }
+
+        job.finishedTasks.erase (it);
+        ++job.nextToWrite;
+    }
+}
+
+void BatchProcessor::finish (FileJob& job, const juce::String& error)
+{
+    auto& result = job.result;
+    result.error = error;
+    result.audioSeconds = (double) job.lengthInSamples / job.sampleRate;
+
+    // Closing the writer completes the file, which only then replaces the target
+    const auto wroteFile = job.writer != nullptr;
+    job.writer.reset();
+
+    if (result.succeeded() && wroteFile && ! job.temporaryFile->overwriteTargetFileWithTemporary())
+        result.error = "Can't replace " + job.item->outputFile.getFullPathName();
+
+    job.temporaryFile.reset();
+    job.finishedTasks.clear();
+    job.previousAudio.reset();
+
+    result.seconds = getSecondsSince (job.startTicks);
+
+    const juce::ScopedLock sl (finishedLock);
+    finishedJobs.push_back (&job);
+    jobFinished.signal();
+}
+
+} // namespace hifitune::batch
@@ -0,0 +1,160 @@
+/*
+  ==============================================================================
+
+    This file contains the headless batch processor behind the command-line tool.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "engine/AnalysisEngine.h"
+#include "engine/AnalysisStore.h"
+#include "engine/DocumentArena.h"
+#include "engine/InferenceScheduler.h"
+#include "engine/PitchCurve.h"
+#include "WorkStealingPool.h"
+
+#include <map>
+#include <optional>
+
+namespace hifitune::batch
+{
+
+//==============================================================================
+/** One file to process: plain audio, or a pitch-edit project naming the audio. */
+struct BatchItem
+{
+    juce::File input;                               // what was asked for, for messages
+    juce::File audioFile;
+    juce::File outputFile;
+    std::shared_ptr<const PitchCurve> pitchCurve;   // null for plain audio
+
+    /** Reads a project exported for batch rendering: a JSON object with the
+        audio file ("audio", relative to the project), optionally where to write
+        the result ("output", likewise) and the pitch edits ("pitchCurve", an
+        array of { "time", "semitones", "flags" } objects using the fields and
+        flags of PitchCurve::Point).
+    */
+    static juce::Result loadProject (const juce::File& projectFile, BatchItem& item);
+};
+
+//==============================================================================
+/**
+    Analyses and resynthesises many files with the plug-in's engine, without a
+    host.
+
+    Each file is analysed by the AnalysisEngine, which also reads and writes the
+    shared AnalysisStore, so files rendered before skip the analysis. Once the
+    analysis is in, the file's segments are rendered on a WorkStealingPool, a
+    few segments per task, with every vocoder call going through one
+    InferenceScheduler: one model session for the whole run, fed batches
+    gathered from all the files being rendered at once.
+
+    Audio is streamed in both directions. Sources are read through
+    SourceStreams, and rendered segments are crossfaded into each other the way
+    RenderTrack::read() does and written out in order as soon as the ones before
+    them are done, so memory doesn't grow with the length of the files. Only a
+    bounded number of files are in flight at once, earlier ones rendering
+    first, so it doesn't grow with their number either.
+
+    Output is written to a temporary file that replaces the target once it's
+    complete, so a failed or interrupted run never leaves half a file behind.
+*/
+class BatchProcessor  : private AnalysisEngine::Listener
+{
+public:
+    //==============================================================================
+    struct Options
+    {
+        int numThreads = juce::SystemStats::getNumPhysicalCpus();
+        int maxFilesInFlight = 0;           // 0 for twice the number of threads
+        juce::String modelName = "vocoder";
+        std::optional<ModelQuality> quality;    // the scheduler's default if not set
+        int bitsPerSample = 24;
+        bool useAnalysisStore = true;
+    };
+
+    /** Rendered segments per pool task. */
+    static constexpr int segmentsPerTask = 8;
+
+    /** Tasks a file may have rendering or waiting to be written at once. */
+    static constexpr int maxTasksAheadPerFile = 8;
+
+    explicit BatchProcessor (const Options&);
+    ~BatchProcessor() override;
+
+    /** Returns the vocoder, waiting for it to load, or nullptr if it can't be
+        loaded. Without one, files are rendered from the dry source audio.
+    */
+    Vocoder* waitForVocoder();
+
+    //==============================================================================
+    struct FileResult
+    {
+        const BatchItem* item = nullptr;
+        juce::String error;                 // empty on success
+        double audioSeconds = 0.0;
+        double seconds = 0.0;               // from starting the analysis to closing the output
+
+        bool succeeded() const noexcept     { return error.isEmpty(); }
+    };
+
+    struct Summary
+    {
+        int numSucceeded = 0, numFailed = 0;
+        double audioSeconds = 0.0;          // of the files that succeeded
+        double seconds = 0.0;
+        juce::int64 numSegments = 0;
+        WorkStealingPool::Statistics pool;
+
+        double getRealtimeFactor() const noexcept   { return seconds > 0.0 ? audioSeconds / seconds : 0.0; }
+    };
+
+    /** Processes every item, calling onFileFinished on the calling thread as each
+        one is done, and returns once all of them are.
+    */
+    Summary process (const std::vector<BatchItem>& items, const std::function<void (const FileResult&)>& onFileFinished);
+
+private:
+    //==============================================================================
+    struct FileJob;
+
+    void startFile (const BatchItem&, juce::int64 sequence);
+    void startRendering (FileJob&);
+    void renderTask (FileJob&, int task);
+    void writeFinishedTasks (FileJob&);
+    void startTasks (FileJob&);
+    void finish (FileJob&, const juce::String& error = {});
+
+    // AnalysisEngine::Listener
+    void analysisFinished (AnalysisEngine::SourceKey, const std::shared_ptr<const SourceAnalysis>&) override;
+
+    //==============================================================================
+    const Options options;
+    juce::AudioFormatManager formatManager;
+    juce::WavAudioFormat wavFormat;
+
+    InferenceScheduler scheduler;
+    std::shared_ptr<Vocoder> vocoder;
+    std::shared_ptr<DocumentArena> arena = std::make_shared<DocumentArena>();
+    juce::SharedResourcePointer<AnalysisStore> analysisStore;
+    std::unique_ptr<AnalysisEngine> analysisEngine;
+    std::unique_ptr<WorkStealingPool> pool;
+
+    // Files between startFile() and the calling thread picking up their result
+    std::map<AnalysisEngine::SourceKey, std::unique_ptr<FileJob>> jobs;
+    juce::CriticalSection jobsLock;
+
+    std::vector<FileJob*> finishedJobs;
+    juce::CriticalSection finishedLock;
+    juce::WaitableEvent jobFinished;
+
+    std::atomic<juce::int64> numSegments { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchProcessor)
+};
+
+} // namespace hifitune::batch
@@ -0,0 +1,170 @@
+/*
+  ==============================================================================
+
+    This file contains the work-stealing thread pool the batch processor runs on.
+
+  ==============================================================================
+*/
+
+#include "WorkStealingPool.h"
+
+namespace hifitune::batch
+{
+
+namespace
+{
+    // Idle threads still look for work this often, in case they missed a signal
+    // while another thread was being woken
+    constexpr int idleWaitMs = 10;
+
+    // The pool and worker the calling thread belongs to, if any
+    thread_local const void* currentPool = nullptr;
+    thread_local int currentWorkerIndex = -1;
+}
+
+//==============================================================================
+class WorkStealingPool::Worker  : public juce::Thread
+{
+public:
+    Worker (WorkStealingPool& ownerIn, int indexIn)
+        : juce::Thread ("HiFiTune Batch"), owner (ownerIn), index (indexIn)
+    {
+    }
+
+    void run() override
+    {
+        currentPool = &owner;
+        currentWorkerIndex = index;
+
+        while (! threadShouldExit())
+            if (! owner.runNextTask (index))
+                owner.workAvailable.wait (idleWaitMs);
+    }
+
+    // Newest at the front, where the owner pushes and pops; thieves take from the back
+    std::deque<Task> tasks;
+    juce::CriticalSection lock;
+
+private:
+    WorkStealingPool& owner;
+    const int index;
+};
+
+//==============================================================================
+WorkStealingPool::WorkStealingPool (int numThreads)
+{
+    for (int i = 0; i < juce::jmax (1, numThreads); ++i)
+        workers.push_back (std::make_unique<Worker> (*this, i));
+
+    for (auto& worker : workers)
+        worker->startThread();
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    waitUntilIdle();
+
+    for (auto& worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto& worker : workers)
+    {
+        workAvailable.signal();
+        worker->stopThread (-1);
+    }
+}
+
+//==============================================================================
+void WorkStealingPool::submit (Task task)
+{
+    ++numPending;
+
+    if (currentPool == this)
+    {
+        auto& worker = *workers[(size_t) currentWorkerIndex];
+        const juce::ScopedLock sl (worker.lock);
+        worker.tasks.push_front (std::move (task));
+    }
+    else
+    {
+        const juce::ScopedLock sl (injectedLock);
+        injected.push_back (std::move (task));
+    }
+
+    workAvailable.signal();
+}
+
+void WorkStealingPool::waitUntilIdle()
+{
+    // Must not be called from a task, which would wait for itself
+    jassert (currentPool != this);
+
+    while (numPending.load() > 0)
+        becameIdle.wait (idleWaitMs);
+}
+
+WorkStealingPool::Statistics WorkStealingPool::getStatistics() const noexcept
+{
+    return { numRun.load(), numStolen.load() };
+}
+
+//==============================================================================
+bool WorkStealingPool::runNextTask (int workerIndex)
+{
+    Task task;
+
+    if (! popTask (workerIndex, task))
+        return false;
+
+    task();
+    task = nullptr;     // whatever the task holds is released before it counts as done
+    ++numRun;
+
+    if (--numPending == 0)
+        becameIdle.signal();
+
+    return true;
+}
+
+bool WorkStealingPool::popTask (int workerIndex, Task& task)
+{
+    {
+        auto& own = *workers[(size_t) workerIndex];
+        const juce::ScopedLock sl (own.lock);
+
+        if (! own.tasks.empty())
+        {
+            task = std::move (own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Start with the next thread along, so that thieves spread over the victims
+    const auto numWorkers = workers.size();
+
+    for (size_t i = 1; i < numWorkers; ++i)
+    {
+        auto& victim = *workers[((size_t) workerIndex + i) % numWorkers];
+        const juce::ScopedLock sl (victim.lock);
+
+        if (! victim.tasks.empty())
+        {
+            task = std::move (victim.tasks.back());
+            victim.tasks.pop_back();
+            ++numStolen;
+            return true;
+        }
+    }
+
+    const juce::ScopedLock sl (injectedLock);
+
+    if (injected.empty())
+        return false;
+
+    task = std::move (injected.front());
+    injected.pop_front();
+    return true;
+}
+
+} // namespace hifitune::batch
@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    This file contains the work-stealing thread pool the batch processor runs on.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <deque>
+
+namespace hifitune::batch
+{
+
+//==============================================================================
+/**
+    A fixed set of threads, each with its own queue of tasks.
+
+    Tasks submitted from one of the pool's threads go to the front of that
+    thread's queue, which it works through newest first, so a task's follow-up
+    work runs while its data is still in cache. A thread whose queue runs dry
+    takes the oldest task of another thread's queue, the one its owner would
+    get to last, before falling back to the tasks submitted from outside.
+    Many small files and a few long ones thus keep every thread busy until the
+    very end.
+
+    Each queue has its own lock, held only to push or pop a task, so threads
+    hardly ever wait for each other.
+*/
+class WorkStealingPool
+{
+public:
+    //==============================================================================
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool (int numThreads = juce::SystemStats::getNumPhysicalCpus());
+
+    /** Finishes every queued task, then stops the threads. */
+    ~WorkStealingPool();
+
+    int getNumThreads() const noexcept      { return (int) workers.size(); }
+
+    /** Queues a task. Can be called from any thread, including from a task. */
+    void submit (Task);
+
+    /** Blocks until every task submitted so far, and everything they submitted
+        in turn, has run.
+    */
+    void waitUntilIdle();
+
+    struct Statistics
+    {
+        juce::uint64 numRun = 0;
+        juce::uint64 numStolen = 0;     // tasks run by a thread other than the one that queued them
+    };
+
+    Statistics getStatistics() const noexcept;
+
+private:
+    //==============================================================================
+    class Worker;
+
+    bool runNextTask (int workerIndex);
+    bool popTask (int workerIndex, Task&);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::deque<Task> injected;
+    juce::CriticalSection injectedLock;
+
+    std::atomic<juce::int64> numPending { 0 };
+    std::atomic<juce::uint64> numRun { 0 }, numStolen { 0 };
+    juce::WaitableEvent workAvailable, becameIdle;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WorkStealingPool)
+};
+
+} // namespace hifitune::batch
@@ -0,0 +1,728 @@
+/*
+  ==============================================================================
+
+    This file contains the background analysis engine for audio sources.
+
+  ==============================================================================
+*/
+
+#include "AnalysisEngine.h"
+#include "ArchiveCodec.h"
+#include "FeatureExtractor.h"
+#include "SourceStream.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Frames read and resampled at once, about 47 seconds of audio. Each chunk
+    // is then analysed in parallel in blocks of framesPerBlock.
+    constexpr int framesPerChunk = 4096;
+    constexpr int framesPerBlock = 256;
+
+    // Source audio is fetched in stream chunks of this many samples, and read
+    // ahead far enough to cover the next analysis chunk while this one is
+    // being analysed
+    constexpr int streamChunkLength = 1 << 18;
+
+    std::unique_ptr<SourceStream> createStream (std::unique_ptr<juce::AudioFormatReader> reader, const FeatureConfig& config)
+    {
+        const auto ratio = reader->sampleRate > 0.0 ? reader->sampleRate / config.sampleRate : 1.0;
+        const auto sourcePerChunk = (double) framesPerChunk * config.hopSize * ratio;
+
+        SourceStream::Options options;
+        options.chunkLength = streamChunkLength;
+        options.readAheadChunks = (int) std::ceil (sourcePerChunk / streamChunkLength) + 1;
+        return std::make_unique<SourceStream> (std::move (reader), options);
+    }
+}
+
+//==============================================================================
+/** The blocks of one chunk, which a job and its helpers claim one at a time. */
+struct AnalysisEngine::ChunkWork
+{
+    // Returns false to stop the remaining blocks from being analysed
+    std::function<bool (FeatureExtractor&, int block)> analyseBlock;
+    FeatureConfig config;
+    int numBlocks = 0;
+
+    std::atomic<int> nextBlock { 0 }, numActiveHelpers { 0 };
+    juce::WaitableEvent helperFinished;
+
+    void run (FeatureExtractor& extractor)
+    {
+        for (int block; (block = nextBlock++) < numBlocks;)
+            if (! analyseBlock (extractor, block))
+                nextBlock = numBlocks;
+    }
+};
+
+//==============================================================================
+/** Helps a job with its current chunk, on another pool thread.
+
+    It may only start after the job has finished the chunk, in which case there
+    is nothing left to claim and it must not touch the job. Registering as
+    active before claiming, and the job waiting for active helpers after its
+    own last claim failed, guarantees that.
+*/
+class AnalysisEngine::Helper  : public juce::ThreadPoolJob
+{
+public:
+    explicit Helper (std::shared_ptr<ChunkWork> workIn)
+        : juce::ThreadPoolJob ("HiFiTune analysis helper"), work (std::move (workIn))
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        ++work->numActiveHelpers;
+
+        if (work->nextBlock.load() < work->numBlocks)
+        {
+            FeatureExtractor extractor (work->config);
+            work->run (extractor);
+        }
+
+        --work->numActiveHelpers;
+        work->helperFinished.signal();
+        return jobHasFinished;
+    }
+
+private:
+    std::shared_ptr<ChunkWork> work;
+};
+
+//==============================================================================
+class AnalysisEngine::Job  : public juce::ThreadPoolJob
+{
+public:
+    /** Analyses a source, or with a previous result, updates it for the changes
+        found by comparing its sample hashes with the new audio.
+    */
+    Job (AnalysisEngine& ownerIn, SourceKey keyIn, std::unique_ptr<juce::AudioFormatReader> readerIn, const juce::String& persistentIDIn,
+         std::shared_ptr<const SourceAnalysis> previousIn = {}, std::vector<juce::uint64> previousHashesIn = {})
+        : juce::ThreadPoolJob ("HiFiTune analysis"),
+          owner (ownerIn), key (keyIn), stream (createStream (std::move (readerIn), ownerIn.config)), persistentID (persistentIDIn),
+          previous (std::move (previousIn)), previousHashes (std::move (previousHashesIn))
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        const auto& config = owner.config;
+        const auto isUpdate = previous != nullptr;
+
+        owner.listener.analysisStarted (key);
+
+        const auto numFramesTotal = config.getNumFramesForSamples (config.toModelSamples (stream->getLengthInSamples(), stream->getSampleRate()));
+
+        hashedChunks.assign ((size_t) stream->getNumChunks(), false);
+        sampleHashes.assign ((size_t) ((stream->getLengthInSamples() + samplesPerHashBlock - 1) / samplesPerHashBlock), 0);
+        peaks.assign ((size_t) ((stream->getLengthInSamples() + SourceOverview::samplesPerPeak - 1) / SourceOverview::samplesPerPeak), {});
+
+        // The store's key covers every sample, since hosts may keep the ID through
+        // destructive edits, so the whole source is hashed first. That reads it
+        // once more on a miss, which is little next to analysing it.
+        juce::uint64 storeKey = 0;
+
+        if (owner.store != nullptr && persistentID.isNotEmpty() && hashRemainingChunks())
+            storeKey = AnalysisStore::computeKey (persistentID, stream->getSampleRate(), stream->getLengthInSamples(),
+                                                  stream->getNumChannels(), sampleHashes, config);
+
+        // An update goes on to find what changed, which renderers need to hear
+        if (storeKey != 0 && ! isUpdate)
+        {
+            if (auto stored = owner.store->find (storeKey, config))
+            {
+                owner.publishResult (key, stored, std::move (sampleHashes));
+                owner.listener.analysisFinished (key, stored);
+                return jobHasFinished;
+            }
+        }
+
+        bool ok = stream->getSampleRate() > 0.0;
+        std::vector<juce::Range<int>> framesToAnalyse { { 0, numFramesTotal } };
+        bool reusePrevious = false;
+
+        if (isUpdate)
+        {
+            std::vector<juce::Range<juce::int64>> changes;
+            ok = ok && findChanges (changes);
+
+            if (! ok)
+            {
+                // Whatever was cached from this source can't be trusted any more
+                if (! shouldExit())
+                {
+                    owner.listener.analysisFoundChanges (key, { SampleChangeLog::everything });
+                    owner.publishResult (key, nullptr, {});
+                }
+
+                owner.listener.analysisFinished (key, nullptr);
+                return jobHasFinished;
+            }
+
+            if (changes.empty())
+            {
+                owner.publishResult (key, previous, std::move (sampleHashes));
+                owner.listener.analysisFinished (key, previous);
+                return jobHasFinished;
+            }
+
+            owner.listener.analysisFoundChanges (key, changes);
+
+            if (changes.front() != SampleChangeLog::everything && canReuse (*previous, numFramesTotal))
+            {
+                reusePrevious = true;
+                framesToAnalyse = getFramesAffectedBy (changes, numFramesTotal);
+            }
+        }
+
+        auto result = std::make_shared<SourceAnalysis>();
+        result->config = config;
+        result->sourceSampleRate = stream->getSampleRate();
+        result->sourceLength = stream->getLengthInSamples();
+        output = result->allocate (numFramesTotal);
+
+        if (reusePrevious)
+            copyFeatures (*previous);
+
+        int numFramesToAnalyse = 0, numFramesDone = 0;
+
+        for (const auto& frames : framesToAnalyse)
+            numFramesToAnalyse += frames.getLength();
+
+        FeatureExtractor extractor (config);
+
+        for (const auto& frames : framesToAnalyse)
+        {
+            for (auto firstFrame = frames.getStart(); ok && firstFrame < frames.getEnd(); firstFrame += framesPerChunk)
+            {
+                if (shouldExit())
+                {
+                    ok = false;
+                    break;
+                }
+
+                const auto numFrames = juce::jmin (framesPerChunk, frames.getEnd() - firstFrame);
+                ok = readChunk (firstFrame, numFrames) && analyseChunk (extractor, firstFrame, numFrames);
+
+                numFramesDone += numFrames;
+                owner.listener.analysisProgressed (key, (float) numFramesDone / (float) numFramesToAnalyse);
+            }
+        }
+
+        ok = ok && hashRemainingChunks();
+
+        std::shared_ptr<const SourceAnalysis> published;
+
+        if (ok)
+        {
+            result->overview = std::make_shared<const SourceOverview> (std::move (peaks),
+                                                                       SourceOverview::computePitch (output.f0, numFramesTotal),
+                                                                       result->getSourceSamplesPerFrame());
+            result->updateContentHash();
+            published = result;
+
+            // Continue with the mapped copy, so that the heap one can go
+            if (storeKey != 0)
+                if (auto stored = owner.store->store (storeKey, *result))
+                    published = std::move (stored);
+
+            owner.publishResult (key, published, std::move (sampleHashes));
+        }
+
+        owner.listener.analysisFinished (key, published);
+        return jobHasFinished;
+    }
+
+private:
+    //==============================================================================
+    // Hashes the sample blocks in a stream chunk, which holds a whole number of
+    // them, and computes its waveform peaks for the overview. Every chunk passes
+    // through here exactly once per job, so the overview always describes the
+    // whole of the current audio.
+    void hashChunk (const SourceStream::Chunk& chunk)
+    {
+        static_assert (streamChunkLength % samplesPerHashBlock == 0);
+        static_assert (streamChunkLength % SourceOverview::samplesPerPeak == 0);
+
+        const auto index = (size_t) stream->getChunkIndexFor (chunk.start);
+
+        if (hashedChunks[index])
+            return;
+
+        hashedChunks[index] = true;
+
+        const auto end = juce::jmin (chunk.start + stream->getChunkLength(), stream->getLengthInSamples());
+
+        for (auto blockStart = chunk.start; blockStart < end; blockStart += samplesPerHashBlock)
+        {
+            const auto numSamples = (size_t) juce::jmin ((juce::int64) samplesPerHashBlock, end - blockStart);
+            ContentHash hash;
+
+            for (int c = 0; c < chunk.audio.getNumChannels(); ++c)
+                hash.add (chunk.audio.getReadPointer (c, (int) (blockStart - chunk.start)), numSamples * sizeof (float));
+
+            sampleHashes[(size_t) (blockStart / samplesPerHashBlock)] = hash.get();
+        }
+
+        SourceOverview::computePeaks (chunk.audio.getArrayOfReadPointers(), chunk.audio.getNumChannels(), (int) (end - chunk.start),
+                                      peaks.data() + chunk.start / SourceOverview::samplesPerPeak);
+    }
+
+    bool hashRemainingChunks()
+    {
+        for (int i = 0; i < stream->getNumChunks(); ++i)
+        {
+            if (shouldExit())
+                return false;
+
+            if (! hashedChunks[(size_t) i])
+            {
+                const auto chunk = stream->getChunk (i);
+
+                if (! chunk->ok)
+                    return false;
+
+                hashChunk (*chunk);
+            }
+        }
+
+        return true;
+    }
+
+    // Hashes the whole source and lists the sample blocks that differ from the
+    // previous hashes, merged into ranges
+    bool findChanges (std::vector<juce::Range<juce::int64>>& changes)
+    {
+        if (! hashRemainingChunks())
+            return false;
+
+        const auto length = stream->getLengthInSamples();
+
+        if (previousHashes.size() != sampleHashes.size()
+            || previous->sourceLength != length
+            || ! juce::exactlyEqual (previous->sourceSampleRate, stream->getSampleRate()))
+        {
+            changes = { SampleChangeLog::everything };
+            return true;
+        }
+
+        for (size_t block = 0; block < sampleHashes.size(); ++block)
+        {
+            if (sampleHashes[block] == previousHashes[block])
+                continue;
+
+            const auto start = (juce::int64) block * samplesPerHashBlock;
+            const juce::Range<juce::int64> range { start, juce::jmin (length, start + samplesPerHashBlock) };
+
+            if (! changes.empty() && changes.back().getEnd() == start)
+                changes.back().setEnd (range.getEnd());
+            else
+                changes.push_back (range);
+        }
+
+        return true;
+    }
+
+    bool canReuse (const SourceAnalysis& old, int numFrames) const noexcept
+    {
+        return old.config == owner.config
+            && old.numFrames == numFrames
+            && old.sourceLength == stream->getLengthInSamples()
+            && juce::exactlyEqual (old.sourceSampleRate, stream->getSampleRate());
+    }
+
+    void copyFeatures (const SourceAnalysis& old) const
+    {
+        std::copy (old.f0, old.f0 + old.numFrames, output.f0);
+        std::copy (old.voicing, old.voicing + old.numFrames, output.voicing);
+        std::copy (old.mel, old.mel + old.getNumMelValues(), output.mel);
+    }
+
+    // Maps changed source samples to the frames whose windows, after resampling,
+    // reach any of them
+    std::vector<juce::Range<int>> getFramesAffectedBy (const std::vector<juce::Range<juce::int64>>& changes, int numFrames) const
+    {
+        std::vector<juce::Range<int>> frames;
+
+        for (const auto& change : changes)
+        {
+            const auto affected = FeatureExtractor::getFramesReading (owner.config, stream->getSampleRate(), change)
+                                      .getIntersectionWith ({ 0, (juce::int64) numFrames });
+
+            if (affected.isEmpty())
+                continue;
+
+            const auto firstFrame = (int) affected.getStart();
+            const auto endFrame = (int) affected.getEnd();
+
+            if (! frames.empty() && frames.back().getEnd() >= firstFrame)
+                frames.back().setEnd (juce::jmax (frames.back().getEnd(), endFrame));
+            else
+                frames.push_back ({ firstFrame, endFrame });
+        }
+
+        return frames;
+    }
+
+    // Reads the source audio for a chunk of frames and resamples it into modelBlock
+    bool readChunk (int firstFrame, int numFrames)
+    {
+        const auto& config = owner.config;
+        const auto halfWindow = config.fftSize / 2;
+        const auto ratio = stream->getSampleRate() / config.sampleRate;
+
+        // Model-rate span covering every frame window in this chunk
+        const auto modelStart = (juce::int64) firstFrame * config.hopSize - halfWindow;
+        const auto numModel = (numFrames - 1) * config.hopSize + config.fftSize;
+
+        // Source span needed by the cubic interpolator for that model span
+        const auto sourceStart = (juce::int64) std::floor ((double) modelStart * ratio) - 1;
+        const auto sourceEnd = (juce::int64) std::floor ((double) (modelStart + numModel - 1) * ratio) + 3;
+        const auto numSource = (int) (sourceEnd - sourceStart);
+
+        // Mix down to mono straight from the stream's chunks, which saves
+        // copying the source channels first
+        const auto numChannelsToMix = juce::jmin (2, stream->getNumChannels());
+        const auto gain = 1.0f / (float) numChannelsToMix;
+
+        sourceBlock.setSize (1, numSource, false, false, true);
+        sourceBlock.clear();
+        auto* mono = sourceBlock.getWritePointer (0);
+
+        const auto ok = stream->visit (juce::Range<juce::int64>::withStartAndLength (sourceStart, numSource),
+                                       [&] (const SourceStream::Chunk& chunk, int startInChunk, juce::int64 position, int numSamples)
+        {
+            if (chunk.ok)
+                hashChunk (chunk);
+
+            for (int c = 0; c < numChannelsToMix; ++c)
+                juce::FloatVectorOperations::addWithMultiply (mono + (position - sourceStart),
+                                                              chunk.audio.getReadPointer (c, startInChunk),
+                                                              gain, numSamples);
+        });
+
+        if (! ok)
+            return false;
+
+        modelBlock.resize ((size_t) numModel);
+        FeatureExtractor::resample (sourceBlock.getReadPointer (0), sourceStart, numSource,
+                                    modelBlock.data(), modelStart, numModel,
+                                    stream->getSampleRate(), config.sampleRate);
+        return true;
+    }
+
+    // Analyses the frames in modelBlock, sharing the blocks with helpers on
+    // otherwise idle pool threads
+    bool analyseChunk (FeatureExtractor& extractor, int firstFrame, int numFrames)
+    {
+        const auto& config = owner.config;
+
+        auto work = std::make_shared<ChunkWork>();
+        work->config = config;
+        work->numBlocks = (numFrames + framesPerBlock - 1) / framesPerBlock;
+        work->analyseBlock = [this, firstFrame, numFrames, &config] (FeatureExtractor& blockExtractor, int block)
+        {
+            if (shouldExit())
+                return false;
+
+            const auto firstInChunk = block * framesPerBlock;
+            const auto frame = firstFrame + firstInChunk;
+
+            blockExtractor.processFrames (modelBlock.data() + (size_t) firstInChunk * (size_t) config.hopSize,
+                                          juce::jmin (framesPerBlock, numFrames - firstInChunk),
+                                          output.f0 + frame,
+                                          output.voicing + frame,
+                                          output.mel + (size_t) frame * (size_t) config.numMelBins);
+            return true;
+        };
+
+        const auto numHelpers = juce::jmin (owner.pool.getNumThreads() - 1, work->numBlocks - 1);
+
+        for (int i = 0; i < numHelpers; ++i)
+            owner.pool.addJob (new Helper (work), true);
+
+        work->run (extractor);
+
+        while (work->numActiveHelpers.load() > 0)
+            work->helperFinished.wait (1);
+
+        return ! shouldExit();
+    }
+
+    AnalysisEngine& owner;
+    const SourceKey key;
+    std::unique_ptr<SourceStream> stream;
+    const juce::String persistentID;
+
+    const std::shared_ptr<const SourceAnalysis> previous;
+    const std::vector<juce::uint64> previousHashes;
+    std::vector<juce::uint64> sampleHashes;
+    std::vector<bool> hashedChunks;
+    std::vector<SourceOverview::Peak> peaks;
+
+    SourceAnalysis::Writable output {};
+    juce::AudioBuffer<float> sourceBlock;
+    std::vector<float> modelBlock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Job)
+};
+
+//==============================================================================
+AnalysisEngine::AnalysisEngine (Listener& listenerIn, const FeatureConfig& configIn, int numThreads, AnalysisStore* storeIn)
+    : listener (listenerIn),
+      config (configIn),
+      store (storeIn),
+      pool (juce::ThreadPoolOptions{}.withThreadName ("HiFiTune Analysis")
+                                     .withNumberOfThreads (numThreads)
+                                     .withDesiredThreadPriority (juce::Thread::Priority::low))
+{
+}
+
+AnalysisEngine::~AnalysisEngine()
+{
+    pool.removeAllJobs (true, -1);
+}
+
+int AnalysisEngine::getDefaultNumThreads()
+{
+    return juce::jmax (1, juce::SystemStats::getNumPhysicalCpus() - 1);
+}
+
+//==============================================================================
+void AnalysisEngine::startAnalysis (SourceKey key, std::unique_ptr<juce::AudioFormatReader> reader, const juce::String& persistentID)
+{
+    jassert (reader != nullptr);
+
+    auto& entry = getEntry (key);
+    stopJob (entry);
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+        entry.result.reset();
+        entry.encodedResult.reset();
+        entry.encodedOverview.reset();
+        entry.sampleHashes.clear();
+        entry.isStale = false;
+        entry.job = std::make_unique<Job> (*this, key, std::move (reader), persistentID);
+    }
+
+    pool.addJob (entry.job.get(), false);
+}
+
+void AnalysisEngine::updateAnalysis (SourceKey key, std::unique_ptr<juce::AudioFormatReader> reader, const juce::String& persistentID)
+{
+    jassert (reader != nullptr);
+
+    // Restored results are decoded here, to have something to copy from
+    auto previous = getAnalysis (key);
+    auto& entry = getEntry (key);
+
+    // An update interrupted by this one leaves the result and hashes it was
+    // comparing against, so its changes are found again
+    stopJob (entry);
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+        entry.isStale = previous != nullptr;
+        entry.job = previous != nullptr ? std::make_unique<Job> (*this, key, std::move (reader), persistentID, previous, entry.sampleHashes)
+                                        : std::make_unique<Job> (*this, key, std::move (reader), persistentID);
+    }
+
+    // Without a result there is nothing to compare with
+    if (previous == nullptr)
+        listener.analysisFoundChanges (key, { SampleChangeLog::everything });
+
+    pool.addJob (entry.job.get(), false);
+}
+
+void AnalysisEngine::cancelAnalysis (SourceKey key)
+{
+    const auto it = entries.find (key);
+
+    if (it == entries.end())
+        return;
+
+    auto& entry = it->second;
+    stopJob (entry);
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+
+        if (! entry.isStale)
+            return;
+
+        entry.result.reset();
+        entry.sampleHashes.clear();
+        entry.isStale = false;
+    }
+
+    listener.analysisFoundChanges (key, { SampleChangeLog::everything });
+}
+
+void AnalysisEngine::removeSource (SourceKey key)
+{
+    cancelAnalysis (key);
+
+    const juce::ScopedLock sl (entriesLock);
+    entries.erase (key);
+}
+
+bool AnalysisEngine::isAnalysing (SourceKey key) const
+{
+    if (auto it = entries.find (key); it != entries.end())
+        return it->second.job != nullptr && pool.contains (it->second.job.get());
+
+    return false;
+}
+
+bool AnalysisEngine::hasAnalysis (SourceKey key) const
+{
+    const juce::ScopedLock sl (entriesLock);
+
+    if (auto it = entries.find (key); it != entries.end())
+        return it->second.result != nullptr || it->second.encodedResult != nullptr;
+
+    return false;
+}
+
+std::shared_ptr<const SourceAnalysis> AnalysisEngine::getAnalysis (SourceKey key)
+{
+    std::shared_ptr<const juce::MemoryBlock> encoded;
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+        const auto it = entries.find (key);
+
+        if (it == entries.end())
+            return {};
+
+        if (it->second.result != nullptr || it->second.encodedResult == nullptr)
+            return it->second.result;
+
+        encoded = it->second.encodedResult;
+    }
+
+    // Decode outside the lock, so other sources stay available meanwhile. If two
+    // threads get here at once, the first one to finish wins.
+    std::shared_ptr<const SourceAnalysis> decoded = ArchiveCodec::decodeAnalysis (*encoded);
+
+    // The chunk passed its checksum when it was restored, so this shouldn't fail
+    jassert (decoded != nullptr);
+
+    const juce::ScopedLock sl (entriesLock);
+    const auto it = entries.find (key);
+
+    if (it == entries.end() || it->second.encodedResult != encoded)
+        return it != entries.end() ? it->second.result : nullptr;
+
+    it->second.result = std::move (decoded);
+    it->second.encodedResult.reset();
+    it->second.encodedOverview.reset();
+    return it->second.result;
+}
+
+std::shared_ptr<const SourceOverview> AnalysisEngine::getOverview (SourceKey key) const
+{
+    const juce::ScopedLock sl (entriesLock);
+
+    if (auto it = entries.find (key); it != entries.end())
+        return it->second.result != nullptr ? it->second.result->overview : it->second.encodedOverview;
+
+    return {};
+}
+
+//==============================================================================
+void AnalysisEngine::restoreAnalysis (SourceKey key, juce::MemoryBlock encoded)
+{
+    auto& entry = getEntry (key);
+    stopJob (entry);
+
+    std::shared_ptr<const juce::MemoryBlock> block;
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+        entry.result.reset();
+        entry.sampleHashes.clear();
+        entry.isStale = false;
+        entry.encodedResult = block = std::make_shared<const juce::MemoryBlock> (std::move (encoded));
+        entry.encodedOverview.reset();
+    }
+
+    // Only the overview is decoded now, for the editor; the features stay encoded
+    // until a renderer asks for them. The source may be gone, or its result
+    // replaced or decoded, by the time this runs.
+    pool.addJob ([this, key, block]
+    {
+        auto overview = ArchiveCodec::decodeOverview (*block);
+
+        const juce::ScopedLock sl (entriesLock);
+
+        if (auto it = entries.find (key); it != entries.end() && it->second.encodedResult == block)
+            it->second.encodedOverview = std::move (overview);
+    });
+}
+
+bool AnalysisEngine::writeEncodedAnalysis (SourceKey key, ByteWriter& writer) const
+{
+    std::shared_ptr<const SourceAnalysis> result;
+    std::shared_ptr<const juce::MemoryBlock> encoded;
+
+    {
+        const juce::ScopedLock sl (entriesLock);
+        const auto it = entries.find (key);
+
+        if (it == entries.end())
+            return false;
+
+        result = it->second.result;
+        encoded = it->second.encodedResult;
+    }
+
+    if (encoded != nullptr)
+        writer.writeBytes (encoded->getData(), encoded->getSize());
+    else if (result != nullptr)
+        ArchiveCodec::encodeAnalysis (*result, writer);
+    else
+        return false;
+
+    return true;
+}
+
+//==============================================================================
+AnalysisEngine::Entry& AnalysisEngine::getEntry (SourceKey key)
+{
+    const juce::ScopedLock sl (entriesLock);
+    return entries[key];
+}
+
+void AnalysisEngine::stopJob (Entry& entry)
+{
+    if (entry.job == nullptr)
+        return;
+
+    // The job's reader must be released on this thread, so wait for the worker
+    // to finish with it before deleting. Its stream makes sure the read-ahead
+    // thread has let go of it too.
+    pool.removeJob (entry.job.get(), true, -1);
+
+    const juce::ScopedLock sl (entriesLock);
+    entry.job.reset();
+}
+
+void AnalysisEngine::publishResult (SourceKey key, std::shared_ptr<const SourceAnalysis> result, std::vector<juce::uint64> sampleHashes)
+{
+    const juce::ScopedLock sl (entriesLock);
+
+    if (auto it = entries.find (key); it != entries.end())
+    {
+        it->second.result = std::move (result);
+        it->second.sampleHashes = std::move (sampleHashes);
+        it->second.isStale = false;
+    }
+}
+
+} // namespace hifitune
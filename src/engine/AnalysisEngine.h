@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    This file contains the background analysis engine for audio sources.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "AnalysisStore.h"
+#include "BinaryCoding.h"
+#include "SampleChangeLog.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Runs pitch, voicing and mel analysis for audio sources on a bounded pool of
+    background threads.
+
+    Sources are identified by an opaque key chosen by the caller (the ARA
+    document controller uses the ARAAudioSource pointer). Each source is read
+    from its own AudioFormatReader through a SourceStream, in large chunks that
+    are read ahead while the previous ones are analysed, so any reader type
+    works: ARAAudioSourceReader inside a host, or a plain file reader elsewhere.
+
+    Frames only depend on the audio around them, so the frames of a chunk are
+    shared out to every idle pool thread. A single long source is analysed
+    about as fast as the pool allows, not at the speed of one thread.
+
+    With an AnalysisStore, finished results are written to disk and used from
+    there, and sources the store already knows skip the analysis altogether.
+    They are still read once, to hash every sample for the store's key.
+
+    When a source's samples change, updateAnalysis() compares the new audio
+    with the old in blocks of samplesPerHashBlock, reports the ranges that
+    differ, and analyses only the frames within reach of them again.
+
+    Results can also be restored from an archive. Those are kept encoded until
+    something first asks for them, so that opening a document doesn't take
+    longer the more audio it contains. Only their overviews, which are small
+    and stored apart from the features, are decoded straight away in the
+    background, for the editor to draw.
+
+    All public methods are meant to be called from a single controlling thread
+    (the message thread in the plug-in), except getAnalysis() and getOverview(),
+    which may be called from anywhere. Listener callbacks arrive on the worker threads,
+    except where noted.
+*/
+class AnalysisEngine
+{
+public:
+    //==============================================================================
+    using SourceKey = const void*;
+
+    /** Receives progress for running analyses. Called on worker threads. */
+    struct Listener
+    {
+        virtual ~Listener() = default;
+
+        virtual void analysisStarted (SourceKey) {}
+        virtual void analysisProgressed (SourceKey, float /*progress*/) {}
+
+        /** Called by updateAnalysis() jobs with the ranges of source samples that
+            differ from those the current result was made from, or with
+            SampleChangeLog::everything if that can't be told. Also called
+            directly from updateAnalysis() when there is no result to compare
+            with, and from cancelAnalysis() when it drops a result that an
+            update didn't get to finish.
+        */
+        virtual void analysisFoundChanges (SourceKey, const std::vector<juce::Range<juce::int64>>& /*changedSamples*/) {}
+
+        /** Called once for every started analysis. The result is nullptr if the
+            analysis failed or was cancelled.
+        */
+        virtual void analysisFinished (SourceKey, const std::shared_ptr<const SourceAnalysis>& /*result*/) {}
+    };
+
+    //==============================================================================
+    AnalysisEngine (Listener& listener, const FeatureConfig& config = {}, int numThreads = getDefaultNumThreads(),
+                    AnalysisStore* store = nullptr);
+    ~AnalysisEngine();
+
+    /** Returns a pool size that leaves a core free for the host's audio and UI threads. */
+    static int getDefaultNumThreads();
+
+    const FeatureConfig& getConfig() const noexcept         { return config; }
+
+    /** Source samples per block compared by updateAnalysis(). */
+    static constexpr int samplesPerHashBlock = 1 << 14;
+
+    //==============================================================================
+    /** Starts (or restarts) the analysis of a source, replacing any earlier result.
+
+        The engine takes ownership of the reader, but always deletes it on the
+        calling thread, as ARAAudioSourceReader requires.
+
+        The persistent ID identifies the source in the AnalysisStore across
+        sessions. Without one, the store isn't used.
+    */
+    void startAnalysis (SourceKey, std::unique_ptr<juce::AudioFormatReader> reader, const juce::String& persistentID = {});
+
+    /** Brings the analysis of a source whose samples have changed up to date,
+        keeping the current result available until the new one is ready.
+
+        Only the frames around the sample blocks that differ from those the
+        current result was made from are analysed again; the rest are copied.
+        If the audio can't be compared (nothing was analysed from it in this
+        session, or its length or rate changed), the whole source is analysed.
+
+        Takes ownership of the reader like startAnalysis().
+    */
+    void updateAnalysis (SourceKey, std::unique_ptr<juce::AudioFormatReader> reader, const juce::String& persistentID = {});
+
+    /** Stops any running analysis for this source, blocking until its worker has
+        let go of it. An unfinished update leaves a result describing samples
+        that are gone, so that result is dropped.
+    */
+    void cancelAnalysis (SourceKey);
+
+    /** Cancels the analysis and forgets the source's result. */
+    void removeSource (SourceKey);
+
+    /** Returns true if an analysis for the source is queued or running. */
+    bool isAnalysing (SourceKey) const;
+
+    /** Returns true if the source has a result, finished or restored. */
+    bool hasAnalysis (SourceKey) const;
+
+    /** Returns the latest finished analysis for a source, or nullptr. Can be called
+        from any thread. A restored result is decoded by the first call that asks
+        for it.
+    */
+    std::shared_ptr<const SourceAnalysis> getAnalysis (SourceKey);
+
+    /** Returns the overview of the source's latest result, or nullptr. For a
+        restored result that hasn't been decoded, this is the overview decoded
+        on its own, once that's done. Never decodes anything itself, so callers
+        such as the editor don't stall. Can be called from any thread.
+    */
+    std::shared_ptr<const SourceOverview> getOverview (SourceKey) const;
+
+    //==============================================================================
+    /** Installs a result encoded by ArchiveCodec::encodeAnalysis(), cancelling any
+        running analysis, and queues its overview to be decoded on the analysis
+        threads. The caller must have checked that it matches the source.
+    */
+    void restoreAnalysis (SourceKey, juce::MemoryBlock encoded);
+
+    /** Appends the source's result in ArchiveCodec format. Restored results that
+        were never decoded are copied as they are. Returns false if there is no
+        result to write.
+    */
+    bool writeEncodedAnalysis (SourceKey, ByteWriter&) const;
+
+private:
+    //==============================================================================
+    class Job;
+    class Helper;
+    struct ChunkWork;
+
+    struct Entry
+    {
+        std::unique_ptr<Job> job;
+        std::shared_ptr<const SourceAnalysis> result;
+        std::shared_ptr<const juce::MemoryBlock> encodedResult;     // restored, not decoded yet
+        std::shared_ptr<const SourceOverview> encodedOverview;      // decoded from encodedResult
+
+        // Hashes of the sample blocks the result was made from, if it was
+        // analysed in this session
+        std::vector<juce::uint64> sampleHashes;
+        bool isStale = false;       // an update is pending
+    };
+
+    Entry& getEntry (SourceKey);
+    void stopJob (Entry&);
+    void publishResult (SourceKey, std::shared_ptr<const SourceAnalysis>, std::vector<juce::uint64> sampleHashes);
+
+    Listener& listener;
+    const FeatureConfig config;
+    AnalysisStore* const store;
+
+    std::map<SourceKey, Entry> entries;
+    mutable juce::CriticalSection entriesLock;
+
+    juce::ThreadPool pool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisEngine)
+};
+
+} // namespace hifitune
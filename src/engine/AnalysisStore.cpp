@@ -0,0 +1,253 @@
+/*
+  ==============================================================================
+
+    This file contains the on-disk store of analysis results.
+
+  ==============================================================================
+*/
+
+#include "AnalysisStore.h"
+#include "BinaryCoding.h"
+#include "ContentHash.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    constexpr juce::uint32 storeMagic = 0x53544648;     // "HFTS"
+    constexpr juce::uint32 storeVersion = 2;          // 1 had no overview
+
+    // The header is padded so that the float arrays after it stay cache-line
+    // aligned in the mapping. The arrays are in native byte order, and are
+    // followed by the encoded overview, which is small and read onto the heap.
+    constexpr size_t headerSize = 64;
+
+    const juce::String fileExtension (".hfa");
+
+    size_t getDataSize (juce::int64 numFrames, juce::int64 numMelBins) noexcept
+    {
+        return (size_t) (numFrames * (numMelBins + 2)) * sizeof (float);
+    }
+}
+
+//==============================================================================
+AnalysisStore::AnalysisStore()
+    : AnalysisStore (getDefaultDirectory(), defaultMaxSizeInBytes)
+{
+}
+
+AnalysisStore::AnalysisStore (const juce::File& directoryIn, juce::int64 maxSizeInBytesIn)
+    : directory (directoryIn), maxSizeInBytes (maxSizeInBytesIn)
+{
+    directory.createDirectory();
+    trim();
+}
+
+juce::File AnalysisStore::getDefaultDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("OpenVPI")
+               .getChildFile ("HiFiTune")
+               .getChildFile ("AnalysisStore");
+}
+
+juce::uint64 AnalysisStore::computeKey (const juce::String& persistentID, double sampleRate, juce::int64 length, int numChannels,
+                                        const std::vector<juce::uint64>& sampleHashes, const FeatureConfig& config)
+{
+    ContentHash hash;
+    hash.add (storeVersion)
+        .add (persistentID)
+        .add (sampleRate)
+        .add (length)
+        .add (numChannels)
+        .add (config.sampleRate)
+        .add (config.hopSize)
+        .add (config.fftSize)
+        .add (config.numMelBins)
+        .add (config.melMinHz)
+        .add (config.melMaxHz)
+        .add (config.f0MinHz)
+        .add (config.f0MaxHz)
+        .add ((juce::uint64) sampleHashes.size())
+        .add (sampleHashes.data(), sampleHashes.size() * sizeof (juce::uint64));
+
+    const auto key = hash.get();
+    return key != 0 ? key : 1;
+}
+
+//==============================================================================
+std::shared_ptr<const SourceAnalysis> AnalysisStore::find (juce::uint64 key, const FeatureConfig& config)
+{
+    const auto file = getFile (key);
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (auto it = mapped.find (key); it != mapped.end())
+            if (auto analysis = it->second.lock())
+                return analysis;
+    }
+
+    if (! file.existsAsFile())
+        return {};
+
+    auto analysis = map (key, file, config);
+
+    // Marks the file as recently used for trim()
+    if (analysis != nullptr)
+        file.setLastModificationTime (juce::Time::getCurrentTime());
+
+    return analysis;
+}
+
+std::shared_ptr<const SourceAnalysis> AnalysisStore::store (juce::uint64 key, const SourceAnalysis& analysis)
+{
+    jassert (key != 0);
+
+    const auto file = getFile (key);
+    const auto tempFile = file.getSiblingFile (file.getFileNameWithoutExtension() + "-" + juce::Uuid().toString() + ".tmp");
+
+    ByteWriter header;
+    header.writeUint64 (storeMagic | ((juce::uint64) storeVersion << 32));
+    header.writeUint64 (key);
+    header.writeDouble (analysis.sourceSampleRate);
+    header.writeUint64 ((juce::uint64) analysis.sourceLength);
+    header.writeUint64 ((juce::uint64) analysis.numFrames);
+    header.writeUint64 ((juce::uint64) analysis.config.numMelBins);
+    header.writeUint64 (analysis.contentHash);
+
+    ByteWriter overview;
+
+    if (analysis.overview != nullptr)
+        analysis.overview->write (overview);
+
+    header.writeUint64 (overview.getSize());
+
+    while (header.getSize() < headerSize)
+        header.writeByte (0);
+
+    bool ok = false;
+
+    if (auto stream = tempFile.createOutputStream())
+    {
+        ok = stream->openedOk()
+             && stream->write (header.getData(), header.getSize())
+             && stream->write (analysis.f0, (size_t) analysis.numFrames * sizeof (float))
+             && stream->write (analysis.voicing, (size_t) analysis.numFrames * sizeof (float))
+             && stream->write (analysis.mel, analysis.getNumMelValues() * sizeof (float))
+             && stream->write (overview.getData(), overview.getSize());
+
+        stream->flush();
+        ok = ok && stream->getStatus().wasOk();
+    }
+
+    // Another instance may have stored the same result meanwhile; its file is
+    // identical, so losing the race is fine.
+    if (! (ok && tempFile.moveFileTo (file)))
+    {
+        tempFile.deleteFile();
+
+        if (! file.existsAsFile())
+            return {};
+    }
+
+    trim();
+    return map (key, file, analysis.config);
+}
+
+void AnalysisStore::trim()
+{
+    std::vector<std::pair<juce::int64, juce::File>> files;
+
+    for (const auto& file : directory.findChildFiles (juce::File::findFiles, false, "*" + fileExtension))
+        files.emplace_back (file.getLastModificationTime().toMilliseconds(), file);
+
+    std::sort (files.begin(), files.end(), [] (const auto& a, const auto& b) { return a.first > b.first; });
+
+    juce::int64 totalSize = 0;
+
+    for (const auto& [time, file] : files)
+    {
+        totalSize += file.getSize();
+
+        // Mapped files stay readable after deletion on POSIX, and can't be
+        // deleted on Windows, so there's no need to check what is in use.
+        if (totalSize > maxSizeInBytes)
+            file.deleteFile();
+    }
+}
+
+//==============================================================================
+juce::File AnalysisStore::getFile (juce::uint64 key) const
+{
+    return directory.getChildFile (juce::String::toHexString ((juce::int64) key).paddedLeft ('0', 16) + fileExtension);
+}
+
+std::shared_ptr<const SourceAnalysis> AnalysisStore::map (juce::uint64 key, const juce::File& file, const FeatureConfig& config)
+{
+    auto mapping = std::make_shared<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readOnly);
+
+    if (mapping->getData() == nullptr || mapping->getSize() < headerSize)
+        return {};
+
+    const auto* data = static_cast<const juce::uint8*> (mapping->getData());
+    ByteReader header (data, headerSize);
+
+    const auto magicAndVersion = header.readUint64();
+    const auto storedKey = header.readUint64();
+
+    auto analysis = std::make_shared<SourceAnalysis>();
+    analysis->config = config;
+    analysis->sourceSampleRate = header.readDouble();
+    analysis->sourceLength = (juce::int64) header.readUint64();
+    const auto numFrames = (juce::int64) header.readUint64();
+    const auto numMelBins = (juce::int64) header.readUint64();
+    analysis->contentHash = header.readUint64();
+    const auto overviewSize = header.readUint64();
+
+    if (header.hasFailed()
+        || magicAndVersion != (storeMagic | ((juce::uint64) storeVersion << 32))
+        || storedKey != key
+        || numMelBins != config.numMelBins
+        || ! juce::isPositiveAndBelow (numFrames, (juce::int64) std::numeric_limits<int>::max())
+        || overviewSize > mapping->getSize()
+        || mapping->getSize() != headerSize + getDataSize (numFrames, numMelBins) + overviewSize)
+    {
+        return {};
+    }
+
+    analysis->numFrames = (int) numFrames;
+
+    const auto* f0 = reinterpret_cast<const float*> (data + headerSize);
+    const auto* voicing = f0 + numFrames;
+    const auto* mel = voicing + numFrames;
+    analysis->useExternalStorage (std::move (mapping), f0, voicing, mel);
+
+    if (overviewSize > 0)
+    {
+        ByteReader overview (data + headerSize + getDataSize (numFrames, numMelBins), (size_t) overviewSize);
+
+        analysis->overview = SourceOverview::read (overview);
+
+        if (analysis->overview == nullptr)
+            return {};
+    }
+
+    const juce::ScopedLock sl (lock);
+
+    // Someone else may have mapped it meanwhile; share theirs
+    auto& entry = mapped[key];
+
+    if (auto existing = entry.lock())
+        return existing;
+
+    for (auto it = mapped.begin(); it != mapped.end();)
+        it = it->second.expired() && it->first != key ? mapped.erase (it) : std::next (it);
+
+    std::shared_ptr<const SourceAnalysis> result = std::move (analysis);
+    entry = result;
+    return result;
+}
+
+} // namespace hifitune
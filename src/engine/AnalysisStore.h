@@ -0,0 +1,80 @@
+/*
+  ==============================================================================
+
+    This file contains the on-disk store of analysis results.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "SourceAnalysis.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    A directory of finished analyses, shared by every plug-in instance on the
+    machine and kept between sessions, so that audio is only analysed once.
+
+    Each result is a single file holding a small header followed by the raw
+    feature arrays and the source's overview. Results are memory-mapped rather than loaded, so readers
+    use the file contents directly and the OS pages them in and out as needed.
+    Instances that open the same result share one mapping.
+
+    Files are written under a temporary name and then moved into place, so
+    other processes never see half-written results. The least recently used
+    files are deleted once the store grows beyond its size limit.
+
+    Use it through a juce::SharedResourcePointer. All methods are thread-safe.
+*/
+class AnalysisStore
+{
+public:
+    //==============================================================================
+    static constexpr juce::int64 defaultMaxSizeInBytes = (juce::int64) 2 << 30;
+
+    AnalysisStore();
+    AnalysisStore (const juce::File& directory, juce::int64 maxSizeInBytes);
+
+    static juce::File getDefaultDirectory();
+
+    /** Computes the key for a source from its persistent ID, its format, the
+        analysis settings and the hashes of all its samples, in blocks, so that
+        audio edited under an unchanged ID, as hosts often keep it through
+        destructive edits, gets a new key wherever the edit is. Never returns 0.
+    */
+    static juce::uint64 computeKey (const juce::String& persistentID, double sampleRate, juce::int64 length, int numChannels,
+                                    const std::vector<juce::uint64>& sampleHashes, const FeatureConfig&);
+
+    //==============================================================================
+    /** Returns the stored analysis for a key, or nullptr if there is none. */
+    std::shared_ptr<const SourceAnalysis> find (juce::uint64 key, const FeatureConfig&);
+
+    /** Writes an analysis to the store and returns the mapped copy, which should
+        be used instead of the original to release its heap memory. Returns
+        nullptr if the file couldn't be written.
+    */
+    std::shared_ptr<const SourceAnalysis> store (juce::uint64 key, const SourceAnalysis&);
+
+    /** Deletes the least recently used files until the store fits its size limit. */
+    void trim();
+
+private:
+    //==============================================================================
+    juce::File getFile (juce::uint64 key) const;
+    std::shared_ptr<const SourceAnalysis> map (juce::uint64 key, const juce::File&, const FeatureConfig&);
+
+    const juce::File directory;
+    const juce::int64 maxSizeInBytes;
+
+    std::map<juce::uint64, std::weak_ptr<const SourceAnalysis>> mapped;
+    juce::CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalysisStore)
+};
+
+} // namespace hifitune
@@ -0,0 +1,439 @@
+/*
+  ==============================================================================
+
+    This file contains the binary format used to store documents.
+
+  ==============================================================================
+*/
+
+#include "ArchiveCodec.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    constexpr juce::uint32 archiveMagic = 0x41544648;     // "HFTA"
+    constexpr juce::uint64 archiveVersion = 1;
+    constexpr juce::uint64 analysisVersion = 3;        // 1 had no overview, 2 had it after the features
+    constexpr juce::uint64 pitchCurveVersion = 2;      // 1 had no point flags
+
+    // Quantisation steps
+    constexpr double f0StepsPerOctave = 12000.0;        // 0.1 cent
+    constexpr float melStepsPerUnit = 256.0f;
+    constexpr float voicingSteps = 255.0f;
+    constexpr double timeStepsPerSecond = 1.0e6;
+    constexpr float semitoneSteps = 1000.0f;
+
+    // Sanity limit for sizes read from an archive, to fail early on garbage. An
+    // hour of analysis takes a few tens of megabytes.
+    constexpr juce::uint64 maxPayloadSize = (juce::uint64) 1 << 30;
+
+    // Payloads are read into a buffer starting at this size and doubling as bytes
+    // arrive, so that a size that is wrong only costs memory for what turns up
+    constexpr size_t firstPayloadPieceSize = (size_t) 1 << 20;
+
+    bool writeVarint (juce::OutputStream& out, juce::uint64 value)
+    {
+        ByteWriter writer;
+        writer.writeVarint (value);
+        return out.write (writer.getData(), writer.getSize());
+    }
+
+    bool readVarint (juce::InputStream& in, juce::uint64& value)
+    {
+        value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            juce::uint8 byte;
+
+            if (in.read (&byte, 1) != 1)
+                return false;
+
+            value |= (juce::uint64) (byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool readFully (juce::InputStream& in, void* dest, size_t numBytes)
+    {
+        auto* bytes = static_cast<char*> (dest);
+
+        while (numBytes > 0)
+        {
+            const auto numThisTime = (int) juce::jmin (numBytes, (size_t) std::numeric_limits<int>::max());
+            const auto numRead = in.read (bytes, numThisTime);
+
+            if (numRead <= 0)
+                return false;
+
+            bytes += numRead;
+            numBytes -= (size_t) numRead;
+        }
+
+        return true;
+    }
+
+    bool readPayload (juce::InputStream& in, juce::MemoryBlock& payload, size_t numBytes)
+    {
+        payload.reset();
+
+        for (size_t numRead = 0; numRead < numBytes;)
+        {
+            const auto numThisTime = juce::jmin (juce::jmax (firstPayloadPieceSize, numRead), numBytes - numRead);
+            payload.setSize (numRead + numThisTime);
+
+            if (! readFully (in, static_cast<char*> (payload.getData()) + numRead, numThisTime))
+                return false;
+
+            numRead += numThisTime;
+        }
+
+        return true;
+    }
+
+    juce::uint64 getChecksum (const void* data, size_t numBytes) noexcept
+    {
+        return ContentHash().add (data, numBytes).get();
+    }
+
+    void writeConfig (const FeatureConfig& config, ByteWriter& writer)
+    {
+        writer.writeDouble (config.sampleRate);
+        writer.writeVarint ((juce::uint64) config.hopSize);
+        writer.writeVarint ((juce::uint64) config.fftSize);
+        writer.writeVarint ((juce::uint64) config.numMelBins);
+        writer.writeDouble (config.melMinHz);
+        writer.writeDouble (config.melMaxHz);
+        writer.writeDouble (config.f0MinHz);
+        writer.writeDouble (config.f0MaxHz);
+    }
+
+    void readConfig (ByteReader& reader, FeatureConfig& config)
+    {
+        config.sampleRate = reader.readDouble();
+        config.hopSize = (int) reader.readVarint();
+        config.fftSize = (int) reader.readVarint();
+        config.numMelBins = (int) reader.readVarint();
+        config.melMinHz = (float) reader.readDouble();
+        config.melMaxHz = (float) reader.readDouble();
+        config.f0MinHz = (float) reader.readDouble();
+        config.f0MaxHz = (float) reader.readDouble();
+    }
+
+    bool readAnalysisHeader (ByteReader& reader, SourceAnalysis& header, juce::uint64& version)
+    {
+        version = reader.readVarint();
+
+        if (version < 1 || version > analysisVersion)
+            return false;
+
+        readConfig (reader, header.config);
+        header.sourceSampleRate = reader.readDouble();
+        header.sourceLength = (juce::int64) reader.readVarint();
+        const auto numFrames = reader.readVarint();
+
+        if (reader.hasFailed() || numFrames > (juce::uint64) std::numeric_limits<int>::max()
+            || header.config.numMelBins <= 0 || header.config.numMelBins > 4096)
+            return false;
+
+        header.numFrames = (int) numFrames;
+        return true;
+    }
+
+    bool readOverview (ByteReader& reader, SourceAnalysis& analysis)
+    {
+        if (reader.readByte() == 0)
+            return ! reader.hasFailed();
+
+        analysis.overview = SourceOverview::read (reader);
+        return analysis.overview != nullptr;
+    }
+}
+
+//==============================================================================
+bool ArchiveCodec::writeHeader (juce::OutputStream& out)
+{
+    return out.writeInt ((int) archiveMagic) && writeVarint (out, archiveVersion);
+}
+
+bool ArchiveCodec::writeChunk (juce::OutputStream& out, ChunkType type, const juce::String& persistentID,
+                               const void* payload, size_t payloadSize)
+{
+    ByteWriter header;
+    header.writeVarint ((juce::uint64) type);
+    header.writeString (persistentID);
+    header.writeVarint (payloadSize);
+    header.writeUint64 (getChecksum (payload, payloadSize));
+
+    return out.write (header.getData(), header.getSize())
+        && out.write (payload, payloadSize);
+}
+
+bool ArchiveCodec::writeEnd (juce::OutputStream& out)
+{
+    return writeVarint (out, (juce::uint64) ChunkType::end);
+}
+
+bool ArchiveCodec::readHeader (juce::InputStream& in)
+{
+    juce::uint64 version;
+    return (juce::uint32) in.readInt() == archiveMagic
+        && readVarint (in, version)
+        && version <= archiveVersion;
+}
+
+bool ArchiveCodec::readChunk (juce::InputStream& in, Chunk& chunk)
+{
+    juce::uint64 type, idSize, payloadSize;
+
+    if (! readVarint (in, type) || type == (juce::uint64) ChunkType::end)
+        return false;
+
+    if (! readVarint (in, idSize) || idSize > 4096)
+        return false;
+
+    juce::HeapBlock<char> id (idSize + 1, true);
+
+    if (! readFully (in, id.get(), (size_t) idSize))
+        return false;
+
+    if (! readVarint (in, payloadSize) || payloadSize > maxPayloadSize)
+        return false;
+
+    // Where the stream knows its length, a payload (and checksum) running past
+    // it is caught before anything is allocated
+    if (const auto totalLength = in.getTotalLength(); totalLength >= 0
+          && payloadSize + sizeof (juce::uint64) > (juce::uint64) juce::jmax ((juce::int64) 0, totalLength - in.getPosition()))
+        return false;
+
+    juce::uint64 checksum = 0;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        juce::uint8 byte;
+
+        if (in.read (&byte, 1) != 1)
+            return false;
+
+        checksum |= (juce::uint64) byte << (8 * i);
+    }
+
+    chunk.type = (ChunkType) type;
+    chunk.persistentID = juce::String::fromUTF8 (id.get(), (int) idSize);
+
+    if (! readPayload (in, chunk.payload, (size_t) payloadSize))
+        return false;
+
+    chunk.isIntact = getChecksum (chunk.payload.getData(), chunk.payload.getSize()) == checksum;
+    return true;
+}
+
+//==============================================================================
+void ArchiveCodec::encodeAnalysis (const SourceAnalysis& analysis, ByteWriter& writer)
+{
+    const auto numFrames = (size_t) analysis.numFrames;
+    const auto numBins = (size_t) analysis.config.numMelBins;
+
+    // Most mel deltas fit in two bytes, the rest in one
+    writer.reserve (writer.getSize() + 128 + numFrames * (numBins * 2 + 4));
+
+    writer.writeVarint (analysisVersion);
+    writeConfig (analysis.config, writer);
+    writer.writeDouble (analysis.sourceSampleRate);
+    writer.writeVarint ((juce::uint64) analysis.sourceLength);
+    writer.writeVarint (numFrames);
+
+    // The overview comes first, so that it can be read without the features
+    writer.writeByte (analysis.overview != nullptr ? 1 : 0);
+
+    if (analysis.overview != nullptr)
+        analysis.overview->write (writer);
+
+    juce::int64 previousF0 = 0;
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+    {
+        const auto f0 = analysis.f0[frame];
+        const auto q = f0 > 0.0f ? (juce::int64) std::llround (std::log2 ((double) f0) * f0StepsPerOctave) : 0;
+        writer.writeSignedVarint (q - previousF0);
+        previousF0 = q;
+    }
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+        writer.writeByte ((juce::uint8) juce::roundToInt (juce::jlimit (0.0f, 1.0f, analysis.voicing[frame]) * voicingSteps));
+
+    std::vector<juce::int64> previousMel (numBins, 0);
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+    {
+        const auto* mel = analysis.getMelFrame ((int) frame);
+
+        for (size_t bin = 0; bin < numBins; ++bin)
+        {
+            const auto q = (juce::int64) std::llround (mel[bin] * melStepsPerUnit);
+            writer.writeSignedVarint (q - previousMel[bin]);
+            previousMel[bin] = q;
+        }
+    }
+}
+
+bool ArchiveCodec::decodeAnalysisHeader (const juce::MemoryBlock& block, SourceAnalysis& header)
+{
+    ByteReader reader (block);
+    juce::uint64 version;
+    return readAnalysisHeader (reader, header, version);
+}
+
+std::shared_ptr<SourceAnalysis> ArchiveCodec::decodeAnalysis (const juce::MemoryBlock& block)
+{
+    ByteReader reader (block);
+    auto analysis = std::make_shared<SourceAnalysis>();
+    juce::uint64 version;
+
+    if (! readAnalysisHeader (reader, *analysis, version)
+        || (version >= 3 && ! readOverview (reader, *analysis)))
+        return {};
+
+    // Every frame takes at least one byte per value, which catches bogus sizes
+    // before they turn into huge allocations
+    if (reader.getNumBytesRemaining() < (size_t) analysis->numFrames * (size_t) (analysis->config.numMelBins + 2))
+        return {};
+
+    const auto numFrames = (size_t) analysis->numFrames;
+    const auto arrays = analysis->allocate (analysis->numFrames);
+
+    juce::int64 f0 = 0;
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+    {
+        f0 += reader.readSignedVarint();
+        arrays.f0[frame] = f0 != 0 ? (float) std::exp2 ((double) f0 / f0StepsPerOctave) : 0.0f;
+    }
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+        arrays.voicing[frame] = (float) reader.readByte() / voicingSteps;
+
+    const auto numBins = (size_t) analysis->config.numMelBins;
+    std::vector<juce::int64> mel (numBins, 0);
+
+    for (size_t frame = 0; frame < numFrames; ++frame)
+    {
+        auto* dest = arrays.mel + frame * numBins;
+
+        for (size_t bin = 0; bin < numBins; ++bin)
+        {
+            mel[bin] += reader.readSignedVarint();
+            dest[bin] = (float) mel[bin] / melStepsPerUnit;
+        }
+    }
+
+    if (version == 2)
+    {
+        if (! readOverview (reader, *analysis))
+            return {};
+    }
+    else if (version < 2)
+    {
+        // The waveform needs the source audio, but the pitch can still be shown
+        analysis->overview = std::make_shared<const SourceOverview> (std::vector<SourceOverview::Peak>(),
+                                                                     SourceOverview::computePitch (analysis->f0, analysis->numFrames),
+                                                                     analysis->getSourceSamplesPerFrame());
+    }
+
+    if (reader.hasFailed())
+        return {};
+
+    analysis->updateContentHash();
+    return analysis;
+}
+
+std::shared_ptr<const SourceOverview> ArchiveCodec::decodeOverview (const juce::MemoryBlock& block)
+{
+    ByteReader reader (block);
+    SourceAnalysis header;
+    juce::uint64 version;
+
+    if (! readAnalysisHeader (reader, header, version))
+        return {};
+
+    // Older versions don't keep it apart from the features
+    if (version < 3)
+    {
+        const auto analysis = decodeAnalysis (block);
+        return analysis != nullptr ? analysis->overview : nullptr;
+    }
+
+    if (! readOverview (reader, header))
+        return {};
+
+    return header.overview;
+}
+
+//==============================================================================
+void ArchiveCodec::encodePitchCurve (const PitchCurve& curve, ByteWriter& writer)
+{
+    writer.writeVarint (pitchCurveVersion);
+    writer.writeVarint ((juce::uint64) curve.getNumPoints());
+
+    juce::int64 previousTime = 0, previousSemitones = 0;
+
+    curve.forEachRun ({ 0, curve.getNumPoints() }, [&] (const double* times, const float* values, const juce::uint8* flags, int num)
+    {
+        for (int i = 0; i < num; ++i)
+        {
+            const auto time = (juce::int64) std::llround (times[i] * timeStepsPerSecond);
+            const auto semitones = (juce::int64) std::llround (values[i] * semitoneSteps);
+
+            writer.writeSignedVarint (time - previousTime);
+            writer.writeSignedVarint (semitones - previousSemitones);
+            writer.writeVarint (flags[i]);
+
+            previousTime = time;
+            previousSemitones = semitones;
+        }
+    });
+}
+
+std::shared_ptr<const PitchCurve> ArchiveCodec::decodePitchCurve (const juce::MemoryBlock& block,
+                                                                 const std::shared_ptr<DocumentArena>& arena)
+{
+    ByteReader reader (block);
+
+    const auto version = reader.readVarint();
+
+    if (version < 1 || version > pitchCurveVersion)
+        return {};
+
+    const auto hasFlags = version >= 2;
+    const auto numPoints = reader.readVarint();
+
+    // Each point takes at least a byte per field
+    if (reader.hasFailed() || numPoints > reader.getNumBytesRemaining() / (hasFlags ? 3 : 2))
+        return {};
+
+    PitchCurve::Points points { ArenaAllocator<PitchCurve::Point> (arena) };
+    points.reserve ((size_t) numPoints);
+
+    juce::int64 time = 0, semitones = 0;
+
+    for (juce::uint64 i = 0; i < numPoints; ++i)
+    {
+        time += reader.readSignedVarint();
+        semitones += reader.readSignedVarint();
+        const auto flags = hasFlags ? (juce::uint8) reader.readVarint() : (juce::uint8) 0;
+        points.push_back ({ (double) time / timeStepsPerSecond, (float) semitones / semitoneSteps, flags });
+    }
+
+    if (reader.hasFailed())
+        return {};
+
+    return PitchCurve::create (std::move (points));
+}
+
+} // namespace hifitune
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    This file contains the binary format used to store documents.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "BinaryCoding.h"
+#include "PitchCurve.h"
+#include "SourceAnalysis.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Reads and writes the document archive: a header followed by independent
+    chunks, one per stored object, each tagged with the object's persistent ID
+    and a checksum. Readers skip chunk types they don't know, so newer
+    versions can add data without breaking older ones.
+
+    Feature data is quantised finely enough to be inaudible (0.1 cent for F0,
+    1/256 of a natural-log unit for mel) and stored as varint deltas along
+    time, which keeps it at roughly half of its in-memory size.
+*/
+struct ArchiveCodec
+{
+    //==============================================================================
+    enum class ChunkType : juce::uint32
+    {
+        end                 = 0,
+        sourceAnalysis      = 1,    // SourceAnalysis of an audio source
+        modificationEdits   = 2     // PitchCurve of an audio modification
+    };
+
+    struct Chunk
+    {
+        ChunkType type = ChunkType::end;
+        juce::String persistentID;
+        juce::MemoryBlock payload;
+        bool isIntact = false;      // false if the payload failed its checksum
+    };
+
+    //==============================================================================
+    static bool writeHeader (juce::OutputStream&);
+    static bool writeChunk (juce::OutputStream&, ChunkType, const juce::String& persistentID, const void* payload, size_t payloadSize);
+    static bool writeEnd (juce::OutputStream&);
+
+    /** Returns false if the stream doesn't start with an archive this version can read. */
+    static bool readHeader (juce::InputStream&);
+
+    /** Reads the next chunk. Returns false at the end of the archive, if the
+        stream is truncated, or if a chunk claims more data than it can hold.
+        Memory is only allocated as the payload's bytes actually arrive.
+    */
+    static bool readChunk (juce::InputStream&, Chunk&);
+
+    //==============================================================================
+    static void encodeAnalysis (const SourceAnalysis&, ByteWriter&);
+
+    /** Decodes only the fixed-size fields of an encoded analysis (everything but
+        the feature vectors), e.g. to check it still matches its source.
+    */
+    static bool decodeAnalysisHeader (const juce::MemoryBlock&, SourceAnalysis& header);
+
+    static std::shared_ptr<SourceAnalysis> decodeAnalysis (const juce::MemoryBlock&);
+
+    /** Decodes only the overview of an encoded analysis, which is stored ahead of
+        the feature vectors, so this costs the same however long the source is.
+        Returns nullptr if there is none.
+    */
+    static std::shared_ptr<const SourceOverview> decodeOverview (const juce::MemoryBlock&);
+
+    //==============================================================================
+    static void encodePitchCurve (const PitchCurve&, ByteWriter&);
+
+    /** Decodes a curve, keeping it in the given document arena if there is one. */
+    static std::shared_ptr<const PitchCurve> decodePitchCurve (const juce::MemoryBlock&,
+                                                               const std::shared_ptr<DocumentArena>& arena = {});
+};
+
+} // namespace hifitune
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    This file contains a holder for immutable snapshots read without locks.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Holds the current version of an immutable object, which writers replace
+    as a whole and readers on any thread, the audio thread included, take a
+    reference to without ever waiting for a lock.
+
+    There are two slots. A writer fills the one readers aren't using and then
+    publishes it; a reader announces itself on the published slot and checks it
+    is still the published one before copying the pointer, so copying never
+    races with a writer replacing the same slot. get() only performs atomic
+    operations and a reference count increment.
+
+    Writers are serialised by a lock and may spin briefly while a reader copies
+    out of the slot they want to fill. The previous snapshot stays alive until
+    the next set(); whichever thread lets go of a snapshot last destroys it.
+*/
+template <typename ObjectType>
+class AtomicSnapshot
+{
+public:
+    //==============================================================================
+    explicit AtomicSnapshot (std::shared_ptr<const ObjectType> initial = {})
+    {
+        slots[0] = std::move (initial);
+    }
+
+    /** Returns the current snapshot. Lock-free and realtime-safe. */
+    std::shared_ptr<const ObjectType> get() const noexcept
+    {
+        for (;;)
+        {
+            const auto index = published.load();
+            readers[index].fetch_add (1);
+
+            if (published.load() == index)
+            {
+                auto snapshot = slots[index];
+                readers[index].fetch_sub (1);
+                return snapshot;
+            }
+
+            // A writer published the other slot in the meantime
+            readers[index].fetch_sub (1);
+        }
+    }
+
+    /** Publishes a new snapshot. Not realtime-safe. */
+    void set (std::shared_ptr<const ObjectType> newSnapshot)
+    {
+        const juce::ScopedLock sl (writeLock);
+        const auto index = 1 - published.load();
+
+        while (readers[index].load() != 0)
+            juce::Thread::yield();
+
+        slots[index] = std::move (newSnapshot);
+        published.store (index);
+    }
+
+private:
+    //==============================================================================
+    std::shared_ptr<const ObjectType> slots[2];
+    std::atomic<int> published { 0 };
+    mutable std::atomic<int> readers[2] { { 0 }, { 0 } };
+    juce::CriticalSection writeLock;
+
+    JUCE_DECLARE_NON_COPYABLE (AtomicSnapshot)
+};
+
+} // namespace hifitune
@@ -0,0 +1,187 @@
+/*
+  ==============================================================================
+
+    This file contains the byte-level helpers used by the archive format.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <bit>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Appends little-endian values and LEB128 varints to a growing byte buffer.
+
+    Signed varints are zigzag-encoded, so small negative deltas stay small.
+*/
+class ByteWriter
+{
+public:
+    //==============================================================================
+    ByteWriter() = default;
+
+    void writeByte (juce::uint8 value)              { bytes.push_back (value); }
+
+    void writeVarint (juce::uint64 value)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back ((juce::uint8) (value | 0x80));
+            value >>= 7;
+        }
+
+        bytes.push_back ((juce::uint8) value);
+    }
+
+    void writeSignedVarint (juce::int64 value)
+    {
+        writeVarint (((juce::uint64) value << 1) ^ (juce::uint64) (value >> 63));
+    }
+
+    void writeUint64 (juce::uint64 value)
+    {
+        for (int i = 0; i < 8; ++i)
+            bytes.push_back ((juce::uint8) (value >> (8 * i)));
+    }
+
+    void writeDouble (double value)                 { writeUint64 (std::bit_cast<juce::uint64> (value)); }
+
+    void writeBytes (const void* data, size_t numBytes)
+    {
+        const auto* source = static_cast<const juce::uint8*> (data);
+        bytes.insert (bytes.end(), source, source + numBytes);
+    }
+
+    void writeString (const juce::String& text)
+    {
+        const auto numBytes = text.getNumBytesAsUTF8();
+        writeVarint (numBytes);
+        writeBytes (text.toRawUTF8(), numBytes);
+    }
+
+    //==============================================================================
+    const juce::uint8* getData() const noexcept     { return bytes.data(); }
+    size_t getSize() const noexcept                 { return bytes.size(); }
+    void reserve (size_t numBytes)                  { bytes.reserve (numBytes); }
+
+    juce::MemoryBlock toMemoryBlock() const         { return { bytes.data(), bytes.size() }; }
+
+private:
+    //==============================================================================
+    std::vector<juce::uint8> bytes;
+};
+
+//==============================================================================
+/**
+    Reads what a ByteWriter wrote. Reading past the end or a malformed varint
+    sets a sticky failure flag and returns zeros, so callers can decode a
+    whole record and check hasFailed() once.
+*/
+class ByteReader
+{
+public:
+    //==============================================================================
+    ByteReader (const void* data, size_t numBytes) noexcept
+        : position (static_cast<const juce::uint8*> (data)), end (position + numBytes)
+    {
+    }
+
+    explicit ByteReader (const juce::MemoryBlock& block) noexcept
+        : ByteReader (block.getData(), block.getSize())
+    {
+    }
+
+    bool hasFailed() const noexcept                 { return failed; }
+    bool isExhausted() const noexcept               { return position >= end; }
+    size_t getNumBytesRemaining() const noexcept    { return (size_t) (end - position); }
+
+    //==============================================================================
+    juce::uint8 readByte() noexcept
+    {
+        if (position >= end)
+        {
+            failed = true;
+            return 0;
+        }
+
+        return *position++;
+    }
+
+    juce::uint64 readVarint() noexcept
+    {
+        juce::uint64 value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            const auto byte = readByte();
+            value |= (juce::uint64) (byte & 0x7f) << shift;
+
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+
+        failed = true;
+        return 0;
+    }
+
+    juce::int64 readSignedVarint() noexcept
+    {
+        const auto value = readVarint();
+        return (juce::int64) (value >> 1) ^ -(juce::int64) (value & 1);
+    }
+
+    juce::uint64 readUint64() noexcept
+    {
+        juce::uint64 value = 0;
+
+        for (int i = 0; i < 8; ++i)
+            value |= (juce::uint64) readByte() << (8 * i);
+
+        return value;
+    }
+
+    double readDouble() noexcept                    { return std::bit_cast<double> (readUint64()); }
+
+    bool readBytes (void* dest, size_t numBytes) noexcept
+    {
+        if (getNumBytesRemaining() < numBytes)
+        {
+            failed = true;
+            return false;
+        }
+
+        std::memcpy (dest, position, numBytes);
+        position += numBytes;
+        return true;
+    }
+
+    juce::String readString()
+    {
+        const auto numBytes = readVarint();
+
+        if (failed || getNumBytesRemaining() < numBytes)
+        {
+            failed = true;
+            return {};
+        }
+
+        const auto* start = reinterpret_cast<const char*> (position);
+        position += numBytes;
+        return juce::String::fromUTF8 (start, (int) numBytes);
+    }
+
+private:
+    //==============================================================================
+    const juce::uint8* position;
+    const juce::uint8* end;
+    bool failed = false;
+};
+
+} // namespace hifitune
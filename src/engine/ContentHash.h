@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    This file contains a small non-cryptographic hash for cache keys.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Builds a 64-bit hash from a sequence of values and memory blocks.
+
+    The hash is only meant to identify identical inputs (rendered segments,
+    analysis results), not to resist deliberate collisions.
+*/
+class ContentHash
+{
+public:
+    //==============================================================================
+    ContentHash() = default;
+
+    ContentHash& add (const void* data, size_t numBytes) noexcept
+    {
+        const auto* bytes = static_cast<const juce::uint8*> (data);
+
+        for (; numBytes >= 8; numBytes -= 8, bytes += 8)
+        {
+            juce::uint64 word;
+            std::memcpy (&word, bytes, 8);
+            mix (word);
+        }
+
+        if (numBytes > 0)
+        {
+            juce::uint64 word = 0;
+            std::memcpy (&word, bytes, numBytes);
+            mix (word ^ ((juce::uint64) numBytes << 56));
+        }
+
+        return *this;
+    }
+
+    template <typename Value, std::enable_if_t<std::is_arithmetic_v<Value>, int> = 0>
+    ContentHash& add (Value value) noexcept
+    {
+        return add (&value, sizeof (value));
+    }
+
+    ContentHash& add (const juce::String& text) noexcept
+    {
+        return add (text.toRawUTF8(), text.getNumBytesAsUTF8());
+    }
+
+    juce::uint64 get() const noexcept
+    {
+        return finalise (state ^ length);
+    }
+
+private:
+    //==============================================================================
+    void mix (juce::uint64 word) noexcept
+    {
+        state = finalise (state ^ (word * 0x9e3779b97f4a7c15ull)) + 0x632be59bd9b4e019ull;
+        length += 8;
+    }
+
+    static juce::uint64 finalise (juce::uint64 x) noexcept
+    {
+        // splitmix64 finaliser
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    juce::uint64 state = 0x84222325cbf29ce4ull, length = 0;
+};
+
+} // namespace hifitune
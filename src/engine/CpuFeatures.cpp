@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    This file contains the detection of CPU features used to pick kernels.
+
+  ==============================================================================
+*/
+
+#include "CpuFeatures.h"
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <cpuid.h>
+ #endif
+#endif
+
+#if JUCE_LINUX && JUCE_ARM && JUCE_64BIT
+ #include <sys/auxv.h>
+ #include <asm/hwcap.h>
+#endif
+
+namespace hifitune
+{
+
+namespace
+{
+   #if JUCE_INTEL
+    // Registers of CPUID leaf 7 for the given sub-leaf, all zero if unsupported
+    std::array<unsigned int, 4> getExtendedFeatures (unsigned int subLeaf)
+    {
+        std::array<unsigned int, 4> registers {};
+
+       #if JUCE_MSVC
+        int info[4] {};
+        __cpuid (info, 0);
+
+        if (info[0] >= 7)
+        {
+            __cpuidex (info, 7, (int) subLeaf);
+
+            for (size_t i = 0; i < 4; ++i)
+                registers[i] = (unsigned int) info[i];
+        }
+       #else
+        if (__get_cpuid_max (0, nullptr) >= 7)
+            __cpuid_count (7, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+       #endif
+
+        return registers;
+    }
+   #endif
+
+    CpuFeatures detect()
+    {
+        CpuFeatures features;
+
+       #if JUCE_INTEL
+        features.avx2 = juce::SystemStats::hasAVX2();
+        features.avx512 = juce::SystemStats::hasAVX512F();
+
+        // AVX512_VNNI is ECX bit 11 of sub-leaf 0, AVX_VNNI EAX bit 4 of sub-leaf 1
+        const auto leaf0 = getExtendedFeatures (0);
+        const auto leaf1 = getExtendedFeatures (1);
+        features.vnni = (features.avx512 && (leaf0[2] & (1u << 11)) != 0)
+                     || (features.avx2 && (leaf1[0] & (1u << 4)) != 0);
+       #elif JUCE_ARM && JUCE_64BIT
+        #if JUCE_MAC || JUCE_IOS
+         // Every Apple Silicon core has it
+         features.fp16Arithmetic = true;
+        #elif JUCE_LINUX
+         features.fp16Arithmetic = (getauxval (AT_HWCAP) & HWCAP_ASIMDHP) != 0;
+        #endif
+       #endif
+
+        return features;
+    }
+}
+
+//==============================================================================
+const CpuFeatures& CpuFeatures::get()
+{
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+juce::String CpuFeatures::getDescription() const
+{
+    juce::StringArray names;
+
+    if (avx2)               names.add ("avx2");
+    if (avx512)             names.add ("avx512");
+    if (vnni)               names.add ("vnni");
+    if (fp16Arithmetic)     names.add ("fp16");
+
+    return names.isEmpty() ? juce::String ("baseline") : names.joinIntoString ("+");
+}
+
+} // namespace hifitune
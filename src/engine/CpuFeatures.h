@@ -0,0 +1,36 @@
+/*
+  ==============================================================================
+
+    This file contains the detection of CPU features used to pick kernels.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    The instruction set extensions that decide which implementation of a hot
+    path, or which precision of a model, runs fastest on this machine.
+
+    Detected once per process; get() is cheap and thread-safe.
+*/
+struct CpuFeatures
+{
+    bool avx2 = false;
+    bool avx512 = false;            // AVX-512 F
+    bool vnni = false;              // AVX-512 VNNI or AVX-VNNI: fast int8 dot products
+    bool fp16Arithmetic = false;    // native half-precision vector arithmetic (ARMv8.2 FP16)
+
+    static const CpuFeatures& get();
+
+    /** A short text naming the features present, e.g. for logs and cache keys. */
+    juce::String getDescription() const;
+};
+
+} // namespace hifitune
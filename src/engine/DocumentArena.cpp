@@ -0,0 +1,159 @@
+/*
+  ==============================================================================
+
+    This file contains the per-document memory arena.
+
+  ==============================================================================
+*/
+
+#include "DocumentArena.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Slabs are aligned to the largest block size, so every block is aligned
+    // to its own size
+    constexpr std::align_val_t slabAlignment { DocumentArena::maxBlockSize };
+
+    // Idle scratch buffers kept for reuse, about one per render thread
+    constexpr size_t maxScratchBuffers = 64;
+}
+
+//==============================================================================
+DocumentArena::DocumentArena() = default;
+
+DocumentArena::~DocumentArena()
+{
+    for (auto& sizeClass : sizeClasses)
+    {
+        // Anything still in use would now be dangling
+        jassert (sizeClass.numInUse == 0);
+
+        for (auto* slab : sizeClass.slabs)
+            ::operator delete (slab, slabAlignment);
+    }
+}
+
+int DocumentArena::getSizeClassIndex (size_t numBytes) noexcept
+{
+    int index = 0;
+
+    for (auto size = minBlockSize; size < numBytes; size <<= 1)
+        ++index;
+
+    return index;
+}
+
+//==============================================================================
+void* DocumentArena::allocate (size_t numBytes, size_t alignment)
+{
+    const auto size = juce::jmax (numBytes, alignment);
+
+    if (size > maxBlockSize)
+    {
+        largeBytesInUse += numBytes;
+        return ::operator new (numBytes, std::align_val_t { juce::jmax (alignment, alignof (std::max_align_t)) });
+    }
+
+    const auto index = getSizeClassIndex (size);
+    const auto blockSize = minBlockSize << index;
+    auto& sizeClass = sizeClasses[(size_t) index];
+
+    const juce::SpinLock::ScopedLockType sl (sizeClass.lock);
+    ++sizeClass.numInUse;
+
+    if (auto* block = sizeClass.freeList)
+    {
+        sizeClass.freeList = block->next;
+        return block;
+    }
+
+    if (sizeClass.unused == sizeClass.unusedEnd)
+    {
+        auto* slab = static_cast<std::byte*> (::operator new (slabSize, slabAlignment));
+        sizeClass.slabs.push_back (slab);
+        sizeClass.unused = slab;
+        sizeClass.unusedEnd = slab + slabSize;
+    }
+
+    auto* block = sizeClass.unused;
+    sizeClass.unused += blockSize;
+    return block;
+}
+
+void DocumentArena::deallocate (void* pointer, size_t numBytes, size_t alignment) noexcept
+{
+    if (pointer == nullptr)
+        return;
+
+    const auto size = juce::jmax (numBytes, alignment);
+
+    if (size > maxBlockSize)
+    {
+        largeBytesInUse -= numBytes;
+        ::operator delete (pointer, std::align_val_t { juce::jmax (alignment, alignof (std::max_align_t)) });
+        return;
+    }
+
+    auto& sizeClass = sizeClasses[(size_t) getSizeClassIndex (size)];
+
+    const juce::SpinLock::ScopedLockType sl (sizeClass.lock);
+    --sizeClass.numInUse;
+
+    auto* block = static_cast<FreeBlock*> (pointer);
+    block->next = sizeClass.freeList;
+    sizeClass.freeList = block;
+}
+
+//==============================================================================
+std::vector<float> DocumentArena::takeScratch()
+{
+    const juce::SpinLock::ScopedLockType sl (scratchLock);
+
+    if (scratchBuffers.empty())
+        return {};
+
+    auto buffer = std::move (scratchBuffers.back());
+    scratchBuffers.pop_back();
+    return buffer;
+}
+
+void DocumentArena::returnScratch (std::vector<float> buffer)
+{
+    if (buffer.capacity() == 0)
+        return;
+
+    buffer.clear();
+
+    const juce::SpinLock::ScopedLockType sl (scratchLock);
+
+    if (scratchBuffers.size() < maxScratchBuffers)
+        scratchBuffers.push_back (std::move (buffer));
+}
+
+DocumentArena::Statistics DocumentArena::getStatistics() const
+{
+    Statistics stats;
+
+    for (size_t i = 0; i < sizeClasses.size(); ++i)
+    {
+        const auto& sizeClass = sizeClasses[i];
+        const juce::SpinLock::ScopedLockType sl (sizeClass.lock);
+
+        stats.slabBytes += sizeClass.slabs.size() * slabSize;
+        stats.blockBytesInUse += sizeClass.numInUse * (minBlockSize << i);
+    }
+
+    stats.largeBytesInUse = largeBytesInUse.load();
+
+    const juce::SpinLock::ScopedLockType sl (scratchLock);
+
+    for (const auto& buffer : scratchBuffers)
+        stats.scratchBytes += buffer.capacity() * sizeof (float);
+
+    return stats;
+}
+
+} // namespace hifitune
@@ -0,0 +1,141 @@
+/*
+  ==============================================================================
+
+    This file contains the per-document memory arena.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Memory for the many small objects a document creates and drops while it is
+    being edited, such as pitch curves and their points, and a pool of scratch
+    buffers for rendering.
+
+    Small blocks are carved from large slabs, one set of slabs per power-of-two
+    size class, and freed blocks are kept on a free list for the next object of
+    that size. Objects of one kind therefore end up next to each other, and a
+    document's editing neither competes for the global heap with the host and
+    other plug-ins nor fragments it. Slabs are only released with the arena,
+    which lives until the last block allocated from it has been freed (see
+    ArenaAllocator).
+
+    All methods are thread-safe. Each size class has its own lock, held for a
+    few instructions, so render workers dropping old curves hardly ever wait for
+    the message thread creating new ones. Not realtime-safe.
+*/
+class DocumentArena
+{
+public:
+    //==============================================================================
+    static constexpr size_t minBlockSize = 16;
+    static constexpr size_t maxBlockSize = 4096;    // larger blocks come from the heap
+    static constexpr size_t slabSize = (size_t) 64 << 10;
+
+    DocumentArena();
+    ~DocumentArena();
+
+    void* allocate (size_t numBytes, size_t alignment);
+    void deallocate (void*, size_t numBytes, size_t alignment) noexcept;
+
+    //==============================================================================
+    /** Returns an empty buffer for temporary data, which keeps the capacity it had
+        when it was last returned, so that repeated renders don't reallocate.
+    */
+    std::vector<float> takeScratch();
+
+    /** Gives a buffer back for reuse. */
+    void returnScratch (std::vector<float>);
+
+    //==============================================================================
+    struct Statistics
+    {
+        size_t slabBytes = 0;           // memory held in slabs
+        size_t blockBytesInUse = 0;     // ...of which handed out
+        size_t largeBytesInUse = 0;     // allocated from the heap for large blocks
+        size_t scratchBytes = 0;        // capacity of the idle scratch buffers
+    };
+
+    Statistics getStatistics() const;
+
+private:
+    //==============================================================================
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    struct SizeClass
+    {
+        FreeBlock* freeList = nullptr;
+        std::byte* unused = nullptr;        // start of the uncarved part of the newest slab
+        std::byte* unusedEnd = nullptr;
+        std::vector<std::byte*> slabs;
+        size_t numInUse = 0;
+        mutable juce::SpinLock lock;
+    };
+
+    static int getSizeClassIndex (size_t numBytes) noexcept;
+
+    static constexpr int numSizeClasses = 9;    // 16 to 4096 bytes
+    std::array<SizeClass, numSizeClasses> sizeClasses;
+    std::atomic<size_t> largeBytesInUse { 0 };
+
+    std::vector<std::vector<float>> scratchBuffers;
+    mutable juce::SpinLock scratchLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DocumentArena)
+};
+
+//==============================================================================
+/**
+    A standard allocator drawing from a DocumentArena, which it keeps alive.
+    Default-constructed, it uses the global heap.
+*/
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    ArenaAllocator() noexcept = default;
+    explicit ArenaAllocator (std::shared_ptr<DocumentArena> arenaIn) noexcept : arena (std::move (arenaIn)) {}
+
+    template <typename Other>
+    ArenaAllocator (const ArenaAllocator<Other>& other) noexcept : arena (other.getArena()) {}
+
+    T* allocate (size_t n)
+    {
+        const auto numBytes = n * sizeof (T);
+
+        if (arena != nullptr)
+            return static_cast<T*> (arena->allocate (numBytes, alignof (T)));
+
+        return static_cast<T*> (::operator new (numBytes));
+    }
+
+    void deallocate (T* p, size_t n) noexcept
+    {
+        if (arena != nullptr)
+            arena->deallocate (p, n * sizeof (T), alignof (T));
+        else
+            ::operator delete (p);
+    }
+
+    const std::shared_ptr<DocumentArena>& getArena() const noexcept     { return arena; }
+
+    template <typename Other>
+    bool operator== (const ArenaAllocator<Other>& other) const noexcept  { return arena == other.getArena(); }
+
+private:
+    std::shared_ptr<DocumentArena> arena;
+};
+
+} // namespace hifitune
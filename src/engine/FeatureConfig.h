@@ -0,0 +1,56 @@
+/*
+  ==============================================================================
+
+    This file contains the frame layout shared by the analysis and the vocoder.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Describes how audio is cut into feature frames.
+
+    The defaults follow the 44.1 kHz NSF-HiFiGAN configuration used by the
+    OpenVPI vocoders: frame k is centred on model sample k * hopSize, and the
+    vocoder turns frame k into the hopSize output samples starting there.
+*/
+struct FeatureConfig
+{
+    double sampleRate = 44100.0;
+    int hopSize = 512;
+    int fftSize = 2048;
+    int numMelBins = 128;
+    float melMinHz = 40.0f;
+    float melMaxHz = 16000.0f;
+    float f0MinHz = 65.0f;
+    float f0MaxHz = 1100.0f;
+
+    /** Mel energies are clamped to this before taking the log. */
+    static constexpr float melFloor = 1.0e-5f;
+
+    /** Returns the log-mel value the analysis produces for digital silence. */
+    static float getSilentMelValue() noexcept       { return std::log (melFloor); }
+
+    bool operator== (const FeatureConfig&) const = default;
+
+    /** Returns the number of frames needed to cover the given number of model-rate samples. */
+    int getNumFramesForSamples (juce::int64 numModelSamples) const noexcept
+    {
+        return (int) juce::jmax ((juce::int64) 1, (numModelSamples + hopSize - 1) / hopSize);
+    }
+
+    /** Converts a length at the given source sample rate to model-rate samples. */
+    juce::int64 toModelSamples (juce::int64 numSourceSamples, double sourceSampleRate) const noexcept
+    {
+        return (juce::int64) std::ceil ((double) numSourceSamples * sampleRate / sourceSampleRate);
+    }
+};
+
+} // namespace hifitune
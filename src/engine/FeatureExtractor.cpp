@@ -0,0 +1,192 @@
+/*
+  ==============================================================================
+
+    This file contains the per-frame pitch and mel feature extractor.
+
+  ==============================================================================
+*/
+
+#include "FeatureExtractor.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    constexpr float yinThreshold = 0.15f;
+    constexpr float silenceThreshold = 1.0e-8f;
+}
+
+//==============================================================================
+FeatureExtractor::FeatureExtractor (const FeatureConfig& configIn)
+    : config (configIn),
+      fft (juce::roundToInt (std::log2 ((double) configIn.fftSize))),
+      melSpectrogram (configIn)
+{
+    jassert (juce::isPowerOfTwo (config.fftSize));
+
+    minLag = juce::jmax (2, (int) std::floor (config.sampleRate / config.f0MaxHz));
+    maxLag = juce::jmin (config.fftSize / 2, (int) std::ceil (config.sampleRate / config.f0MinHz));
+
+    yinBuffer.resize ((size_t) maxLag + 1);
+    correlationBuffer.resize ((size_t) config.fftSize);
+    correlationSpectrum.resize ((size_t) config.fftSize);
+}
+
+//==============================================================================
+void FeatureExtractor::processFrame (const float* frame, float& f0, float& voicing, float* melOut)
+{
+    estimatePitch (frame, f0, voicing);
+    melSpectrogram.process (frame, 1, melOut);
+}
+
+void FeatureExtractor::processFrames (const float* samples, int numFrames, float* f0, float* voicing, float* melOut)
+{
+    for (int i = 0; i < numFrames; ++i)
+        estimatePitch (samples + (size_t) i * (size_t) config.hopSize, f0[i], voicing[i]);
+
+    melSpectrogram.process (samples, numFrames, melOut);
+}
+
+void FeatureExtractor::estimatePitch (const float* frame, float& f0, float& voicing) noexcept
+{
+    const int windowLength = config.fftSize - maxLag;
+
+    float energy = 0.0f;
+
+    for (int j = 0; j < windowLength; ++j)
+        energy += frame[j] * frame[j];
+
+    f0 = 0.0f;
+    voicing = 0.0f;
+
+    if (energy < silenceThreshold * (float) windowLength)
+        return;
+
+    // The difference function d(lag) expands to the window's energy, plus the
+    // energy of the window shifted by lag, minus twice their cross-correlation.
+    // The correlation for all lags comes from one FFT of the window and the
+    // whole frame packed into a complex signal, and one inverse FFT. The frame
+    // is exactly windowLength + maxLag long, so nothing wraps around.
+    const auto size = config.fftSize;
+
+    for (int j = 0; j < size; ++j)
+        correlationBuffer[(size_t) j] = { j < windowLength ? frame[j] : 0.0f, frame[j] };
+
+    fft.perform (correlationBuffer.data(), correlationSpectrum.data(), false);
+
+    for (int k = 0; k < size; ++k)
+    {
+        const auto z = correlationSpectrum[(size_t) k];
+        const auto zMirror = std::conj (correlationSpectrum[(size_t) ((size - k) & (size - 1))]);
+        const auto windowSpectrum = (z + zMirror) * 0.5f;
+        const auto frameSpectrum = (z - zMirror) * std::complex<float> (0.0f, -0.5f);
+
+        correlationBuffer[(size_t) k] = std::conj (windowSpectrum) * frameSpectrum;
+    }
+
+    fft.perform (correlationBuffer.data(), correlationSpectrum.data(), true);
+
+    // Cumulative mean normalisation
+    yinBuffer[0] = 1.0f;
+    float runningSum = 0.0f;
+    auto shiftedEnergy = (double) energy;
+
+    for (int lag = 1; lag <= maxLag; ++lag)
+    {
+        const auto leaving = frame[lag - 1];
+        const auto entering = frame[lag + windowLength - 1];
+        shiftedEnergy += (double) (entering * entering) - (double) (leaving * leaving);
+
+        const auto sum = juce::jmax (0.0f, (float) ((double) energy + shiftedEnergy)
+                                               - 2.0f * correlationSpectrum[(size_t) lag].real());
+
+        runningSum += sum;
+        yinBuffer[(size_t) lag] = runningSum > 0.0f ? sum * (float) lag / runningSum : 1.0f;
+    }
+
+    int bestLag = -1;
+
+    for (int lag = minLag; lag < maxLag; ++lag)
+    {
+        if (yinBuffer[(size_t) lag] < yinThreshold)
+        {
+            while (lag + 1 < maxLag && yinBuffer[(size_t) lag + 1] < yinBuffer[(size_t) lag])
+                ++lag;
+
+            bestLag = lag;
+            break;
+        }
+    }
+
+    if (bestLag < 0)
+    {
+        const auto lowest = std::min_element (yinBuffer.begin() + minLag, yinBuffer.begin() + maxLag);
+        voicing = juce::jlimit (0.0f, 1.0f, 1.0f - *lowest);
+        return;
+    }
+
+    // Parabolic interpolation around the chosen dip
+    const auto a = yinBuffer[(size_t) bestLag - 1];
+    const auto b = yinBuffer[(size_t) bestLag];
+    const auto c = yinBuffer[(size_t) bestLag + 1];
+    const auto denominator = a - 2.0f * b + c;
+    const auto shift = std::abs (denominator) > 1.0e-9f ? 0.5f * (a - c) / denominator : 0.0f;
+
+    f0 = (float) config.sampleRate / ((float) bestLag + juce::jlimit (-1.0f, 1.0f, shift));
+    voicing = juce::jlimit (0.0f, 1.0f, 1.0f - b);
+}
+
+//==============================================================================
+void FeatureExtractor::resample (const float* input, juce::int64 inputStart, int numInput,
+                                 float* output, juce::int64 outputStart, int numOutput,
+                                 double inputSampleRate, double outputSampleRate) noexcept
+{
+    const auto sampleAt = [&] (juce::int64 index) noexcept
+    {
+        const auto offset = index - inputStart;
+        return juce::isPositiveAndBelow (offset, (juce::int64) numInput) ? input[offset] : 0.0f;
+    };
+
+    if (juce::approximatelyEqual (inputSampleRate, outputSampleRate))
+    {
+        for (int i = 0; i < numOutput; ++i)
+            output[i] = sampleAt (outputStart + i);
+
+        return;
+    }
+
+    const auto ratio = inputSampleRate / outputSampleRate;
+
+    for (int i = 0; i < numOutput; ++i)
+    {
+        const auto position = (double) (outputStart + i) * ratio;
+        const auto index = (juce::int64) std::floor (position);
+        const auto t = (float) (position - (double) index);
+
+        const auto xm1 = sampleAt (index - 1);
+        const auto x0  = sampleAt (index);
+        const auto x1  = sampleAt (index + 1);
+        const auto x2  = sampleAt (index + 2);
+
+        // Catmull-Rom
+        output[i] = x0 + 0.5f * t * (x1 - xm1 + t * (2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2
+                                                     + t * (3.0f * (x0 - x1) + x2 - xm1)));
+    }
+}
+
+juce::Range<juce::int64> FeatureExtractor::getFramesReading (const FeatureConfig& config, double sourceSampleRate,
+                                                             juce::Range<juce::int64> sourceSamples) noexcept
+{
+    if (sourceSamples.isEmpty())
+        return {};
+
+    // The cubic interpolator reads two source samples either side
+    const auto ratio = sourceSampleRate / config.sampleRate;
+    const auto modelStart = (juce::int64) std::floor ((double) (sourceSamples.getStart() - 2) / ratio) - 1;
+    const auto modelEnd = (juce::int64) std::ceil ((double) (sourceSamples.getEnd() + 2) / ratio) + 1;
+
+    return MelSpectrogram::getFramesOverlapping (config, { modelStart, modelEnd });
+}
+
+} // namespace hifitune
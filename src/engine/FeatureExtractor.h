@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    This file contains the per-frame pitch and mel feature extractor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+#include "MelSpectrogram.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Computes F0, voicing and a log-mel spectrum for frames.
+
+    Each frame looks at fftSize model-rate samples centred on it. The pitch
+    estimate is YIN over the same window, with the difference function computed
+    from an FFT cross-correlation rather than lag by lag, and the mel spectra
+    come from a MelSpectrogram, which is fastest given runs of frames at once.
+    Instances hold scratch buffers and so must not be shared between threads.
+*/
+class FeatureExtractor
+{
+public:
+    //==============================================================================
+    explicit FeatureExtractor (const FeatureConfig& config);
+
+    const FeatureConfig& getConfig() const noexcept     { return config; }
+
+    /** Analyses one frame of getConfig().fftSize samples. */
+    void processFrame (const float* frame, float& f0, float& voicing, float* melOut);
+
+    /** Analyses numFrames consecutive frames, frame i starting at samples + i * hopSize,
+        writing one F0 and voicing value and numMelBins mel values per frame.
+    */
+    void processFrames (const float* samples, int numFrames, float* f0, float* voicing, float* melOut);
+
+    /** Estimates only the pitch of a frame of getConfig().fftSize samples, e.g.
+        for streaming use where the mel spectrum isn't needed. f0 is 0 for
+        unvoiced frames. Doesn't allocate.
+    */
+    void estimatePitch (const float* frame, float& f0, float& voicing) noexcept;
+
+    //==============================================================================
+    /** Resamples a mono block using cubic interpolation.
+
+        'input' holds samples starting at index inputStart at the input rate, and
+        'output' receives the samples starting at index outputStart at the output
+        rate. Samples outside the supplied input are treated as silence, so
+        neighbouring blocks resampled independently join up exactly.
+    */
+    static void resample (const float* input, juce::int64 inputStart, int numInput,
+                          float* output, juce::int64 outputStart, int numOutput,
+                          double inputSampleRate, double outputSampleRate) noexcept;
+
+    /** Returns the frames whose windows, after resampling the source with
+        resample(), read any of the given source samples. The range isn't
+        limited to the frames a source actually has.
+    */
+    static juce::Range<juce::int64> getFramesReading (const FeatureConfig&, double sourceSampleRate,
+                                                      juce::Range<juce::int64> sourceSamples) noexcept;
+
+private:
+    //==============================================================================
+    FeatureConfig config;
+    juce::dsp::FFT fft;
+    MelSpectrogram melSpectrogram;
+    std::vector<float> yinBuffer;
+    std::vector<std::complex<float>> correlationBuffer, correlationSpectrum;
+    int minLag = 2, maxLag = 2;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FeatureExtractor)
+};
+
+} // namespace hifitune
@@ -0,0 +1,522 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide scheduler for vocoder inference.
+
+  ==============================================================================
+*/
+
+#include "InferenceScheduler.h"
+#include "Instrumentation.h"
+
+#include <deque>
+
+namespace hifitune
+{
+
+namespace
+{
+    int getIntFromEnvironment (const char* name, int defaultValue)
+    {
+        const auto value = juce::SystemStats::getEnvironmentVariable (name, {});
+        return value.isNotEmpty() ? juce::jmax (1, value.getIntValue()) : defaultValue;
+    }
+
+    ModelQuality getQualityFromEnvironment (ModelQuality defaultValue)
+    {
+        const auto value = juce::SystemStats::getEnvironmentVariable ("HIFITUNE_MODEL_QUALITY", {}).trim().toLowerCase();
+
+        if (value == "best")        return ModelQuality::best;
+        if (value == "balanced")    return ModelQuality::balanced;
+        if (value == "fastest")     return ModelQuality::fastest;
+
+        return defaultValue;
+    }
+
+    // Frames in the silent request that warms a freshly loaded model up, enough
+    // for the runtime to allocate and plan for a typical segment
+    constexpr int warmUpFrames = 128;
+
+    // How often the loader thread looks for replaced vocoders nobody uses any more
+    constexpr int retiredCheckIntervalMs = 1000;
+}
+
+//==============================================================================
+class InferenceScheduler::InferenceThread  : public juce::Thread
+{
+public:
+    InferenceThread (InferenceScheduler& ownerIn, bool isOfflineIn)
+        : juce::Thread ("HiFiTune Inference"), owner (ownerIn), isOffline (isOfflineIn)
+    {
+    }
+
+    void run() override
+    {
+        std::vector<Task*> batch;
+        std::vector<Vocoder::Request> requests;
+
+        while (! threadShouldExit())
+        {
+            if (isOffline && owner.numOfflineRenders.load() == 0)
+            {
+                wait (-1);
+                continue;
+            }
+
+            if (! owner.takeNextBatch (batch, isOffline))
+                continue;
+
+            requests.clear();
+
+            for (auto* task : batch)
+                requests.push_back (task->request);
+
+            {
+                const Instrumentation::ScopedTimer timer (Instrumentation::EventType::inferenceBatch, (juce::int64) requests.size());
+                batch.front()->vocoder->renderBatch (requests.data(), (int) requests.size());
+            }
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                batch[i]->request.succeeded = requests[i].succeeded;
+                batch[i]->finished.signal();
+            }
+        }
+
+        if (isOffline)
+            return;
+
+        // Don't leave anyone waiting for a batch that will never run
+        const juce::ScopedLock sl (owner.tasksLock);
+
+        for (auto* task : owner.pendingTasks)
+        {
+            task->request.succeeded = false;
+            task->finished.signal();
+        }
+
+        owner.pendingTasks.clear();
+    }
+
+private:
+    InferenceScheduler& owner;
+    const bool isOffline;
+};
+
+//==============================================================================
+/** Loads models one after the other, in the order they were first asked for. */
+class InferenceScheduler::LoaderThread  : public juce::Thread
+{
+public:
+    explicit LoaderThread (InferenceScheduler& ownerIn)
+        : juce::Thread ("HiFiTune Model Loader"), owner (ownerIn)
+    {
+    }
+
+    void add (Model& model)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+            queue.push_back (&model);
+        }
+
+        notify();
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            Model* next = nullptr;
+
+            {
+                const juce::ScopedLock sl (lock);
+
+                if (! queue.empty())
+                {
+                    next = queue.front();
+                    queue.pop_front();
+                }
+            }
+
+            if (next == nullptr)
+            {
+                owner.releaseRetiredVocoders();
+                wait (retiredCheckIntervalMs);
+            }
+            else
+            {
+                owner.load (*next);
+            }
+        }
+
+        // Don't leave anyone waiting for a model that will never load
+        const juce::ScopedLock sl (lock);
+
+        for (auto* model : queue)
+        {
+            model->isLoaded = true;
+            model->loaded.signal();
+        }
+
+        queue.clear();
+    }
+
+private:
+    InferenceScheduler& owner;
+    std::deque<Model*> queue;
+    juce::CriticalSection lock;
+};
+
+//==============================================================================
+InferenceScheduler::Options InferenceScheduler::getDefaultOptions()
+{
+    // Render workers take half the physical cores (see RenderWorkerPool) and
+    // spend most of their time waiting for inference, so give it the other half
+    // minus one for the host's audio thread.
+    const auto numPhysicalCpus = juce::SystemStats::getNumPhysicalCpus();
+
+    Options options;
+    options.inference.intraOpThreads = getIntFromEnvironment ("HIFITUNE_INTRA_OP_THREADS", juce::jmax (1, numPhysicalCpus / 2 - 1));
+    options.inference.interOpThreads = getIntFromEnvironment ("HIFITUNE_INTER_OP_THREADS", 1);
+
+    // A batch runs on its calling thread plus the intra-op threads, which all
+    // batches share, so offline this many calling threads fill every core
+    options.numOfflineThreads = getIntFromEnvironment ("HIFITUNE_OFFLINE_THREADS",
+                                                       juce::jmax (1, numPhysicalCpus - (options.inference.intraOpThreads - 1)));
+    options.inference.maxBatchSize = getIntFromEnvironment ("HIFITUNE_MAX_BATCH_SIZE", options.inference.maxBatchSize);
+    options.inference.quality = getQualityFromEnvironment (options.inference.quality);
+    return options;
+}
+
+InferenceScheduler::InferenceScheduler (const FeatureConfig& configIn, const Options& optionsIn)
+    : config (configIn), options (optionsIn), quality (optionsIn.inference.quality)
+{
+    for (int i = 0; i < juce::jmax (1, options.numOfflineThreads); ++i)
+    {
+        threads.push_back (std::make_unique<InferenceThread> (*this, i > 0));
+        threads.back()->startThread();
+    }
+
+    loader = std::make_unique<LoaderThread> (*this);
+    loader->startThread (juce::Thread::Priority::low);
+}
+
+InferenceScheduler::~InferenceScheduler()
+{
+    loader->signalThreadShouldExit();
+    loader->notify();
+    loader->stopThread (-1);
+
+    // The first thread goes last, to fail whatever the others left behind
+    for (auto it = threads.rbegin(); it != threads.rend(); ++it)
+    {
+        (*it)->signalThreadShouldExit();
+        (*it)->notify();
+        taskAdded.signal();
+        (*it)->stopThread (-1);
+    }
+}
+
+//==============================================================================
+void InferenceScheduler::setModelQuality (ModelQuality newQuality) noexcept
+{
+    quality = newQuality;
+}
+
+std::shared_ptr<Vocoder> InferenceScheduler::getVocoder (const juce::String& modelName)
+{
+    const auto model = getModel (modelName);
+    return getServedVocoder (*model);
+}
+
+std::shared_ptr<Vocoder> InferenceScheduler::waitForVocoder (const juce::String& modelName)
+{
+    const auto model = getModel (modelName);
+    model->loaded.wait (-1);
+    return getServedVocoder (*model);
+}
+
+void InferenceScheduler::preloadVocoder (const juce::String& modelName)
+{
+    getModel (modelName);
+}
+
+std::shared_ptr<InferenceScheduler::Model> InferenceScheduler::getModel (const juce::String& modelName)
+{
+    const juce::ScopedLock sl (modelsLock);
+
+    // A failed load is remembered as a model without vocoder, so it isn't
+    // retried on every call
+    const auto modelQuality = quality.load();
+    auto& model = models[{ modelName, modelQuality }];
+
+    if (model == nullptr)
+    {
+        model = std::make_shared<Model>();
+        model->name = modelName;
+        model->quality = modelQuality;
+        loader->add (*model);
+    }
+
+    return model;
+}
+
+std::shared_ptr<Vocoder> InferenceScheduler::getServedVocoder (const Model& model)
+{
+    const juce::ScopedLock sl (modelsLock);
+    auto& served = servedVocoders[model.name];
+
+    // Keep handing out the vocoder in use until this one is ready, or if it
+    // can't be loaded
+    if (! model.isLoaded.load() || model.vocoder == nullptr || served == model.vocoder)
+        return served;
+
+    // A waiter may get here after the setting has changed again
+    const auto current = models.find ({ model.name, quality.load() });
+
+    if (current == models.end() || current->second.get() != &model)
+        return served != nullptr ? served : model.vocoder;
+
+    // Switch over, and let go of the models for the other settings, which are
+    // only kept until their last user is done with them. Those still loading
+    // stay, as the loader thread refers to them.
+    served = model.vocoder;
+
+    for (auto it = models.begin(); it != models.end();)
+    {
+        auto& other = *it->second;
+
+        if (other.name == model.name && &other != &model && other.isLoaded.load())
+        {
+            if (other.vocoder != nullptr)
+                retiredVocoders.push_back (std::move (other.vocoder));
+
+            it = models.erase (it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return served;
+}
+
+void InferenceScheduler::releaseRetiredVocoders()
+{
+    std::vector<std::shared_ptr<Vocoder>> unused;
+
+    {
+        const juce::ScopedLock sl (modelsLock);
+
+        // Nobody can get hold of a retired vocoder any more, so once the list
+        // holds the only reference, it stays that way
+        for (auto it = retiredVocoders.begin(); it != retiredVocoders.end();)
+        {
+            if (it->use_count() == 1)
+            {
+                unused.push_back (std::move (*it));
+                it = retiredVocoders.erase (it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    // Sessions are freed here, outside the lock and away from the render threads
+    unused.clear();
+}
+
+void InferenceScheduler::load (Model& model)
+{
+    auto inferenceOptions = options.inference;
+    inferenceOptions.quality = model.quality;
+
+    auto vocoder = Vocoder::create (model.name, config, inferenceOptions);
+
+    // The first inference is much slower than the rest while the runtime sets
+    // itself up; get that over with before anyone is waiting for audio
+    if (vocoder != nullptr)
+    {
+        const std::vector<float> mel ((size_t) warmUpFrames * (size_t) config.numMelBins, FeatureConfig::getSilentMelValue());
+        const std::vector<float> f0 ((size_t) warmUpFrames, 0.0f);
+        std::vector<float> output ((size_t) warmUpFrames * (size_t) config.hopSize);
+
+        if (! vocoder->render (mel.data(), f0.data(), warmUpFrames, output.data()))
+            vocoder.reset();
+    }
+
+    {
+        const juce::ScopedLock sl (modelsLock);
+        model.vocoder = std::move (vocoder);
+        model.isLoaded = true;
+    }
+
+    model.loaded.signal();
+}
+
+bool InferenceScheduler::render (Vocoder& vocoder, const float* mel, const float* f0, int numFrames, float* output, juce::int64 priority)
+{
+    Vocoder::Request request { mel, f0, numFrames, output };
+    render (vocoder, &request, 1, priority);
+    return request.succeeded;
+}
+
+void InferenceScheduler::render (Vocoder& vocoder, Vocoder::Request* requests, int numRequests, juce::int64 priority)
+{
+    if (numRequests <= 0)
+        return;
+
+    std::vector<Task> tasks ((size_t) numRequests);
+    int numFrames = 0;
+
+    for (int i = 0; i < numRequests; ++i)
+    {
+        auto& task = tasks[(size_t) i];
+        task.vocoder = &vocoder;
+        task.request = requests[i];
+        task.request.succeeded = false;
+        task.priority = priority;
+        numFrames += requests[i].numFrames;
+    }
+
+    const Instrumentation::ScopedTimer timer (Instrumentation::EventType::inferenceRequest, numFrames);
+
+    {
+        const juce::ScopedLock sl (tasksLock);
+
+        if (threads.front()->threadShouldExit())
+        {
+            for (int i = 0; i < numRequests; ++i)
+                requests[i].succeeded = false;
+
+            return;
+        }
+
+        for (auto& task : tasks)
+        {
+            task.sequence = nextSequence++;
+            pendingTasks.push_back (&task);
+        }
+
+        Instrumentation::count (Instrumentation::EventType::inferenceQueueDepth, (juce::int64) pendingTasks.size());
+    }
+
+    taskAdded.signal();
+
+    for (int i = 0; i < numRequests; ++i)
+    {
+        tasks[(size_t) i].finished.wait (-1);
+        requests[i].succeeded = tasks[(size_t) i].request.succeeded;
+    }
+}
+
+void InferenceScheduler::beginOfflineRendering() noexcept
+{
+    if (numOfflineRenders++ == 0)
+        for (size_t i = 1; i < threads.size(); ++i)
+            threads[i]->notify();
+}
+
+void InferenceScheduler::endOfflineRendering() noexcept
+{
+    jassert (numOfflineRenders.load() > 0);
+    --numOfflineRenders;
+}
+
+//==============================================================================
+bool InferenceScheduler::takeNextBatch (std::vector<Task*>& batch, bool isOfflineThread)
+{
+    batch.clear();
+
+    auto isMoreUrgent = [] (const Task* a, const Task* b)
+    {
+        return a->priority != b->priority ? a->priority < b->priority
+                                          : a->sequence < b->sequence;
+    };
+
+    auto getBatchLimit = [this, &isMoreUrgent]
+    {
+        const auto* mostUrgent = *std::min_element (pendingTasks.begin(), pendingTasks.end(), isMoreUrgent);
+        return (size_t) juce::jmax (1, mostUrgent->vocoder->getMaxBatchSize());
+    };
+
+    auto shouldStop = [this, isOfflineThread]
+    {
+        return juce::Thread::currentThreadShouldExit() || (isOfflineThread && numOfflineRenders.load() == 0);
+    };
+
+    bool hasPendingTasks;
+
+    {
+        const juce::ScopedLock sl (tasksLock);
+        hasPendingTasks = ! pendingTasks.empty();
+    }
+
+    if (! hasPendingTasks)
+    {
+        taskAdded.wait (100);
+        return false;
+    }
+
+    // Give other render threads a moment to add to a batch that isn't full yet
+    const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) options.gatherWindowMs;
+
+    for (;;)
+    {
+        {
+            const juce::ScopedLock sl (tasksLock);
+
+            // Another inference thread may have taken them meanwhile
+            if (pendingTasks.empty())
+                return false;
+
+            if (pendingTasks.size() >= getBatchLimit())
+                break;
+        }
+
+        const auto now = juce::Time::getMillisecondCounter();
+
+        if (now >= deadline || shouldStop())
+            break;
+
+        taskAdded.wait ((double) (deadline - now));
+    }
+
+    const juce::ScopedLock sl (tasksLock);
+
+    if (pendingTasks.empty())
+        return false;
+
+    std::sort (pendingTasks.begin(), pendingTasks.end(), isMoreUrgent);
+
+    // Only requests of the same length are combined: padding the shorter ones
+    // would change what the model produces towards their ends
+    auto* vocoder = pendingTasks.front()->vocoder;
+    const auto numFrames = pendingTasks.front()->request.numFrames;
+    const auto limit = getBatchLimit();
+
+    for (auto it = pendingTasks.begin(); it != pendingTasks.end() && batch.size() < limit;)
+    {
+        if ((*it)->vocoder == vocoder && (*it)->request.numFrames == numFrames)
+        {
+            batch.push_back (*it);
+            it = pendingTasks.erase (it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // Let another inference thread start on what's left
+    if (! pendingTasks.empty())
+        taskAdded.signal();
+
+    return true;
+}
+
+} // namespace hifitune
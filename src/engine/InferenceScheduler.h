@@ -0,0 +1,176 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide scheduler for vocoder inference.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Vocoder.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Funnels every vocoder call in the process through one inference thread.
+
+    Render threads hand their requests to render() and block until they're
+    done. Meanwhile the inference thread collects requests from all renderers
+    of all plug-in instances and combines those for the same model and of the
+    same length into batches, most urgent first, so that speculative renders
+    far ahead of the playhead never delay one that is about to be heard.
+    Requests are never padded, so their audio doesn't depend on what else they
+    were batched with, and a bounce sounds exactly like playback.
+
+    While something renders offline, such as a bounce, further inference threads
+    run batches alongside the first one, so that inference has every core
+    rather than the share left over during playback.
+
+    The scheduler also owns the vocoders themselves, one per model, all using
+    the same InferenceOptions so that inference stays within its thread budget.
+    Used through the RenderWorkerPool's SharedResourcePointer, that makes one
+    session per model for the whole process, however many plug-in instances
+    there are. Models are loaded on a background thread on first use and
+    warmed up with a short inference before they are handed out, so neither
+    creating an instance nor the first render after loading has to wait.
+*/
+class InferenceScheduler
+{
+public:
+    //==============================================================================
+    /** Priority of requests that someone is already waiting for, e.g. offline rendering. */
+    static constexpr juce::int64 immediatePriority = std::numeric_limits<juce::int64>::min();
+
+    struct Options
+    {
+        InferenceOptions inference;
+
+        // How long the inference thread waits for more requests before running a
+        // batch that isn't full yet
+        int gatherWindowMs = 2;
+
+        // Batches run at once while rendering offline, each on its own thread
+        // plus the shared intra-op threads
+        int numOfflineThreads = 1;
+    };
+
+    /** Returns options leaving most cores to the host and its audio threads
+        during playback, and using all of them offline. The environment variables
+        HIFITUNE_INTRA_OP_THREADS, HIFITUNE_INTER_OP_THREADS, HIFITUNE_OFFLINE_THREADS,
+        HIFITUNE_MAX_BATCH_SIZE and HIFITUNE_MODEL_QUALITY (best, balanced or
+        fastest) override the defaults.
+    */
+    static Options getDefaultOptions();
+
+    explicit InferenceScheduler (const FeatureConfig& = {}, const Options& = getDefaultOptions());
+    ~InferenceScheduler();
+
+    const Options& getOptions() const noexcept      { return options; }
+
+    /** Changes the quality setting used to pick the precision of the models
+        handed out. The model for the previous setting keeps being handed out
+        until the new one has loaded, so playback never drops to dry audio, and
+        is released once nobody is using it any more.
+    */
+    void setModelQuality (ModelQuality) noexcept;
+    ModelQuality getModelQuality() const noexcept   { return quality.load(); }
+
+    //==============================================================================
+    /** Returns the vocoder for a model in the model directory once it has been
+        loaded and warmed up for the current quality setting. Until then, returns
+        the one loaded for the previous setting if there is one, or nullptr. The
+        first call starts loading it in the background. Never waits for the
+        load, so renderers can play dry audio meanwhile.
+
+        Hold on to the returned pointer for as long as the vocoder is in use;
+        a vocoder that has been replaced is released after the last user lets
+        go of it.
+    */
+    std::shared_ptr<Vocoder> getVocoder (const juce::String& modelName = "vocoder");
+
+    /** Like getVocoder(), but waits for a load in progress to finish, e.g. for
+        offline rendering, which should never fall back to dry audio.
+    */
+    std::shared_ptr<Vocoder> waitForVocoder (const juce::String& modelName = "vocoder");
+
+    /** Starts loading a model in the background if that hasn't happened yet, so
+        that it's ready by the time anything renders.
+    */
+    void preloadVocoder (const juce::String& modelName = "vocoder");
+
+    /** Queues a request for one of this scheduler's vocoders and blocks until it
+        has been rendered. Requests with lower priority values go first; render
+        threads typically pass the distance to the playhead in samples.
+    */
+    bool render (Vocoder&, const float* mel, const float* f0, int numFrames, float* output, juce::int64 priority);
+
+    /** Queues several requests at once, so that those of the same length can
+        share a batch, and blocks until all of them have been rendered, setting
+        each one's succeeded flag.
+    */
+    void render (Vocoder&, Vocoder::Request* requests, int numRequests, juce::int64 priority);
+
+    //==============================================================================
+    /** Lets batches run on the offline threads too, until the matching call to
+        endOfflineRendering(). Calls may be nested, e.g. by several bounces.
+    */
+    void beginOfflineRendering() noexcept;
+    void endOfflineRendering() noexcept;
+
+private:
+    //==============================================================================
+    class InferenceThread;
+    class LoaderThread;
+
+    struct Model
+    {
+        juce::String name;
+        ModelQuality quality;
+        std::shared_ptr<Vocoder> vocoder;           // set under modelsLock
+        std::atomic<bool> isLoaded { false };       // successfully or not
+        juce::WaitableEvent loaded { true };
+    };
+
+    std::shared_ptr<Model> getModel (const juce::String& modelName);
+    std::shared_ptr<Vocoder> getServedVocoder (const Model&);
+    void load (Model&);
+    void releaseRetiredVocoders();
+
+    struct Task
+    {
+        Vocoder* vocoder;
+        Vocoder::Request request;
+        juce::int64 priority;
+        juce::uint64 sequence;
+        juce::WaitableEvent finished;
+    };
+
+    bool takeNextBatch (std::vector<Task*>& batch, bool isOfflineThread);
+
+    const FeatureConfig config;
+    const Options options;
+    std::atomic<ModelQuality> quality;
+
+    std::map<std::pair<juce::String, ModelQuality>, std::shared_ptr<Model>> models;
+    std::map<juce::String, std::shared_ptr<Vocoder>> servedVocoders;   // by model name
+    std::vector<std::shared_ptr<Vocoder>> retiredVocoders;             // replaced, maybe still in use
+    juce::CriticalSection modelsLock;
+
+    std::vector<Task*> pendingTasks;
+    juce::uint64 nextSequence = 0;
+    juce::CriticalSection tasksLock;
+    juce::WaitableEvent taskAdded;
+
+    std::atomic<int> numOfflineRenders { 0 };
+
+    // The first thread runs batches all the time, the others only offline
+    std::vector<std::unique_ptr<InferenceThread>> threads;
+    std::unique_ptr<LoaderThread> loader;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (InferenceScheduler)
+};
+
+} // namespace hifitune
@@ -0,0 +1,311 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide timing and event instrumentation.
+
+  ==============================================================================
+*/
+
+#include "Instrumentation.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // How often the collector empties the ring buffer. At 64k events this leaves
+    // plenty of headroom even with many instances playing small blocks.
+    constexpr int drainIntervalMs = 50;
+}
+
+//==============================================================================
+class Instrumentation::Collector  : public juce::Thread
+{
+public:
+    explicit Collector (Instrumentation& ownerIn)
+        : juce::Thread ("HiFiTune Instrumentation"), owner (ownerIn)
+    {
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            owner.drain();
+            wait (drainIntervalMs);
+        }
+
+        owner.drain();
+    }
+
+private:
+    Instrumentation& owner;
+};
+
+//==============================================================================
+const char* Instrumentation::getName (EventType type) noexcept
+{
+    switch (type)
+    {
+        case EventType::processorBlock:         return "processorBlock";
+        case EventType::rendererBlock:          return "rendererBlock";
+        case EventType::renderAheadHit:         return "renderAheadHit";
+        case EventType::renderAheadMiss:        return "renderAheadMiss";
+        case EventType::segmentCacheHit:        return "segmentCacheHit";
+        case EventType::segmentCacheMiss:       return "segmentCacheMiss";
+        case EventType::segmentRender:          return "segmentRender";
+        case EventType::sourceRead:             return "sourceRead";
+        case EventType::inferenceRequest:       return "inferenceRequest";
+        case EventType::inferenceBatch:         return "inferenceBatch";
+        case EventType::inferenceQueueDepth:    return "inferenceQueueDepth";
+        case EventType::liveCorrectionHop:      return "liveCorrectionHop";
+        case EventType::liveCorrectionMiss:     return "liveCorrectionMiss";
+    }
+
+    return "unknown";
+}
+
+Instrumentation::Instrumentation()
+    : ring (std::make_unique<Slot[]> ((size_t) ringSize))
+{
+    for (int i = 0; i < ringSize; ++i)
+        ring[(size_t) i].sequence.store ((juce::uint64) i, std::memory_order_relaxed);
+}
+
+Instrumentation::~Instrumentation()
+{
+    enabled = false;
+
+    if (collector != nullptr)
+        collector->stopThread (-1);
+}
+
+int Instrumentation::getThreadIndex() noexcept
+{
+    // A thread_local would be simpler, but the first access to one from a new
+    // host audio thread can allocate inside a plug-in, so threads are looked up
+    // by ID instead, starting where the ID hashes to
+    const auto id = juce::Thread::getCurrentThreadId();
+    const auto start = (size_t) (((juce::uint64) (juce::pointer_sized_uint) id * 0x9e3779b97f4a7c15ull) >> 56) % maxRecordingThreads;
+
+    for (size_t i = 0; i < maxRecordingThreads; ++i)
+    {
+        const auto index = (start + i) % maxRecordingThreads;
+        auto& slot = recordingThreads[index];
+        auto current = slot.load (std::memory_order_acquire);
+
+        if (current == nullptr && slot.compare_exchange_strong (current, id, std::memory_order_acq_rel))
+            return (int) index;
+
+        if (current == id)
+            return (int) index;
+    }
+
+    // Threads beyond the table share one index
+    return (int) maxRecordingThreads;
+}
+
+Instrumentation& Instrumentation::getInstance()
+{
+    static Instrumentation instance;
+    return instance;
+}
+
+//==============================================================================
+void Instrumentation::setEnabled (bool shouldBeEnabled)
+{
+    auto& instance = getInstance();
+    const juce::ScopedLock sl (instance.collectorLock);
+
+    if (shouldBeEnabled == isEnabled())
+        return;
+
+    if (shouldBeEnabled)
+    {
+        instance.reset();
+        enabled = true;
+
+        instance.collector = std::make_unique<Collector> (instance);
+        instance.collector->startThread (juce::Thread::Priority::low);
+    }
+    else
+    {
+        enabled = false;
+
+        instance.collector->signalThreadShouldExit();
+        instance.collector->notify();
+        instance.collector->stopThread (-1);
+        instance.collector.reset();
+    }
+}
+
+void Instrumentation::push (EventType type, juce::int64 startTicks, juce::int64 durationTicks, juce::int64 value) noexcept
+{
+    auto position = writePosition.load (std::memory_order_relaxed);
+
+    for (;;)
+    {
+        auto& slot = ring[(size_t) (position & (ringSize - 1))];
+        const auto sequence = slot.sequence.load (std::memory_order_acquire);
+
+        if (sequence == position)
+        {
+            if (writePosition.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+            {
+                slot.event = { type, getThreadIndex(), startTicks, durationTicks, value };
+                slot.sequence.store (position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (sequence < position)
+        {
+            // Still holds an event the collector hasn't taken
+            numDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = writePosition.load (std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Instrumentation::pop (Event& event) noexcept
+{
+    auto& slot = ring[(size_t) (readPosition & (ringSize - 1))];
+
+    if (slot.sequence.load (std::memory_order_acquire) != readPosition + 1)
+        return false;
+
+    event = slot.event;
+    slot.sequence.store (readPosition + ringSize, std::memory_order_release);
+    ++readPosition;
+    return true;
+}
+
+void Instrumentation::drain()
+{
+    const juce::ScopedLock sl (resultsLock);
+    Event event;
+
+    while (pop (event))
+    {
+        auto& accumulator = accumulators[(size_t) event.type];
+        ++accumulator.count;
+        accumulator.totalTicks += event.durationTicks;
+        accumulator.maxTicks = juce::jmax (accumulator.maxTicks, event.durationTicks);
+        accumulator.totalValue += event.value;
+        accumulator.maxValue = juce::jmax (accumulator.maxValue, event.value);
+
+        // Keep the most recent events for export
+        if (history.size() >= maxHistory)
+            history.pop_front();
+
+        history.push_back (event);
+    }
+}
+
+void Instrumentation::reset()
+{
+    const juce::ScopedLock sl (resultsLock);
+    Event event;
+
+    while (pop (event))
+        ;
+
+    accumulators = {};
+    history.clear();
+    numDropped = 0;
+    startTicks = juce::Time::getHighResolutionTicks();
+}
+
+//==============================================================================
+Instrumentation::Summary Instrumentation::getSummary()
+{
+    auto& instance = getInstance();
+    const juce::ScopedLock sl (instance.resultsLock);
+
+    const auto microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    Summary summary;
+
+    for (size_t i = 0; i < summary.totals.size(); ++i)
+    {
+        const auto& accumulator = instance.accumulators[i];
+        auto& totals = summary.totals[i];
+
+        totals.count = accumulator.count;
+        totals.maxMicroseconds = (double) accumulator.maxTicks * microsecondsPerTick;
+        totals.maxValue = accumulator.maxValue;
+
+        if (accumulator.count > 0)
+        {
+            totals.meanMicroseconds = (double) accumulator.totalTicks * microsecondsPerTick / (double) accumulator.count;
+            totals.meanValue = (double) accumulator.totalValue / (double) accumulator.count;
+        }
+    }
+
+    summary.numDropped = instance.numDropped.load();
+
+    if (instance.startTicks != 0)
+        summary.seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - instance.startTicks);
+
+    return summary;
+}
+
+void Instrumentation::writeChromeTrace (juce::OutputStream& stream)
+{
+    auto& instance = getInstance();
+    const juce::ScopedLock sl (instance.resultsLock);
+
+    const auto microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+    auto toMicroseconds = [&] (juce::int64 ticks) { return juce::String ((double) ticks * microsecondsPerTick, 3); };
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool isFirst = true;
+
+    for (const auto& event : instance.history)
+    {
+        const auto type = event.type;
+        const juce::String name (getName (type));
+        const auto timestamp = toMicroseconds (event.startTicks - instance.startTicks);
+
+        stream << (isFirst ? "\n" : ",\n");
+        isFirst = false;
+
+        // Timed events become slices, the queue depth a counter track and the
+        // rest instant markers on their thread
+        if (event.durationTicks > 0)
+            stream << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.threadIndex
+                   << ",\"ts\":" << timestamp << ",\"dur\":" << toMicroseconds (event.durationTicks)
+                   << ",\"args\":{\"value\":" << event.value << "}}";
+        else if (type == EventType::inferenceQueueDepth)
+            stream << "{\"name\":\"" << name << "\",\"ph\":\"C\",\"pid\":1,\"ts\":" << timestamp
+                   << ",\"args\":{\"depth\":" << event.value << "}}";
+        else
+            stream << "{\"name\":\"" << name << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << event.threadIndex
+                   << ",\"ts\":" << timestamp << ",\"args\":{\"value\":" << event.value << "}}";
+    }
+
+    stream << "\n]}\n";
+}
+
+void Instrumentation::writeCsv (juce::OutputStream& stream)
+{
+    auto& instance = getInstance();
+    const juce::ScopedLock sl (instance.resultsLock);
+
+    const auto microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+    stream << "event,thread,startMicroseconds,durationMicroseconds,value\n";
+
+    for (const auto& event : instance.history)
+        stream << getName (event.type) << ','
+               << event.threadIndex << ','
+               << juce::String ((double) (event.startTicks - instance.startTicks) * microsecondsPerTick, 3) << ','
+               << juce::String ((double) event.durationTicks * microsecondsPerTick, 3) << ','
+               << event.value << '\n';
+}
+
+} // namespace hifitune
@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide timing and event instrumentation.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <deque>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Collects timings and counts from the audio, render and inference threads,
+    to show where the time goes when playback can't keep up.
+
+    Threads record fixed-size events into a lock-free ring buffer, which a
+    background thread drains into running totals and a bounded history that
+    can be exported as a Chrome trace (chrome://tracing, Perfetto) or as CSV.
+
+    Recording is realtime-safe. While instrumentation is disabled, which is the
+    default, recording costs one relaxed atomic load and nothing is timed.
+    When the ring buffer is full, events are dropped and counted.
+*/
+class Instrumentation
+{
+public:
+    //==============================================================================
+    enum class EventType
+    {
+        processorBlock,         // HiFiTuneAudioProcessor::processBlock, value = samples
+        rendererBlock,          // HiFiTunePlaybackRenderer::processBlock, value = samples
+        renderAheadHit,         // a block found everything rendered
+        renderAheadMiss,        // a block had to play silence or dry audio, value = samples affected
+        segmentCacheHit,        // SegmentCache lookup served from memory (value 0) or disk (value 1)
+        segmentCacheMiss,
+        segmentRender,          // rendering a run of segments on a worker, value = segments
+        sourceRead,             // one chunk read from a source reader, value = samples
+        inferenceRequest,       // from queueing a vocoder request until it's done, value = frames
+        inferenceBatch,         // one batched vocoder call, value = requests in the batch
+        inferenceQueueDepth,    // requests waiting when one was added, value = depth
+        liveCorrectionHop,      // LiveCorrector analysing and shifting one hop, value = samples
+        liveCorrectionMiss      // a block fell back to dry audio in live correction, value = samples affected
+    };
+
+    static constexpr int numEventTypes = (int) EventType::liveCorrectionMiss + 1;
+
+    static const char* getName (EventType) noexcept;
+
+    struct Event
+    {
+        EventType type;
+        int threadIndex;                    // small number per recording thread
+        juce::int64 startTicks;             // juce::Time high resolution ticks
+        juce::int64 durationTicks;          // 0 for counts and instant events
+        juce::int64 value;
+    };
+
+    //==============================================================================
+    static bool isEnabled() noexcept        { return enabled.load (std::memory_order_relaxed); }
+
+    /** Starts or stops collecting. Enabling clears earlier results. */
+    static void setEnabled (bool);
+
+    /** Records an event. Realtime-safe. */
+    static void record (EventType type, juce::int64 startTicks, juce::int64 durationTicks, juce::int64 value = 0) noexcept
+    {
+        if (isEnabled())
+            getInstance().push (type, startTicks, durationTicks, value);
+    }
+
+    /** Records an event without a duration, timestamped now. Realtime-safe. */
+    static void count (EventType type, juce::int64 value = 0) noexcept
+    {
+        if (isEnabled())
+            getInstance().push (type, juce::Time::getHighResolutionTicks(), 0, value);
+    }
+
+    /** Records the time between its construction and destruction. */
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer (EventType typeIn, juce::int64 valueIn = 0) noexcept
+            : type (typeIn), value (valueIn), startTicks (isEnabled() ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedTimer()
+        {
+            if (startTicks != 0)
+                record (type, startTicks, juce::Time::getHighResolutionTicks() - startTicks, value);
+        }
+
+        /** Changes the value recorded with the event, e.g. once it is known. */
+        void setValue (juce::int64 newValue) noexcept   { value = newValue; }
+
+    private:
+        const EventType type;
+        juce::int64 value;
+        const juce::int64 startTicks;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedTimer)
+    };
+
+    //==============================================================================
+    /** Totals per event type since collection was enabled. */
+    struct Summary
+    {
+        struct Totals
+        {
+            juce::uint64 count = 0;
+            double meanMicroseconds = 0.0, maxMicroseconds = 0.0;
+            double meanValue = 0.0;
+            juce::int64 maxValue = 0;
+        };
+
+        std::array<Totals, numEventTypes> totals;
+        juce::uint64 numDropped = 0;
+        double seconds = 0.0;
+    };
+
+    /** Returns the totals as of the last drain. Not realtime-safe. */
+    static Summary getSummary();
+
+    /** Writes the recorded history in the Chrome trace event format. */
+    static void writeChromeTrace (juce::OutputStream&);
+
+    /** Writes the recorded history as CSV, one event per line. */
+    static void writeCsv (juce::OutputStream&);
+
+    static constexpr int ringSize = 1 << 16;
+    static constexpr size_t maxHistory = (size_t) 1 << 20;
+
+private:
+    //==============================================================================
+    class Collector;
+
+    struct Slot
+    {
+        std::atomic<juce::uint64> sequence { 0 };
+        Event event;
+    };
+
+    Instrumentation();
+    ~Instrumentation();
+
+    static Instrumentation& getInstance();
+
+    void push (EventType, juce::int64 startTicks, juce::int64 durationTicks, juce::int64 value) noexcept;
+    bool pop (Event&) noexcept;
+    int getThreadIndex() noexcept;
+    void drain();
+    void reset();
+
+    inline static std::atomic<bool> enabled { false };
+
+    // Bounded multi-producer queue (after Dmitry Vyukov): a slot whose sequence
+    // equals the write position is free, one whose sequence is one past it is
+    // ready to be read
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<juce::uint64> writePosition { 0 };
+    juce::uint64 readPosition = 0;
+    std::atomic<juce::uint64> numDropped { 0 };
+
+    // IDs of the threads that have recorded events; a thread's index is its slot
+    static constexpr size_t maxRecordingThreads = 256;
+    std::array<std::atomic<juce::Thread::ThreadID>, maxRecordingThreads> recordingThreads {};
+
+    // Touched by the collector and readers of the results
+    struct Accumulator
+    {
+        juce::uint64 count = 0;
+        juce::int64 totalTicks = 0, maxTicks = 0, totalValue = 0, maxValue = 0;
+    };
+
+    std::array<Accumulator, numEventTypes> accumulators;
+    std::deque<Event> history;
+    juce::int64 startTicks = 0;
+    juce::CriticalSection resultsLock;
+
+    std::unique_ptr<Collector> collector;
+    juce::CriticalSection collectorLock;
+
+    // No leak detector: the instance lives until static destruction
+    JUCE_DECLARE_NON_COPYABLE (Instrumentation)
+};
+
+} // namespace hifitune
@@ -0,0 +1,400 @@
+/*
+  ==============================================================================
+
+    This file contains the low-latency streaming pitch correction.
+
+  ==============================================================================
+*/
+
+#include "LiveCorrector.h"
+#include "Instrumentation.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Samples the worker processes at a time, and over which the output fades
+    // between corrected and dry audio
+    constexpr int hopSize = 64;
+    constexpr int fadeLength = 64;
+
+    // Length of the shifter's grains: two periods of a 200 Hz voice, and still
+    // one of the lowest sung notes. Half of it adds to the latency, so longer
+    // grains would take up most of the budget.
+    constexpr double grainSeconds = 0.01;
+
+    // The shortest delay a read head can interpolate at from samples already written
+    constexpr int minimumDelay = 2;
+
+    // While there's nothing to correct, the read heads drift back to where one of
+    // them plays alone at the nominal delay, detuning by at most this much
+    constexpr double parkingCents = 10.0;
+
+    /** Calls function (ringIndex, offset, numSamples) for the one or two parts a
+        run of samples occupies in a ring buffer.
+    */
+    template <typename Function>
+    void forEachRingPart (juce::int64 position, int numSamples, int ringMask, Function&& function)
+    {
+        const auto first = (int) (position & ringMask);
+        const auto numFirst = juce::jmin (numSamples, ringMask + 1 - first);
+
+        function (first, 0, numFirst);
+
+        if (numFirst < numSamples)
+            function (0, numFirst, numSamples - numFirst);
+    }
+}
+
+//==============================================================================
+class LiveCorrector::Worker  : public juce::Thread
+{
+public:
+    explicit Worker (LiveCorrector& ownerIn)
+        : juce::Thread ("HiFiTune Live Correction"), owner (ownerIn)
+    {
+    }
+
+    void run() override
+    {
+        const auto ringSize = (juce::int64) owner.ringMask + 1;
+        juce::int64 position = 0;
+
+        while (! threadShouldExit())
+        {
+            // Read before inputEnd, so that input arriving in between makes the
+            // wait return at once
+            const auto signal = owner.inputSignal.load (std::memory_order_acquire);
+            const auto end = owner.inputEnd.load (std::memory_order_acquire);
+
+            if (end - position < hopSize)
+            {
+                owner.inputSignal.wait (signal, std::memory_order_acquire);
+                continue;
+            }
+
+            // So far behind that the input is about to be overwritten, and long
+            // since played dry: start again from the newest input
+            if (end - position > ringSize / 2)
+            {
+                position = end - (end - position) % hopSize;
+                owner.reset();
+
+                // What's in the output ring before the new position, and what
+                // the emptied read heads reach back to, is older audio
+                owner.validFrom.store (position + minimumDelay + owner.grainLength, std::memory_order_release);
+            }
+
+            // Hops that have been played already are only fed through the
+            // shifter, to catch up as quickly as possible
+            const auto isLate = position + hopSize <= owner.playPosition.load (std::memory_order_relaxed);
+
+            owner.processHop (position, ! isLate);
+            position += hopSize;
+            owner.processedEnd.store (position, std::memory_order_release);
+        }
+    }
+
+private:
+    LiveCorrector& owner;
+};
+
+//==============================================================================
+LiveCorrector::LiveCorrector() = default;
+
+LiveCorrector::~LiveCorrector()
+{
+    release();
+}
+
+void LiveCorrector::prepare (double newSampleRate, int newMaximumBlockSize, int newNumChannels)
+{
+    release();
+
+    sampleRate = newSampleRate;
+    maximumBlockSize = juce::jmax (1, newMaximumBlockSize);
+    numChannels = juce::jmax (1, newNumChannels);
+
+    // The output is read one block, one hop and one fade behind the input, so
+    // that a worker keeping up always has the next samples ready with room to
+    // fade out if it falls behind. The shifter delays by half a grain on top.
+    grainLength = juce::jmax (4 * hopSize, juce::roundToInt (grainSeconds * sampleRate));
+    shifterDelay = minimumDelay + grainLength / 2;
+    latency = maximumBlockSize + hopSize + fadeLength + shifterDelay;
+
+    const auto ringSize = juce::nextPowerOfTwo (4 * (latency + maximumBlockSize + hopSize));
+    ringMask = ringSize - 1;
+
+    inputRing.setSize (numChannels, ringSize);
+    outputRing.setSize (numChannels, ringSize);
+    inputRing.clear();
+    outputRing.clear();
+
+    inputEnd = 0;
+    processedEnd = 0;
+    validFrom = 0;
+    playPosition = 0;
+    wetGain = 0.0f;
+    numMissedSamples = 0;
+
+    // The window has to hold two periods of the lowest pitch; all of it is in
+    // the past, so it adds no latency
+    FeatureConfig config;
+    config.sampleRate = sampleRate;
+    config.hopSize = hopSize;
+    config.fftSize = juce::nextPowerOfTwo (2 * (int) std::ceil (sampleRate / config.f0MinHz));
+    config.melMaxHz = juce::jmin (config.melMaxHz, (float) (0.45 * sampleRate));
+
+    pitchTracker = std::make_unique<FeatureExtractor> (config);
+    analysisWindow.assign ((size_t) config.fftSize, 0.0f);
+
+    const auto delayLineLength = juce::nextPowerOfTwo (minimumDelay + grainLength + 4);
+    delayMask = delayLineLength - 1;
+    delayLines.assign ((size_t) numChannels, std::vector<float> ((size_t) delayLineLength));
+
+    reset();
+
+    worker = std::make_unique<Worker> (*this);
+    worker->startThread (juce::Thread::Priority::highest);
+}
+
+void LiveCorrector::release()
+{
+    if (worker == nullptr)
+        return;
+
+    worker->signalThreadShouldExit();
+    signalWorker();
+    worker->stopThread (-1);
+    worker.reset();
+}
+
+void LiveCorrector::signalWorker() noexcept
+{
+    // No lock involved: this is a futex wake or similar, and only a counter
+    // update when the worker isn't waiting
+    inputSignal.fetch_add (1, std::memory_order_release);
+    inputSignal.notify_one();
+}
+
+double LiveCorrector::getTailLengthSeconds() const noexcept
+{
+    // The output lags the shifter by the latency less its nominal delay, and
+    // the shifter's longest read head reaches a whole grain back
+    if (worker == nullptr)
+        return 0.0;
+
+    return (double) (latency - shifterDelay + minimumDelay + grainLength) / sampleRate;
+}
+
+//==============================================================================
+void LiveCorrector::setEnabled (bool shouldBeEnabled) noexcept
+{
+    enabled.store (shouldBeEnabled, std::memory_order_relaxed);
+}
+
+void LiveCorrector::setAmount (float newAmount) noexcept
+{
+    amount.store (juce::jlimit (0.0f, 1.0f, newAmount), std::memory_order_relaxed);
+}
+
+void LiveCorrector::setRetuneTime (float milliseconds) noexcept
+{
+    retuneTime.store (juce::jmax (0.0f, milliseconds), std::memory_order_relaxed);
+}
+
+//==============================================================================
+void LiveCorrector::process (juce::AudioBuffer<float>& buffer) noexcept
+{
+    if (worker == nullptr)
+        return;
+
+    for (int start = 0; start < buffer.getNumSamples(); start += maximumBlockSize)
+        processPart (buffer, start, juce::jmin (maximumBlockSize, buffer.getNumSamples() - start));
+}
+
+void LiveCorrector::processPart (juce::AudioBuffer<float>& buffer, int start, int numSamples) noexcept
+{
+    const auto numBufferChannels = juce::jmin (buffer.getNumChannels(), numChannels);
+
+    if (numBufferChannels == 0)
+        return;
+
+    // Hand the input over; channels the buffer lacks repeat its last one
+    const auto writePosition = inputEnd.load (std::memory_order_relaxed);
+
+    forEachRingPart (writePosition, numSamples, ringMask, [&] (int ringIndex, int offset, int num)
+    {
+        for (int c = 0; c < numChannels; ++c)
+            juce::FloatVectorOperations::copy (inputRing.getWritePointer (c, ringIndex),
+                                               buffer.getReadPointer (juce::jmin (c, numBufferChannels - 1), start + offset),
+                                               num);
+    });
+
+    inputEnd.store (writePosition + numSamples, std::memory_order_release);
+    signalWorker();
+
+    // Take back what the worker has finished
+    const auto wetPosition = writePosition - (latency - shifterDelay);
+    playPosition.store (wetPosition + numSamples, std::memory_order_relaxed);
+
+    // The worker moves validFrom before it publishes anything past it
+    const auto available = processedEnd.load (std::memory_order_acquire);
+    const auto firstValid = validFrom.load (std::memory_order_acquire);
+    const auto isEnabled = enabled.load (std::memory_order_relaxed);
+    int numMissed = 0;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto wetIndex = wetPosition + i;
+        const auto hasWet = wetIndex >= firstValid && wetIndex < available;
+
+        // Fade out while there's still enough corrected audio left to fade with
+        const auto isAhead = hasWet && available - wetIndex >= fadeLength;
+        const auto target = isEnabled && isAhead ? 1.0f : 0.0f;
+
+        wetGain = target > wetGain ? juce::jmin (target, wetGain + 1.0f / (float) fadeLength)
+                                   : juce::jmax (target, wetGain - 1.0f / (float) fadeLength);
+
+        if (! hasWet)
+            wetGain = 0.0f;
+
+        if (isEnabled && ! isAhead)
+            ++numMissed;
+
+        const auto wetRingIndex = (int) (wetIndex & ringMask);
+        const auto dryRingIndex = (int) ((wetIndex - shifterDelay) & ringMask);
+
+        for (int c = 0; c < numBufferChannels; ++c)
+        {
+            const auto dry = inputRing.getReadPointer (c)[dryRingIndex];
+            const auto wet = hasWet ? outputRing.getReadPointer (c)[wetRingIndex] : dry;
+            buffer.getWritePointer (c)[start + i] = dry + wetGain * (wet - dry);
+        }
+    }
+
+    if (numMissed > 0)
+    {
+        numMissedSamples.fetch_add (numMissed, std::memory_order_relaxed);
+        Instrumentation::count (Instrumentation::EventType::liveCorrectionMiss, numMissed);
+    }
+}
+
+//==============================================================================
+void LiveCorrector::reset()
+{
+    std::fill (analysisWindow.begin(), analysisWindow.end(), 0.0f);
+
+    for (auto& line : delayLines)
+        std::fill (line.begin(), line.end(), 0.0f);
+
+    delayWriteIndex = 0;
+    phase = 0.5;
+    shift = 0.0f;
+    targetShift = 0.0f;
+}
+
+void LiveCorrector::processHop (juce::int64 start, bool analyse)
+{
+    const Instrumentation::ScopedTimer timer (Instrumentation::EventType::liveCorrectionHop, hopSize);
+
+    // Hops never straddle the end of the ring, as it's a multiple of their size
+    const auto ringIndex = (int) (start & ringMask);
+
+    // Slide the analysis window on by the mono mix of the hop
+    std::move (analysisWindow.begin() + hopSize, analysisWindow.end(), analysisWindow.begin());
+    auto* newest = analysisWindow.data() + analysisWindow.size() - hopSize;
+
+    juce::FloatVectorOperations::copy (newest, inputRing.getReadPointer (0, ringIndex), hopSize);
+
+    for (int c = 1; c < numChannels; ++c)
+        juce::FloatVectorOperations::add (newest, inputRing.getReadPointer (c, ringIndex), hopSize);
+
+    juce::FloatVectorOperations::multiply (newest, 1.0f / (float) numChannels, hopSize);
+
+    updateShift (analyse);
+
+    // Two read heads sweep through [minimumDelay, minimumDelay + grainLength)
+    // half a grain apart, each faded in and out with a Hann window, so that the
+    // delay changes smoothly by (1 - ratio) samples per sample.
+    const auto ratio = std::exp2 ((double) shift / 12.0);
+    const auto phaseStep = (1.0 - ratio) / (double) grainLength;
+    const auto maxDrift = (std::exp2 (parkingCents / 1200.0) - 1.0) / (double) grainLength;
+
+    // At a fixed delay the two heads would comb-filter, so let one take over
+    const auto isParking = std::abs (targetShift) < 1.0e-3f && std::abs (shift) < 1.0e-2f;
+
+    for (int i = 0; i < hopSize; ++i)
+    {
+        for (int c = 0; c < numChannels; ++c)
+            delayLines[(size_t) c][(size_t) delayWriteIndex] = inputRing.getReadPointer (c)[ringIndex + i];
+
+        phase += phaseStep;
+
+        if (isParking)
+            phase += juce::jlimit (-maxDrift, maxDrift, 0.5 - phase);
+
+        phase -= std::floor (phase);
+
+        const auto otherPhase = phase < 0.5 ? phase + 0.5 : phase - 0.5;
+        const auto delay = minimumDelay + phase * (double) grainLength;
+        const auto otherDelay = minimumDelay + otherPhase * (double) grainLength;
+        const auto gain = (float) (0.5 - 0.5 * std::cos (juce::MathConstants<double>::twoPi * phase));
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            const auto& line = delayLines[(size_t) c];
+            outputRing.getWritePointer (c)[ringIndex + i] = gain * readDelayLine (line, delay)
+                                                          + (1.0f - gain) * readDelayLine (line, otherDelay);
+        }
+
+        delayWriteIndex = (delayWriteIndex + 1) & delayMask;
+    }
+}
+
+void LiveCorrector::updateShift (bool analyse)
+{
+    // The pitch is that of the last window's worth of input, slightly older than
+    // the audio being shifted; the retune time smooths over the difference
+    if (analyse)
+    {
+        float f0 = 0.0f, voicing = 0.0f;
+        pitchTracker->estimatePitch (analysisWindow.data(), f0, voicing);
+
+        if (f0 > 0.0f)
+        {
+            const auto semitones = 12.0f * std::log2 (f0 / 440.0f);
+            targetShift = (std::round (semitones) - semitones) * amount.load (std::memory_order_relaxed);
+        }
+        else
+        {
+            targetShift = 0.0f;
+        }
+    }
+
+    const auto time = retuneTime.load (std::memory_order_relaxed);
+    const auto coefficient = time > 0.0f ? 1.0f - (float) std::exp (-hopSize / (time * 0.001 * sampleRate)) : 1.0f;
+
+    shift += (targetShift - shift) * coefficient;
+}
+
+float LiveCorrector::readDelayLine (const std::vector<float>& line, double delay) const noexcept
+{
+    const auto position = (double) delayWriteIndex - delay;
+    const auto index = (int) std::floor (position);
+    const auto t = (float) (position - (double) index);
+
+    const auto sampleAt = [&] (int i) noexcept { return line[(size_t) (i & delayMask)]; };
+
+    const auto xm1 = sampleAt (index - 1);
+    const auto x0  = sampleAt (index);
+    const auto x1  = sampleAt (index + 1);
+    const auto x2  = sampleAt (index + 2);
+
+    // Catmull-Rom
+    return x0 + 0.5f * t * (x1 - xm1 + t * (2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2
+                                            + t * (3.0f * (x0 - x1) + x2 - xm1)));
+}
+
+} // namespace hifitune
@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    This file contains the low-latency streaming pitch correction.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "FeatureExtractor.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Pitch-corrects a live input towards the nearest semitone, for monitoring
+    while tracking and for hosts without ARA.
+
+    The audio thread only copies its block into a ring buffer, publishes how
+    far the input goes and copies corrected audio out of a second ring buffer.
+    It wakes the worker by bumping an atomic counter the worker waits on
+    (std::atomic::wait(), a futex or the platform's equivalent), so samples
+    change hands without the audio thread ever taking a lock. The worker
+    thread takes the input a short hop at a time, estimates its pitch from the most recent samples
+    (YIN, as in the offline analysis) and shifts it with two crossfaded
+    delay-line read heads.
+
+    Output is delayed by a fixed getLatencySamples(), made up of one host block,
+    one hop, a crossfade and the shifter's own delay, about 8 ms plus the block.
+    That keeps it within 20 ms for host blocks of up to 512 samples at 44.1 kHz
+    and above; larger blocks add their length. Whenever the worker hasn't
+    delivered the samples due (it was descheduled, or the machine is overloaded)
+    the output crossfades to the input delayed by the same amount, and back once
+    the worker has caught up, so a missed deadline is heard as a moment without
+    correction rather than a dropout.
+
+    The neural vocoder isn't used here: its frames alone span more than the
+    whole latency budget.
+*/
+class LiveCorrector
+{
+public:
+    //==============================================================================
+    LiveCorrector();
+    ~LiveCorrector();
+
+    /** Allocates everything and starts the worker thread. Not realtime-safe. */
+    void prepare (double sampleRate, int maximumBlockSize, int numChannels);
+
+    /** Stops the worker thread. */
+    void release();
+
+    /** Returns the delay of the output, valid after prepare(). */
+    int getLatencySamples() const noexcept              { return latency; }
+
+    /** Returns how long output continues after the input has stopped. */
+    double getTailLengthSeconds() const noexcept;
+
+    //==============================================================================
+    /** Switches the correction on or off. While off, the input passes through
+        with the same latency, so that switching never shifts the timing.
+    */
+    void setEnabled (bool) noexcept;
+
+    /** Sets how far towards the nearest semitone the pitch is pulled, 0 to 1. */
+    void setAmount (float) noexcept;
+
+    /** Sets how quickly the correction follows the sung pitch; 0 snaps at once. */
+    void setRetuneTime (float milliseconds) noexcept;
+
+    //==============================================================================
+    /** Replaces the buffer's contents with the corrected input. Realtime-safe.
+        Blocks longer than the prepared maximum are processed in parts.
+    */
+    void process (juce::AudioBuffer<float>&) noexcept;
+
+    /** Returns the number of samples played dry because the worker was late. */
+    juce::int64 getNumMissedSamples() const noexcept    { return numMissedSamples.load(); }
+
+private:
+    //==============================================================================
+    class Worker;
+
+    void processPart (juce::AudioBuffer<float>&, int start, int numSamples) noexcept;
+    void signalWorker() noexcept;
+
+    // Worker thread
+    void reset();
+    void processHop (juce::int64 start, bool analyse);
+    void updateShift (bool analyse);
+    float readDelayLine (const std::vector<float>&, double delay) const noexcept;
+
+    double sampleRate = 44100.0;
+    int maximumBlockSize = 0, numChannels = 0;
+    int latency = 0, grainLength = 0, shifterDelay = 0;
+
+    // Shared between the audio thread and the worker
+    int ringMask = 0;
+    juce::AudioBuffer<float> inputRing, outputRing;
+    std::atomic<juce::int64> inputEnd { 0 }, processedEnd { 0 }, playPosition { 0 };
+    std::atomic<juce::int64> validFrom { 0 };      // output before this is stale, after the worker skipped ahead
+    std::atomic<juce::uint32> inputSignal { 0 };   // bumped whenever the worker should look at inputEnd again
+    std::atomic<bool> enabled { true };
+    std::atomic<float> amount { 1.0f }, retuneTime { 20.0f };
+
+    // Audio thread
+    float wetGain = 0.0f;
+    std::atomic<juce::int64> numMissedSamples { 0 };
+
+    // Worker thread
+    std::unique_ptr<FeatureExtractor> pitchTracker;
+    std::vector<float> analysisWindow;
+    std::vector<std::vector<float>> delayLines;
+    int delayMask = 0, delayWriteIndex = 0;
+    double phase = 0.5;
+    float shift = 0.0f, targetShift = 0.0f;      // in semitones
+
+    std::unique_ptr<Worker> worker;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LiveCorrector)
+};
+
+} // namespace hifitune
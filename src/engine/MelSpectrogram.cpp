@@ -0,0 +1,171 @@
+/*
+  ==============================================================================
+
+    This file contains the batched STFT and mel filterbank front end.
+
+  ==============================================================================
+*/
+
+#include "MelSpectrogram.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Slaney-style mel scale, as used by librosa and the HiFiGAN training recipes.
+    float hzToMel (float hz) noexcept
+    {
+        constexpr float minLogHz = 1000.0f, minLogMel = 15.0f;
+        const float logStep = std::log (6.4f) / 27.0f;
+
+        return hz < minLogHz ? hz * 3.0f / 200.0f
+                             : minLogMel + std::log (hz / minLogHz) / logStep;
+    }
+
+    float melToHz (float mel) noexcept
+    {
+        constexpr float minLogHz = 1000.0f, minLogMel = 15.0f;
+        const float logStep = std::log (6.4f) / 27.0f;
+
+        return mel < minLogMel ? mel * 200.0f / 3.0f
+                               : minLogHz * std::exp (logStep * (mel - minLogMel));
+    }
+
+    juce::int64 floorDivide (juce::int64 a, juce::int64 b) noexcept
+    {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+}
+
+//==============================================================================
+MelSpectrogram::MelSpectrogram (const FeatureConfig& configIn)
+    : config (configIn),
+      fft (juce::roundToInt (std::log2 ((double) configIn.fftSize)))
+{
+    jassert (juce::isPowerOfTwo (config.fftSize));
+
+    const auto numBins = config.fftSize / 2 + 1;
+
+    window.resize ((size_t) config.fftSize);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables (window.data(), window.size(),
+                                                              juce::dsp::WindowingFunction<float>::hann, false);
+
+    fftBuffer.resize ((size_t) config.fftSize * 2);
+
+    // Triangular filters with Slaney area normalisation
+    const auto minMel = hzToMel (config.melMinHz);
+    const auto maxMel = hzToMel (config.melMaxHz);
+    std::vector<float> edges ((size_t) config.numMelBins + 2);
+
+    for (size_t i = 0; i < edges.size(); ++i)
+        edges[i] = melToHz (minMel + (maxMel - minMel) * (float) i / (float) (edges.size() - 1));
+
+    const auto binWidth = (float) config.sampleRate / (float) config.fftSize;
+    std::vector<float> row ((size_t) numBins);
+
+    firstBin = numBins;
+    endBin = 0;
+
+    for (int m = 0; m < config.numMelBins; ++m)
+    {
+        const auto lower = edges[(size_t) m], centre = edges[(size_t) m + 1], upper = edges[(size_t) m + 2];
+        const auto norm = 2.0f / (upper - lower);
+        juce::Range<int> bins;
+
+        for (int k = 0; k < numBins; ++k)
+        {
+            const auto hz = (float) k * binWidth;
+            const auto weight = juce::jmin ((hz - lower) / (centre - lower), (upper - hz) / (upper - centre));
+            row[(size_t) k] = juce::jmax (0.0f, weight) * norm;
+
+            if (row[(size_t) k] > 0.0f)
+                bins = bins.isEmpty() ? juce::Range<int> (k, k + 1) : bins.withEnd (k + 1);
+        }
+
+        filterFirstBin.push_back (bins.getStart());
+        filterWeightStart.push_back ((int) weights.size());
+        weights.insert (weights.end(), row.begin() + bins.getStart(), row.begin() + bins.getEnd());
+
+        if (! bins.isEmpty())
+        {
+            firstBin = juce::jmin (firstBin, bins.getStart());
+            endBin = juce::jmax (endBin, bins.getEnd());
+        }
+    }
+
+    filterWeightStart.push_back ((int) weights.size());
+    firstBin = juce::jmin (firstBin, endBin);
+
+    // Filters too narrow to weight any bin just point at the first one
+    for (auto& bin : filterFirstBin)
+        bin = juce::jlimit (firstBin, endBin, bin);
+
+    batchSpectra.resize ((size_t) (endBin - firstBin) * framesPerBatch);
+    batchMel.resize ((size_t) config.numMelBins * framesPerBatch);
+}
+
+//==============================================================================
+void MelSpectrogram::process (const float* samples, int numFrames, float* melOut) noexcept
+{
+    for (int first = 0; first < numFrames; first += framesPerBatch)
+        processBatch (samples + (size_t) first * (size_t) config.hopSize,
+                      juce::jmin (framesPerBatch, numFrames - first),
+                      melOut + (size_t) first * (size_t) config.numMelBins);
+}
+
+void MelSpectrogram::processBatch (const float* samples, int numFrames, float* melOut) noexcept
+{
+    const auto size = config.fftSize;
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        juce::FloatVectorOperations::multiply (fftBuffer.data(), samples + (size_t) frame * (size_t) config.hopSize, window.data(), size);
+        juce::FloatVectorOperations::clear (fftBuffer.data() + size, size);
+        fft.performFrequencyOnlyForwardTransform (fftBuffer.data(), true);
+
+        for (int k = firstBin; k < endBin; ++k)
+            batchSpectra[(size_t) (k - firstBin) * framesPerBatch + (size_t) frame] = fftBuffer[(size_t) k];
+    }
+
+    // Each weight scales one bin of every frame in the batch, so the inner
+    // loop runs across frames, which lie next to each other
+    for (int m = 0; m < config.numMelBins; ++m)
+    {
+        auto* sums = batchMel.data() + (size_t) m * framesPerBatch;
+        const auto* filterWeights = weights.data() + filterWeightStart[(size_t) m];
+        const auto numWeights = filterWeightStart[(size_t) m + 1] - filterWeightStart[(size_t) m];
+        const auto* spectra = batchSpectra.data() + (size_t) (filterFirstBin[(size_t) m] - firstBin) * framesPerBatch;
+
+        juce::FloatVectorOperations::clear (sums, numFrames);
+
+        for (int i = 0; i < numWeights; ++i)
+            juce::FloatVectorOperations::addWithMultiply (sums, spectra + (size_t) i * framesPerBatch, filterWeights[i], numFrames);
+
+        juce::FloatVectorOperations::max (sums, sums, FeatureConfig::melFloor, numFrames);
+    }
+
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        auto* frameMel = melOut + (size_t) frame * (size_t) config.numMelBins;
+
+        for (int m = 0; m < config.numMelBins; ++m)
+            frameMel[m] = std::log (batchMel[(size_t) m * framesPerBatch + (size_t) frame]);
+    }
+}
+
+//==============================================================================
+juce::Range<juce::int64> MelSpectrogram::getFramesOverlapping (const FeatureConfig& config, juce::Range<juce::int64> modelSamples) noexcept
+{
+    if (modelSamples.isEmpty())
+        return {};
+
+    // Frame k reads [k * hopSize - fftSize / 2, k * hopSize + fftSize / 2)
+    const auto halfWindow = (juce::int64) config.fftSize / 2;
+    const auto first = floorDivide (modelSamples.getStart() - halfWindow, config.hopSize) + 1;
+    const auto last = floorDivide (modelSamples.getEnd() - 1 + halfWindow, config.hopSize);
+
+    return { first, juce::jmax (first, last + 1) };
+}
+
+} // namespace hifitune
@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    This file contains the batched STFT and mel filterbank front end.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+#include "FeatureConfig.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Turns runs of consecutive frames into log-mel spectra, the features the
+    vocoder is conditioned on.
+
+    The Hann window is computed once, and the mel filterbank is stored sparsely:
+    each triangular filter keeps only the contiguous run of bins it weights.
+    Frames are transformed in batches of framesPerBatch, with the magnitudes of
+    a batch stored bin by bin, so that every filter weight is applied to the
+    whole batch at once with a vectorised multiply-add. Per frame, the results
+    are the same as windowing, transforming and filtering it on its own.
+
+    Frame k covers the fftSize model-rate samples centred on sample k * hopSize,
+    so getFramesOverlapping() tells which frames a change to some samples
+    affects; recomputing only those keeps everything else as it was.
+
+    Instances hold scratch buffers and so must not be shared between threads.
+*/
+class MelSpectrogram
+{
+public:
+    //==============================================================================
+    static constexpr int framesPerBatch = 16;
+
+    explicit MelSpectrogram (const FeatureConfig& config);
+
+    const FeatureConfig& getConfig() const noexcept     { return config; }
+
+    /** Computes numFrames frames of numMelBins log-mel values each, frame-major.
+        Frame i reads the fftSize samples starting at samples + i * hopSize.
+        Doesn't allocate.
+    */
+    void process (const float* samples, int numFrames, float* melOut) noexcept;
+
+    /** Returns the frames whose windows include any of the given model-rate
+        samples. The range may start below 0 or end past the last frame.
+    */
+    static juce::Range<juce::int64> getFramesOverlapping (const FeatureConfig&, juce::Range<juce::int64> modelSamples) noexcept;
+
+private:
+    //==============================================================================
+    void processBatch (const float* samples, int numFrames, float* melOut) noexcept;
+
+    FeatureConfig config;
+    juce::dsp::FFT fft;
+    std::vector<float> window, fftBuffer;
+
+    // The non-zero weights of all filters, one contiguous run per filter
+    std::vector<float> weights;
+    std::vector<int> filterFirstBin, filterWeightStart;     // per filter, plus one past the end for filterWeightStart
+    int firstBin = 0, endBin = 0;                           // the bins any filter weights
+
+    // Magnitudes of a batch, bin-major, and the filter outputs, filter-major
+    std::vector<float> batchSpectra, batchMel;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MelSpectrogram)
+};
+
+} // namespace hifitune
@@ -0,0 +1,227 @@
+/*
+  ==============================================================================
+
+    This file contains the vectorised kernels used to mix rendered audio.
+
+  ==============================================================================
+*/
+
+#include "MixKernels.h"
+
+#if defined (__AVX__)
+ #include <immintrin.h>
+ #define HIFITUNE_MIX_AVX 1
+#elif defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define HIFITUNE_MIX_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define HIFITUNE_MIX_NEON 1
+#endif
+
+namespace hifitune
+{
+
+namespace
+{
+    //==============================================================================
+    // A minimal wrapper over the target's float vector type, using unaligned
+    // loads and stores since the kernels work at arbitrary buffer offsets.
+   #if HIFITUNE_MIX_AVX
+    struct Vec
+    {
+        static constexpr int size = 8;
+        __m256 v;
+
+        static Vec load (const float* p) noexcept           { return { _mm256_loadu_ps (p) }; }
+        static Vec broadcast (float x) noexcept             { return { _mm256_set1_ps (x) }; }
+        static Vec ramp (float start, float step) noexcept
+        {
+            return { _mm256_add_ps (_mm256_set1_ps (start),
+                                    _mm256_mul_ps (_mm256_set1_ps (step), _mm256_setr_ps (0, 1, 2, 3, 4, 5, 6, 7))) };
+        }
+
+        void store (float* p) const noexcept                { _mm256_storeu_ps (p, v); }
+        Vec operator+ (Vec other) const noexcept            { return { _mm256_add_ps (v, other.v) }; }
+        Vec operator- (Vec other) const noexcept            { return { _mm256_sub_ps (v, other.v) }; }
+        Vec operator* (Vec other) const noexcept            { return { _mm256_mul_ps (v, other.v) }; }
+    };
+   #elif HIFITUNE_MIX_SSE
+    struct Vec
+    {
+        static constexpr int size = 4;
+        __m128 v;
+
+        static Vec load (const float* p) noexcept           { return { _mm_loadu_ps (p) }; }
+        static Vec broadcast (float x) noexcept             { return { _mm_set1_ps (x) }; }
+        static Vec ramp (float start, float step) noexcept
+        {
+            return { _mm_add_ps (_mm_set1_ps (start), _mm_mul_ps (_mm_set1_ps (step), _mm_setr_ps (0, 1, 2, 3))) };
+        }
+
+        void store (float* p) const noexcept                { _mm_storeu_ps (p, v); }
+        Vec operator+ (Vec other) const noexcept            { return { _mm_add_ps (v, other.v) }; }
+        Vec operator- (Vec other) const noexcept            { return { _mm_sub_ps (v, other.v) }; }
+        Vec operator* (Vec other) const noexcept            { return { _mm_mul_ps (v, other.v) }; }
+    };
+   #elif HIFITUNE_MIX_NEON
+    struct Vec
+    {
+        static constexpr int size = 4;
+        float32x4_t v;
+
+        static Vec load (const float* p) noexcept           { return { vld1q_f32 (p) }; }
+        static Vec broadcast (float x) noexcept             { return { vdupq_n_f32 (x) }; }
+        static Vec ramp (float start, float step) noexcept
+        {
+            const float offsets[] = { 0.0f, 1.0f, 2.0f, 3.0f };
+            return { vmlaq_n_f32 (vdupq_n_f32 (start), vld1q_f32 (offsets), step) };
+        }
+
+        void store (float* p) const noexcept                { vst1q_f32 (p, v); }
+        Vec operator+ (Vec other) const noexcept            { return { vaddq_f32 (v, other.v) }; }
+        Vec operator- (Vec other) const noexcept            { return { vsubq_f32 (v, other.v) }; }
+        Vec operator* (Vec other) const noexcept            { return { vmulq_f32 (v, other.v) }; }
+    };
+   #endif
+
+    //==============================================================================
+    // Each kernel handles whole vectors first and the remainder with scalar code.
+    // The gain is recomputed from the index rather than accumulated, so long
+    // ramps don't drift.
+    template <bool addToDest>
+    void rampKernel (float* dest, const float* source, int numSamples, float startGain, float step) noexcept
+    {
+        int i = 0;
+
+       #if HIFITUNE_MIX_AVX || HIFITUNE_MIX_SSE || HIFITUNE_MIX_NEON
+        for (; i + Vec::size <= numSamples; i += Vec::size)
+        {
+            auto result = Vec::load (source + i) * Vec::ramp (startGain + step * (float) i, step);
+
+            if constexpr (addToDest)
+                result = result + Vec::load (dest + i);
+
+            result.store (dest + i);
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+        {
+            const auto sample = source[i] * (startGain + step * (float) i);
+
+            if constexpr (addToDest)
+                dest[i] += sample;
+            else
+                dest[i] = sample;
+        }
+    }
+
+    template <bool addToDest>
+    void crossfadeKernel (float* dest, const float* from, const float* to, int numSamples, float startGain, float step) noexcept
+    {
+        int i = 0;
+
+       #if HIFITUNE_MIX_AVX || HIFITUNE_MIX_SSE || HIFITUNE_MIX_NEON
+        for (; i + Vec::size <= numSamples; i += Vec::size)
+        {
+            const auto a = Vec::load (from + i);
+            auto result = a + (Vec::load (to + i) - a) * Vec::ramp (startGain + step * (float) i, step);
+
+            if constexpr (addToDest)
+                result = result + Vec::load (dest + i);
+
+            result.store (dest + i);
+        }
+       #endif
+
+        for (; i < numSamples; ++i)
+        {
+            const auto sample = from[i] + (to[i] - from[i]) * (startGain + step * (float) i);
+
+            if constexpr (addToDest)
+                dest[i] += sample;
+            else
+                dest[i] = sample;
+        }
+    }
+}
+
+//==============================================================================
+void MixKernels::mix (float* dest, const float* source, int numSamples, bool addToDest) noexcept
+{
+    if (addToDest)
+        juce::FloatVectorOperations::add (dest, source, numSamples);
+    else
+        juce::FloatVectorOperations::copy (dest, source, numSamples);
+}
+
+void MixKernels::mixWithRamp (float* dest, const float* source, int numSamples,
+                              float startGain, float endGain, bool addToDest) noexcept
+{
+    if (numSamples <= 0)
+        return;
+
+    if (juce::exactlyEqual (startGain, endGain))
+    {
+        if (addToDest)
+            juce::FloatVectorOperations::addWithMultiply (dest, source, startGain, numSamples);
+        else
+            juce::FloatVectorOperations::multiply (dest, source, startGain, numSamples);
+
+        return;
+    }
+
+    const auto step = (endGain - startGain) / (float) numSamples;
+
+    if (addToDest)
+        rampKernel<true> (dest, source, numSamples, startGain, step);
+    else
+        rampKernel<false> (dest, source, numSamples, startGain, step);
+}
+
+void MixKernels::mixCrossfade (float* dest, const float* from, const float* to, int numSamples,
+                               float startGain, float endGain, bool addToDest) noexcept
+{
+    if (numSamples <= 0)
+        return;
+
+    // With one side silent, a crossfade is just a ramp of the other
+    if (from == nullptr && to == nullptr)
+    {
+        if (! addToDest)
+            juce::FloatVectorOperations::clear (dest, numSamples);
+    }
+    else if (from == nullptr)
+    {
+        mixWithRamp (dest, to, numSamples, startGain, endGain, addToDest);
+    }
+    else if (to == nullptr)
+    {
+        mixWithRamp (dest, from, numSamples, 1.0f - startGain, 1.0f - endGain, addToDest);
+    }
+    else
+    {
+        const auto step = (endGain - startGain) / (float) numSamples;
+
+        if (addToDest)
+            crossfadeKernel<true> (dest, from, to, numSamples, startGain, step);
+        else
+            crossfadeKernel<false> (dest, from, to, numSamples, startGain, step);
+    }
+}
+
+const char* MixKernels::getInstructionSetName() noexcept
+{
+   #if HIFITUNE_MIX_AVX
+    return "AVX";
+   #elif HIFITUNE_MIX_SSE
+    return "SSE2";
+   #elif HIFITUNE_MIX_NEON
+    return "NEON";
+   #else
+    return "scalar";
+   #endif
+}
+
+} // namespace hifitune
@@ -0,0 +1,51 @@
+/*
+  ==============================================================================
+
+    This file contains the vectorised kernels used to mix rendered audio.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Copies or accumulates one channel of rendered audio into an output buffer,
+    optionally under a linear gain ramp or as a crossfade between two signals.
+
+    These are the inner loops of playback, run for every region and channel
+    of every block, so they use SSE, AVX or NEON where the target supports
+    them and plain loops elsewhere.
+
+    Ramps go linearly from startGain at the first sample towards endGain, which
+    would be reached one sample after the last. That way, consecutive calls
+    over adjacent ranges join up seamlessly.
+*/
+struct MixKernels
+{
+    /** dest = source, or dest += source. */
+    static void mix (float* dest, const float* source, int numSamples, bool addToDest) noexcept;
+
+    /** dest = source * gain, or dest += source * gain, with the gain ramping from
+        startGain to endGain.
+    */
+    static void mixWithRamp (float* dest, const float* source, int numSamples,
+                             float startGain, float endGain, bool addToDest) noexcept;
+
+    /** Mixes a linear crossfade from one signal to another: the second signal's
+        gain ramps from startGain to endGain while the first one's does the
+        opposite. Either signal may be nullptr for silence.
+    */
+    static void mixCrossfade (float* dest, const float* from, const float* to, int numSamples,
+                              float startGain, float endGain, bool addToDest) noexcept;
+
+    /** Returns the name of the instruction set the kernels were built for. */
+    static const char* getInstructionSetName() noexcept;
+};
+
+} // namespace hifitune
@@ -0,0 +1,284 @@
+/*
+  ==============================================================================
+
+    This file contains the ONNX Runtime implementation of the vocoder.
+
+  ==============================================================================
+*/
+
+#include "OnnxVocoder.h"
+#include "ContentHash.h"
+
+#if HIFITUNE_USE_ONNXRUNTIME
+
+namespace hifitune
+{
+
+namespace
+{
+    std::basic_string<ORTCHAR_T> toOrtPath (const juce::File& file)
+    {
+       #if JUCE_WINDOWS
+        return file.getFullPathName().toWideCharPointer();
+       #else
+        return file.getFullPathName().toStdString();
+       #endif
+    }
+
+    bool isOrtFormat (const juce::File& file)
+    {
+        return file.hasFileExtension (".ort");
+    }
+}
+
+//==============================================================================
+OnnxVocoder::OnnxVocoder (const juce::File& modelFile, const FeatureConfig& configIn, const InferenceOptions& options)
+    : config (configIn),
+      modelVersion (modelFile.getFileName() + "-" + juce::String::toHexString (modelFile.getSize())
+                      + "-" + juce::String::toHexString (modelFile.getLastModificationTime().toMilliseconds())),
+      env (getSharedEnvironment()),
+      session (createSession (modelFile, options)),
+      memoryInfo (Ort::MemoryInfo::CreateCpu (OrtArenaAllocator, OrtMemTypeDefault))
+{
+    // Exports with a fixed batch of 1 can still be used, one request at a time
+    bool hasDynamicBatch = true;
+
+    for (size_t i = 0; i < session.GetInputCount(); ++i)
+    {
+        const auto shape = session.GetInputTypeInfo (i).GetTensorTypeAndShapeInfo().GetShape();
+        hasDynamicBatch = hasDynamicBatch && ! shape.empty() && shape[0] < 0;
+    }
+
+    maxBatchSize = hasDynamicBatch ? juce::jmax (1, options.maxBatchSize) : 1;
+}
+
+std::shared_ptr<Ort::Env> OnnxVocoder::getSharedEnvironment()
+{
+    static std::mutex mutex;
+    static std::weak_ptr<Ort::Env> shared;
+
+    const std::lock_guard<std::mutex> lock (mutex);
+    auto env = shared.lock();
+
+    if (env == nullptr)
+    {
+        env = std::make_shared<Ort::Env> (ORT_LOGGING_LEVEL_WARNING, "HiFiTune");
+        shared = env;
+    }
+
+    return env;
+}
+
+Ort::SessionOptions OnnxVocoder::createSessionOptions (const InferenceOptions& options)
+{
+    Ort::SessionOptions sessionOptions;
+    sessionOptions.SetIntraOpNumThreads (juce::jmax (1, options.intraOpThreads));
+    sessionOptions.SetInterOpNumThreads (juce::jmax (1, options.interOpThreads));
+    sessionOptions.SetExecutionMode (options.interOpThreads > 1 ? ExecutionMode::ORT_PARALLEL
+                                                                : ExecutionMode::ORT_SEQUENTIAL);
+    return sessionOptions;
+}
+
+juce::File OnnxVocoder::getOptimisedModelFile (const juce::File& modelFile)
+{
+    // Fully optimised graphs use kernels and layouts picked for this CPU and
+    // can only be read by the runtime version that wrote them
+    const auto key = ContentHash().add (modelFile.getFullPathName())
+                                  .add (modelFile.getSize())
+                                  .add (modelFile.getLastModificationTime().toMilliseconds())
+                                  .add (CpuFeatures::get().getDescription())
+                                  .add (juce::String (OrtGetApiBase()->GetVersionString()))
+                                  .get();
+
+    return getModelCacheDirectory().getChildFile (modelFile.getFileNameWithoutExtension()
+                                                    + "-" + juce::String::toHexString ((juce::int64) key) + ".ort");
+}
+
+Ort::Session OnnxVocoder::createSession (const juce::File& modelFile, const InferenceOptions& options)
+{
+    if (isOrtFormat (modelFile))
+        return loadOrtModel (modelFile, options, false);
+
+    const auto optimisedFile = getOptimisedModelFile (modelFile);
+
+    if (optimisedFile.existsAsFile())
+    {
+        try
+        {
+            return loadOrtModel (optimisedFile, options, true);
+        }
+        catch (const Ort::Exception& e)
+        {
+            // Truncated, or otherwise unreadable; make a new one
+            juce::ignoreUnused (e);
+            DBG ("Discarding optimised model: " << e.what());
+            modelMapping.reset();
+            optimisedFile.deleteFile();
+        }
+    }
+
+    auto sessionOptions = createSessionOptions (options);
+    sessionOptions.SetGraphOptimizationLevel (GraphOptimizationLevel::ORT_ENABLE_ALL);
+
+    // Written to a temporary file first, so that other processes loading the
+    // same model never see half of it
+    const juce::TemporaryFile tempFile (optimisedFile);
+    const auto canSave = optimisedFile.getParentDirectory().createDirectory().wasOk();
+
+    if (canSave)
+    {
+        sessionOptions.SetOptimizedModelFilePath (toOrtPath (tempFile.getFile()).c_str());
+        sessionOptions.AddConfigEntry ("session.save_model_format", "ORT");
+    }
+
+    Ort::Session newSession (*env, toOrtPath (modelFile).c_str(), sessionOptions);
+
+    if (canSave && tempFile.getFile().existsAsFile())
+        tempFile.overwriteTargetFileWithTemporary();
+
+    return newSession;
+}
+
+Ort::Session OnnxVocoder::loadOrtModel (const juce::File& modelFile, const InferenceOptions& options, bool isOptimised)
+{
+    auto sessionOptions = createSessionOptions (options);
+
+    // Optimising again would only repeat what was done before saving
+    if (isOptimised)
+        sessionOptions.SetGraphOptimizationLevel (GraphOptimizationLevel::ORT_DISABLE_ALL);
+
+    modelMapping = std::make_unique<juce::MemoryMappedFile> (modelFile, juce::MemoryMappedFile::readOnly);
+
+    // Mapping can fail, e.g. on some network drives; loading from the path still works
+    if (modelMapping->getData() == nullptr)
+    {
+        modelMapping.reset();
+        return Ort::Session (*env, toOrtPath (modelFile).c_str(), sessionOptions);
+    }
+
+    // Keep pointing into the mapping instead of copying the graph and weights
+    sessionOptions.AddConfigEntry ("session.use_ort_model_bytes_directly", "1");
+    sessionOptions.AddConfigEntry ("session.use_ort_model_bytes_for_initializers", "1");
+
+    return Ort::Session (*env, modelMapping->getData(), modelMapping->getSize(), sessionOptions);
+}
+
+//==============================================================================
+bool OnnxVocoder::render (const float* mel, const float* f0, int numFrames, float* output)
+{
+    const auto numExpected = (size_t) numFrames * (size_t) config.hopSize;
+
+    return run (mel, f0, 1, numFrames, [&] (const float* waveform, size_t numProduced)
+    {
+        std::copy (waveform, waveform + juce::jmin (numExpected, numProduced), output);
+        std::fill (output + juce::jmin (numExpected, numProduced), output + numExpected, 0.0f);
+    });
+}
+
+void OnnxVocoder::renderBatch (Request* requests, int numRequests)
+{
+    if (numRequests <= 1 || maxBatchSize <= 1)
+    {
+        Vocoder::renderBatch (requests, numRequests);
+        return;
+    }
+
+    jassert (numRequests <= maxBatchSize);
+
+    // Requests are only combined if they're the same length. Padding the shorter
+    // ones would change their audio near the end, depending on what they happen
+    // to be batched with. The InferenceScheduler only batches equal lengths.
+    const auto numFrames = requests[0].numFrames;
+
+    for (int i = 1; i < numRequests; ++i)
+    {
+        if (requests[i].numFrames != numFrames)
+        {
+            Vocoder::renderBatch (requests, numRequests);
+            return;
+        }
+    }
+
+    // The input tensors are kept between calls, as batches tend to be the same
+    // size. A batch run alongside on another inference thread uses its own.
+    const juce::ScopedTryLock sl (batchLock);
+    std::vector<float> ownMel, ownF0;
+
+    const auto numBins = (size_t) config.numMelBins;
+    auto& mel = sl.isLocked() ? batchMel : ownMel;
+    auto& f0 = sl.isLocked() ? batchF0 : ownF0;
+    mel.resize ((size_t) numRequests * (size_t) numFrames * numBins);
+    f0.resize ((size_t) numRequests * (size_t) numFrames);
+
+    for (int i = 0; i < numRequests; ++i)
+    {
+        const auto& request = requests[i];
+        const auto row = (size_t) i * (size_t) numFrames;
+
+        std::copy (request.mel, request.mel + (size_t) request.numFrames * numBins, mel.data() + row * numBins);
+        std::copy (request.f0, request.f0 + request.numFrames, f0.data() + row);
+    }
+
+    const auto rowLength = (size_t) numFrames * (size_t) config.hopSize;
+
+    const auto ok = run (mel.data(), f0.data(), numRequests, numFrames, [&] (const float* waveform, size_t numProduced)
+    {
+        for (int i = 0; i < numRequests; ++i)
+        {
+            const auto& request = requests[i];
+            const auto rowStart = (size_t) i * rowLength;
+            const auto numExpected = (size_t) request.numFrames * (size_t) config.hopSize;
+            const auto numAvailable = juce::jmin (numExpected, numProduced - juce::jmin (numProduced, rowStart));
+
+            std::copy (waveform + rowStart, waveform + rowStart + numAvailable, request.output);
+            std::fill (request.output + numAvailable, request.output + numExpected, 0.0f);
+        }
+    });
+
+    for (int i = 0; i < numRequests; ++i)
+        requests[i].succeeded = ok;
+}
+
+bool OnnxVocoder::run (const float* mel, const float* f0, int batchSize, int numFrames,
+                       const std::function<void (const float*, size_t)>& consumeOutput)
+{
+    const std::array<int64_t, 3> melShape { batchSize, numFrames, config.numMelBins };
+    const std::array<int64_t, 2> f0Shape { batchSize, numFrames };
+    const auto numFrameValues = (size_t) batchSize * (size_t) numFrames;
+
+    const char* inputNames[]  { "mel", "f0" };
+    const char* outputNames[] { "waveform" };
+
+    // Creating the inputs throws too, e.g. on a shape mismatch, and nothing may
+    // escape to the calling render or inference thread
+    try
+    {
+        // ORT only reads from input tensors, the const_casts are needed by its C API
+        std::array<Ort::Value, 2> inputs
+        {
+            Ort::Value::CreateTensor<float> (memoryInfo, const_cast<float*> (mel),
+                                             numFrameValues * (size_t) config.numMelBins,
+                                             melShape.data(), melShape.size()),
+            Ort::Value::CreateTensor<float> (memoryInfo, const_cast<float*> (f0), numFrameValues,
+                                             f0Shape.data(), f0Shape.size())
+        };
+
+        auto outputs = session.Run (Ort::RunOptions { nullptr },
+                                    inputNames, inputs.data(), inputs.size(),
+                                    outputNames, 1);
+
+        consumeOutput (outputs[0].GetTensorData<float>(),
+                       outputs[0].GetTensorTypeAndShapeInfo().GetElementCount());
+        return true;
+    }
+    catch (const Ort::Exception& e)
+    {
+        juce::ignoreUnused (e);
+        DBG ("Vocoder inference failed: " << e.what());
+        return false;
+    }
+}
+
+} // namespace hifitune
+
+#endif
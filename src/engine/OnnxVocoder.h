@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    This file contains the ONNX Runtime implementation of the vocoder.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Vocoder.h"
+
+#if HIFITUNE_USE_ONNXRUNTIME
+
+#include <onnxruntime_cxx_api.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Runs an exported NSF-HiFiGAN model, with inputs "mel" [batch, frames, bins]
+    and "f0" [batch, frames] and output "waveform" [batch, frames * hop].
+
+    Batches are only combined if the model was exported with a dynamic batch
+    dimension, and only for requests of the same length, which need no padding
+    and so render the same as they would alone. All instances share one
+    Ort::Env, which lives as long as any of them.
+
+    Models converted to ORT format (.ort) are memory-mapped and used straight
+    from the mapping, weights included, so their pages are shared with every
+    other process that maps the same file and can be dropped by the OS under
+    memory pressure. ONNX exports are fully graph-optimised for this CPU the
+    first time they're loaded, and the result is saved in ORT format to the
+    model cache directory, so later loads skip the optimisation and get the
+    same benefits.
+*/
+class OnnxVocoder  : public Vocoder
+{
+public:
+    //==============================================================================
+    OnnxVocoder (const juce::File& modelFile, const FeatureConfig&, const InferenceOptions& = {});
+
+    juce::String getModelVersion() const override       { return modelVersion; }
+    bool render (const float* mel, const float* f0, int numFrames, float* output) override;
+
+    int getMaxBatchSize() const override                { return maxBatchSize; }
+    void renderBatch (Request* requests, int numRequests) override;
+
+private:
+    //==============================================================================
+    static std::shared_ptr<Ort::Env> getSharedEnvironment();
+    static Ort::SessionOptions createSessionOptions (const InferenceOptions&);
+    static juce::File getOptimisedModelFile (const juce::File& modelFile);
+    Ort::Session createSession (const juce::File& modelFile, const InferenceOptions&);
+    Ort::Session loadOrtModel (const juce::File& modelFile, const InferenceOptions&, bool isOptimised);
+
+    bool run (const float* mel, const float* f0, int batchSize, int numFrames,
+              const std::function<void (const float* waveform, size_t numProduced)>& consumeOutput);
+
+    FeatureConfig config;
+    juce::String modelVersion;
+
+    std::shared_ptr<Ort::Env> env;
+    std::unique_ptr<juce::MemoryMappedFile> modelMapping;     // must outlive the session
+    Ort::Session session;
+    Ort::MemoryInfo memoryInfo;
+    int maxBatchSize = 1;
+
+    // Batch inputs, reused by every renderBatch() call
+    std::vector<float> batchMel, batchF0;
+    juce::CriticalSection batchLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OnnxVocoder)
+};
+
+} // namespace hifitune
+
+#endif
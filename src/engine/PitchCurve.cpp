@@ -0,0 +1,432 @@
+/*
+  ==============================================================================
+
+    This file contains the pitch edit curve applied to an audio modification.
+
+  ==============================================================================
+*/
+
+#include "PitchCurve.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // A walk through the points that would pass more than this many of them
+    // binary-searches instead
+    constexpr int maxLinearSteps = 16;
+
+    // Values sampled per call when shifting F0, kept on the stack
+    constexpr int sampleChunkSize = 256;
+}
+
+//==============================================================================
+void PitchCurve::Summary::add (const Summary& other) noexcept
+{
+    minValue = juce::jmin (minValue, other.minValue);
+    maxValue = juce::jmax (maxValue, other.maxValue);
+    hasPhraseEnd = hasPhraseEnd || other.hasPhraseEnd;
+}
+
+//==============================================================================
+juce::uint64 PitchCurve::getNextId() noexcept
+{
+    static std::atomic<juce::uint64> nextId { 1 };
+    return nextId++;
+}
+
+PitchCurve::PitchCurve (Points points)
+    : arena (points.get_allocator().getArena())
+{
+    std::stable_sort (points.begin(), points.end(),
+                      [] (const Point& a, const Point& b) { return a.time < b.time; });
+
+    packBlocks (points.data(), points.size(), blocks);
+    buildIndex();
+}
+
+PitchCurve::PitchCurve (std::vector<BlockPtr> blocksIn, std::shared_ptr<DocumentArena> arenaIn)
+    : arena (std::move (arenaIn)), blocks (std::move (blocksIn))
+{
+    buildIndex();
+}
+
+std::shared_ptr<const PitchCurve> PitchCurve::create (Points points)
+{
+    const ArenaAllocator<PitchCurve> allocator (points.get_allocator());
+    return std::allocate_shared<PitchCurve> (allocator, std::move (points));
+}
+
+void PitchCurve::packBlocks (const Point* points, size_t num, std::vector<BlockPtr>& destBlocks) const
+{
+    for (size_t start = 0; start < num; start += (size_t) Block::capacity)
+    {
+        auto block = std::allocate_shared<Block> (ArenaAllocator<Block> (arena));
+        block->numPoints = (int) juce::jmin ((size_t) Block::capacity, num - start);
+
+        for (int i = 0; i < block->numPoints; ++i)
+        {
+            const auto& point = points[start + (size_t) i];
+            block->times[i] = point.time;
+            block->values[i] = point.semitones;
+            block->flags[i] = point.flags;
+        }
+
+        destBlocks.push_back (std::move (block));
+    }
+}
+
+void PitchCurve::buildIndex()
+{
+    blockStartTimes.clear();
+    blockOffsets.clear();
+    numPoints = 0;
+
+    for (const auto& block : blocks)
+    {
+        jassert (block->numPoints > 0);
+
+        blockStartTimes.push_back (block->times[0]);
+        blockOffsets.push_back (numPoints);
+        numPoints += block->numPoints;
+    }
+
+    treeSize = juce::nextPowerOfTwo (juce::jmax (1, (int) blocks.size()));
+    tree.assign ((size_t) treeSize * 2, {});
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+        tree[(size_t) treeSize + i] = summariseRun (*blocks[i], 0, blocks[i]->numPoints);
+
+    for (auto node = treeSize - 1; node > 0; --node)
+    {
+        tree[(size_t) node] = tree[(size_t) node * 2];
+        tree[(size_t) node].add (tree[(size_t) node * 2 + 1]);
+    }
+}
+
+//==============================================================================
+PitchCurve::Point PitchCurve::getPoint (int index) const noexcept
+{
+    jassert (juce::isPositiveAndBelow (index, numPoints));
+
+    const auto blockIndex = getBlockIndexFor (index);
+    const auto& block = *blocks[(size_t) blockIndex];
+    const auto i = index - blockOffsets[(size_t) blockIndex];
+
+    return { block.times[i], block.values[i], block.flags[i] };
+}
+
+juce::Range<double> PitchCurve::getTimeRange() const noexcept
+{
+    if (isEmpty())
+        return {};
+
+    const auto& last = *blocks.back();
+    return { blocks.front()->times[0], last.times[last.numPoints - 1] };
+}
+
+juce::Range<int> PitchCurve::getPointsIn (juce::Range<double> timeRange) const noexcept
+{
+    // The first point in the block before the first block that bound finds,
+    // or else that block's first point
+    const auto findFirst = [this] (double time, auto&& bound) noexcept
+    {
+        const auto nextBlock = (int) (bound (blockStartTimes.data(), blockStartTimes.data() + blockStartTimes.size(), time)
+                                        - blockStartTimes.data());
+
+        if (nextBlock > 0)
+        {
+            const auto& block = *blocks[(size_t) nextBlock - 1];
+            const auto* found = bound (block.times, block.times + block.numPoints, time);
+
+            if (found != block.times + block.numPoints)
+                return blockOffsets[(size_t) nextBlock - 1] + (int) (found - block.times);
+        }
+
+        return nextBlock < (int) blocks.size() ? blockOffsets[(size_t) nextBlock] : numPoints;
+    };
+
+    const auto lowerBound = [] (const double* begin, const double* end, double time) { return std::lower_bound (begin, end, time); };
+    const auto upperBound = [] (const double* begin, const double* end, double time) { return std::upper_bound (begin, end, time); };
+
+    return { findFirst (timeRange.getStart(), lowerBound), findFirst (timeRange.getEnd(), upperBound) };
+}
+
+//==============================================================================
+int PitchCurve::getBlockIndexFor (int pointIndex) const noexcept
+{
+    const auto it = std::upper_bound (blockOffsets.begin(), blockOffsets.end(), pointIndex);
+    return juce::jmax (0, (int) (it - blockOffsets.begin()) - 1);
+}
+
+PitchCurve::Position PitchCurve::getLastPositionAtOrBefore (double time) const noexcept
+{
+    jassert (! isEmpty() && time >= blockStartTimes.front());
+
+    const auto blockIndex = juce::jmax (0, (int) (std::upper_bound (blockStartTimes.begin(), blockStartTimes.end(), time)
+                                                    - blockStartTimes.begin()) - 1);
+    const auto& block = *blocks[(size_t) blockIndex];
+    const auto* next = std::upper_bound (block.times, block.times + block.numPoints, time);
+
+    return { blockIndex, juce::jmax (0, (int) (next - block.times) - 1) };
+}
+
+bool PitchCurve::getNextPosition (Position& position) const noexcept
+{
+    if (position.index + 1 < blocks[(size_t) position.block]->numPoints)
+    {
+        ++position.index;
+        return true;
+    }
+
+    if (position.block + 1 < (int) blocks.size())
+    {
+        position = { position.block + 1, 0 };
+        return true;
+    }
+
+    return false;
+}
+
+float PitchCurve::getValueAfter (Position position, double time) const noexcept
+{
+    const auto& block = *blocks[(size_t) position.block];
+    const auto startTime = block.times[position.index];
+    const auto startValue = block.values[position.index];
+    const auto flags = block.flags[position.index];
+
+    auto next = position;
+
+    if (time <= startTime)
+        return startValue;
+
+    if (! getNextPosition (next) || (flags & phraseEnd) != 0)
+        return 0.0f;
+
+    if ((flags & hold) != 0)
+        return startValue;
+
+    const auto& nextBlock = *blocks[(size_t) next.block];
+    const auto endTime = nextBlock.times[next.index];
+    const auto endValue = nextBlock.values[next.index];
+    const auto span = endTime - startTime;
+
+    if (span <= 0.0)
+        return endValue;
+
+    return startValue + (endValue - startValue) * (float) ((time - startTime) / span);
+}
+
+//==============================================================================
+float PitchCurve::getSemitonesAt (double time) const noexcept
+{
+    if (isEmpty() || time < blockStartTimes.front() || time > getTimeRange().getEnd())
+        return 0.0f;
+
+    return getValueAfter (getLastPositionAtOrBefore (time), time);
+}
+
+void PitchCurve::sample (float* dest, int numValues, double firstTime, double interval) const noexcept
+{
+    jassert (interval > 0.0);
+
+    if (isEmpty())
+    {
+        std::fill (dest, dest + numValues, 0.0f);
+        return;
+    }
+
+    const auto timeRange = getTimeRange();
+    Position position;
+    bool hasPosition = false;
+
+    for (int i = 0; i < numValues; ++i)
+    {
+        const auto time = firstTime + i * interval;
+
+        if (time < timeRange.getStart() || time > timeRange.getEnd())
+        {
+            dest[i] = 0.0f;
+            continue;
+        }
+
+        // Step along while the points are close together, search when they aren't
+        auto isFound = false;
+
+        for (int step = 0; hasPosition && step < maxLinearSteps; ++step)
+        {
+            auto next = position;
+
+            if (! getNextPosition (next) || blocks[(size_t) next.block]->times[next.index] > time)
+            {
+                isFound = true;
+                break;
+            }
+
+            position = next;
+        }
+
+        if (! isFound)
+            position = getLastPositionAtOrBefore (time);
+
+        hasPosition = true;
+        dest[i] = getValueAfter (position, time);
+    }
+}
+
+juce::Range<float> PitchCurve::getMinMax (juce::Range<double> timeRange) const noexcept
+{
+    if (isEmpty())
+        return {};
+
+    const auto startValue = getSemitonesAt (timeRange.getStart());
+    const auto endValue = getSemitonesAt (timeRange.getEnd());
+
+    Summary summary;
+    summary.minValue = juce::jmin (startValue, endValue);
+    summary.maxValue = juce::jmax (startValue, endValue);
+
+    const auto inside = getPointsIn (timeRange);
+
+    if (! inside.isEmpty())
+    {
+        const auto pointsSummary = summarise (inside.getStart(), inside.getEnd());
+        summary.minValue = juce::jmin (summary.minValue, pointsSummary.minValue);
+        summary.maxValue = juce::jmax (summary.maxValue, pointsSummary.maxValue);
+
+        // A phrase break after the last point inside reaches past the range,
+        // where endValue already accounts for it
+        if (pointsSummary.hasPhraseEnd && summarise (inside.getStart(), inside.getEnd() - 1).hasPhraseEnd)
+        {
+            summary.minValue = juce::jmin (summary.minValue, 0.0f);
+            summary.maxValue = juce::jmax (summary.maxValue, 0.0f);
+        }
+    }
+
+    return { summary.minValue, summary.maxValue };
+}
+
+void PitchCurve::applyToF0 (float* f0, int numFrames, double firstFrameTime, double frameDuration) const noexcept
+{
+    if (isEmpty())
+        return;
+
+    float semitones[sampleChunkSize];
+
+    for (int start = 0; start < numFrames; start += sampleChunkSize)
+    {
+        const auto num = juce::jmin (sampleChunkSize, numFrames - start);
+        sample (semitones, num, firstFrameTime + start * frameDuration, frameDuration);
+
+        for (int i = 0; i < num; ++i)
+            if (f0[start + i] > 0.0f && ! juce::exactlyEqual (semitones[i], 0.0f))
+                f0[start + i] *= std::exp2 (semitones[i] / 12.0f);
+    }
+}
+
+//==============================================================================
+PitchCurve::Summary PitchCurve::summarise (int firstPoint, int lastPoint) const noexcept
+{
+    Summary summary;
+
+    if (firstPoint >= lastPoint)
+        return summary;
+
+    const auto firstBlock = getBlockIndexFor (firstPoint);
+    const auto lastBlock = getBlockIndexFor (lastPoint - 1);
+    const auto firstOffset = blockOffsets[(size_t) firstBlock];
+    const auto lastOffset = blockOffsets[(size_t) lastBlock];
+
+    if (firstBlock == lastBlock)
+        return summariseRun (*blocks[(size_t) firstBlock], firstPoint - firstOffset, lastPoint - firstOffset);
+
+    summary.add (summariseRun (*blocks[(size_t) firstBlock], firstPoint - firstOffset, blocks[(size_t) firstBlock]->numPoints));
+    summary.add (summariseRun (*blocks[(size_t) lastBlock], 0, lastPoint - lastOffset));
+
+    // The whole blocks in between, from the tree
+    for (auto left = firstBlock + 1 + treeSize, right = lastBlock + treeSize; left < right; left >>= 1, right >>= 1)
+    {
+        if ((left & 1) != 0)
+            summary.add (tree[(size_t) left++]);
+
+        if ((right & 1) != 0)
+            summary.add (tree[(size_t) --right]);
+    }
+
+    return summary;
+}
+
+PitchCurve::Summary PitchCurve::summariseRun (const Block& block, int start, int end) noexcept
+{
+    Summary summary;
+
+    if (start >= end)
+        return summary;
+
+    const auto range = juce::FloatVectorOperations::findMinAndMax (block.values + start, end - start);
+    summary.minValue = range.getStart();
+    summary.maxValue = range.getEnd();
+    summary.hasPhraseEnd = std::any_of (block.flags + start, block.flags + end,
+                                        [] (juce::uint8 flags) { return (flags & phraseEnd) != 0; });
+    return summary;
+}
+
+//==============================================================================
+std::shared_ptr<const PitchCurve> PitchCurve::withPointsReplaced (juce::Range<double> timeRange, const std::vector<Point>& newPoints) const
+{
+    jassert (std::is_sorted (newPoints.begin(), newPoints.end(), [] (const Point& a, const Point& b) { return a.time < b.time; }));
+    jassert (newPoints.empty() || (newPoints.front().time >= timeRange.getStart() && newPoints.back().time <= timeRange.getEnd()));
+
+    const auto removed = getPointsIn (timeRange);
+    std::vector<BlockPtr> newBlocks;
+    std::vector<Point> gathered;
+
+    if (isEmpty())
+    {
+        gathered = newPoints;
+        packBlocks (gathered.data(), gathered.size(), newBlocks);
+    }
+    else
+    {
+        // Only the blocks holding the removed points, or the one the new points
+        // go into, are rebuilt
+        const auto first = juce::jmin (removed.getStart(), numPoints - 1);
+        const auto last = juce::jmin (juce::jmax (removed.getStart(), removed.getEnd() - 1), numPoints - 1);
+        const auto firstBlock = getBlockIndexFor (first);
+        auto lastBlock = getBlockIndexFor (last);
+
+        const auto& head = *blocks[(size_t) firstBlock];
+        const auto headEnd = juce::jmin (head.numPoints, removed.getStart() - blockOffsets[(size_t) firstBlock]);
+
+        for (int i = 0; i < headEnd; ++i)
+            gathered.push_back ({ head.times[i], head.values[i], head.flags[i] });
+
+        gathered.insert (gathered.end(), newPoints.begin(), newPoints.end());
+
+        auto appendBlock = [&] (const Block& block, int start)
+        {
+            for (int i = start; i < block.numPoints; ++i)
+                gathered.push_back ({ block.times[i], block.values[i], block.flags[i] });
+        };
+
+        appendBlock (*blocks[(size_t) lastBlock], removed.getEnd() - blockOffsets[(size_t) lastBlock]);
+
+        // Fold a small remainder into the following block rather than leave
+        // ever smaller blocks behind repeated edits
+        const auto remainder = (int) gathered.size() % Block::capacity;
+
+        if (remainder != 0 && remainder < Block::capacity / 2 && lastBlock + 1 < (int) blocks.size())
+            appendBlock (*blocks[(size_t) ++lastBlock], 0);
+
+        newBlocks.reserve (blocks.size() + gathered.size() / (size_t) Block::capacity + 1);
+        newBlocks.insert (newBlocks.end(), blocks.begin(), blocks.begin() + firstBlock);
+        packBlocks (gathered.data(), gathered.size(), newBlocks);
+        newBlocks.insert (newBlocks.end(), blocks.begin() + lastBlock + 1, blocks.end());
+    }
+
+    PitchCurve edited (std::move (newBlocks), arena);
+    return std::allocate_shared<PitchCurve> (ArenaAllocator<PitchCurve> (arena), std::move (edited));
+}
+
+} // namespace hifitune
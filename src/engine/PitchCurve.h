@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    This file contains the pitch edit curve applied to an audio modification.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "DocumentArena.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    A pitch offset, in semitones, over modification time.
+
+    Between points the offset is interpolated linearly, unless the earlier
+    point holds its value or ends a phrase; before the first and after the
+    last point it is zero, as it is within a phrase break, so an edit only
+    affects the spans it covers.
+
+    Points are stored in blocks of up to Block::capacity, each with contiguous
+    time, value and flag columns, so that lookups, drawing and rendering walk
+    through memory in order. A summary tree over the blocks answers range
+    minimum and maximum queries in O(log n), and finding the points in a time
+    range is a binary search.
+
+    Instances are immutable, and shared between the editor and the renderers.
+    Edits make a new curve with withPointsReplaced(), which shares every block
+    the edit didn't touch with the old one, so even a long take with dense
+    automation is cheap to edit. Use create() to keep a curve and its blocks in
+    a document's arena.
+*/
+class PitchCurve
+{
+public:
+    //==============================================================================
+    enum Flags : juce::uint8
+    {
+        hold        = 1 << 0,   // keep this point's value until the next point
+        phraseEnd   = 1 << 1    // the offset returns to zero until the next point
+    };
+
+    struct Point
+    {
+        double time;        // seconds from the start of the audio modification
+        float semitones;
+        juce::uint8 flags = 0;
+    };
+
+    using Points = std::vector<Point, ArenaAllocator<Point>>;
+
+    /** A run of points, stored column by column. */
+    struct Block
+    {
+        static constexpr int capacity = 128;
+
+        double times[capacity];
+        float values[capacity];
+        juce::uint8 flags[capacity];
+        int numPoints = 0;
+    };
+
+    PitchCurve() = default;
+    explicit PitchCurve (Points points);
+
+    /** Creates a shared curve whose object and blocks both live in the arena, or
+        on the heap if the arena is null.
+    */
+    static std::shared_ptr<const PitchCurve> create (Points points);
+
+    //==============================================================================
+    /** Returns a number no other curve made in this process has, so that
+        renderers can tell curves apart without comparing their points.
+    */
+    juce::uint64 getId() const noexcept                     { return id; }
+
+    bool isEmpty() const noexcept                           { return numPoints == 0; }
+    int getNumPoints() const noexcept                       { return numPoints; }
+    Point getPoint (int index) const noexcept;
+
+    /** Returns the time from the first point to the last. */
+    juce::Range<double> getTimeRange() const noexcept;
+
+    /** Returns the indices of the points inside a time range, ends included. */
+    juce::Range<int> getPointsIn (juce::Range<double> timeRange) const noexcept;
+
+    /** Calls callback (const double* times, const float* values, const juce::uint8* flags, int num)
+        for each run of contiguous points among the given indices, in order.
+    */
+    template <typename Callback>
+    void forEachRun (juce::Range<int> indices, Callback&& callback) const
+    {
+        indices = indices.getIntersectionWith ({ 0, numPoints });
+
+        for (auto index = indices.getStart(); index < indices.getEnd();)
+        {
+            const auto blockIndex = getBlockIndexFor (index);
+            const auto& block = *blocks[(size_t) blockIndex];
+            const auto start = index - blockOffsets[(size_t) blockIndex];
+            const auto num = juce::jmin (block.numPoints - start, indices.getEnd() - index);
+
+            callback (block.times + start, block.values + start, block.flags + start, num);
+            index += num;
+        }
+    }
+
+    //==============================================================================
+    /** Returns the offset at a given time. */
+    float getSemitonesAt (double time) const noexcept;
+
+    /** Writes the offset at firstTime + i * interval for i in [0, numValues),
+        walking through the points once.
+    */
+    void sample (float* dest, int numValues, double firstTime, double interval) const noexcept;
+
+    /** Returns the lowest and highest offset anywhere in a time range, e.g. to
+        draw a whole stretch of the curve in one pixel column.
+    */
+    juce::Range<float> getMinMax (juce::Range<double> timeRange) const noexcept;
+
+    /** Shifts an F0 curve sampled at frames firstFrameTime + i * frameDuration.
+        Unvoiced frames (F0 of zero) are left alone.
+    */
+    void applyToF0 (float* f0, int numFrames, double firstFrameTime, double frameDuration) const noexcept;
+
+    //==============================================================================
+    /** Returns a copy of this curve with the points inside a time range, ends
+        included, replaced by others, which should lie inside the same range.
+        Blocks outside the edit are shared with this curve. The new blocks come
+        from the same arena as this curve's.
+    */
+    std::shared_ptr<const PitchCurve> withPointsReplaced (juce::Range<double> timeRange, const std::vector<Point>& newPoints) const;
+
+private:
+    //==============================================================================
+    using BlockPtr = std::shared_ptr<const Block>;
+
+    struct Summary
+    {
+        float minValue = std::numeric_limits<float>::max();
+        float maxValue = std::numeric_limits<float>::lowest();
+        bool hasPhraseEnd = false;
+
+        void add (const Summary&) noexcept;
+    };
+
+    /** Where a point sits: the block holding it and its index in the block. */
+    struct Position
+    {
+        int block = 0, index = 0;
+    };
+
+    PitchCurve (std::vector<BlockPtr>, std::shared_ptr<DocumentArena>);
+
+    void packBlocks (const Point* points, size_t numPoints, std::vector<BlockPtr>& destBlocks) const;
+    void buildIndex();
+
+    int getBlockIndexFor (int pointIndex) const noexcept;
+    Position getLastPositionAtOrBefore (double time) const noexcept;
+    bool getNextPosition (Position&) const noexcept;
+    float getValueAfter (Position, double time) const noexcept;
+
+    Summary summarise (int firstPoint, int lastPoint) const noexcept;
+    static Summary summariseRun (const Block&, int start, int end) noexcept;
+    static juce::uint64 getNextId() noexcept;
+
+    juce::uint64 id = getNextId();
+    std::shared_ptr<DocumentArena> arena;
+    std::vector<BlockPtr> blocks;
+    std::vector<double> blockStartTimes;
+    std::vector<int> blockOffsets;      // index of each block's first point
+    std::vector<Summary> tree;          // over the blocks, leaves from treeSize
+    int treeSize = 0, numPoints = 0;
+
+    JUCE_LEAK_DETECTOR (PitchCurve)
+};
+
+} // namespace hifitune
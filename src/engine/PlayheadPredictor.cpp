@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    This file contains the playhead tracking used to decide what to render next.
+
+  ==============================================================================
+*/
+
+#include "PlayheadPredictor.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // How much each block's measured speed contributes to the smoothed value
+    constexpr float speedSmoothing = 0.2f;
+
+    // Speeds beyond this (fast-forward, scrubbing) don't widen the window any more
+    constexpr float maxSpeedScale = 4.0f;
+}
+
+//==============================================================================
+PlayheadPredictor::PlayheadPredictor (juce::int64 lookAheadSamples)
+    : lookAhead (juce::jmax ((juce::int64) 1, lookAheadSamples))
+{
+    for (auto& seek : recentSeeks)
+        seek = -1;
+}
+
+void PlayheadPredictor::update (juce::int64 newPosition, int numSamples, bool isPlayingNow,
+                                juce::Range<juce::int64> loopRange) noexcept
+{
+    const auto isLooping = ! loopRange.isEmpty();
+
+    if (hasUpdated)
+    {
+        const auto expected = lastPosition + (wasPlaying ? lastNumSamples : 0);
+        const auto tolerance = (juce::int64) juce::jmax (lastNumSamples, numSamples);
+        const auto wrappedAroundLoop = isLooping && wasPlaying
+                                        && expected >= loopRange.getEnd() - tolerance
+                                        && std::abs (newPosition - loopRange.getStart()) <= tolerance;
+
+        if (std::abs (newPosition - expected) > tolerance && ! wrappedAroundLoop)
+        {
+            recordSeek (newPosition);
+        }
+        else if (isPlayingNow && wasPlaying && lastNumSamples > 0 && ! wrappedAroundLoop)
+        {
+            const auto measured = (float) (newPosition - lastPosition) / (float) lastNumSamples;
+            speed = speed.load() + speedSmoothing * (measured - speed.load());
+        }
+    }
+
+    if (isPlayingNow && ! wasPlaying)
+        speed = 1.0f;
+    else if (! isPlayingNow)
+        speed = 0.0f;
+
+    lastPosition = newPosition;
+    lastNumSamples = numSamples;
+    wasPlaying = isPlayingNow;
+    hasUpdated = true;
+
+    loopStart = isLooping ? loopRange.getStart() : 0;
+    loopEnd = isLooping ? loopRange.getEnd() : 0;
+    playing = isPlayingNow;
+    position = newPosition;
+}
+
+void PlayheadPredictor::recordSeek (juce::int64 target) noexcept
+{
+    // Going back to a recent target doesn't add it again
+    for (const auto& seek : recentSeeks)
+        if (seek.load() == target)
+            return;
+
+    const auto index = numSeeks.load();
+    recentSeeks[(size_t) (index % numRecentSeeks)] = target;
+    numSeeks = index + 1;
+}
+
+//==============================================================================
+int PlayheadPredictor::getWindows (Windows& windows) const noexcept
+{
+    const auto current = position.load();
+    const auto baseLookAhead = lookAhead.load();
+    const auto speedScale = playing.load() ? juce::jlimit (1.0f, maxSpeedScale, speed.load()) : 1.0f;
+    const auto horizon = (juce::int64) ((float) baseLookAhead * speedScale);
+    const juce::Range<juce::int64> loop { loopStart.load(), loopEnd.load() };
+
+    int numWindows = 0;
+
+    auto addWindow = [&] (juce::Range<juce::int64> range, juce::int64 distance)
+    {
+        if (! range.isEmpty() && numWindows < maxWindows)
+            windows[(size_t) numWindows++] = { range, distance };
+    };
+
+    if (! loop.isEmpty() && loop.contains (current))
+    {
+        // Playback wraps around at the loop end, so continue from the loop start
+        const auto untilWrap = loop.getEnd() - current;
+        addWindow ({ current, juce::jmin (loop.getEnd(), current + horizon) }, 0);
+
+        if (horizon > untilWrap)
+            addWindow ({ loop.getStart(), loop.getStart() + juce::jmin (horizon - untilWrap, loop.getLength()) }, untilWrap);
+    }
+    else
+    {
+        addWindow ({ current, current + horizon }, 0);
+    }
+
+    // Recent locate targets come after everything the playhead is about to reach,
+    // most recent first
+    const auto count = numSeeks.load();
+
+    for (int i = 1; i <= juce::jmin (count, numRecentSeeks); ++i)
+    {
+        const auto target = recentSeeks[(size_t) ((count - i) % numRecentSeeks)].load();
+
+        if (target >= 0 && ! windows[0].range.contains (target))
+            addWindow ({ target, target + baseLookAhead / 2 }, horizon + (juce::int64) i * baseLookAhead);
+    }
+
+    return numWindows;
+}
+
+} // namespace hifitune
@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    This file contains the playhead tracking used to decide what to render next.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Follows the host's playhead from the audio thread and predicts which parts
+    of the song will be heard next, so that render workers can have them ready.
+
+    Besides the stretch ahead of the playhead, scaled by the playback speed,
+    this covers the start of the loop when playback is about to wrap around,
+    and the last few places the user located to, since tweak-and-listen
+    sessions keep going back to them.
+
+    update() is realtime-safe and must only be called from one thread at a
+    time; everything else can be called from any thread.
+*/
+class PlayheadPredictor
+{
+public:
+    //==============================================================================
+    /** A stretch of song time worth rendering. */
+    struct Window
+    {
+        juce::Range<juce::int64> range;     // song samples
+        juce::int64 distance;               // how soon range.getStart() will be heard, in samples
+    };
+
+    static constexpr int numRecentSeeks = 4;
+    static constexpr int maxWindows = 2 + numRecentSeeks;
+    using Windows = std::array<Window, maxWindows>;
+
+    explicit PlayheadPredictor (juce::int64 lookAheadSamples = 0);
+
+    /** Sets how far ahead of the playhead to render at normal speed. */
+    void setLookAhead (juce::int64 numSamples) noexcept     { lookAhead = juce::jmax ((juce::int64) 1, numSamples); }
+    juce::int64 getLookAhead() const noexcept               { return lookAhead.load(); }
+
+    //==============================================================================
+    /** Tells the predictor where the block about to be rendered starts. Pass an
+        empty loop range if the host isn't looping.
+    */
+    void update (juce::int64 position, int numSamples, bool isPlaying, juce::Range<juce::int64> loopRange) noexcept;
+
+    juce::int64 getPosition() const noexcept                { return position.load(); }
+    bool isPlaying() const noexcept                         { return playing.load(); }
+
+    /** Returns the current playback speed relative to normal, 0 when stopped. */
+    float getSpeed() const noexcept                         { return speed.load(); }
+
+    /** Fills in the windows worth rendering, most urgent first, and returns how
+        many there are.
+    */
+    int getWindows (Windows&) const noexcept;
+
+private:
+    //==============================================================================
+    void recordSeek (juce::int64 target) noexcept;
+
+    std::atomic<juce::int64> lookAhead;
+    std::atomic<juce::int64> position { 0 }, loopStart { 0 }, loopEnd { 0 };
+    std::atomic<float> speed { 0.0f };
+    std::atomic<bool> playing { false };
+
+    std::array<std::atomic<juce::int64>, numRecentSeeks> recentSeeks;
+    std::atomic<int> numSeeks { 0 };
+
+    // Only touched by update()
+    juce::int64 lastPosition = 0;
+    int lastNumSamples = 0;
+    bool wasPlaying = false, hasUpdated = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PlayheadPredictor)
+};
+
+} // namespace hifitune
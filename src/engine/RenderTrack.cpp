@@ -0,0 +1,228 @@
+/*
+  ==============================================================================
+
+    This file contains the render-ahead cache for one audio modification.
+
+  ==============================================================================
+*/
+
+#include "RenderTrack.h"
+#include "MixKernels.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Several threads may wait for claims at once, and each signal only wakes
+    // one of them, so the others check again after this long
+    constexpr int claimWaitMs = 2;
+}
+
+//==============================================================================
+RenderTrack::RenderTrack (juce::int64 lengthInSamplesIn, int numChannelsIn, int segmentLengthIn)
+    : lengthInSamples (lengthInSamplesIn),
+      numChannels (numChannelsIn),
+      segmentLength (segmentLengthIn),
+      numSegments ((int) ((lengthInSamplesIn + segmentLengthIn - 1) / segmentLengthIn)),
+      slots (std::make_unique<Slot[]> ((size_t) juce::jmax (1, numSegments)))
+{
+}
+
+RenderTrack::~RenderTrack()
+{
+    for (int i = 0; i < numSegments; ++i)
+        delete slots[(size_t) i].segment.load();
+}
+
+int RenderTrack::getSegmentIndexFor (juce::int64 sample) const noexcept
+{
+    return (int) juce::jlimit ((juce::int64) 0, (juce::int64) numSegments - 1, sample / segmentLength);
+}
+
+juce::Range<juce::int64> RenderTrack::getSegmentRange (int index) const noexcept
+{
+    const auto start = (juce::int64) index * segmentLength;
+    return { start, juce::jmin (lengthInSamples, start + segmentLength) };
+}
+
+//==============================================================================
+RenderTrack::ReadStatus RenderTrack::read (juce::AudioBuffer<float>& dest, int destStartSample,
+                                           juce::int64 start, int numSamples, bool addToDest) const noexcept
+{
+    readSequence.fetch_add (1);
+
+    ReadStatus status;
+
+    while (numSamples > 0)
+    {
+        const auto index = (int) (start / segmentLength);
+        const auto offsetInSegment = (int) (start - (juce::int64) index * segmentLength);
+        auto numThisTime = juce::jmin (numSamples, segmentLength - offsetInSegment);
+
+        const auto* segment = juce::isPositiveAndBelow (index, numSegments) ? slots[(size_t) index].segment.load()
+                                                                            : nullptr;
+
+        // At the start of a segment, fade in from the previous one's tail, or
+        // from silence if it's missing
+        const auto isInCrossfade = offsetInSegment < crossfadeLength && juce::isPositiveAndBelow (index - 1, numSegments - 1);
+        const auto* previous = isInCrossfade ? slots[(size_t) index - 1].segment.load() : nullptr;
+        const auto previousHasTail = previous != nullptr && previous->audio->getNumSamples() >= segmentLength + crossfadeLength;
+        const auto crossfade = isInCrossfade && (previousHasTail || (previous == nullptr && segment != nullptr));
+
+        if (crossfade)
+            numThisTime = juce::jmin (numThisTime, crossfadeLength - offsetInSegment);
+
+        for (int c = 0; c < dest.getNumChannels(); ++c)
+        {
+            auto* channelData = dest.getWritePointer (c, destStartSample);
+            const auto* segmentData = segment != nullptr
+                                          ? segment->audio->getReadPointer (c % segment->audio->getNumChannels(), offsetInSegment)
+                                          : nullptr;
+
+            if (crossfade)
+            {
+                const auto* previousData = previous != nullptr
+                                               ? previous->audio->getReadPointer (c % previous->audio->getNumChannels(),
+                                                                                  segmentLength + offsetInSegment)
+                                               : nullptr;
+
+                MixKernels::mixCrossfade (channelData, previousData, segmentData, numThisTime,
+                                          (float) offsetInSegment / crossfadeLength,
+                                          (float) (offsetInSegment + numThisTime) / crossfadeLength,
+                                          addToDest);
+            }
+            else if (segmentData != nullptr)
+            {
+                MixKernels::mix (channelData, segmentData, numThisTime, addToDest);
+            }
+            else if (! addToDest)
+            {
+                juce::FloatVectorOperations::clear (channelData, numThisTime);
+            }
+        }
+
+        if (segment == nullptr)
+            status.numMissing += numThisTime;
+        else if (segment->quality == RenderedSegment::Quality::dry)
+            status.numDry += numThisTime;
+
+        start += numThisTime;
+        destStartSample += numThisTime;
+        numSamples -= numThisTime;
+    }
+
+    readSequence.fetch_add (1);
+    return status;
+}
+
+//==============================================================================
+RenderedSegment::Quality RenderTrack::getQuality (int index) const noexcept
+{
+    const auto* segment = slots[(size_t) index].segment.load();
+    return segment != nullptr ? segment->quality : RenderedSegment::Quality::none;
+}
+
+juce::uint64 RenderTrack::getKey (int index) const noexcept
+{
+    const auto* segment = slots[(size_t) index].segment.load();
+    return segment != nullptr ? segment->key : 0;
+}
+
+bool RenderTrack::needsUpdate (int index, juce::uint64 wantedKey) const noexcept
+{
+    return wantedKey != 0 && getKey (index) != wantedKey;
+}
+
+bool RenderTrack::tryClaim (int index, juce::uint64 wantedKey) noexcept
+{
+    if (! needsUpdate (index, wantedKey))
+        return false;
+
+    auto& slot = slots[(size_t) index];
+
+    if (slot.claimed.exchange (true))
+        return false;
+
+    // Someone else may have published between the check and the claim
+    if (! needsUpdate (index, wantedKey))
+    {
+        slot.claimed = false;
+        claimReleased.signal();
+        return false;
+    }
+
+    return true;
+}
+
+void RenderTrack::markUpToDate (int index, juce::uint64 inputsStamp, juce::uint64 key) noexcept
+{
+    auto& slot = slots[(size_t) index];
+    slot.checkedStamp = inputsStamp;
+
+    // publish() clears the stamp after swapping the segment in, so if the key
+    // still matches here, the stamp can't have outlived the segment it was for
+    if (getKey (index) != key)
+        slot.checkedStamp = 0;
+}
+
+bool RenderTrack::isKnownUpToDate (int index, juce::uint64 inputsStamp) const noexcept
+{
+    return inputsStamp != 0 && slots[(size_t) index].checkedStamp.load() == inputsStamp;
+}
+
+bool RenderTrack::isClaimed (int index) const noexcept
+{
+    return slots[(size_t) index].claimed.load();
+}
+
+void RenderTrack::waitUntilUnclaimed (int index) const
+{
+    while (isClaimed (index))
+        claimReleased.wait (claimWaitMs);
+}
+
+void RenderTrack::publish (int index, std::unique_ptr<RenderedSegment> segment)
+{
+    jassert (isClaimed (index));
+    jassert (segment != nullptr && segment->key != 0);
+    jassert (segment->audio != nullptr && segment->audio->getNumSamples() >= getSegmentRange (index).getLength());
+
+    auto& slot = slots[(size_t) index];
+    std::unique_ptr<RenderedSegment> previous (slot.segment.exchange (segment.release()));
+    slot.checkedStamp = 0;
+    slot.claimed = false;
+    claimReleased.signal();
+
+    {
+        const juce::ScopedLock sl (retiredLock);
+
+        if (previous != nullptr)
+            retiredSegments.push_back ({ std::move (previous), readSequence.load() });
+
+        deleteRetiredSegments();
+    }
+}
+
+void RenderTrack::releaseClaim (int index) noexcept
+{
+    slots[(size_t) index].claimed = false;
+    claimReleased.signal();
+}
+
+void RenderTrack::deleteRetiredSegments()
+{
+    // A segment retired while the reader was outside read() (even sequence) can
+    // go straight away. Otherwise the reader must have moved on since.
+    const auto currentSequence = readSequence.load();
+
+    retiredSegments.erase (std::remove_if (retiredSegments.begin(), retiredSegments.end(),
+                                           [currentSequence] (const RetiredSegment& retired)
+                                           {
+                                               return (retired.readSequence & 1) == 0
+                                                   || retired.readSequence != currentSequence;
+                                           }),
+                           retiredSegments.end());
+}
+
+} // namespace hifitune
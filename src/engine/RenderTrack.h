@@ -0,0 +1,162 @@
+/*
+  ==============================================================================
+
+    This file contains the render-ahead cache for one audio modification.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+namespace hifitune
+{
+
+//==============================================================================
+/** One block of rendered output, immutable once published to a RenderTrack. */
+struct RenderedSegment
+{
+    enum class Quality
+    {
+        none,       // nothing rendered yet
+        dry,        // source audio passed through, used until analysis and model are ready
+        neural      // vocoder output
+    };
+
+    // The segment's samples, optionally followed by RenderTrack::crossfadeLength
+    // more. May be shared with a SegmentCache.
+    std::shared_ptr<const juce::AudioBuffer<float>> audio;
+    Quality quality = Quality::dry;
+
+    // Hash of everything the audio was rendered from, never zero
+    juce::uint64 key = 0;
+};
+
+//==============================================================================
+/**
+    Holds the rendered output of one audio modification, cut into fixed-length
+    segments that worker threads fill ahead of the playhead.
+
+    Segments are published through atomic pointers, so read() never locks or
+    allocates and can be called on the audio thread. Replaced segments are only
+    deleted once the reading thread is known to have let go of them. Only one
+    thread may call read() at a time (the renderer's processBlock).
+
+    Segments that carry audio past their end are crossfaded into the next one,
+    which hides the seam where neighbours were rendered with different inputs
+    or quality. Changes from or to missing segments are faded the same way.
+*/
+class RenderTrack
+{
+public:
+    //==============================================================================
+    static constexpr int defaultSegmentLength = 1 << 15;
+
+    /** Samples over which one segment fades into the next. */
+    static constexpr int crossfadeLength = 256;
+
+    RenderTrack (juce::int64 lengthInSamples, int numChannels, int segmentLength = defaultSegmentLength);
+    ~RenderTrack();
+
+    juce::int64 getLengthInSamples() const noexcept         { return lengthInSamples; }
+    int getNumChannels() const noexcept                     { return numChannels; }
+    int getSegmentLength() const noexcept                   { return segmentLength; }
+    int getNumSegments() const noexcept                     { return numSegments; }
+
+    int getSegmentIndexFor (juce::int64 sample) const noexcept;
+    juce::Range<juce::int64> getSegmentRange (int index) const noexcept;
+
+    //==============================================================================
+    /** What a read() had to make do with. */
+    struct ReadStatus
+    {
+        int numMissing = 0;     // samples output as silence
+        int numDry = 0;         // samples output from dry segments
+    };
+
+    /** Copies the rendered samples [start, start + numSamples) into dest, or adds
+        them if addToDest is true. Parts that are not rendered yet are written as
+        silence (or left untouched when adding).
+
+        Realtime-safe.
+    */
+    ReadStatus read (juce::AudioBuffer<float>& dest, int destStartSample,
+                     juce::int64 start, int numSamples, bool addToDest) const noexcept;
+
+    //==============================================================================
+    /** Returns the quality of the segment currently published for this index. */
+    RenderedSegment::Quality getQuality (int index) const noexcept;
+
+    /** Returns the key of the segment currently published for this index, or 0. */
+    juce::uint64 getKey (int index) const noexcept;
+
+    /** Returns true if the published segment doesn't match the wanted key, i.e.
+        it is missing or was rendered from inputs that have changed since.
+        A wanted key of 0 means nothing can be rendered.
+    */
+    bool needsUpdate (int index, juce::uint64 wantedKey) const noexcept;
+
+    /** Claims a segment for rendering, if nobody else is rendering it and it
+        needs an update. Every successful claim must be followed by publish()
+        or releaseClaim().
+    */
+    bool tryClaim (int index, juce::uint64 wantedKey) noexcept;
+
+    /** Remembers that the published segment was found to match the key wanted
+        for inputs with the given stamp (see SegmentSynthesiser::getInputsStamp()),
+        so that it needn't be checked again until the inputs change. Forgotten
+        as soon as another segment is published.
+    */
+    void markUpToDate (int index, juce::uint64 inputsStamp, juce::uint64 key) noexcept;
+
+    /** Returns true if markUpToDate() was called for this stamp since the
+        segment was published.
+    */
+    bool isKnownUpToDate (int index, juce::uint64 inputsStamp) const noexcept;
+
+    /** Returns true if a thread is currently rendering this segment. */
+    bool isClaimed (int index) const noexcept;
+
+    /** Blocks until no thread is rendering this segment. Not for realtime use. */
+    void waitUntilUnclaimed (int index) const;
+
+    /** Publishes a rendered segment and releases the claim on it. */
+    void publish (int index, std::unique_ptr<RenderedSegment>);
+
+    /** Gives up a claim without publishing anything. */
+    void releaseClaim (int index) noexcept;
+
+private:
+    //==============================================================================
+    struct Slot
+    {
+        std::atomic<RenderedSegment*> segment { nullptr };
+        std::atomic<bool> claimed { false };
+        std::atomic<juce::uint64> checkedStamp { 0 };
+    };
+
+    struct RetiredSegment
+    {
+        std::unique_ptr<RenderedSegment> segment;
+        juce::uint64 readSequence;
+    };
+
+    void deleteRetiredSegments();
+
+    const juce::int64 lengthInSamples;
+    const int numChannels, segmentLength, numSegments;
+    std::unique_ptr<Slot[]> slots;
+
+    // Odd while the reader is inside read()
+    mutable std::atomic<juce::uint64> readSequence { 0 };
+
+    std::vector<RetiredSegment> retiredSegments;
+    juce::CriticalSection retiredLock;
+
+    mutable juce::WaitableEvent claimReleased;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderTrack)
+};
+
+} // namespace hifitune
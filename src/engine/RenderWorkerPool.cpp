@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide pool of render worker threads.
+
+  ==============================================================================
+*/
+
+#include "RenderWorkerPool.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // Workers with nothing to do still wake up this often, so that they notice
+    // the playhead moving without the audio thread having to signal them.
+    constexpr int idleWaitMs = 10;
+}
+
+//==============================================================================
+class RenderWorkerPool::Worker  : public juce::Thread
+{
+public:
+    explicit Worker (RenderWorkerPool& ownerIn)
+        : juce::Thread ("HiFiTune Render"), owner (ownerIn)
+    {
+    }
+
+    void run() override
+    {
+        size_t cursor = 0;
+
+        while (! threadShouldExit())
+        {
+            bool didWork = false;
+
+            for (auto numToVisit = owner.getNumClients(); numToVisit > 0 && ! threadShouldExit(); --numToVisit)
+            {
+                if (auto entry = owner.acquireNextClient (cursor))
+                {
+                    didWork = entry->client->renderNextSegment (owner) || didWork;
+                    --entry->numUsers;
+                }
+            }
+
+            if (! didWork)
+                owner.workAvailable.wait (idleWaitMs);
+        }
+    }
+
+private:
+    RenderWorkerPool& owner;
+};
+
+//==============================================================================
+RenderWorkerPool::RenderWorkerPool()
+{
+    const auto numWorkers = juce::jmax (1, juce::SystemStats::getNumPhysicalCpus() / 2);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        workers.push_back (std::make_unique<Worker> (*this));
+        workers.back()->startThread();
+    }
+}
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+    jassert (clients.empty());
+
+    for (auto& worker : workers)
+        worker->signalThreadShouldExit();
+
+    workAvailable.signal();
+
+    for (auto& worker : workers)
+        worker->stopThread (-1);
+}
+
+std::shared_ptr<Vocoder> RenderWorkerPool::getVocoder()
+{
+    return scheduler.getVocoder();
+}
+
+std::shared_ptr<Vocoder> RenderWorkerPool::waitForVocoder()
+{
+    return scheduler.waitForVocoder();
+}
+
+//==============================================================================
+void RenderWorkerPool::addClient (Client& client)
+{
+    auto entry = std::make_shared<ClientEntry>();
+    entry->client = &client;
+
+    {
+        const juce::ScopedLock sl (clientsLock);
+        clients.push_back (std::move (entry));
+    }
+
+    notify();
+}
+
+void RenderWorkerPool::removeClient (Client& client)
+{
+    std::shared_ptr<ClientEntry> entry;
+
+    {
+        const juce::ScopedLock sl (clientsLock);
+
+        const auto it = std::find_if (clients.begin(), clients.end(),
+                                      [&client] (const auto& e) { return e->client == &client; });
+
+        if (it == clients.end())
+            return;
+
+        entry = *it;
+        clients.erase (it);
+    }
+
+    // No worker can pick the client up any more; wait for those already inside it
+    while (entry->numUsers.load() > 0)
+        juce::Thread::sleep (1);
+}
+
+void RenderWorkerPool::notify()
+{
+    workAvailable.signal();
+}
+
+size_t RenderWorkerPool::getNumClients() const
+{
+    const juce::ScopedLock sl (clientsLock);
+    return clients.size();
+}
+
+std::shared_ptr<RenderWorkerPool::ClientEntry> RenderWorkerPool::acquireNextClient (size_t& cursor)
+{
+    const juce::ScopedLock sl (clientsLock);
+
+    if (clients.empty())
+        return {};
+
+    auto entry = clients[cursor++ % clients.size()];
+    ++entry->numUsers;
+    return entry;
+}
+
+} // namespace hifitune
@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    This file contains the process-wide pool of render worker threads.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "InferenceScheduler.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    A set of background threads that fill RenderTracks for every playback
+    renderer in the process.
+
+    Use it through a juce::SharedResourcePointer so that all plug-in instances
+    share the same threads and the same InferenceScheduler.
+*/
+class RenderWorkerPool
+{
+public:
+    //==============================================================================
+    /** Something with segments to render, typically a playback renderer. */
+    struct Client
+    {
+        virtual ~Client() = default;
+
+        /** Renders one pending segment and returns true, or returns false if there
+            is nothing to do right now. Called on worker threads, possibly from
+            several at once.
+        */
+        virtual bool renderNextSegment (RenderWorkerPool&) = 0;
+    };
+
+    //==============================================================================
+    RenderWorkerPool();
+    ~RenderWorkerPool();
+
+    /** Returns the shared vocoder, or nullptr while it's still loading in the
+        background (or if it can't be loaded). Never blocks. Keep the pointer
+        for as long as the vocoder is used, see InferenceScheduler::getVocoder().
+    */
+    std::shared_ptr<Vocoder> getVocoder();
+
+    /** Returns the shared vocoder, waiting for it to finish loading if needed. */
+    std::shared_ptr<Vocoder> waitForVocoder();
+
+    /** Returns the scheduler all vocoder calls should go through. */
+    InferenceScheduler& getInferenceScheduler() noexcept    { return scheduler; }
+
+    //==============================================================================
+    void addClient (Client&);
+
+    /** Removes a client, blocking until no worker is using it any more. */
+    void removeClient (Client&);
+
+    /** Wakes the workers up, e.g. after new work became available. */
+    void notify();
+
+private:
+    //==============================================================================
+    class Worker;
+
+    struct ClientEntry
+    {
+        Client* client;
+        std::atomic<int> numUsers { 0 };
+    };
+
+    size_t getNumClients() const;
+    std::shared_ptr<ClientEntry> acquireNextClient (size_t& cursor);
+
+    std::vector<std::shared_ptr<ClientEntry>> clients;
+    mutable juce::CriticalSection clientsLock;
+    juce::WaitableEvent workAvailable;
+
+    InferenceScheduler scheduler;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderWorkerPool)
+};
+
+} // namespace hifitune
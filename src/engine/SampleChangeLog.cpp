@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    This file contains the log of changes to an audio source's samples.
+
+  ==============================================================================
+*/
+
+#include "SampleChangeLog.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+void SampleChangeLog::add (juce::Range<juce::int64> samples)
+{
+    if (samples.isEmpty())
+        return;
+
+    const juce::ScopedLock sl (lock);
+
+    if (changes.size() >= maxChanges)
+    {
+        forgottenGeneration = changes.front().generation;
+        changes.pop_front();
+    }
+
+    changes.push_back ({ generation.load() + 1, samples });
+    ++generation;
+}
+
+juce::uint64 SampleChangeLog::getLastChangeTo (juce::Range<juce::int64> samples) const
+{
+    const juce::ScopedLock sl (lock);
+
+    for (auto it = changes.rbegin(); it != changes.rend(); ++it)
+        if (it->samples.intersects (samples))
+            return it->generation;
+
+    // A forgotten change might have been anywhere
+    return forgottenGeneration;
+}
+
+std::vector<juce::Range<juce::int64>> SampleChangeLog::getChangesSince (juce::uint64 since) const
+{
+    const juce::ScopedLock sl (lock);
+
+    if (since < forgottenGeneration)
+        return { everything };
+
+    std::vector<juce::Range<juce::int64>> result;
+
+    for (const auto& change : changes)
+        if (change.generation > since)
+            result.push_back (change.samples);
+
+    return result;
+}
+
+} // namespace hifitune
@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    This file contains the log of changes to an audio source's samples.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <deque>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Records which ranges of an audio source's samples the host has replaced,
+    so that anything derived from the old samples can tell whether it is
+    affected: renderers drop cached source audio and re-render only the dry
+    segments overlapping a change, and until the analysis catches up, compute
+    the features of the frames around a change themselves.
+
+    Every change gets a new generation number. Only the most recent changes
+    are kept; older ones are summarised as "something, somewhere", which makes
+    queries about them conservative rather than wrong.
+
+    All methods are thread-safe. getGeneration() and the analysed generation
+    accessors are lock-free; the others take a lock and are not realtime-safe.
+*/
+class SampleChangeLog
+{
+public:
+    //==============================================================================
+    /** A range covering any source, for changes whose extent isn't known. */
+    static constexpr juce::Range<juce::int64> everything { 0, std::numeric_limits<juce::int64>::max() };
+
+    static constexpr size_t maxChanges = 256;
+
+    SampleChangeLog() = default;
+
+    /** Records that the samples in this range have changed. */
+    void add (juce::Range<juce::int64> samples);
+
+    /** Returns the generation of the latest change, 0 if there was none. */
+    juce::uint64 getGeneration() const noexcept             { return generation.load(); }
+
+    /** Returns the generation of the latest change overlapping the range, or 0 if
+        none did. Suitable as part of a cache key for anything read from there.
+    */
+    juce::uint64 getLastChangeTo (juce::Range<juce::int64> samples) const;
+
+    /** Returns the ranges changed after the given generation. */
+    std::vector<juce::Range<juce::int64>> getChangesSince (juce::uint64 generation) const;
+
+    /** Records that the source's analysis now reflects every change up to this
+        generation, so that renderers can tell which of its frames are stale.
+    */
+    void setAnalysedGeneration (juce::uint64 analysed) noexcept    { analysedGeneration = analysed; }
+
+    /** Returns the generation set by setAnalysedGeneration(), 0 if none was. */
+    juce::uint64 getAnalysedGeneration() const noexcept             { return analysedGeneration.load(); }
+
+private:
+    //==============================================================================
+    struct Change
+    {
+        juce::uint64 generation;
+        juce::Range<juce::int64> samples;
+    };
+
+    std::deque<Change> changes;
+    juce::uint64 forgottenGeneration = 0;   // newest change dropped from the log
+    std::atomic<juce::uint64> generation { 0 }, analysedGeneration { 0 };
+    mutable juce::CriticalSection lock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleChangeLog)
+};
+
+} // namespace hifitune
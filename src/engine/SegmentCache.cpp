@@ -0,0 +1,280 @@
+/*
+  ==============================================================================
+
+    This file contains the content-addressed cache of rendered segments.
+
+  ==============================================================================
+*/
+
+#include "SegmentCache.h"
+#include "Instrumentation.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+SegmentCache::SegmentCache (size_t memoryBudgetInBytes)
+    : memoryBudget (memoryBudgetInBytes)
+{
+}
+
+SegmentCache::~SegmentCache()
+{
+    if (spillDirectory != juce::File())
+        spillDirectory.deleteRecursively();
+}
+
+void SegmentCache::setSpillDirectory (const juce::File& directory, size_t diskBudgetInBytes)
+{
+    const juce::ScopedLock sl (spillLock);
+
+    if (spillDirectory != juce::File() && spillDirectory != directory)
+        spillDirectory.deleteRecursively();
+
+    spillOrder.clear();
+    spilledSizes.clear();
+    diskBytes = 0;
+
+    spillDirectory = directory;
+    diskBudget = diskBudgetInBytes;
+
+    if (spillDirectory != juce::File() && ! spillDirectory.createDirectory())
+        spillDirectory = juce::File();
+}
+
+void SegmentCache::setMemoryBudget (size_t budgetInBytes)
+{
+    std::vector<Entry> evicted;
+
+    {
+        const juce::ScopedLock sl (lock);
+        memoryBudget = budgetInBytes;
+        evictOverBudgetLocked (evicted);
+    }
+
+    spill (evicted);
+}
+
+//==============================================================================
+SegmentCache::Buffer SegmentCache::find (juce::uint64 key)
+{
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (const auto it = index.find (key); it != index.end())
+        {
+            entries.splice (entries.begin(), entries, it->second);
+            ++hits;
+            Instrumentation::count (Instrumentation::EventType::segmentCacheHit);
+            return it->second->buffer;
+        }
+    }
+
+    auto buffer = readSpilled (key);
+    std::vector<Entry> evicted;
+
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (buffer == nullptr)
+        {
+            ++misses;
+            Instrumentation::count (Instrumentation::EventType::segmentCacheMiss);
+            return {};
+        }
+
+        ++diskHits;
+        Instrumentation::count (Instrumentation::EventType::segmentCacheHit, 1);
+        insertLocked (key, buffer);
+        evictOverBudgetLocked (evicted);
+    }
+
+    // Entries read back from disk still have their file, so this only writes
+    // those that were never spilled before
+    spill (evicted);
+    return buffer;
+}
+
+void SegmentCache::insert (juce::uint64 key, Buffer buffer)
+{
+    jassert (buffer != nullptr);
+    std::vector<Entry> evicted;
+
+    {
+        const juce::ScopedLock sl (lock);
+        insertLocked (key, std::move (buffer));
+        evictOverBudgetLocked (evicted);
+    }
+
+    spill (evicted);
+}
+
+void SegmentCache::clear()
+{
+    {
+        const juce::ScopedLock sl (lock);
+        entries.clear();
+        index.clear();
+        memoryBytes = 0;
+    }
+
+    const juce::ScopedLock sl (spillLock);
+
+    for (const auto key : spillOrder)
+        getSpillFile (key).deleteFile();
+
+    spillOrder.clear();
+    spilledSizes.clear();
+    diskBytes = 0;
+}
+
+SegmentCache::Statistics SegmentCache::getStatistics() const
+{
+    Statistics stats;
+
+    {
+        const juce::ScopedLock sl (lock);
+        stats.hits = hits;
+        stats.diskHits = diskHits;
+        stats.misses = misses;
+        stats.memoryBytes = memoryBytes;
+        stats.numEntries = (int) entries.size();
+    }
+
+    const juce::ScopedLock sl (spillLock);
+    stats.diskBytes = diskBytes;
+    return stats;
+}
+
+//==============================================================================
+size_t SegmentCache::getNumBytes (const juce::AudioBuffer<float>& buffer) noexcept
+{
+    return (size_t) buffer.getNumChannels() * (size_t) buffer.getNumSamples() * sizeof (float);
+}
+
+void SegmentCache::insertLocked (juce::uint64 key, Buffer buffer)
+{
+    if (const auto it = index.find (key); it != index.end())
+    {
+        memoryBytes -= getNumBytes (*it->second->buffer);
+        entries.erase (it->second);
+        index.erase (it);
+    }
+
+    memoryBytes += getNumBytes (*buffer);
+    entries.push_front ({ key, std::move (buffer) });
+    index[key] = entries.begin();
+}
+
+void SegmentCache::evictOverBudgetLocked (std::vector<Entry>& evicted)
+{
+    // Always keep the newest entry, even if it alone is over budget
+    while (memoryBytes > memoryBudget && entries.size() > 1)
+    {
+        auto& oldest = entries.back();
+        memoryBytes -= getNumBytes (*oldest.buffer);
+        index.erase (oldest.key);
+        evicted.push_back (std::move (oldest));
+        entries.pop_back();
+    }
+}
+
+//==============================================================================
+juce::File SegmentCache::getSpillFile (juce::uint64 key) const
+{
+    return spillDirectory.getChildFile (juce::String::toHexString ((juce::int64) key).paddedLeft ('0', 16) + ".seg");
+}
+
+void SegmentCache::spill (const std::vector<Entry>& evicted)
+{
+    if (evicted.empty())
+        return;
+
+    const juce::ScopedLock sl (spillLock);
+
+    if (spillDirectory == juce::File())
+        return;
+
+    for (const auto& entry : evicted)
+    {
+        if (spilledSizes.count (entry.key) != 0)
+            continue;
+
+        const auto& buffer = *entry.buffer;
+        const auto file = getSpillFile (entry.key);
+        bool ok = false;
+
+        {
+            juce::FileOutputStream out (file);
+
+            // FileOutputStream appends to existing files
+            if (out.openedOk() && out.setPosition (0) && out.truncate().wasOk())
+            {
+                out.writeInt (buffer.getNumChannels());
+                out.writeInt (buffer.getNumSamples());
+
+                ok = true;
+
+                for (int c = 0; ok && c < buffer.getNumChannels(); ++c)
+                    ok = out.write (buffer.getReadPointer (c), (size_t) buffer.getNumSamples() * sizeof (float));
+
+                out.flush();
+                ok = ok && out.getStatus().wasOk();
+            }
+        }
+
+        if (! ok)
+        {
+            file.deleteFile();
+            continue;
+        }
+
+        const auto numBytes = getNumBytes (buffer);
+        spillOrder.push_back (entry.key);
+        spilledSizes[entry.key] = numBytes;
+        diskBytes += numBytes;
+
+        while (diskBytes > diskBudget && ! spillOrder.empty())
+        {
+            const auto oldest = spillOrder.front();
+            spillOrder.pop_front();
+            getSpillFile (oldest).deleteFile();
+            diskBytes -= spilledSizes[oldest];
+            spilledSizes.erase (oldest);
+        }
+    }
+}
+
+SegmentCache::Buffer SegmentCache::readSpilled (juce::uint64 key)
+{
+    const juce::ScopedLock sl (spillLock);
+
+    if (spillDirectory == juce::File() || spilledSizes.count (key) == 0)
+        return {};
+
+    juce::FileInputStream in (getSpillFile (key));
+
+    if (! in.openedOk())
+        return {};
+
+    const auto numChannels = in.readInt();
+    const auto numSamples = in.readInt();
+
+    if (numChannels <= 0 || numSamples <= 0
+        || in.getTotalLength() != 8 + (juce::int64) numChannels * numSamples * (juce::int64) sizeof (float))
+        return {};
+
+    auto buffer = std::make_shared<juce::AudioBuffer<float>> (numChannels, numSamples);
+
+    for (int c = 0; c < numChannels; ++c)
+    {
+        const auto numBytes = (int) ((size_t) numSamples * sizeof (float));
+
+        if (in.read (buffer->getWritePointer (c), numBytes) != numBytes)
+            return {};
+    }
+
+    return buffer;
+}
+
+} // namespace hifitune
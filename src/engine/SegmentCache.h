@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    This file contains the content-addressed cache of rendered segments.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_basics/juce_audio_basics.h>
+
+#include <list>
+#include <unordered_map>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Keeps rendered segments by the hash of everything that went into them, so
+    that a segment whose inputs didn't change is never synthesised twice, e.g.
+    after an edit elsewhere in the clip, an undo, or when several regions play
+    the same modification.
+
+    Memory use is bounded: least recently used entries are dropped, or written
+    to a spill directory if one is set and read back from there on a later
+    miss. All methods are thread-safe; none are realtime-safe.
+*/
+class SegmentCache
+{
+public:
+    //==============================================================================
+    using Buffer = std::shared_ptr<const juce::AudioBuffer<float>>;
+
+    struct Statistics
+    {
+        juce::uint64 hits = 0, diskHits = 0, misses = 0;
+        size_t memoryBytes = 0, diskBytes = 0;
+        int numEntries = 0;
+    };
+
+    static constexpr size_t defaultMemoryBudget = (size_t) 256 << 20;
+    static constexpr size_t defaultDiskBudget = (size_t) 2 << 30;
+
+    explicit SegmentCache (size_t memoryBudgetInBytes = defaultMemoryBudget);
+
+    /** Deletes the spill directory, if one was set. */
+    ~SegmentCache();
+
+    //==============================================================================
+    /** Enables spilling evicted segments to files in the given directory, which is
+        created if needed and deleted along with the cache. Pass an empty File to
+        disable spilling.
+    */
+    void setSpillDirectory (const juce::File& directory, size_t diskBudgetInBytes = defaultDiskBudget);
+
+    void setMemoryBudget (size_t budgetInBytes);
+
+    //==============================================================================
+    /** Returns the segment stored for a key, or nullptr. */
+    Buffer find (juce::uint64 key);
+
+    /** Stores a segment, replacing any previous one with the same key. */
+    void insert (juce::uint64 key, Buffer);
+
+    void clear();
+
+    Statistics getStatistics() const;
+
+private:
+    //==============================================================================
+    struct Entry
+    {
+        juce::uint64 key;
+        Buffer buffer;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    static size_t getNumBytes (const juce::AudioBuffer<float>&) noexcept;
+
+    void insertLocked (juce::uint64 key, Buffer);
+    void evictOverBudgetLocked (std::vector<Entry>& evicted);
+    void spill (const std::vector<Entry>& evicted);
+    Buffer readSpilled (juce::uint64 key);
+    juce::File getSpillFile (juce::uint64 key) const;
+
+    EntryList entries;      // most recently used first
+    std::unordered_map<juce::uint64, EntryList::iterator> index;
+    size_t memoryBudget, memoryBytes = 0;
+    juce::uint64 hits = 0, diskHits = 0, misses = 0;
+
+    juce::File spillDirectory;
+    size_t diskBudget = 0, diskBytes = 0;
+    std::list<juce::uint64> spillOrder;     // oldest first
+    std::unordered_map<juce::uint64, size_t> spilledSizes;
+
+    mutable juce::CriticalSection lock;
+    juce::CriticalSection spillLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SegmentCache)
+};
+
+} // namespace hifitune
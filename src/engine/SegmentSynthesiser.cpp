@@ -0,0 +1,640 @@
+/*
+  ==============================================================================
+
+    This file contains the code that renders one segment of a RenderTrack.
+
+  ==============================================================================
+*/
+
+#include "SegmentSynthesiser.h"
+#include "ContentHash.h"
+#include "FeatureExtractor.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    // The source samples the resampler reads for the windows of a run of frames
+    juce::Range<juce::int64> getSourceSamplesFor (const FeatureConfig& config, double sourceSampleRate, juce::Range<juce::int64> frames) noexcept
+    {
+        const auto ratio = sourceSampleRate / config.sampleRate;
+        const auto modelStart = frames.getStart() * config.hopSize - config.fftSize / 2;
+        const auto modelEnd = modelStart + (frames.getLength() - 1) * config.hopSize + config.fftSize;
+
+        return { (juce::int64) std::floor ((double) modelStart * ratio) - 1,
+                 (juce::int64) std::floor ((double) (modelEnd - 1) * ratio) + 3 };
+    }
+
+    // Where a rendered frame falls in the analysis, in (fractional) analysis frames
+    double getSourceFramePosition (const SegmentSynthesiser::Source& source, juce::int64 frame) noexcept
+    {
+        const auto& config = source.analysis->config;
+        return source.sourceStart * config.sampleRate / source.sampleRate / config.hopSize + (double) frame * source.timeRatio;
+    }
+
+    // The source samples the grains of a stretched dry range read
+    juce::Range<juce::int64> getStretchedDrySourceSamples (const SegmentSynthesiser::Source& source, juce::Range<juce::int64> range) noexcept
+    {
+        const auto grainLength = SegmentSynthesiser::dryGrainLength;
+        const auto start = source.sourceStart + (double) (range.getStart() - grainLength) * source.timeRatio;
+        const auto end = source.sourceStart + (double) (range.getEnd() + grainLength) * source.timeRatio;
+
+        return { (juce::int64) std::floor (start) - grainLength, (juce::int64) std::ceil (end) + grainLength };
+    }
+
+    juce::int64 floorDivide (juce::int64 a, juce::int64 b) noexcept
+    {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    // The periodic Hann window dry grains are faded with, computed once
+    const std::array<float, SegmentSynthesiser::dryGrainLength>& getDryGrainWindow()
+    {
+        static const auto window = []
+        {
+            std::array<float, SegmentSynthesiser::dryGrainLength> values;
+
+            for (size_t i = 0; i < values.size(); ++i)
+                values[i] = 0.5f - 0.5f * std::cos (juce::MathConstants<float>::twoPi * (float) i / (float) values.size());
+
+            return values;
+        }();
+
+        return window;
+    }
+}
+
+//==============================================================================
+SegmentSynthesiser::SegmentSynthesiser (Vocoder* vocoderIn, SegmentCache* cacheIn, InferenceScheduler* schedulerIn,
+                                        DocumentArena* arenaIn)
+    : vocoder (vocoderIn), cache (cacheIn), scheduler (schedulerIn), arena (arenaIn)
+{
+    if (arena != nullptr)
+    {
+        mel = arena->takeScratch();
+        f0 = arena->takeScratch();
+        modelAudio = arena->takeScratch();
+        requestMel = arena->takeScratch();
+        requestF0 = arena->takeScratch();
+    }
+}
+
+SegmentSynthesiser::~SegmentSynthesiser()
+{
+    if (arena != nullptr)
+    {
+        arena->returnScratch (std::move (mel));
+        arena->returnScratch (std::move (f0));
+        arena->returnScratch (std::move (modelAudio));
+        arena->returnScratch (std::move (requestMel));
+        arena->returnScratch (std::move (requestF0));
+    }
+}
+
+RenderedSegment::Quality SegmentSynthesiser::getAvailableQuality (const Source& source) const noexcept
+{
+    if (vocoder != nullptr && source.analysis != nullptr)
+        return RenderedSegment::Quality::neural;
+
+    if (source.stream != nullptr)
+        return RenderedSegment::Quality::dry;
+
+    return RenderedSegment::Quality::none;
+}
+
+juce::uint64 SegmentSynthesiser::getSegmentKey (const Source& source, juce::Range<juce::int64> range, int numChannels)
+{
+    const auto quality = getAvailableQuality (source);
+
+    if (quality == RenderedSegment::Quality::none)
+        return 0;
+
+    ContentHash hash;
+    hash.add ((int) quality)
+        .add (source.sampleRate)
+        .add (range.getStart())
+        .add (range.getLength())
+        .add (RenderTrack::crossfadeLength)
+        .add (numChannels);
+
+    if (source.hasTimeMap())
+        hash.add (source.sourceStart).add (source.timeRatio);
+
+    if (quality == RenderedSegment::Quality::neural)
+    {
+        // The mel frames are covered by the hash of the analysed frames in the
+        // window, so that re-analysing audio elsewhere in the source keeps this
+        // key. Only the edited F0 needs hashing here.
+        const auto frames = getFrameWindow (source, range);
+        const auto sourceFrames = getSourceFrames (source, frames);
+        gatherFeatures (source, frames, false);
+
+        hash.add (source.analysis->getFrameRangeHash (sourceFrames))
+            .add (vocoder->getModelVersion())
+            .add (f0.data(), f0.size() * sizeof (float));
+
+        // Frames analysed again while rendering depend on the source audio instead
+        findStaleFrames (source, sourceFrames);
+
+        for (const auto& stale : staleFrames)
+            hash.add (stale.getStart())
+                .add (stale.getLength())
+                .add (source.changes->getLastChangeTo (getSourceSamplesFor (source.analysis->config, source.sampleRate, stale)));
+    }
+    else if (source.changes != nullptr)
+    {
+        // Dry audio is read straight from the source, tail included
+        const auto rendered = range.withEnd (range.getEnd() + RenderTrack::crossfadeLength);
+        hash.add (source.changes->getLastChangeTo (source.hasTimeMap() ? getStretchedDrySourceSamples (source, rendered) : rendered));
+    }
+
+    const auto key = hash.get();
+    return key != 0 ? key : 1;
+}
+
+juce::uint64 SegmentSynthesiser::getInputsStamp (const Source& source, int numChannels) const
+{
+    const auto quality = getAvailableQuality (source);
+
+    ContentHash hash;
+    hash.add ((int) quality)
+        .add (source.sampleRate)
+        .add (numChannels)
+        .add (source.sourceStart)
+        .add (source.timeRatio)
+        .add (source.pitchCurve != nullptr ? source.pitchCurve->getId() : (juce::uint64) 0)
+        .add (source.analysedGeneration)
+        .add (source.changes != nullptr ? source.changes->getGeneration() : (juce::uint64) 0);
+
+    if (source.analysis != nullptr)
+        hash.add (source.analysis->contentHash).add (source.analysis->numFrames);
+
+    if (quality == RenderedSegment::Quality::neural)
+        hash.add (vocoder->getModelVersion());
+
+    const auto stamp = hash.get();
+    return stamp != 0 ? stamp : 1;
+}
+
+std::vector<std::unique_ptr<RenderedSegment>> SegmentSynthesiser::render (const Source& source,
+                                                                          const std::vector<juce::Range<juce::int64>>& ranges,
+                                                                          int numChannels,
+                                                                          juce::int64 priority)
+{
+    std::vector<std::unique_ptr<RenderedSegment>> segments (ranges.size());
+    const auto quality = getAvailableQuality (source);
+
+    if (quality == RenderedSegment::Quality::none)
+        return segments;
+
+    const auto isNeural = quality == RenderedSegment::Quality::neural;
+
+    std::vector<juce::uint64> keys;
+    keys.reserve (ranges.size());
+
+    for (const auto& range : ranges)
+        keys.push_back (getSegmentKey (source, range, numChannels));
+
+    auto makeSegment = [&] (size_t i, SegmentCache::Buffer audio)
+    {
+        auto segment = std::make_unique<RenderedSegment>();
+        segment->audio = std::move (audio);
+        segment->quality = quality;
+        segment->key = keys[i];
+        return segment;
+    };
+
+    if (isNeural)
+    {
+        std::vector<juce::Range<juce::int64>> missing;
+        std::vector<size_t> missingIndices;
+
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            if (cache != nullptr)
+                if (auto audio = cache->find (keys[i]))
+                    segments[i] = makeSegment (i, std::move (audio));
+
+            if (segments[i] == nullptr)
+            {
+                missing.push_back (ranges[i]);
+                missingIndices.push_back (i);
+            }
+        }
+
+        auto rendered = renderNeural (source, missing, numChannels, priority);
+
+        for (size_t j = 0; j < missing.size(); ++j)
+        {
+            if (rendered[j] == nullptr)
+                continue;
+
+            const auto i = missingIndices[j];
+
+            if (cache != nullptr)
+                cache->insert (keys[i], rendered[j]);
+
+            segments[i] = makeSegment (i, std::move (rendered[j]));
+        }
+
+        return segments;
+    }
+
+    for (size_t first = 0; first < ranges.size();)
+    {
+        // Dry audio comes from fixed source positions, however it's split up, so
+        // each run of adjacent ranges is read in one go
+        auto last = first;
+
+        while (last + 1 < ranges.size() && ranges[last + 1].getStart() == ranges[last].getEnd())
+            ++last;
+
+        // Every segment gets a tail for the RenderTrack to crossfade into its successor
+        const juce::Range<juce::int64> runRange { ranges[first].getStart(), ranges[last].getEnd() + RenderTrack::crossfadeLength };
+        auto runAudio = std::make_shared<juce::AudioBuffer<float>> (numChannels, (int) runRange.getLength());
+
+        const auto ok = renderDry (source, runRange, *runAudio);
+
+        for (auto i = first; ok && i <= last; ++i)
+        {
+            auto audio = runAudio;
+
+            if (first != last)
+            {
+                auto part = std::make_shared<juce::AudioBuffer<float>> (numChannels, (int) ranges[i].getLength() + RenderTrack::crossfadeLength);
+
+                for (int c = 0; c < numChannels; ++c)
+                    part->copyFrom (c, 0, *runAudio, c, (int) (ranges[i].getStart() - runRange.getStart()), part->getNumSamples());
+
+                audio = std::move (part);
+            }
+
+            segments[i] = makeSegment (i, std::move (audio));
+        }
+
+        first = last + 1;
+    }
+
+    return segments;
+}
+
+//==============================================================================
+juce::Range<juce::int64> SegmentSynthesiser::getFrameWindow (const Source& source, juce::Range<juce::int64> range) const noexcept
+{
+    const auto& config = source.analysis->config;
+    const auto ratio = source.sampleRate / config.sampleRate;
+
+    // Model-rate samples the interpolator needs for this range and its crossfade
+    // tail, and the frames producing them
+    const auto modelFirst = (juce::int64) std::floor ((double) range.getStart() / ratio) - 1;
+    const auto modelLast = (juce::int64) std::floor ((double) (range.getEnd() + RenderTrack::crossfadeLength - 1) / ratio) + 2;
+
+    const auto firstFrame = (juce::int64) std::floor ((double) modelFirst / config.hopSize) - contextFrames;
+    const auto endFrame = modelLast / config.hopSize + 1 + contextFrames;
+    return { firstFrame, endFrame };
+}
+
+juce::Range<juce::int64> SegmentSynthesiser::getSourceFrames (const Source& source, juce::Range<juce::int64> frames) const noexcept
+{
+    if (! source.hasTimeMap())
+        return frames;
+
+    // The analysed frames either side of every rendered one
+    const auto first = getSourceFramePosition (source, frames.getStart());
+    const auto last = first + (double) (frames.getLength() - 1) * source.timeRatio;
+
+    return { (juce::int64) std::floor (first), (juce::int64) std::floor (last) + 2 };
+}
+
+bool SegmentSynthesiser::gatherFeatures (const Source& source, juce::Range<juce::int64> frames, bool includeMel)
+{
+    const auto sourceFrames = getSourceFrames (source, frames);
+
+    if (! gatherAnalysedFeatures (source, sourceFrames, includeMel))
+        return false;
+
+    if (source.hasTimeMap())
+        stretchFeatures (source, frames, sourceFrames, includeMel);
+
+    if (source.pitchCurve != nullptr)
+    {
+        const auto& config = source.analysis->config;
+        const auto frameDuration = config.hopSize / config.sampleRate;
+        const auto firstPosition = source.hasTimeMap() ? getSourceFramePosition (source, frames.getStart()) : (double) frames.getStart();
+
+        source.pitchCurve->applyToF0 (f0.data(), (int) frames.getLength(), firstPosition * frameDuration, frameDuration * source.timeRatio);
+    }
+
+    return true;
+}
+
+bool SegmentSynthesiser::gatherAnalysedFeatures (const Source& source, juce::Range<juce::int64> frames, bool includeMel)
+{
+    const auto& analysis = *source.analysis;
+    const auto& config = analysis.config;
+    const auto numFrames = (int) frames.getLength();
+    const auto numBins = (size_t) config.numMelBins;
+
+    f0.resize ((size_t) numFrames);
+
+    if (includeMel)
+        mel.resize ((size_t) numFrames * numBins);
+
+    for (int i = 0; i < numFrames; ++i)
+    {
+        const auto frame = frames.getStart() + i;
+        const auto isInside = juce::isPositiveAndBelow (frame, (juce::int64) analysis.numFrames);
+
+        f0[(size_t) i] = isInside ? analysis.f0[(size_t) frame] : 0.0f;
+
+        if (! includeMel)
+            continue;
+
+        auto* melFrame = mel.data() + (size_t) i * numBins;
+
+        if (isInside)
+            std::copy (analysis.getMelFrame ((int) frame), analysis.getMelFrame ((int) frame) + numBins, melFrame);
+        else
+            std::fill (melFrame, melFrame + numBins, FeatureConfig::getSilentMelValue());
+    }
+
+    // Without the mel, this is only for the key, which covers stale frames differently
+    if (includeMel)
+    {
+        findStaleFrames (source, frames);
+
+        if (! staleFrames.empty() && ! analyseStaleFrames (source, frames))
+            return false;
+    }
+
+    return true;
+}
+
+void SegmentSynthesiser::stretchFeatures (const Source& source, juce::Range<juce::int64> frames, juce::Range<juce::int64> sourceFrames,
+                                          bool includeMel)
+{
+    const auto numFrames = (size_t) frames.getLength();
+    const auto numBins = (size_t) source.analysis->config.numMelBins;
+    const auto lastIndex = (juce::int64) sourceFrames.getLength() - 2;
+    const auto firstPosition = getSourceFramePosition (source, frames.getStart()) - (double) sourceFrames.getStart();
+
+    stretchedF0.resize (numFrames);
+
+    if (includeMel)
+        stretchedMel.resize (numFrames * numBins);
+
+    // Linear interpolation between the analysed frames either side. Pitch is
+    // only interpolated between voiced frames; at voicing changes the nearer
+    // frame wins, which keeps note onsets sharp.
+    for (size_t i = 0; i < numFrames; ++i)
+    {
+        const auto position = firstPosition + (double) i * source.timeRatio;
+        const auto index = (size_t) juce::jlimit ((juce::int64) 0, lastIndex, (juce::int64) std::floor (position));
+        const auto t = (float) juce::jlimit (0.0, 1.0, position - (double) index);
+
+        const auto a = f0[index], b = f0[index + 1];
+        stretchedF0[i] = a > 0.0f && b > 0.0f ? a + t * (b - a) : (t < 0.5f ? a : b);
+
+        if (! includeMel)
+            continue;
+
+        const auto* melA = mel.data() + index * numBins;
+        const auto* melB = melA + numBins;
+        auto* dest = stretchedMel.data() + i * numBins;
+
+        for (size_t bin = 0; bin < numBins; ++bin)
+            dest[bin] = melA[bin] + t * (melB[bin] - melA[bin]);
+    }
+
+    f0.assign (stretchedF0.begin(), stretchedF0.end());
+
+    if (includeMel)
+        mel.assign (stretchedMel.begin(), stretchedMel.end());
+}
+
+void SegmentSynthesiser::findStaleFrames (const Source& source, juce::Range<juce::int64> frames)
+{
+    staleFrames.clear();
+
+    if (source.changes == nullptr || source.stream == nullptr
+        || source.changes->getGeneration() == source.analysedGeneration)
+        return;
+
+    const auto& analysis = *source.analysis;
+
+    if (! juce::exactlyEqual (analysis.sourceSampleRate, source.sampleRate))
+        return;
+
+    const auto inside = frames.getIntersectionWith ({ 0, (juce::int64) analysis.numFrames });
+
+    for (const auto& change : source.changes->getChangesSince (source.analysedGeneration))
+    {
+        // After a change of unknown extent the whole analysis is redone, and
+        // patching it here would mean analysing everything that's rendered
+        if (change == SampleChangeLog::everything)
+        {
+            staleFrames.clear();
+            return;
+        }
+
+        const auto affected = FeatureExtractor::getFramesReading (analysis.config, analysis.sourceSampleRate, change)
+                                  .getIntersectionWith (inside);
+
+        if (! affected.isEmpty())
+            staleFrames.push_back (affected);
+    }
+
+    std::sort (staleFrames.begin(), staleFrames.end(), [] (auto a, auto b) { return a.getStart() < b.getStart(); });
+
+    // Merge overlapping and touching runs
+    size_t numMerged = 0;
+
+    for (const auto& run : staleFrames)
+    {
+        if (numMerged > 0 && staleFrames[numMerged - 1].getEnd() >= run.getStart())
+            staleFrames[numMerged - 1].setEnd (juce::jmax (staleFrames[numMerged - 1].getEnd(), run.getEnd()));
+        else
+            staleFrames[numMerged++] = run;
+    }
+
+    staleFrames.resize (numMerged);
+}
+
+bool SegmentSynthesiser::analyseStaleFrames (const Source& source, juce::Range<juce::int64> frames)
+{
+    const auto& config = source.analysis->config;
+    const auto numBins = (size_t) config.numMelBins;
+
+    if (extractor == nullptr || extractor->getConfig() != config)
+        extractor = std::make_unique<FeatureExtractor> (config);
+
+    for (const auto& stale : staleFrames)
+    {
+        const auto numStale = (int) stale.getLength();
+        const auto modelStart = stale.getStart() * config.hopSize - config.fftSize / 2;
+        const auto numModel = (numStale - 1) * config.hopSize + config.fftSize;
+        const auto sourceRange = getSourceSamplesFor (config, source.sampleRate, stale);
+        const auto numSource = (int) sourceRange.getLength();
+
+        // Mixed down and resampled as the AnalysisEngine does
+        const auto numChannelsToMix = juce::jmin (2, source.stream->getNumChannels());
+        const auto gain = 1.0f / (float) numChannelsToMix;
+
+        staleSource.setSize (1, numSource, false, false, true);
+        staleSource.clear();
+        auto* mono = staleSource.getWritePointer (0);
+
+        const auto ok = source.stream->visit (sourceRange,
+                                              [&] (const SourceStream::Chunk& chunk, int startInChunk, juce::int64 position, int numSamples)
+        {
+            for (int c = 0; c < numChannelsToMix; ++c)
+                juce::FloatVectorOperations::addWithMultiply (mono + (position - sourceRange.getStart()),
+                                                              chunk.audio.getReadPointer (c, startInChunk),
+                                                              gain, numSamples);
+        });
+
+        if (! ok)
+            return false;
+
+        modelAudio.resize ((size_t) numModel);
+        FeatureExtractor::resample (mono, sourceRange.getStart(), numSource, modelAudio.data(), modelStart, numModel,
+                                    source.sampleRate, config.sampleRate);
+
+        const auto offset = (size_t) (stale.getStart() - frames.getStart());
+        staleVoicing.resize ((size_t) numStale);
+        extractor->processFrames (modelAudio.data(), numStale, f0.data() + offset, staleVoicing.data(), mel.data() + offset * numBins);
+    }
+
+    return true;
+}
+
+std::vector<SegmentCache::Buffer> SegmentSynthesiser::renderNeural (const Source& source,
+                                                                   const std::vector<juce::Range<juce::int64>>& ranges,
+                                                                   int numChannels, juce::int64 priority)
+{
+    const auto& config = source.analysis->config;
+    const auto numBins = (size_t) config.numMelBins;
+    std::vector<SegmentCache::Buffer> rendered (ranges.size());
+
+    // Each range is rendered from its own frame window, the same whatever it's
+    // rendered with, so that playback and bounces produce identical audio. The
+    // features of all of them are gathered first, to queue them together.
+    std::vector<juce::Range<juce::int64>> frameWindows;
+    constexpr auto notGathered = std::numeric_limits<size_t>::max();
+    std::vector<size_t> firstFrames;    // in requestF0, or notGathered
+    requestMel.clear();
+    requestF0.clear();
+
+    for (const auto& range : ranges)
+    {
+        const auto frames = getFrameWindow (source, range);
+        frameWindows.push_back (frames);
+
+        if (! gatherFeatures (source, frames, true))
+        {
+            firstFrames.push_back (notGathered);
+            continue;
+        }
+
+        firstFrames.push_back (requestF0.size());
+        requestMel.insert (requestMel.end(), mel.begin(), mel.end());
+        requestF0.insert (requestF0.end(), f0.begin(), f0.end());
+    }
+
+    modelAudio.resize (requestF0.size() * (size_t) config.hopSize);
+
+    std::vector<Vocoder::Request> requests;
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+        if (firstFrames[i] != notGathered)
+            requests.push_back ({ requestMel.data() + firstFrames[i] * numBins,
+                                  requestF0.data() + firstFrames[i],
+                                  (int) frameWindows[i].getLength(),
+                                  modelAudio.data() + firstFrames[i] * (size_t) config.hopSize });
+
+    if (scheduler != nullptr)
+        scheduler->render (*vocoder, requests.data(), (int) requests.size(), priority);
+    else
+        for (auto& request : requests)
+            request.succeeded = vocoder->render (request.mel, request.f0, request.numFrames, request.output);
+
+    auto request = requests.begin();
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        if (firstFrames[i] == notGathered || ! (request++)->succeeded)
+            continue;
+
+        const auto& frames = frameWindows[i];
+        auto audio = std::make_shared<juce::AudioBuffer<float>> (numChannels, (int) ranges[i].getLength() + RenderTrack::crossfadeLength);
+
+        FeatureExtractor::resample (modelAudio.data() + firstFrames[i] * (size_t) config.hopSize,
+                                    frames.getStart() * config.hopSize, (int) frames.getLength() * config.hopSize,
+                                    audio->getWritePointer (0), ranges[i].getStart(), audio->getNumSamples(),
+                                    config.sampleRate, source.sampleRate);
+
+        for (int c = 1; c < numChannels; ++c)
+            audio->copyFrom (c, 0, *audio, 0, 0, audio->getNumSamples());
+
+        rendered[i] = std::move (audio);
+    }
+
+    return rendered;
+}
+
+bool SegmentSynthesiser::renderDry (const Source& source, juce::Range<juce::int64> range, juce::AudioBuffer<float>& output)
+{
+    if (source.hasTimeMap())
+        return renderStretchedDry (source, range, output);
+
+    const auto numChannelsToRead = juce::jmin (output.getNumChannels(), source.stream->getNumChannels());
+
+    if (! source.stream->read (output.getArrayOfWritePointers(), numChannelsToRead, range.getStart(), output.getNumSamples()))
+        return false;
+
+    for (int c = numChannelsToRead; c < output.getNumChannels(); ++c)
+        output.copyFrom (c, 0, output, c % numChannelsToRead, 0, output.getNumSamples());
+
+    return true;
+}
+
+bool SegmentSynthesiser::renderStretchedDry (const Source& source, juce::Range<juce::int64> range, juce::AudioBuffer<float>& output)
+{
+    constexpr int grainHop = dryGrainLength / 2;
+    const auto numChannels = output.getNumChannels();
+    const auto& window = getDryGrainWindow();
+
+    grain.setSize (numChannels, dryGrainLength, false, false, true);
+    output.clear();
+
+    // Grain g covers rendered samples [g * grainHop, g * grainHop + dryGrainLength)
+    // and is read around the source position its centre maps to. Periodic Hann
+    // windows at half overlap sum to one, and the grains sit at fixed positions,
+    // so ranges rendered separately join up exactly.
+    const auto firstGrain = floorDivide (range.getStart() - dryGrainLength, grainHop) + 1;
+    const auto lastGrain = floorDivide (range.getEnd() - 1, grainHop);
+
+    for (auto g = firstGrain; g <= lastGrain; ++g)
+    {
+        const auto grainStart = g * grainHop;
+        const auto centre = source.sourceStart + (double) (grainStart + grainHop) * source.timeRatio;
+
+        if (! source.stream->read (grain.getArrayOfWritePointers(), numChannels, (juce::int64) std::llround (centre) - grainHop, dryGrainLength))
+            return false;
+
+        const auto overlap = range.getIntersectionWith ({ grainStart, grainStart + dryGrainLength });
+        const auto indexInGrain = (int) (overlap.getStart() - grainStart);
+        const auto indexInOutput = (int) (overlap.getStart() - range.getStart());
+
+        for (int c = 0; c < numChannels; ++c)
+            juce::FloatVectorOperations::addWithMultiply (output.getWritePointer (c, indexInOutput),
+                                                          grain.getReadPointer (c, indexInGrain),
+                                                          window.data() + indexInGrain,
+                                                          (int) overlap.getLength());
+    }
+
+    return true;
+}
+
+} // namespace hifitune
@@ -0,0 +1,160 @@
+/*
+  ==============================================================================
+
+    This file contains the code that renders one segment of a RenderTrack.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include "DocumentArena.h"
+#include "InferenceScheduler.h"
+#include "PitchCurve.h"
+#include "RenderTrack.h"
+#include "SampleChangeLog.h"
+#include "SegmentCache.h"
+#include "SourceAnalysis.h"
+#include "SourceStream.h"
+#include "Vocoder.h"
+
+namespace hifitune
+{
+
+class FeatureExtractor;
+
+//==============================================================================
+/**
+    Produces the audio for ranges of source samples, either by running the
+    vocoder over the analysed (and pitch-edited) features or, when no analysis
+    or model is available yet, by reading the dry source audio.
+
+    Every rendered segment carries a key hashing all of its inputs. Neural
+    segments are looked up in and added to a SegmentCache by that key, so only
+    segments whose inputs actually changed are synthesised again.
+
+    With an InferenceScheduler, vocoder calls are queued there, so that they
+    can be batched with those of other threads.
+
+    Ranges are in rendered samples, which are source samples unless the Source
+    has a time map, as playback regions stretched to a different duration do.
+    Those are rendered from the analysed features resampled in time, so that the
+    vocoder stretches without changing pitch or formants; dry audio is stretched
+    by overlap-adding windowed grains read from the mapped positions.
+
+    Frames whose windows reach source audio the host has changed since the
+    analysis was made are analysed again here, from the source stream, so that
+    edited audio renders with its own features while the AnalysisEngine is
+    still catching up.
+
+    Instances hold scratch buffers, so each rendering thread needs its own.
+    With a DocumentArena, the buffers are borrowed from it and given back on
+    destruction, so that instances created for every render don't reallocate.
+*/
+class SegmentSynthesiser
+{
+public:
+    //==============================================================================
+    /** Everything needed to render one audio modification. */
+    struct Source
+    {
+        double sampleRate = 44100.0;
+        SourceStream* stream = nullptr;                 // used for dry rendering
+        const SampleChangeLog* changes = nullptr;       // the host's edits to the source audio, if known
+        juce::uint64 analysedGeneration = 0;            // the last of those the analysis reflects
+        std::shared_ptr<const SourceAnalysis> analysis;
+        std::shared_ptr<const PitchCurve> pitchCurve;   // may be null if there are no edits
+
+        // Rendered sample x plays source position sourceStart + x * timeRatio
+        double sourceStart = 0.0;
+        double timeRatio = 1.0;
+
+        bool hasTimeMap() const noexcept    { return ! juce::exactlyEqual (timeRatio, 1.0) || ! juce::exactlyEqual (sourceStart, 0.0); }
+    };
+
+    /** Frames of context rendered on either side of a segment and then discarded,
+        so that segment edges sound the same as the middle.
+    */
+    static constexpr int contextFrames = 8;
+
+    /** Length of the grains dry audio is stretched with, overlapping by half. */
+    static constexpr int dryGrainLength = 1024;
+
+    SegmentSynthesiser (Vocoder* vocoder, SegmentCache* cache = nullptr, InferenceScheduler* scheduler = nullptr,
+                        DocumentArena* arena = nullptr);
+    ~SegmentSynthesiser();
+
+    /** Returns the best quality that can currently be rendered for this source. */
+    RenderedSegment::Quality getAvailableQuality (const Source&) const noexcept;
+
+    /** Returns the key a segment rendered now for this range would get, or 0 if
+        nothing can be rendered. It covers the analysis, the pitch edits within
+        reach of the range, the model and the output format, plus for dry
+        segments the host's changes to the source audio in the range, so it
+        changes exactly when the rendered audio would.
+    */
+    juce::uint64 getSegmentKey (const Source&, juce::Range<juce::int64> range, int numChannels);
+
+    /** Returns a hash of the identity of everything getSegmentKey() depends on
+        apart from the range: the analysis, the pitch curve, the model, the time
+        map and the generations of the host's changes. Whenever any segment's
+        key could have changed, so has this, but it costs no feature gathering,
+        so that renderers can skip segments they have already found up to date.
+    */
+    juce::uint64 getInputsStamp (const Source&, int numChannels) const;
+
+    /** Renders a list of ranges, typically consecutive segments of a RenderTrack.
+        Cached segments are taken from the cache. The missing ones each get a
+        vocoder call of their own, over a frame window that only depends on
+        their range, so a segment sounds the same however the ranges are
+        grouped; the calls are queued together, to be batched. Returns one
+        segment per range, or nullptr where rendering failed.
+
+        Each segment's audio extends RenderTrack::crossfadeLength samples past
+        the end of its range.
+
+        The priority is passed on to the InferenceScheduler, if there is one.
+    */
+    std::vector<std::unique_ptr<RenderedSegment>> render (const Source&,
+                                                          const std::vector<juce::Range<juce::int64>>& ranges,
+                                                          int numChannels,
+                                                          juce::int64 priority = InferenceScheduler::immediatePriority);
+
+private:
+    //==============================================================================
+    juce::Range<juce::int64> getFrameWindow (const Source&, juce::Range<juce::int64> range) const noexcept;
+    juce::Range<juce::int64> getSourceFrames (const Source&, juce::Range<juce::int64> frames) const noexcept;
+    bool gatherFeatures (const Source&, juce::Range<juce::int64> frames, bool includeMel);
+    bool gatherAnalysedFeatures (const Source&, juce::Range<juce::int64> frames, bool includeMel);
+    void stretchFeatures (const Source&, juce::Range<juce::int64> frames, juce::Range<juce::int64> sourceFrames, bool includeMel);
+    void findStaleFrames (const Source&, juce::Range<juce::int64> frames);
+    bool analyseStaleFrames (const Source&, juce::Range<juce::int64> frames);
+
+    std::vector<SegmentCache::Buffer> renderNeural (const Source&, const std::vector<juce::Range<juce::int64>>& ranges,
+                                                    int numChannels, juce::int64 priority);
+    bool renderDry (const Source&, juce::Range<juce::int64> range, juce::AudioBuffer<float>& output);
+    bool renderStretchedDry (const Source&, juce::Range<juce::int64> range, juce::AudioBuffer<float>& output);
+
+    Vocoder* vocoder;
+    SegmentCache* cache;
+    InferenceScheduler* scheduler;
+    DocumentArena* arena;
+    std::vector<float> mel, f0, modelAudio;
+    std::vector<float> requestMel, requestF0;       // the features of every range rendered at once
+
+    // For frames the analysis is out of date for; only created when there are some
+    std::vector<juce::Range<juce::int64>> staleFrames;
+    std::unique_ptr<FeatureExtractor> extractor;
+    juce::AudioBuffer<float> staleSource;
+    std::vector<float> staleVoicing;
+
+    // For sources with a time map
+    std::vector<float> stretchedMel, stretchedF0;
+    juce::AudioBuffer<float> grain;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SegmentSynthesiser)
+};
+
+} // namespace hifitune
@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    This file contains the analysis results kept for each audio source.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "ContentHash.h"
+#include "FeatureConfig.h"
+#include "SourceOverview.h"
+
+#include <mutex>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    The per-frame features extracted from one audio source.
+
+    The feature arrays either live on the heap, after allocate(), or are views
+    into memory owned by someone else, typically a file mapped by the
+    AnalysisStore, which keeps them out of resident memory until they're read.
+
+    Instances are immutable once published by the AnalysisEngine, so they can be
+    shared freely between the document controller, renderers and the editor.
+*/
+struct SourceAnalysis
+{
+    FeatureConfig config;
+    double sourceSampleRate = 44100.0;
+    juce::int64 sourceLength = 0;
+    int numFrames = 0;
+
+    // Identifies the feature data, so that caches keyed on it survive re-analysis
+    // of unchanged audio
+    juce::uint64 contentHash = 0;
+
+    const float* f0 = nullptr;          // numFrames values in Hz, 0 where unvoiced
+    const float* voicing = nullptr;     // numFrames values, 0..1 voicing confidence
+    const float* mel = nullptr;         // numFrames * numMelBins, log-magnitude, frame-major
+
+    // What the editor draws. Analyses restored from older documents only have
+    // the pitch in it, as the waveform needs the source audio.
+    std::shared_ptr<const SourceOverview> overview;
+
+    //==============================================================================
+    SourceAnalysis() = default;
+
+    const float* getMelFrame (int frame) const noexcept
+    {
+        jassert (juce::isPositiveAndBelow (frame, numFrames));
+        return mel + (size_t) frame * (size_t) config.numMelBins;
+    }
+
+    size_t getNumMelValues() const noexcept         { return (size_t) numFrames * (size_t) config.numMelBins; }
+
+    /** Returns the distance between frames in source samples. */
+    double getSourceSamplesPerFrame() const noexcept    { return config.hopSize * sourceSampleRate / config.sampleRate; }
+
+    /** Writable pointers to heap-allocated feature arrays. */
+    struct Writable
+    {
+        float* f0;
+        float* voicing;
+        float* mel;
+    };
+
+    /** Allocates zeroed heap storage for the given number of frames. */
+    Writable allocate (int numFramesToUse)
+    {
+        numFrames = numFramesToUse;
+        heapStorage.assign ((size_t) numFrames * 2 + getNumMelValues(), 0.0f);
+        externalStorage.reset();
+
+        auto* data = heapStorage.data();
+        f0 = data;
+        voicing = data + numFrames;
+        mel = data + (size_t) numFrames * 2;
+
+        return { data, data + numFrames, data + (size_t) numFrames * 2 };
+    }
+
+    /** Points the feature arrays at memory kept alive by the given owner. */
+    void useExternalStorage (std::shared_ptr<const void> owner, const float* f0In, const float* voicingIn, const float* melIn)
+    {
+        heapStorage = {};
+        externalStorage = std::move (owner);
+        f0 = f0In;
+        voicing = voicingIn;
+        mel = melIn;
+    }
+
+    void updateContentHash() noexcept
+    {
+        contentHash = ContentHash().add (f0, (size_t) numFrames * sizeof (float))
+                                   .add (mel, getNumMelValues() * sizeof (float))
+                                   .get();
+    }
+
+    //==============================================================================
+    /** Frames per block hashed by getFrameRangeHash(). */
+    static constexpr int framesPerHashBlock = 32;
+
+    /** Returns a hash of the features of the frames in a range, which only
+        changes if those frames (or others in the same blocks of
+        framesPerHashBlock) do. Unlike contentHash, it survives re-analysis of
+        audio that changed somewhere else in the source. Frames outside the
+        analysis count as silent.
+
+        Block hashes are computed on first use, so only the parts of a source
+        that are actually rendered are ever read for this.
+    */
+    juce::uint64 getFrameRangeHash (juce::Range<juce::int64> frames) const
+    {
+        ContentHash hash;
+        hash.add (frames.getStart()).add (frames.getLength());
+
+        const auto inside = frames.getIntersectionWith ({ 0, (juce::int64) numFrames });
+
+        if (inside.isEmpty())
+            return hash.get();
+
+        std::call_once (blockHashesCreated, [this]
+        {
+            blockHashes = std::make_unique<std::atomic<juce::uint64>[]> ((size_t) getNumHashBlocks());
+        });
+
+        const auto firstBlock = (int) (inside.getStart() / framesPerHashBlock);
+        const auto lastBlock = (int) ((inside.getEnd() - 1) / framesPerHashBlock);
+
+        for (auto block = firstBlock; block <= lastBlock; ++block)
+            hash.add (getBlockHash (block));
+
+        return hash.get();
+    }
+
+private:
+    //==============================================================================
+    int getNumHashBlocks() const noexcept       { return (numFrames + framesPerHashBlock - 1) / framesPerHashBlock; }
+
+    juce::uint64 getBlockHash (int block) const noexcept
+    {
+        auto& cached = blockHashes[(size_t) block];
+
+        if (const auto known = cached.load (std::memory_order_relaxed); known != 0)
+            return known;
+
+        // Threads racing for the same block compute the same value
+        const auto first = block * framesPerHashBlock;
+        const auto numInBlock = juce::jmin (framesPerHashBlock, numFrames - first);
+        const auto bins = (size_t) config.numMelBins;
+
+        const auto computed = ContentHash().add (f0 + first, (size_t) numInBlock * sizeof (float))
+                                           .add (mel + (size_t) first * bins, (size_t) numInBlock * bins * sizeof (float))
+                                           .get() | 1;
+        cached.store (computed, std::memory_order_relaxed);
+        return computed;
+    }
+
+    std::vector<float> heapStorage;
+    std::shared_ptr<const void> externalStorage;
+
+    // 0 where not computed yet
+    mutable std::unique_ptr<std::atomic<juce::uint64>[]> blockHashes;
+    mutable std::once_flag blockHashesCreated;
+
+    JUCE_DECLARE_NON_COPYABLE (SourceAnalysis)
+};
+
+} // namespace hifitune
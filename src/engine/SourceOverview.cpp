@@ -0,0 +1,266 @@
+/*
+  ==============================================================================
+
+    This file contains the multi-resolution waveform and pitch overview of a source.
+
+  ==============================================================================
+*/
+
+#include "SourceOverview.h"
+
+namespace hifitune
+{
+
+namespace
+{
+    constexpr juce::uint64 overviewVersion = 1;
+
+    // Pitch is stored in cents, which is finer than any editor draws it
+    constexpr float pitchStepsPerNote = 100.0f;
+
+    // Sanity limit for sizes read from storage
+    constexpr juce::uint64 maxEntries = (juce::uint64) 1 << 32;
+
+    juce::int16 toPeakValue (float sample) noexcept
+    {
+        return (juce::int16) juce::roundToInt (juce::jlimit (-1.0f, 1.0f, sample) * SourceOverview::Peak::fullScale);
+    }
+}
+
+//==============================================================================
+SourceOverview::Peak SourceOverview::Peak::combine (const Peak* peaks, int num) noexcept
+{
+    if (num <= 0)
+        return {};
+
+    Peak result { std::numeric_limits<juce::int16>::max(), std::numeric_limits<juce::int16>::min(), 0 };
+    double sumOfSquares = 0.0;
+
+    for (int i = 0; i < num; ++i)
+    {
+        result.minValue = juce::jmin (result.minValue, peaks[i].minValue);
+        result.maxValue = juce::jmax (result.maxValue, peaks[i].maxValue);
+        sumOfSquares += (double) peaks[i].rms * peaks[i].rms;
+    }
+
+    result.rms = (juce::int16) std::sqrt (sumOfSquares / num);
+    return result;
+}
+
+SourceOverview::PitchRange SourceOverview::PitchRange::combine (const PitchRange* ranges, int num) noexcept
+{
+    PitchRange result;
+
+    for (int i = 0; i < num; ++i)
+    {
+        if (! ranges[i].isVoiced())
+            continue;
+
+        result.lowNote = result.isVoiced() ? juce::jmin (result.lowNote, ranges[i].lowNote) : ranges[i].lowNote;
+        result.highNote = juce::jmax (result.highNote, ranges[i].highNote);
+    }
+
+    return result;
+}
+
+//==============================================================================
+template <typename Entry>
+SourceOverview::Levels<Entry>::Levels (std::vector<Entry> finest, double unitLengthIn, double originIn)
+    : unitLength (unitLengthIn), origin (originIn)
+{
+    levels.push_back (std::move (finest));
+
+    while (levels.back().size() > 1)
+    {
+        const auto& below = levels.back();
+        std::vector<Entry> above ((below.size() + levelFactor - 1) / levelFactor);
+
+        for (size_t i = 0; i < above.size(); ++i)
+        {
+            const auto first = i * levelFactor;
+            above[i] = Entry::combine (below.data() + first, (int) juce::jmin ((size_t) levelFactor, below.size() - first));
+        }
+
+        levels.push_back (std::move (above));
+    }
+}
+
+template <typename Entry>
+void SourceOverview::Levels<Entry>::get (Entry* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept
+{
+    // The coarsest level with entries no longer than a column
+    size_t level = 0;
+    auto entryLength = unitLength;
+
+    while (level + 1 < levels.size() && entryLength * levelFactor <= samplesPerColumn)
+    {
+        ++level;
+        entryLength *= levelFactor;
+    }
+
+    const auto& entries = levels[level];
+    const auto numEntries = (juce::int64) entries.size();
+
+    for (int column = 0; column < numColumns; ++column)
+    {
+        const auto start = (firstSample + column * samplesPerColumn - origin) / entryLength;
+        const auto end = (firstSample + (column + 1) * samplesPerColumn - origin) / entryLength;
+
+        const auto first = juce::jlimit ((juce::int64) 0, numEntries, (juce::int64) std::floor (start));
+        const auto last = juce::jlimit ((juce::int64) 0, numEntries, juce::jmax ((juce::int64) std::floor (start) + 1,
+                                                                                 (juce::int64) std::ceil (end)));
+
+        dest[column] = Entry::combine (entries.data() + first, (int) (last - first));
+    }
+}
+
+//==============================================================================
+SourceOverview::SourceOverview (std::vector<Peak> peaks, std::vector<PitchRange> pitch, double samplesPerFrameIn)
+    : peakLevels (std::move (peaks), samplesPerPeak, 0.0),
+      pitchLevels (std::move (pitch), samplesPerFrameIn, -0.5 * samplesPerFrameIn),    // frames are centred on their position
+      samplesPerFrame (samplesPerFrameIn)
+{
+}
+
+void SourceOverview::computePeaks (const float* const* channels, int numChannels, int numSamples, Peak* dest) noexcept
+{
+    for (int start = 0; start < numSamples; start += samplesPerPeak)
+    {
+        const auto num = juce::jmin (samplesPerPeak, numSamples - start);
+        auto minValue = std::numeric_limits<float>::max(), maxValue = std::numeric_limits<float>::lowest();
+        double sumOfSquares = 0.0;
+
+        for (int c = 0; c < numChannels; ++c)
+        {
+            const auto* samples = channels[c] + start;
+            const auto range = juce::FloatVectorOperations::findMinAndMax (samples, num);
+
+            minValue = juce::jmin (minValue, range.getStart());
+            maxValue = juce::jmax (maxValue, range.getEnd());
+
+            for (int i = 0; i < num; ++i)
+                sumOfSquares += (double) samples[i] * samples[i];
+        }
+
+        auto& peak = dest[start / samplesPerPeak];
+
+        if (numChannels <= 0)
+        {
+            peak = {};
+            continue;
+        }
+
+        peak.minValue = toPeakValue (minValue);
+        peak.maxValue = toPeakValue (maxValue);
+        peak.rms = toPeakValue ((float) std::sqrt (sumOfSquares / ((double) num * numChannels)));
+    }
+}
+
+std::vector<SourceOverview::PitchRange> SourceOverview::computePitch (const float* f0, int numFrames)
+{
+    std::vector<PitchRange> pitch ((size_t) juce::jmax (0, numFrames));
+
+    for (size_t frame = 0; frame < pitch.size(); ++frame)
+    {
+        if (f0[frame] > 0.0f)
+        {
+            const auto note = 69.0f + 12.0f * std::log2 (f0[frame] / 440.0f);
+            pitch[frame] = { note, note };
+        }
+    }
+
+    return pitch;
+}
+
+//==============================================================================
+void SourceOverview::getPeaks (Peak* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept
+{
+    peakLevels.get (dest, numColumns, firstSample, samplesPerColumn);
+}
+
+void SourceOverview::getPitch (PitchRange* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept
+{
+    pitchLevels.get (dest, numColumns, firstSample, samplesPerColumn);
+}
+
+//==============================================================================
+void SourceOverview::write (ByteWriter& writer) const
+{
+    const auto& peaks = peakLevels.getFinest();
+    const auto& pitch = pitchLevels.getFinest();
+
+    writer.reserve (writer.getSize() + 32 + peaks.size() * 6 + pitch.size() * 2);
+    writer.writeVarint (overviewVersion);
+    writer.writeDouble (samplesPerFrame);
+
+    // Neighbouring peaks are similar, so their deltas stay small
+    writer.writeVarint (peaks.size());
+    Peak previous;
+
+    for (const auto& peak : peaks)
+    {
+        writer.writeSignedVarint (peak.minValue - previous.minValue);
+        writer.writeSignedVarint (peak.maxValue - previous.maxValue);
+        writer.writeSignedVarint (peak.rms - previous.rms);
+        previous = peak;
+    }
+
+    // The finest level has one note per frame, or none
+    writer.writeVarint (pitch.size());
+    juce::int64 previousNote = 0;
+
+    for (const auto& range : pitch)
+    {
+        const auto note = range.isVoiced() ? (juce::int64) std::llround (range.lowNote * pitchStepsPerNote) : 0;
+        writer.writeSignedVarint (note - previousNote);
+        previousNote = note;
+    }
+}
+
+std::shared_ptr<const SourceOverview> SourceOverview::read (ByteReader& reader)
+{
+    if (reader.readVarint() != overviewVersion)
+        return {};
+
+    const auto samplesPerFrame = reader.readDouble();
+    const auto numPeaks = reader.readVarint();
+
+    // Every peak takes at least three bytes
+    if (reader.hasFailed() || numPeaks > maxEntries || numPeaks > reader.getNumBytesRemaining() / 3
+        || ! (samplesPerFrame > 0.0))
+        return {};
+
+    std::vector<Peak> peaks ((size_t) numPeaks);
+    Peak previous;
+
+    for (auto& peak : peaks)
+    {
+        peak.minValue = (juce::int16) (previous.minValue + reader.readSignedVarint());
+        peak.maxValue = (juce::int16) (previous.maxValue + reader.readSignedVarint());
+        peak.rms = (juce::int16) (previous.rms + reader.readSignedVarint());
+        previous = peak;
+    }
+
+    const auto numFrames = reader.readVarint();
+
+    if (reader.hasFailed() || numFrames > maxEntries || numFrames > reader.getNumBytesRemaining())
+        return {};
+
+    std::vector<PitchRange> pitch ((size_t) numFrames);
+    juce::int64 note = 0;
+
+    for (auto& range : pitch)
+    {
+        note += reader.readSignedVarint();
+
+        if (note != 0)
+            range.lowNote = range.highNote = (float) note / pitchStepsPerNote;
+    }
+
+    if (reader.hasFailed())
+        return {};
+
+    return std::make_shared<const SourceOverview> (std::move (peaks), std::move (pitch), samplesPerFrame);
+}
+
+} // namespace hifitune
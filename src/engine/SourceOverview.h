@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    This file contains the multi-resolution waveform and pitch overview of a source.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "BinaryCoding.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    What the editor draws for an audio source: waveform peaks (minimum, maximum
+    and RMS over all channels) and the range of the detected pitch, each kept
+    at several resolutions.
+
+    The finest waveform level has one peak per samplesPerPeak source samples
+    and the finest pitch level one entry per analysis frame; every level above
+    combines levelFactor entries of the one below. Drawing at any zoom reads
+    the coarsest level that still has at least one entry per column, so a column
+    combines at most a handful of entries, and an hour of audio draws as
+    quickly as a second of it, without reading source samples or features.
+
+    The AnalysisEngine builds an overview while it analyses a source, from the
+    audio it reads anyway, and it is stored with the analysis. Instances are
+    immutable.
+*/
+class SourceOverview
+{
+public:
+    //==============================================================================
+    static constexpr int samplesPerPeak = 256;
+    static constexpr int levelFactor = 4;
+
+    /** Sample values as 16-bit fractions of full scale. */
+    struct Peak
+    {
+        juce::int16 minValue = 0, maxValue = 0, rms = 0;
+
+        static constexpr float fullScale = 32767.0f;
+
+        static Peak combine (const Peak* peaks, int num) noexcept;
+    };
+
+    /** The lowest and highest pitch, as MIDI note numbers, of the voiced frames
+        in a span. Both are zero if none of them is voiced.
+    */
+    struct PitchRange
+    {
+        float lowNote = 0.0f, highNote = 0.0f;
+
+        bool isVoiced() const noexcept      { return highNote > 0.0f; }
+
+        static PitchRange combine (const PitchRange* ranges, int num) noexcept;
+    };
+
+    //==============================================================================
+    /** Creates an overview from its finest levels. samplesPerFrame is the distance
+        between analysis frames in source samples.
+    */
+    SourceOverview (std::vector<Peak> peaks, std::vector<PitchRange> pitch, double samplesPerFrame);
+
+    /** Computes the peaks of numSamples samples, writing one for every
+        samplesPerPeak of them, the last one possibly covering fewer.
+    */
+    static void computePeaks (const float* const* channels, int numChannels, int numSamples, Peak* dest) noexcept;
+
+    /** Converts an F0 curve (in Hz, 0 where unvoiced) to the finest pitch level. */
+    static std::vector<PitchRange> computePitch (const float* f0, int numFrames);
+
+    //==============================================================================
+    int getNumPeaks() const noexcept            { return (int) peakLevels.getFinest().size(); }
+    int getNumPitchFrames() const noexcept      { return (int) pitchLevels.getFinest().size(); }
+
+    /** Writes the combined peaks of numColumns consecutive columns of source
+        samples, starting at firstSample.
+    */
+    void getPeaks (Peak* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept;
+
+    /** Like getPeaks(), for the pitch. */
+    void getPitch (PitchRange* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept;
+
+    //==============================================================================
+    /** Appends the finest levels; the others are rebuilt when reading. */
+    void write (ByteWriter&) const;
+
+    /** Reads what write() wrote, or returns nullptr if it is malformed. */
+    static std::shared_ptr<const SourceOverview> read (ByteReader&);
+
+private:
+    //==============================================================================
+    /** Successively coarser copies of a sequence of entries, each entry of the
+        finest level covering unitLength source samples from origin.
+    */
+    template <typename Entry>
+    class Levels
+    {
+    public:
+        Levels (std::vector<Entry> finest, double unitLength, double origin);
+
+        const std::vector<Entry>& getFinest() const noexcept    { return levels.front(); }
+
+        void get (Entry* dest, int numColumns, double firstSample, double samplesPerColumn) const noexcept;
+
+    private:
+        std::vector<std::vector<Entry>> levels;
+        double unitLength, origin;
+    };
+
+    Levels<Peak> peakLevels;
+    Levels<PitchRange> pitchLevels;
+    double samplesPerFrame;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SourceOverview)
+};
+
+} // namespace hifitune
@@ -0,0 +1,393 @@
+/*
+  ==============================================================================
+
+    This file contains the chunked, read-ahead access to source audio.
+
+  ==============================================================================
+*/
+
+#include "SourceStream.h"
+#include "Instrumentation.h"
+
+#include <deque>
+
+namespace hifitune
+{
+
+namespace
+{
+    constexpr int chunkAlignment = 64;
+
+    // Requests beyond this are dropped rather than queued; the consumer will
+    // read those chunks itself when it gets there
+    constexpr size_t maxQueuedReads = 256;
+
+    // Idle buffers a pool keeps on top of those the read-ahead needs
+    constexpr size_t numSpareBuffers = 2;
+}
+
+//==============================================================================
+/** Recycles the buffers of chunks once nobody is using them any more. */
+class SourceStream::BufferPool
+{
+public:
+    BufferPool (int numChannelsIn, int lengthIn, size_t maxIdleIn)
+        : numChannels (numChannelsIn), length (lengthIn), maxIdle (maxIdleIn)
+    {
+    }
+
+    std::unique_ptr<Chunk> take()
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (! idle.empty())
+            {
+                auto chunk = std::move (idle.back());
+                idle.pop_back();
+                return chunk;
+            }
+        }
+
+        auto chunk = std::make_unique<Chunk>();
+        chunk->audio.setSize (numChannels, length);
+        return chunk;
+    }
+
+    /** Wraps a chunk so that its buffer comes back here when the last user lets go. */
+    static ChunkPtr share (const std::shared_ptr<BufferPool>& pool, std::unique_ptr<Chunk> chunk)
+    {
+        return ChunkPtr (chunk.release(), [pool] (const Chunk* released)
+        {
+            pool->give (std::unique_ptr<Chunk> (const_cast<Chunk*> (released)));
+        });
+    }
+
+private:
+    void give (std::unique_ptr<Chunk> chunk)
+    {
+        const juce::ScopedLock sl (lock);
+
+        if (idle.size() < maxIdle)
+            idle.push_back (std::move (chunk));
+    }
+
+    const int numChannels, length;
+    const size_t maxIdle;
+    std::vector<std::unique_ptr<Chunk>> idle;
+    juce::CriticalSection lock;
+};
+
+//==============================================================================
+/** Reads chunks ahead for every stream in the process, oldest request first. */
+class SourceStream::ReadAheadThread  : public juce::Thread
+{
+public:
+    ReadAheadThread()
+        : juce::Thread ("HiFiTune Read-Ahead")
+    {
+        startThread();
+    }
+
+    ~ReadAheadThread() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread (-1);
+    }
+
+    void add (SourceStream& stream, int index)
+    {
+        {
+            const juce::ScopedLock sl (lock);
+
+            if (queue.size() >= maxQueuedReads
+                || std::find (queue.begin(), queue.end(), Request { &stream, index }) != queue.end())
+                return;
+
+            queue.push_back ({ &stream, index });
+        }
+
+        notify();
+    }
+
+    /** Forgets a stream's requests, waiting if one of them is being read right now. */
+    void cancel (SourceStream& stream)
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl (lock);
+                queue.erase (std::remove_if (queue.begin(), queue.end(), [&] (const Request& r) { return r.stream == &stream; }),
+                             queue.end());
+
+                if (currentStream != &stream)
+                    return;
+            }
+
+            requestFinished.wait (10);
+        }
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            Request request;
+
+            {
+                const juce::ScopedLock sl (lock);
+
+                if (! queue.empty())
+                {
+                    request = queue.front();
+                    queue.pop_front();
+                    currentStream = request.stream;
+                }
+            }
+
+            if (request.stream == nullptr)
+            {
+                wait (100);
+                continue;
+            }
+
+            request.stream->readAhead (request.index);
+
+            {
+                const juce::ScopedLock sl (lock);
+                currentStream = nullptr;
+            }
+
+            requestFinished.signal();
+        }
+    }
+
+private:
+    struct Request
+    {
+        SourceStream* stream = nullptr;
+        int index = 0;
+
+        bool operator== (const Request& other) const noexcept   { return stream == other.stream && index == other.index; }
+    };
+
+    std::deque<Request> queue;
+    SourceStream* currentStream = nullptr;
+    juce::CriticalSection lock;
+    juce::WaitableEvent requestFinished;
+};
+
+//==============================================================================
+SourceStream::SourceStream (std::unique_ptr<juce::AudioFormatReader> readerIn, const Options& optionsIn)
+    : reader (std::move (readerIn)),
+      lengthInSamples (juce::jmax ((juce::int64) 0, reader->lengthInSamples)),
+      numChannels ((int) juce::jmax (1u, reader->numChannels)),
+      sampleRate (reader->sampleRate),
+      chunkLength ((juce::jmax (1, optionsIn.chunkLength) + chunkAlignment - 1) / chunkAlignment * chunkAlignment),
+      numChunks ((int) ((lengthInSamples + chunkLength - 1) / chunkLength)),
+      options (optionsIn),
+      bufferPool (std::make_shared<BufferPool> (numChannels, chunkLength,
+                                                (size_t) juce::jmax (0, options.readAheadChunks) + 1 + numSpareBuffers)),
+      chunkFinished (true)
+{
+}
+
+SourceStream::~SourceStream()
+{
+    readAheadThread->cancel (*this);
+}
+
+int SourceStream::getChunkIndexFor (juce::int64 sample) const noexcept
+{
+    return (int) juce::jlimit ((juce::int64) 0, (juce::int64) juce::jmax (0, numChunks - 1), sample / chunkLength);
+}
+
+//==============================================================================
+SourceStream::ChunkPtr SourceStream::getChunk (int index)
+{
+    if (! juce::isPositiveAndBelow (index, numChunks))
+        return {};
+
+    ChunkPtr chunk;
+
+    for (;;)
+    {
+        {
+            const juce::ScopedLock sl (stateLock);
+
+            const auto it = std::find_if (resident.begin(), resident.end(), [index] (const auto& r) { return r.first == index; });
+
+            if (it != resident.end())
+            {
+                resident.splice (resident.begin(), resident, it);
+                chunk = it->second;
+                break;
+            }
+
+            // Nobody is reading it, so read it here
+            if (chunksInFlight.insert (index).second)
+                break;
+
+            chunkFinished.reset();
+        }
+
+        chunkFinished.wait (10);
+    }
+
+    if (chunk == nullptr)
+    {
+        chunk = BufferPool::share (bufferPool, readChunk (index));
+
+        {
+            const juce::ScopedLock sl (stateLock);
+            chunksInFlight.erase (index);
+
+            if (chunk->ok)
+                addResidentLocked (index, chunk);
+        }
+
+        chunkFinished.signal();
+    }
+
+    queueReadAhead (index + 1, index + options.readAheadChunks);
+    return chunk;
+}
+
+bool SourceStream::read (float* const* dest, int numDestChannels, juce::int64 start, int numSamples)
+{
+    const auto range = juce::Range<juce::int64>::withStartAndLength (start, numSamples);
+
+    if (range.getIntersectionWith ({ 0, lengthInSamples }) != range)
+        for (int c = 0; c < numDestChannels; ++c)
+            if (dest[c] != nullptr)
+                juce::FloatVectorOperations::clear (dest[c], numSamples);
+
+    return visit (range, [&] (const Chunk& chunk, int startInChunk, juce::int64 position, int numInChunk)
+    {
+        for (int c = 0; c < numDestChannels; ++c)
+            if (dest[c] != nullptr)
+                juce::FloatVectorOperations::copy (dest[c] + (position - start),
+                                                   chunk.audio.getReadPointer (juce::jmin (c, numChannels - 1), startInChunk),
+                                                   numInChunk);
+    });
+}
+
+void SourceStream::prefetch (juce::Range<juce::int64> samples)
+{
+    samples = samples.getIntersectionWith ({ 0, lengthInSamples });
+
+    if (! samples.isEmpty())
+        queueReadAhead (getChunkIndexFor (samples.getStart()), getChunkIndexFor (samples.getEnd() - 1));
+}
+
+void SourceStream::invalidate (juce::Range<juce::int64> samples)
+{
+    samples = samples.getIntersectionWith ({ 0, lengthInSamples });
+
+    if (samples.isEmpty())
+        return;
+
+    const auto first = getChunkIndexFor (samples.getStart());
+    const auto last = getChunkIndexFor (samples.getEnd() - 1);
+
+    const juce::ScopedLock sl (stateLock);
+
+    for (auto it = resident.begin(); it != resident.end();)
+    {
+        if (it->first < first || it->first > last)
+        {
+            ++it;
+            continue;
+        }
+
+        residentBytes -= (size_t) it->second->audio.getNumChannels() * (size_t) chunkLength * sizeof (float);
+        it = resident.erase (it);
+    }
+}
+
+size_t SourceStream::getResidentBytes() const
+{
+    const juce::ScopedLock sl (stateLock);
+    return residentBytes;
+}
+
+//==============================================================================
+std::unique_ptr<SourceStream::Chunk> SourceStream::readChunk (int index)
+{
+    auto chunk = bufferPool->take();
+    chunk->start = (juce::int64) index * chunkLength;
+
+    const auto numToRead = (int) juce::jmin ((juce::int64) chunkLength, lengthInSamples - chunk->start);
+
+    {
+        const Instrumentation::ScopedTimer timer (Instrumentation::EventType::sourceRead, numToRead);
+        const juce::ScopedLock sl (readerLock);
+        chunk->ok = reader->read (chunk->audio.getArrayOfWritePointers(), numChannels, chunk->start, numToRead);
+    }
+
+    if (numToRead < chunkLength)
+        chunk->audio.clear (numToRead, chunkLength - numToRead);
+
+    return chunk;
+}
+
+void SourceStream::queueReadAhead (int first, int last)
+{
+    last = juce::jmin (last, numChunks - 1);
+
+    for (int index = juce::jmax (0, first); index <= last; ++index)
+    {
+        {
+            const juce::ScopedLock sl (stateLock);
+
+            if (chunksInFlight.count (index) > 0
+                || std::any_of (resident.begin(), resident.end(), [index] (const auto& r) { return r.first == index; }))
+                continue;
+        }
+
+        readAheadThread->add (*this, index);
+    }
+}
+
+void SourceStream::addResidentLocked (int index, ChunkPtr chunk)
+{
+    const auto chunkBytes = (size_t) chunk->audio.getNumChannels() * (size_t) chunkLength * sizeof (float);
+
+    resident.emplace_front (index, std::move (chunk));
+    residentBytes += chunkBytes;
+
+    // Always room for the read-ahead and the chunk being read
+    const auto budget = juce::jmax (options.cacheBudget, (size_t) (juce::jmax (0, options.readAheadChunks) + 1) * chunkBytes);
+
+    while (residentBytes > budget && resident.size() > 1)
+    {
+        resident.pop_back();
+        residentBytes -= chunkBytes;
+    }
+}
+
+void SourceStream::readAhead (int index)
+{
+    {
+        const juce::ScopedLock sl (stateLock);
+
+        if (std::any_of (resident.begin(), resident.end(), [index] (const auto& r) { return r.first == index; })
+            || ! chunksInFlight.insert (index).second)
+            return;
+    }
+
+    auto chunk = BufferPool::share (bufferPool, readChunk (index));
+
+    {
+        const juce::ScopedLock sl (stateLock);
+        chunksInFlight.erase (index);
+
+        if (chunk->ok)
+            addResidentLocked (index, chunk);
+    }
+
+    chunkFinished.signal();
+}
+
+} // namespace hifitune
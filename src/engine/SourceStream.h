@@ -0,0 +1,170 @@
+/*
+  ==============================================================================
+
+    This file contains the chunked, read-ahead access to source audio.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+
+#include <list>
+#include <set>
+
+namespace hifitune
+{
+
+//==============================================================================
+/**
+    Reads an audio source in large, aligned chunks, so that hosts whose sample
+    access is slow (ARAAudioSourceReader calls back into the host for every
+    read) see a few big requests instead of many small ones.
+
+    Chunks are handed out as shared, immutable buffers that consumers read in
+    place. Their memory comes from a pool and goes back to it once the last
+    consumer lets go, so streaming through a long source allocates nothing
+    after the first few chunks.
+
+    A process-wide read-ahead thread fetches the chunks after the ones being
+    read, or any range asked for with prefetch(), while the consumer works on
+    the current ones. Recently used chunks can optionally be kept, up to a
+    budget in bytes, for consumers that keep coming back to the same audio.
+
+    All methods are thread-safe; reads from the underlying reader are never
+    concurrent. None are realtime-safe. The reader is deleted with the stream,
+    on the thread deleting it, as ARAAudioSourceReader requires.
+*/
+class SourceStream
+{
+public:
+    //==============================================================================
+    /** A chunk of source audio. Samples past the end of the source are zero. */
+    struct Chunk
+    {
+        juce::AudioBuffer<float> audio;
+        juce::int64 start = 0;
+        bool ok = false;        // false if the reader failed
+    };
+
+    using ChunkPtr = std::shared_ptr<const Chunk>;
+
+    struct Options
+    {
+        // Samples per chunk, rounded up to a multiple of 64 so that every
+        // chunk starts on a SIMD-friendly boundary
+        int chunkLength = 1 << 16;
+
+        // Chunks fetched in the background after each one read
+        int readAheadChunks = 2;
+
+        // Bytes of recently used chunks to keep for re-reading, 0 to keep only
+        // those being read ahead
+        size_t cacheBudget = 0;
+    };
+
+    SourceStream (std::unique_ptr<juce::AudioFormatReader> reader, const Options& = {});
+
+    /** Cancels any pending read-ahead, blocking until the read-ahead thread has
+        let go of the stream.
+    */
+    ~SourceStream();
+
+    //==============================================================================
+    juce::int64 getLengthInSamples() const noexcept         { return lengthInSamples; }
+    int getNumChannels() const noexcept                     { return numChannels; }
+    double getSampleRate() const noexcept                   { return sampleRate; }
+    int getChunkLength() const noexcept                     { return chunkLength; }
+    int getNumChunks() const noexcept                       { return numChunks; }
+
+    int getChunkIndexFor (juce::int64 sample) const noexcept;
+
+    /** Gives access to the reader, e.g. to fingerprint it. Only safe while
+        nothing else reads from the stream and nothing is being read ahead.
+    */
+    juce::AudioFormatReader& getReader() const noexcept     { return *reader; }
+
+    //==============================================================================
+    /** Returns a chunk, waiting for it to be read if needed, and queues the ones
+        after it for reading ahead. Returns nullptr for indices out of range.
+    */
+    ChunkPtr getChunk (int index);
+
+    /** Calls back with each chunk covering the part of a range inside the source,
+        in order, so that it can be read in place without copying:
+        callback (const Chunk&, int startInChunk, juce::int64 position, int numSamples).
+        Returns false if the reader failed for any of them.
+    */
+    template <typename Callback>
+    bool visit (juce::Range<juce::int64> samples, Callback&& callback)
+    {
+        samples = samples.getIntersectionWith ({ 0, lengthInSamples });
+        bool ok = true;
+
+        for (auto position = samples.getStart(); position < samples.getEnd();)
+        {
+            const auto chunk = getChunk (getChunkIndexFor (position));
+            const auto numSamples = (int) (juce::jmin (samples.getEnd(), chunk->start + chunkLength) - position);
+
+            ok = chunk->ok && ok;
+            callback (*chunk, (int) (position - chunk->start), position, numSamples);
+            position += numSamples;
+        }
+
+        return ok;
+    }
+
+    /** Copies [start, start + numSamples) into dest, from as many chunks as it
+        spans. Parts outside the source are zero. Channels past the source's are
+        copies of its last one. Returns false if the reader failed.
+    */
+    bool read (float* const* dest, int numDestChannels, juce::int64 start, int numSamples);
+
+    /** Queues the chunks covering a range for reading in the background, e.g.
+        the part of the source a consumer will need after the current one.
+    */
+    void prefetch (juce::Range<juce::int64> samples);
+
+    /** Drops the chunks held for a range whose audio has changed, so that they
+        are read again when next needed. Chunks being read at the time may
+        still carry the old audio.
+    */
+    void invalidate (juce::Range<juce::int64> samples);
+
+    /** Returns the number of bytes of chunks currently held by the stream. */
+    size_t getResidentBytes() const;
+
+private:
+    //==============================================================================
+    class ReadAheadThread;
+    class BufferPool;
+
+    std::unique_ptr<Chunk> readChunk (int index);
+    void queueReadAhead (int first, int last);
+    void addResidentLocked (int index, ChunkPtr);
+    void readAhead (int index);
+
+    const std::unique_ptr<juce::AudioFormatReader> reader;
+    const juce::int64 lengthInSamples;
+    const int numChannels;
+    const double sampleRate;
+    const int chunkLength, numChunks;
+    const Options options;
+
+    std::shared_ptr<BufferPool> bufferPool;
+    juce::CriticalSection readerLock;
+
+    // Chunks kept for read-ahead or caching, most recently used first
+    std::list<std::pair<int, ChunkPtr>> resident;
+    std::set<int> chunksInFlight;
+    size_t residentBytes = 0;
+    mutable juce::CriticalSection stateLock;
+    juce::WaitableEvent chunkFinished;
+
+    juce::SharedResourcePointer<ReadAheadThread> readAheadThread;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SourceStream)
+};
+
+} // namespace hifitune
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    This file contains the neural vocoder interface.
+
+  ==============================================================================
+*/
+
+#include "Vocoder.h"
+#include "OnnxVocoder.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+juce::File Vocoder::getModelDirectory()
+{
+    return juce::File::getSpecialLocation (juce::File::userApplicationDataDirectory)
+               .getChildFile ("OpenVPI")
+               .getChildFile ("HiFiTune")
+               .getChildFile ("Models");
+}
+
+juce::File Vocoder::getModelCacheDirectory()
+{
+    return getModelDirectory().getSiblingFile ("ModelCache");
+}
+
+std::unique_ptr<Vocoder> Vocoder::createDefault (const FeatureConfig& config, const InferenceOptions& options)
+{
+    return create ("vocoder", config, options);
+}
+
+std::unique_ptr<Vocoder> Vocoder::create (const juce::String& modelName, const FeatureConfig& config, const InferenceOptions& options)
+{
+    for (const auto precision : getPreferredPrecisions (options.quality))
+        if (auto vocoder = create (modelName, precision, config, options))
+            return vocoder;
+
+    return {};
+}
+
+std::unique_ptr<Vocoder> Vocoder::create (const juce::String& modelName, ModelPrecision precision,
+                                          const FeatureConfig& config, const InferenceOptions& options)
+{
+   #if HIFITUNE_USE_ONNXRUNTIME
+    const auto fileName = modelName + getFileSuffix (precision);
+
+    // An ORT-format conversion, if there is one, can be used without copying its weights
+    auto modelFile = getModelDirectory().getChildFile (fileName + ".ort");
+
+    if (! modelFile.existsAsFile())
+        modelFile = getModelDirectory().getChildFile (fileName + ".onnx");
+
+    if (modelFile.existsAsFile())
+    {
+        try
+        {
+            return std::make_unique<OnnxVocoder> (modelFile, config, options);
+        }
+        catch (const Ort::Exception& e)
+        {
+            juce::ignoreUnused (e);
+            DBG ("Could not load vocoder model: " << e.what());
+        }
+    }
+   #else
+    juce::ignoreUnused (modelName, precision, config, options);
+   #endif
+
+    return {};
+}
+
+std::vector<ModelPrecision> Vocoder::getPreferredPrecisions (ModelQuality quality, const CpuFeatures& cpu)
+{
+    // int8 matrix products are only much faster than fp32 with VNNI, and fp16
+    // only where the CPU computes in it; elsewhere the runtime converts back
+    // to fp32 and the smaller model merely saves memory
+    switch (quality)
+    {
+        case ModelQuality::best:
+            return { ModelPrecision::fp32 };
+
+        case ModelQuality::balanced:
+            if (cpu.fp16Arithmetic)     return { ModelPrecision::fp16, ModelPrecision::fp32 };
+            if (cpu.vnni)               return { ModelPrecision::int8, ModelPrecision::fp32 };
+            return { ModelPrecision::fp32 };
+
+        case ModelQuality::fastest:
+            if (cpu.fp16Arithmetic)     return { ModelPrecision::fp16, ModelPrecision::int8, ModelPrecision::fp32 };
+            return { ModelPrecision::int8, ModelPrecision::fp32 };
+    }
+
+    return { ModelPrecision::fp32 };
+}
+
+juce::String Vocoder::getFileSuffix (ModelPrecision precision)
+{
+    switch (precision)
+    {
+        case ModelPrecision::fp32:  return {};
+        case ModelPrecision::fp16:  return ".fp16";
+        case ModelPrecision::int8:  return ".int8";
+    }
+
+    return {};
+}
+
+//==============================================================================
+void Vocoder::renderBatch (Request* requests, int numRequests)
+{
+    for (int i = 0; i < numRequests; ++i)
+    {
+        auto& request = requests[i];
+        request.succeeded = render (request.mel, request.f0, request.numFrames, request.output);
+    }
+}
+
+} // namespace hifitune
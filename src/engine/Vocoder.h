@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    This file contains the neural vocoder interface.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "CpuFeatures.h"
+#include "FeatureConfig.h"
+
+namespace hifitune
+{
+
+//==============================================================================
+/** The numeric precision a model's weights were exported in. */
+enum class ModelPrecision
+{
+    fp32,
+    fp16,
+    int8        // dynamically quantised
+};
+
+/** How to trade sound quality for inference speed when choosing a precision. */
+enum class ModelQuality
+{
+    best,       // always full precision
+    balanced,   // reduced precision only where the CPU runs it natively
+    fastest     // the fastest precision available
+};
+
+//==============================================================================
+/** How much of the machine model inference may use. */
+struct InferenceOptions
+{
+    int intraOpThreads = 1;     // threads used inside one operator
+    int interOpThreads = 1;     // operators run concurrently; 1 runs the graph sequentially
+    int maxBatchSize = 8;       // requests combined into one model call, if the model allows
+    ModelQuality quality = ModelQuality::balanced;
+};
+
+//==============================================================================
+/**
+    Turns mel frames and an F0 curve back into audio at the model rate.
+
+    Frame k of the input produces output samples [k * hopSize, (k + 1) * hopSize).
+    Implementations must allow render() to be called from several threads at once.
+*/
+class Vocoder
+{
+public:
+    //==============================================================================
+    /** One input to renderBatch(), laid out as for render(). */
+    struct Request
+    {
+        const float* mel = nullptr;
+        const float* f0 = nullptr;
+        int numFrames = 0;
+        float* output = nullptr;
+        bool succeeded = false;
+    };
+
+    //==============================================================================
+    virtual ~Vocoder() = default;
+
+    /** Identifies the model weights; rendered audio is only reusable for the same version. */
+    virtual juce::String getModelVersion() const = 0;
+
+    /** Renders numFrames * hopSize samples into output.
+
+        mel holds numFrames * numMelBins values, frame-major, and f0 holds one
+        value in Hz per frame (0 for unvoiced). Returns false on failure.
+    */
+    virtual bool render (const float* mel, const float* f0, int numFrames, float* output) = 0;
+
+    /** Returns how many requests renderBatch() can usefully combine. */
+    virtual int getMaxBatchSize() const     { return 1; }
+
+    /** Renders several requests, setting each one's succeeded flag. The default
+        renders them one after the other.
+    */
+    virtual void renderBatch (Request* requests, int numRequests);
+
+    //==============================================================================
+    /** Returns the directory the plug-in looks in for its model files. */
+    static juce::File getModelDirectory();
+
+    /** Returns the directory holding optimised copies of the models, made the
+        first time each one is loaded on this machine.
+    */
+    static juce::File getModelCacheDirectory();
+
+    /** Creates the vocoder used for playback, or nullptr if no model can be loaded
+        (for example because the build has no ONNX Runtime support).
+    */
+    static std::unique_ptr<Vocoder> createDefault (const FeatureConfig&, const InferenceOptions& = {});
+
+    /** Creates the vocoder for a model in the model directory, trying the
+        precisions returned by getPreferredPrecisions() for the options' quality
+        in turn. Returns nullptr if none of them can be loaded.
+    */
+    static std::unique_ptr<Vocoder> create (const juce::String& modelName, const FeatureConfig&, const InferenceOptions& = {});
+
+    /** Creates the vocoder for one precision of a model, i.e. the model file
+        name.onnx, name.fp16.onnx or name.int8.onnx, preferring an ORT-format
+        conversion (.ort) of it. Returns nullptr if it can't be loaded.
+    */
+    static std::unique_ptr<Vocoder> create (const juce::String& modelName, ModelPrecision,
+                                            const FeatureConfig&, const InferenceOptions& = {});
+
+    /** Returns the precisions to try for a quality setting on a CPU, best first.
+        fp32 always comes last, as every model is exported in it.
+    */
+    static std::vector<ModelPrecision> getPreferredPrecisions (ModelQuality, const CpuFeatures& = CpuFeatures::get());
+
+    /** Returns the suffix of a precision's model files, e.g. ".int8". */
+    static juce::String getFileSuffix (ModelPrecision);
+};
+
+} // namespace hifitune
@@ -0,0 +1,42 @@
+/*
+  ==============================================================================
+
+    This file contains the audio modification class holding the user's edits.
+
+  ==============================================================================
+*/
+
+#include "PluginARAAudioModification.h"
+
+//==============================================================================
+HiFiTuneAudioModification::HiFiTuneAudioModification (juce::ARAAudioSource* audioSource,
+                                                      ARA::ARAAudioModificationHostRef hostRef,
+                                                      const juce::ARAAudioModification* optionalModificationToClone)
+    : juce::ARAAudioModification (audioSource, hostRef, optionalModificationToClone)
+{
+    // Curves are immutable, so a clone can share the original's
+    if (auto* original = dynamic_cast<const HiFiTuneAudioModification*> (optionalModificationToClone))
+        pitchCurve.set (original->getPitchCurve());
+    else
+        pitchCurve.set (std::make_shared<const hifitune::PitchCurve>());
+}
+
+//==============================================================================
+std::shared_ptr<const hifitune::PitchCurve> HiFiTuneAudioModification::getPitchCurve() const
+{
+    return pitchCurve.get();
+}
+
+void HiFiTuneAudioModification::setPitchCurve (std::shared_ptr<const hifitune::PitchCurve> newCurve, bool notifyARAHost)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    if (newCurve == nullptr)
+        newCurve = std::make_shared<const hifitune::PitchCurve>();
+
+    pitchCurve.set (std::move (newCurve));
+
+    // Render workers pick the new curve up by themselves and only re-render the
+    // segments whose keys it changes
+    notifyContentChanged (juce::ARAContentUpdateScopes::samplesAreAffected(), notifyARAHost);
+}
@@ -0,0 +1,48 @@
+/*
+  ==============================================================================
+
+    This file contains the audio modification class holding the user's edits.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include "engine/AtomicSnapshot.h"
+#include "engine/PitchCurve.h"
+
+//==============================================================================
+/**
+    An audio modification carrying the pitch edits made to its audio source.
+
+    The curve is replaced as a whole on every edit, and render workers and the
+    audio thread take a reference to the current one without locking, so they
+    never see a half-applied edit and never wait for one.
+*/
+class HiFiTuneAudioModification  : public juce::ARAAudioModification
+{
+public:
+    //==============================================================================
+    HiFiTuneAudioModification (juce::ARAAudioSource* audioSource,
+                               ARA::ARAAudioModificationHostRef hostRef,
+                               const juce::ARAAudioModification* optionalModificationToClone);
+
+    //==============================================================================
+    /** Returns the current edits. Never returns nullptr. Thread-safe and
+        realtime-safe.
+    */
+    std::shared_ptr<const hifitune::PitchCurve> getPitchCurve() const;
+
+    /** Replaces the edits and tells listeners, and optionally the host, that the
+        output changed. Call this on the message thread.
+    */
+    void setPitchCurve (std::shared_ptr<const hifitune::PitchCurve>, bool notifyARAHost = true);
+
+private:
+    //==============================================================================
+    hifitune::AtomicSnapshot<hifitune::PitchCurve> pitchCurve;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTuneAudioModification)
+};
@@ -9,9 +9,54 @@
 */
 
 #include "PluginARADocumentController.h"
+#include "PluginARAAudioModification.h"
 #include "PluginARAPlaybackRenderer.h"
 
 //==============================================================================
+HiFiTuneDocumentController::HiFiTuneDocumentController (const ARA::PlugIn::PlugInEntry* entry,
+                                                        const ARA::ARADocumentControllerHostInstance* instance)
+    : ARADocumentControllerSpecialisation (entry, instance)
+{
+    // Segments evicted from memory are kept on disk for the lifetime of the document
+    segmentCache.setSpillDirectory (juce::File::getSpecialLocation (juce::File::tempDirectory)
+                                        .getChildFile ("HiFiTune")
+                                        .getChildFile ("SegmentCache-" + juce::Uuid().toString()));
+
+    // Doesn't wait: the model loads and warms up in the background, once for
+    // all instances, while the host carries on opening the project
+    workerPool->getInferenceScheduler().preloadVocoder();
+}
+
+//==============================================================================
+juce::ARAAudioSource* HiFiTuneDocumentController::doCreateAudioSource (juce::ARADocument* document,
+                                                                      ARA::ARAAudioSourceHostRef hostRef) noexcept
+{
+    auto* audioSource = new juce::ARAAudioSource (document, hostRef);
+    audioSource->addListener (this);
+
+    const juce::ScopedLock sl (registeredSourcesLock);
+    registeredSources.insert (audioSource);
+
+    return audioSource;
+}
+
+juce::ARAAudioModification* HiFiTuneDocumentController::doCreateAudioModification (juce::ARAAudioSource* audioSource,
+                                                                                  ARA::ARAAudioModificationHostRef hostRef,
+                                                                                  const juce::ARAAudioModification* optionalModificationToClone) noexcept
+{
+    return new HiFiTuneAudioModification (audioSource, hostRef, optionalModificationToClone);
+}
+
+juce::ARAPlaybackRegion* HiFiTuneDocumentController::doCreatePlaybackRegion (juce::ARAAudioModification* modification,
+                                                                            ARA::ARAPlaybackRegionHostRef hostRef) noexcept
+{
+    // Regions sound a little before and after their borders, where they fade
+    // in and out, so the host has to play them that much longer
+    auto* playbackRegion = new juce::ARAPlaybackRegion (modification, hostRef);
+    playbackRegion->setHeadAndTailTime (HiFiTunePlaybackRenderer::regionFadeSeconds, HiFiTunePlaybackRenderer::regionFadeSeconds);
+    return playbackRegion;
+}
+
 juce::ARAPlaybackRenderer* HiFiTuneDocumentController::doCreatePlaybackRenderer() noexcept
 {
     return new HiFiTunePlaybackRenderer (getDocumentController());
@@ -20,18 +65,272 @@ juce::ARAPlaybackRenderer* HiFiTuneDocumentController::doCreatePlaybackRenderer(
 //==============================================================================
 bool HiFiTuneDocumentController::doRestoreObjectsFromStream (juce::ARAInputStream& input, const juce::ARARestoreObjectsFilter* filter) noexcept
 {
-    // You should use this method to read any persistent data associated with
-    // your ARA model graph stored in an archive using the supplied ARAInputStream.
-    // Be sure to check the ARARestoreObjectsFilter to determine which objects to restore.
-    return true;
+    jassert (filter != nullptr);
+
+    // Documents saved before anything was stored have empty archives
+    if (input.getTotalLength() == 0 || filter == nullptr)
+        return true;
+
+    if (! hifitune::ArchiveCodec::readHeader (input))
+        return false;
+
+    // Chunks for objects the filter doesn't ask for are read past and dropped,
+    // and so are damaged ones: their sources simply get analysed again.
+    hifitune::ArchiveCodec::Chunk chunk;
+
+    // Running out of memory on a damaged archive must not take the host down;
+    // whatever was restored before that is kept
+    try
+    {
+        while (hifitune::ArchiveCodec::readChunk (input, chunk))
+        {
+            if (! chunk.isIntact)
+                continue;
+
+            switch (chunk.type)
+            {
+                case hifitune::ArchiveCodec::ChunkType::sourceAnalysis:     restoreAnalysis (chunk, *filter); break;
+                case hifitune::ArchiveCodec::ChunkType::modificationEdits:  restoreEdits (chunk, *filter); break;
+                case hifitune::ArchiveCodec::ChunkType::end:
+                default:                                                    break;
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+
+    return ! input.failed();
 }
 
 bool HiFiTuneDocumentController::doStoreObjectsToStream (juce::ARAOutputStream& output, const juce::ARAStoreObjectsFilter* filter) noexcept
 {
-    // You should use this method to write any persistent data associated with
-    // your ARA model graph into the an archive using the supplied ARAOutputStream.
-    // Be sure to check the ARAStoreObjectsFilter to determine which objects to store.
-    return true;
+    jassert (filter != nullptr);
+
+    if (filter == nullptr || ! hifitune::ArchiveCodec::writeHeader (output))
+        return false;
+
+    for (auto* audioSource : filter->getAudioSourcesToStore())
+    {
+        hifitune::ByteWriter payload;
+
+        if (analysisEngine.writeEncodedAnalysis (audioSource, payload)
+            && ! hifitune::ArchiveCodec::writeChunk (output, hifitune::ArchiveCodec::ChunkType::sourceAnalysis,
+                                                     audioSource->getPersistentID(), payload.getData(), payload.getSize()))
+            return false;
+    }
+
+    for (auto* audioModification : filter->getAudioModificationsToStore<HiFiTuneAudioModification>())
+    {
+        const auto pitchCurve = audioModification->getPitchCurve();
+
+        if (pitchCurve->isEmpty())
+            continue;
+
+        hifitune::ByteWriter payload;
+        hifitune::ArchiveCodec::encodePitchCurve (*pitchCurve, payload);
+
+        if (! hifitune::ArchiveCodec::writeChunk (output, hifitune::ArchiveCodec::ChunkType::modificationEdits,
+                                                  audioModification->getPersistentID(), payload.getData(), payload.getSize()))
+            return false;
+    }
+
+    return hifitune::ArchiveCodec::writeEnd (output);
+}
+
+void HiFiTuneDocumentController::restoreAnalysis (hifitune::ArchiveCodec::Chunk& chunk, const juce::ARARestoreObjectsFilter& filter)
+{
+    auto* audioSource = filter.getAudioSourceToRestoreStateWithID (chunk.persistentID.toRawUTF8());
+
+    if (audioSource == nullptr)
+        return;
+
+    // Only the header is decoded here, and the overview on the analysis threads;
+    // the features wait until a renderer first asks for them. A result that
+    // doesn't fit the source any more (different audio, or a different analysis
+    // setup) is dropped.
+    hifitune::SourceAnalysis header;
+
+    if (! hifitune::ArchiveCodec::decodeAnalysisHeader (chunk.payload, header)
+        || header.config != analysisEngine.getConfig()
+        || header.sourceLength != audioSource->getSampleCount()
+        || ! juce::exactlyEqual (header.sourceSampleRate, audioSource->getSampleRate()))
+        return;
+
+    analysisEngine.restoreAnalysis (audioSource, std::move (chunk.payload));
+}
+
+void HiFiTuneDocumentController::restoreEdits (const hifitune::ArchiveCodec::Chunk& chunk, const juce::ARARestoreObjectsFilter& filter)
+{
+    auto* audioModification = filter.getAudioModificationToRestoreStateWithID<HiFiTuneAudioModification> (chunk.persistentID.toRawUTF8());
+
+    if (audioModification == nullptr)
+        return;
+
+    if (auto pitchCurve = hifitune::ArchiveCodec::decodePitchCurve (chunk.payload, arena))
+        audioModification->setPitchCurve (std::move (pitchCurve), false);
+}
+
+//==============================================================================
+void HiFiTuneDocumentController::willEnableAudioSourceSamplesAccess (juce::ARAAudioSource* audioSource, bool enable)
+{
+    // The analysis reader becomes invalid once access is withdrawn
+    if (! enable)
+        analysisEngine.cancelAnalysis (audioSource);
+}
+
+void HiFiTuneDocumentController::didEnableAudioSourceSamplesAccess (juce::ARAAudioSource* audioSource, bool enable)
+{
+    if (enable)
+        startAnalysisIfNeeded (audioSource);
+}
+
+void HiFiTuneDocumentController::willUpdateAudioSourceProperties (juce::ARAAudioSource* audioSource,
+                                                                  juce::ARAAudioSource::PropertiesPtr newProperties)
+{
+    // A different length, rate or layout leaves nothing to compare the new
+    // samples with, so everything derived from the old ones goes
+    if (newProperties->sampleCount == audioSource->getSampleCount()
+        && juce::exactlyEqual (newProperties->sampleRate, audioSource->getSampleRate())
+        && newProperties->channelCount == audioSource->getChannelCount())
+        return;
+
+    analysisEngine.removeSource (audioSource);
+    getSampleChangeLog (audioSource)->add (hifitune::SampleChangeLog::everything);
+}
+
+void HiFiTuneDocumentController::didUpdateAudioSourceProperties (juce::ARAAudioSource* audioSource)
+{
+    startAnalysisIfNeeded (audioSource);
+}
+
+void HiFiTuneDocumentController::doUpdateAudioSourceContent (juce::ARAAudioSource* audioSource,
+                                                             juce::ARAContentUpdateScopes scopeFlags)
+{
+    if (! scopeFlags.affectSamples())
+        return;
+
+    // Without sample access the new audio can't be compared with the old, so
+    // the result is dropped and the source analysed again once it's back
+    if (! audioSource->isSampleAccessEnabled() || audioSource->isDeactivatedForUndoHistory())
+    {
+        analysisEngine.removeSource (audioSource);
+        getSampleChangeLog (audioSource)->add (hifitune::SampleChangeLog::everything);
+        return;
+    }
+
+    // The host doesn't say which samples changed. The engine finds out by
+    // comparing block hashes, reports the ranges to analysisFoundChanges(), and
+    // analyses only the frames around them again. Rendered segments elsewhere
+    // keep their keys and stay valid.
+    analysisEngine.updateAnalysis (audioSource, std::make_unique<juce::ARAAudioSourceReader> (audioSource),
+                                   audioSource->getPersistentID());
+}
+
+void HiFiTuneDocumentController::willDeactivateAudioSourceForUndoHistory (juce::ARAAudioSource* audioSource, bool deactivate)
+{
+    if (deactivate)
+        analysisEngine.cancelAnalysis (audioSource);
+}
+
+void HiFiTuneDocumentController::didDeactivateAudioSourceForUndoHistory (juce::ARAAudioSource* audioSource, bool deactivate)
+{
+    if (! deactivate)
+        startAnalysisIfNeeded (audioSource);
+}
+
+void HiFiTuneDocumentController::willDestroyAudioSource (juce::ARAAudioSource* audioSource)
+{
+    {
+        const juce::ScopedLock sl (registeredSourcesLock);
+        registeredSources.erase (audioSource);
+    }
+
+    analysisEngine.removeSource (audioSource);
+    audioSource->removeListener (this);
+
+    const juce::ScopedLock sl (sampleChangeLogsLock);
+    sampleChangeLogs.erase (audioSource);
+}
+
+std::shared_ptr<hifitune::SampleChangeLog> HiFiTuneDocumentController::getSampleChangeLog (juce::ARAAudioSource* audioSource)
+{
+    const juce::ScopedLock sl (sampleChangeLogsLock);
+    auto& log = sampleChangeLogs[audioSource];
+
+    if (log == nullptr)
+        log = std::make_shared<hifitune::SampleChangeLog>();
+
+    return log;
+}
+
+void HiFiTuneDocumentController::startAnalysisIfNeeded (juce::ARAAudioSource* audioSource)
+{
+    if (! audioSource->isSampleAccessEnabled()
+        || audioSource->isDeactivatedForUndoHistory()
+        || analysisEngine.isAnalysing (audioSource)
+        || analysisEngine.hasAnalysis (audioSource))
+        return;
+
+    // Readers register themselves as listeners of the source, so they are
+    // created here on the message thread and handed over to the engine.
+    analysisEngine.startAnalysis (audioSource, std::make_unique<juce::ARAAudioSourceReader> (audioSource),
+                                  audioSource->getPersistentID());
+}
+
+//==============================================================================
+template <typename Callback>
+void HiFiTuneDocumentController::withRegisteredSource (hifitune::AnalysisEngine::SourceKey key, Callback&& callback)
+{
+    // Holding the lock keeps the source alive: willDestroyAudioSource() has to
+    // take it before cancelling the analysis.
+    const juce::ScopedLock sl (registeredSourcesLock);
+
+    auto* audioSource = static_cast<juce::ARAAudioSource*> (const_cast<void*> (key));
+
+    if (registeredSources.count (audioSource) != 0)
+        callback (*audioSource);
+}
+
+void HiFiTuneDocumentController::analysisStarted (hifitune::AnalysisEngine::SourceKey key)
+{
+    withRegisteredSource (key, [] (juce::ARAAudioSource& source) { source.notifyAnalysisProgressStarted(); });
+}
+
+void HiFiTuneDocumentController::analysisProgressed (hifitune::AnalysisEngine::SourceKey key, float progress)
+{
+    withRegisteredSource (key, [progress] (juce::ARAAudioSource& source) { source.notifyAnalysisProgressUpdated (progress); });
+}
+
+void HiFiTuneDocumentController::analysisFoundChanges (hifitune::AnalysisEngine::SourceKey key,
+                                                       const std::vector<juce::Range<juce::int64>>& changedSamples)
+{
+    withRegisteredSource (key, [&] (juce::ARAAudioSource& source)
+    {
+        const auto log = getSampleChangeLog (&source);
+
+        for (const auto& range : changedSamples)
+            log->add (range);
+    });
+}
+
+void HiFiTuneDocumentController::analysisFinished (hifitune::AnalysisEngine::SourceKey key,
+                                                   const std::shared_ptr<const hifitune::SourceAnalysis>& analysis)
+{
+    withRegisteredSource (key, [&] (juce::ARAAudioSource& source)
+    {
+        // The changes this job found were logged before it published, so the
+        // analysis covers them. Renderers read this before the analysis, and so
+        // at worst take a new analysis for a stale one, which is harmless.
+        if (analysis != nullptr)
+        {
+            const auto log = getSampleChangeLog (&source);
+            log->setAnalysedGeneration (log->getGeneration());
+        }
+
+        source.notifyAnalysisProgressCompleted();
+    });
 }
 
 //==============================================================================
@@ -12,19 +12,52 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 
+#include "engine/AnalysisEngine.h"
+#include "engine/ArchiveCodec.h"
+#include "engine/RenderWorkerPool.h"
+#include "engine/SegmentCache.h"
+
 //==============================================================================
 /**
 */
-class HiFiTuneDocumentController  : public juce::ARADocumentControllerSpecialisation
+class HiFiTuneDocumentController  : public juce::ARADocumentControllerSpecialisation,
+                                    private juce::ARAAudioSource::Listener,
+                                    private hifitune::AnalysisEngine::Listener
 {
 public:
     //==============================================================================
-    using ARADocumentControllerSpecialisation::ARADocumentControllerSpecialisation;
+    HiFiTuneDocumentController (const ARA::PlugIn::PlugInEntry* entry,
+                                const ARA::ARADocumentControllerHostInstance* instance);
+
+    //==============================================================================
+    /** Returns the analysis engine shared by everything in this document. */
+    hifitune::AnalysisEngine& getAnalysisEngine() noexcept          { return analysisEngine; }
+
+    /** Returns the cache of rendered segments shared by this document's renderers. */
+    hifitune::SegmentCache& getSegmentCache() noexcept              { return segmentCache; }
+
+    /** Returns the memory arena for this document's edits and render scratch buffers. */
+    const std::shared_ptr<hifitune::DocumentArena>& getArena() const noexcept  { return arena; }
+
+    /** Returns the record of which samples of a source the host has changed,
+        creating it on first use.
+    */
+    std::shared_ptr<hifitune::SampleChangeLog> getSampleChangeLog (juce::ARAAudioSource*);
 
 protected:
     //==============================================================================
     // Override document controller customization methods here
 
+    juce::ARAAudioSource* doCreateAudioSource (juce::ARADocument* document,
+                                               ARA::ARAAudioSourceHostRef hostRef) noexcept override;
+
+    juce::ARAAudioModification* doCreateAudioModification (juce::ARAAudioSource* audioSource,
+                                                           ARA::ARAAudioModificationHostRef hostRef,
+                                                           const juce::ARAAudioModification* optionalModificationToClone) noexcept override;
+
+    juce::ARAPlaybackRegion* doCreatePlaybackRegion (juce::ARAAudioModification* modification,
+                                                     ARA::ARAPlaybackRegionHostRef hostRef) noexcept override;
+
     juce::ARAPlaybackRenderer* doCreatePlaybackRenderer() noexcept override;
 
     bool doRestoreObjectsFromStream (juce::ARAInputStream& input, const juce::ARARestoreObjectsFilter* filter) noexcept override;
@@ -32,5 +65,49 @@ protected:
 
 private:
     //==============================================================================
+    // ARAAudioSource::Listener
+    void willEnableAudioSourceSamplesAccess (juce::ARAAudioSource*, bool enable) override;
+    void didEnableAudioSourceSamplesAccess (juce::ARAAudioSource*, bool enable) override;
+    void willUpdateAudioSourceProperties (juce::ARAAudioSource*, juce::ARAAudioSource::PropertiesPtr newProperties) override;
+    void didUpdateAudioSourceProperties (juce::ARAAudioSource*) override;
+    void doUpdateAudioSourceContent (juce::ARAAudioSource*, juce::ARAContentUpdateScopes) override;
+    void willDeactivateAudioSourceForUndoHistory (juce::ARAAudioSource*, bool deactivate) override;
+    void didDeactivateAudioSourceForUndoHistory (juce::ARAAudioSource*, bool deactivate) override;
+    void willDestroyAudioSource (juce::ARAAudioSource*) override;
+
+    // AnalysisEngine::Listener
+    void analysisStarted (hifitune::AnalysisEngine::SourceKey) override;
+    void analysisProgressed (hifitune::AnalysisEngine::SourceKey, float progress) override;
+    void analysisFoundChanges (hifitune::AnalysisEngine::SourceKey, const std::vector<juce::Range<juce::int64>>&) override;
+    void analysisFinished (hifitune::AnalysisEngine::SourceKey, const std::shared_ptr<const hifitune::SourceAnalysis>&) override;
+
+    //==============================================================================
+    void startAnalysisIfNeeded (juce::ARAAudioSource*);
+
+    void restoreAnalysis (hifitune::ArchiveCodec::Chunk&, const juce::ARARestoreObjectsFilter&);
+    void restoreEdits (const hifitune::ArchiveCodec::Chunk&, const juce::ARARestoreObjectsFilter&);
+
+    template <typename Callback>
+    void withRegisteredSource (hifitune::AnalysisEngine::SourceKey, Callback&&);
+
+    // Sources that may receive progress notifications from the analysis workers
+    std::set<juce::ARAAudioSource*> registeredSources;
+    juce::CriticalSection registeredSourcesLock;
+
+    // Shared with the renderers, which drop cached source audio the host replaced
+    std::map<const juce::ARAAudioSource*, std::shared_ptr<hifitune::SampleChangeLog>> sampleChangeLogs;
+    juce::CriticalSection sampleChangeLogsLock;
+
+    // Kept alive by whatever was allocated from it, e.g. curves still held by renderers
+    std::shared_ptr<hifitune::DocumentArena> arena = std::make_shared<hifitune::DocumentArena>();
+
+    // Shared with every renderer in the process; holding it here gets the model
+    // loading as soon as a document exists
+    juce::SharedResourcePointer<hifitune::RenderWorkerPool> workerPool;
+
+    juce::SharedResourcePointer<hifitune::AnalysisStore> analysisStore;
+    hifitune::AnalysisEngine analysisEngine { *this, {}, hifitune::AnalysisEngine::getDefaultNumThreads(), &analysisStore.get() };
+    hifitune::SegmentCache segmentCache;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTuneDocumentController)
 };
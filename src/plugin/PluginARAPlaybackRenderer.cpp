@@ -9,18 +9,154 @@
 */
 
 #include "PluginARAPlaybackRenderer.h"
+#include "PluginARAAudioModification.h"
+#include "PluginARADocumentController.h"
+#include "engine/Instrumentation.h"
+#include "engine/MixKernels.h"
+
+namespace
+{
+    // How many segments the offline path renders per vocoder call
+    constexpr int offlineBatchSegments = 8;
+
+    // Converts the host's loop points to song samples, assuming the tempo doesn't
+    // change between the playhead and the loop. Returns an empty range if the
+    // host isn't looping or doesn't say enough to place the loop.
+    juce::Range<juce::int64> getLoopRangeInSamples (const juce::AudioPlayHead::PositionInfo& positionInfo, double sampleRate)
+    {
+        const auto loopPoints = positionInfo.getLoopPoints();
+        const auto ppqPosition = positionInfo.getPpqPosition();
+        const auto bpm = positionInfo.getBpm();
+        const auto timeInSamples = positionInfo.getTimeInSamples();
+
+        if (! positionInfo.getIsLooping() || ! loopPoints || ! ppqPosition || ! bpm || ! timeInSamples || *bpm <= 0.0)
+            return {};
+
+        const auto samplesPerQuarterNote = sampleRate * 60.0 / *bpm;
+        auto toSamples = [&] (double ppq) { return *timeInSamples + (juce::int64) std::llround ((ppq - *ppqPosition) * samplesPerQuarterNote); };
+
+        return { toSamples (loopPoints->ppqStart), toSamples (loopPoints->ppqEnd) };
+    }
+
+    // Gain of a region's border fades at a song position, given the song samples
+    // it outputs
+    float getRegionFadeGain (juce::int64 position, juce::Range<juce::int64> outputRange,
+                             juce::int64 fadeInLength, juce::int64 fadeOutLength) noexcept
+    {
+        const auto fadeIn = (float) juce::jlimit ((juce::int64) 0, fadeInLength, position - outputRange.getStart()) / (float) fadeInLength;
+        const auto fadeOut = (float) juce::jlimit ((juce::int64) 0, fadeOutLength, outputRange.getEnd() - position) / (float) fadeOutLength;
+        return juce::jmin (fadeIn, fadeOut);
+    }
+
+    // Playback and modification durations that differ by no more than rounding
+    // are played unstretched
+    constexpr juce::int64 maxUnstretchedDifference = 1;
+}
+
+//==============================================================================
+HiFiTunePlaybackRenderer::~HiFiTunePlaybackRenderer()
+{
+    releaseResources();
+}
 
 //==============================================================================
 void HiFiTunePlaybackRenderer::prepareToPlay (double sampleRateIn, int maximumSamplesPerBlockIn, int numChannelsIn, juce::AudioProcessor::ProcessingPrecision, AlwaysNonRealtime alwaysNonRealtime)
 {
+    releaseResources();
+
     numChannels = numChannelsIn;
     sampleRate = sampleRateIn;
     maximumSamplesPerBlock = maximumSamplesPerBlockIn;
     useBufferedAudioSourceReader = alwaysNonRealtime == AlwaysNonRealtime::no;
+    isBouncing = alwaysNonRealtime == AlwaysNonRealtime::yes;
+    playhead.setLookAhead ((juce::int64) (lookAheadSeconds.load() * sampleRate));
+    regionFadeLength = juce::jmax (1, juce::roundToInt (regionFadeSeconds * sampleRate));
+    fadeBuffer.setSize (numChannels, maximumSamplesPerBlock);
+
+    documentController = juce::ARADocumentControllerSpecialisation::getSpecialisedDocumentController<HiFiTuneDocumentController> (getDocumentController());
+
+    // Playback regions can't be added or removed while we're prepared, so all the
+    // per-region state the audio thread needs can be set up here.
+    for (const auto& playbackRegion : getPlaybackRegions())
+    {
+        auto* audioModification = playbackRegion->getAudioModification();
+        auto* audioSource = audioModification->getAudioSource();
+
+        auto& sourceState = sourceStates[audioSource];
+
+        if (sourceState == nullptr)
+        {
+            sourceState = std::make_unique<SourceState>();
+            sourceState->audioSource = audioSource;
+
+            hifitune::SourceStream::Options streamOptions;
+            streamOptions.cacheBudget = sourceCacheBudget;
+            sourceState->stream = std::make_unique<hifitune::SourceStream> (std::make_unique<juce::ARAAudioSourceReader> (audioSource),
+                                                                            streamOptions);
+
+            if (documentController != nullptr)
+            {
+                sourceState->changes = documentController->getSampleChangeLog (audioSource);
+                sourceState->changesApplied = sourceState->changes->getGeneration();
+            }
+        }
+
+        auto& track = renderTracks[audioModification];
+
+        if (track == nullptr)
+            track = std::make_unique<hifitune::RenderTrack> (audioSource->getSampleCount(), numChannels);
+
+        auto regionState = std::make_unique<RegionState>();
+        regionState->playbackRegion = playbackRegion;
+        regionState->audioModification = static_cast<HiFiTuneAudioModification*> (audioModification);
+        regionState->track = track.get();
+        regionState->source = sourceState.get();
+
+        // Made for every region, as it may be stretched while we're prepared.
+        // It costs nothing but its slots until something is rendered into it.
+        updateStretchedTrack (*regionState);
+        updatePlacement (*regionState);
+
+        playbackRegion->addListener (this);
+        regionStates.push_back (std::move (regionState));
+    }
+
+    // A bounce renders everything itself, as fast as the cores allow, rather
+    // than following a playhead from the shared workers
+    if (isBouncing)
+    {
+        offlinePool = std::make_unique<juce::ThreadPool> (juce::ThreadPoolOptions{}.withThreadName ("HiFiTune Bounce")
+                                                                                   .withNumberOfThreads (juce::SystemStats::getNumCpus()));
+        workerPool->getInferenceScheduler().beginOfflineRendering();
+        return;
+    }
+
+    workerPool->addClient (*this);
+    isRegisteredWithWorkers = true;
 }
 
 void HiFiTunePlaybackRenderer::releaseResources()
 {
+    if (isRegisteredWithWorkers)
+    {
+        workerPool->removeClient (*this);
+        isRegisteredWithWorkers = false;
+    }
+
+    // Queued segments refer to the region states, so they go first
+    if (offlinePool != nullptr)
+    {
+        offlinePool->removeAllJobs (true, -1);
+        offlinePool.reset();
+        workerPool->getInferenceScheduler().endOfflineRendering();
+    }
+
+    for (const auto& regionState : regionStates)
+        regionState->playbackRegion->removeListener (this);
+
+    regionStates.clear();
+    renderTracks.clear();
+    sourceStates.clear();
 }
 
 //==============================================================================
@@ -28,15 +164,25 @@ bool HiFiTunePlaybackRenderer::processBlock (juce::AudioBuffer<float>& buffer,
                                                        juce::AudioProcessor::Realtime realtime,
                                                        const juce::AudioPlayHead::PositionInfo& positionInfo) noexcept
 {
+    using hifitune::Instrumentation;
+
     const auto numSamples = buffer.getNumSamples();
+    const Instrumentation::ScopedTimer blockTimer (Instrumentation::EventType::rendererBlock, numSamples);
     jassert (numSamples <= maximumSamplesPerBlock);
     jassert (numChannels == buffer.getNumChannels());
     jassert (realtime == juce::AudioProcessor::Realtime::no || useBufferedAudioSourceReader);
     const auto timeInSamples = positionInfo.getTimeInSamples().orFallback (0);
     const auto isPlaying = positionInfo.getIsPlaying();
 
+    // Outside realtime we're allowed to block, so rather than relying on the
+    // workers having kept up, render whatever is missing right here.
+    const auto renderMissingSegments = realtime == juce::AudioProcessor::Realtime::no;
+
+    playhead.update (timeInSamples, numSamples, isPlaying, getLoopRangeInSamples (positionInfo, sampleRate));
+
     bool success = true;
     bool didRenderAnyRegion = false;
+    hifitune::RenderTrack::ReadStatus blockStatus;
 
     if (isPlaying)
     {
@@ -44,51 +190,59 @@ bool HiFiTunePlaybackRenderer::processBlock (juce::AudioBuffer<float>& buffer,
 
         for (const auto& playbackRegion : getPlaybackRegions())
         {
-            // Evaluate region borders in song time, calculate sample range to render in song time.
-            // Note that this example does not use head- or tailtime, so the includeHeadAndTail
-            // parameter is set to false here - this might need to be adjusted in actual plug-ins.
-            const auto playbackSampleRange = playbackRegion->getSampleRange (sampleRate,
-                                                                             juce::ARAPlaybackRegion::IncludeHeadAndTail::no);
-            auto renderRange = blockRange.getIntersectionWith (playbackSampleRange);
+            auto* regionState = findRegionState (playbackRegion);
 
-            if (renderRange.isEmpty())
+            if (regionState == nullptr)
                 continue;
 
-            // Evaluate region borders in modification/source time and calculate offset between
-            // song and source samples, then clip song samples accordingly
-            // (if an actual plug-in supports time stretching, this must be taken into account here).
-            juce::Range<juce::int64> modificationSampleRange { playbackRegion->getStartInAudioModificationSamples(),
-                                                               playbackRegion->getEndInAudioModificationSamples() };
-            const auto modificationSampleOffset = modificationSampleRange.getStart() - playbackSampleRange.getStart();
+            updatePlacement (*regionState);
 
-            renderRange = renderRange.getIntersectionWith (modificationSampleRange.movedToStartAt (playbackSampleRange.getStart()));
+            // Only the part of the region its track has samples for is read; the
+            // rest is silent
+            auto& track = regionState->getTrack();
+            const auto trackOffset = regionState->trackOffset.load();
+            const juce::Range<juce::int64> outputRange { regionState->outputStart.load(), regionState->outputEnd.load() };
+            const auto renderRange = blockRange.getIntersectionWith (outputRange)
+                                               .getIntersectionWith ({ -trackOffset, track.getLengthInSamples() - trackOffset });
 
             if (renderRange.isEmpty())
                 continue;
 
-            // Now calculate the samples in renderRange for this PlaybackRegion based on the ARA model
-            // graph. If didRenderAnyRegion is true, add the region's output samples in renderRange to
-            // the buffer. Otherwise the buffer needs to be initialised so the sample value must be
-            // overwritten.
+            // Copy the region's rendered output for renderRange from its render track. If
+            // didRenderAnyRegion is true, add the samples to the buffer. Otherwise the buffer
+            // needs to be initialised so the sample values must be overwritten.
             const int numSamplesToRead = (int) renderRange.getLength();
             const int startInBuffer = (int) (renderRange.getStart() - blockRange.getStart());
-            const auto startInSource = renderRange.getStart() + modificationSampleOffset;
+            const auto startInTrack = renderRange.getStart() + trackOffset;
 
-            for (int c = 0; c < numChannels; ++c)
+            if (renderMissingSegments)
             {
-                auto* channelData = buffer.getWritePointer (c);
+                const auto trackRange = juce::Range<juce::int64>::withStartAndLength (startInTrack, numSamplesToRead);
 
-                for (int i = 0; i < numSamplesToRead; ++i)
-                {
-                    // Calculate region output sample at index startInSource + i ...
-                    float sample = 0.0f;
+                if (isBouncing)
+                    renderOffline (*regionState, track, trackRange);
+                else
+                    renderSynchronously (*regionState, track, trackRange);
+            }
 
-                    if (didRenderAnyRegion)
-                        channelData[startInBuffer + i] += sample;
-                    else
-                        channelData[startInBuffer + i] = sample;
-                }
+            // Blocks touching the region's borders go through fadeBuffer to be faded
+            const auto needsFades = renderRange.getStart() < outputRange.getStart() + regionState->fadeInLength
+                                 || renderRange.getEnd() > outputRange.getEnd() - regionState->fadeOutLength;
+
+            hifitune::RenderTrack::ReadStatus status;
+
+            if (needsFades)
+            {
+                status = track.read (fadeBuffer, 0, startInTrack, numSamplesToRead, false);
+                mixWithRegionFades (buffer, startInBuffer, renderRange, *regionState, didRenderAnyRegion);
             }
+            else
+            {
+                status = track.read (buffer, startInBuffer, startInTrack, numSamplesToRead, didRenderAnyRegion);
+            }
+
+            blockStatus.numMissing += status.numMissing;
+            blockStatus.numDry += status.numDry;
 
             // If rendering first region, clear any excess at start or end of the region.
             if (! didRenderAnyRegion)
@@ -96,7 +250,7 @@ bool HiFiTunePlaybackRenderer::processBlock (juce::AudioBuffer<float>& buffer,
                 if (startInBuffer != 0)
                     buffer.clear (0, startInBuffer);
 
-                const int endInBuffer = startInBuffer + numSamples;
+                const int endInBuffer = startInBuffer + numSamplesToRead;
                 const int remainingSamples = numSamples - endInBuffer;
 
                 if (remainingSamples != 0)
@@ -108,7 +262,407 @@ bool HiFiTunePlaybackRenderer::processBlock (juce::AudioBuffer<float>& buffer,
     }
 
     if (! didRenderAnyRegion)
+    {
         buffer.clear();
+    }
+    else
+    {
+        numBlocks.fetch_add (1, std::memory_order_relaxed);
+
+        if (blockStatus.numMissing > 0)
+            numSilentBlocks.fetch_add (1, std::memory_order_relaxed);
+        else if (blockStatus.numDry > 0)
+            numDryBlocks.fetch_add (1, std::memory_order_relaxed);
+
+        if (blockStatus.numMissing + blockStatus.numDry > 0)
+            Instrumentation::count (Instrumentation::EventType::renderAheadMiss, blockStatus.numMissing + blockStatus.numDry);
+        else
+            Instrumentation::count (Instrumentation::EventType::renderAheadHit);
+    }
 
     return success;
 }
+
+void HiFiTunePlaybackRenderer::mixWithRegionFades (juce::AudioBuffer<float>& buffer, int startInBuffer,
+                                                   juce::Range<juce::int64> renderRange, const RegionState& regionState,
+                                                   bool addToBuffer) noexcept
+{
+    const juce::Range<juce::int64> outputRange { regionState.outputStart.load(), regionState.outputEnd.load() };
+    const auto fadeInLength = regionState.fadeInLength, fadeOutLength = regionState.fadeOutLength;
+
+    // Split at the ends of the fade-in and the start of the fade-out, so that the
+    // gain is linear within each piece
+    const juce::int64 splits[] = { renderRange.getStart(),
+                                   juce::jlimit (renderRange.getStart(), renderRange.getEnd(), outputRange.getStart() + fadeInLength),
+                                   juce::jlimit (renderRange.getStart(), renderRange.getEnd(), outputRange.getEnd() - fadeOutLength),
+                                   renderRange.getEnd() };
+
+    for (size_t i = 0; i + 1 < std::size (splits); ++i)
+    {
+        const auto numInPiece = (int) (splits[i + 1] - splits[i]);
+
+        if (numInPiece <= 0)
+            continue;
+
+        const auto offset = (int) (splits[i] - renderRange.getStart());
+        const auto startGain = getRegionFadeGain (splits[i], outputRange, fadeInLength, fadeOutLength);
+        const auto endGain = getRegionFadeGain (splits[i + 1], outputRange, fadeInLength, fadeOutLength);
+
+        for (int c = 0; c < buffer.getNumChannels(); ++c)
+            hifitune::MixKernels::mixWithRamp (buffer.getWritePointer (c, startInBuffer + offset),
+                                               fadeBuffer.getReadPointer (c, offset),
+                                               numInPiece, startGain, endGain, addToBuffer);
+    }
+}
+
+//==============================================================================
+HiFiTunePlaybackRenderer::PlaybackStatistics HiFiTunePlaybackRenderer::getPlaybackStatistics() const noexcept
+{
+    PlaybackStatistics stats;
+    stats.numBlocks = numBlocks.load (std::memory_order_relaxed);
+    stats.numSilentBlocks = numSilentBlocks.load (std::memory_order_relaxed);
+    stats.numDryBlocks = numDryBlocks.load (std::memory_order_relaxed);
+    return stats;
+}
+
+void HiFiTunePlaybackRenderer::resetPlaybackStatistics() noexcept
+{
+    numBlocks = 0;
+    numSilentBlocks = 0;
+    numDryBlocks = 0;
+}
+
+void HiFiTunePlaybackRenderer::setLookAheadSeconds (double seconds) noexcept
+{
+    lookAheadSeconds = seconds;
+    playhead.setLookAhead ((juce::int64) (seconds * sampleRate));
+}
+
+//==============================================================================
+HiFiTunePlaybackRenderer::RegionState* HiFiTunePlaybackRenderer::findRegionState (const juce::ARAPlaybackRegion* playbackRegion) const noexcept
+{
+    for (const auto& regionState : regionStates)
+        if (regionState->playbackRegion == playbackRegion)
+            return regionState.get();
+
+    return nullptr;
+}
+
+void HiFiTunePlaybackRenderer::updatePlacement (RegionState& regionState) const noexcept
+{
+    const auto& playbackRegion = *regionState.playbackRegion;
+    const auto playbackRange = playbackRegion.getSampleRange (sampleRate, juce::ARAPlaybackRegion::IncludeHeadAndTail::no);
+    const auto outputRange = playbackRegion.getSampleRange (sampleRate, juce::ARAPlaybackRegion::IncludeHeadAndTail::yes);
+    const juce::Range<juce::int64> modificationRange { playbackRegion.getStartInAudioModificationSamples(),
+                                                       playbackRegion.getEndInAudioModificationSamples() };
+
+    const auto headLength = playbackRange.getStart() - outputRange.getStart();
+    const auto tailLength = outputRange.getEnd() - playbackRange.getEnd();
+    const auto isStretched = std::abs (modificationRange.getLength() - playbackRange.getLength()) > maxUnstretchedDifference
+                          && ! playbackRange.isEmpty();
+
+    if (isStretched)
+    {
+        // The stretched track starts with the head, which plays the source just
+        // before the region at the same rate as the region itself
+        const auto timeRatio = (double) modificationRange.getLength() / (double) playbackRange.getLength();
+        regionState.timeRatio = timeRatio;
+        regionState.sourceStart = (double) modificationRange.getStart() - (double) headLength * timeRatio;
+        regionState.trackOffset = -outputRange.getStart();
+    }
+    else
+    {
+        regionState.trackOffset = modificationRange.getStart() - playbackRange.getStart();
+    }
+
+    regionState.isStretched = isStretched;
+    regionState.outputStart = outputRange.getStart();
+    regionState.outputEnd = outputRange.getEnd();
+
+    // Fades centred on the borders, over the head and the tail and as much of the
+    // region again. Should the host not play the head or tail, the fades stay
+    // inside the region.
+    const auto maxFadeLength = juce::jmax ((juce::int64) 1, outputRange.getLength() / 2);
+    regionState.fadeInLength = juce::jlimit ((juce::int64) 1, maxFadeLength, headLength > 0 ? 2 * headLength : (juce::int64) regionFadeLength);
+    regionState.fadeOutLength = juce::jlimit ((juce::int64) 1, maxFadeLength, tailLength > 0 ? 2 * tailLength : (juce::int64) regionFadeLength);
+}
+
+void HiFiTunePlaybackRenderer::updateStretchedTrack (RegionState& regionState)
+{
+    const auto outputRange = regionState.playbackRegion->getSampleRange (sampleRate, juce::ARAPlaybackRegion::IncludeHeadAndTail::yes);
+    const auto length = juce::jmax ((juce::int64) 1, outputRange.getLength());
+    const auto* current = regionState.stretchedTrack.load();
+
+    if (current != nullptr && current->getLengthInSamples() >= length)
+        return;
+
+    // A region that grew once is likely to grow again while its end is being
+    // dragged, so leave some room rather than replace the track every time
+    const auto newLength = current != nullptr ? length + length / 2 : length;
+
+    regionState.stretchedTracks.push_back (std::make_unique<hifitune::RenderTrack> (newLength, numChannels));
+    regionState.stretchedTrack = regionState.stretchedTracks.back().get();
+}
+
+void HiFiTunePlaybackRenderer::didUpdatePlaybackRegionProperties (juce::ARAPlaybackRegion* playbackRegion)
+{
+    // Only the track is replaced here; processBlock picks up the new placement
+    if (auto* regionState = findRegionState (playbackRegion))
+        updateStretchedTrack (*regionState);
+}
+
+hifitune::SegmentSynthesiser::Source HiFiTunePlaybackRenderer::getSynthesiserSource (const RegionState& regionState,
+                                                                                     const hifitune::RenderTrack& track) const
+{
+    auto& sourceState = *regionState.source;
+
+    hifitune::SegmentSynthesiser::Source source;
+    source.sampleRate = sourceState.audioSource->getSampleRate();
+    source.stream = sourceState.stream.get();
+    source.pitchCurve = regionState.audioModification->getPitchCurve();
+
+    if (&track != regionState.track)
+    {
+        source.sourceStart = regionState.sourceStart.load();
+        source.timeRatio = regionState.timeRatio.load();
+    }
+
+    if (sourceState.changes != nullptr)
+    {
+        // Forget cached audio the host has replaced since the last look. Dry
+        // segments over those ranges get new keys and are rendered again.
+        auto applied = sourceState.changesApplied.load();
+        const auto generation = sourceState.changes->getGeneration();
+
+        if (generation != applied && sourceState.changesApplied.compare_exchange_strong (applied, generation))
+            for (const auto& range : sourceState.changes->getChangesSince (applied))
+                sourceState.stream->invalidate (range);
+
+        source.changes = sourceState.changes.get();
+
+        // Read before the analysis is, see HiFiTuneDocumentController::analysisFinished()
+        source.analysedGeneration = sourceState.changes->getAnalysedGeneration();
+    }
+
+    if (documentController != nullptr)
+        source.analysis = documentController->getAnalysisEngine().getAnalysis (sourceState.audioSource);
+
+    return source;
+}
+
+hifitune::SegmentCache* HiFiTunePlaybackRenderer::getSegmentCache() const noexcept
+{
+    return documentController != nullptr ? &documentController->getSegmentCache() : nullptr;
+}
+
+hifitune::DocumentArena* HiFiTunePlaybackRenderer::getArena() const noexcept
+{
+    return documentController != nullptr ? documentController->getArena().get() : nullptr;
+}
+
+//==============================================================================
+bool HiFiTunePlaybackRenderer::renderNextSegment (hifitune::RenderWorkerPool& pool)
+{
+    // Pick the most urgent segment in the windows the playhead is predicted to
+    // reach that is missing, or whose key says it was rendered from inputs that
+    // have changed since (an edit, a finished analysis, a newly loaded model).
+    hifitune::PlayheadPredictor::Windows windows;
+    const auto numWindows = playhead.getWindows (windows);
+
+    hifitune::RenderTrack* bestTrack = nullptr;
+    hifitune::SegmentSynthesiser::Source bestSource;
+    int bestSegment = -1;
+    juce::uint64 bestKey = 0;
+    auto bestDistance = std::numeric_limits<juce::int64>::max();
+
+    const auto vocoder = pool.getVocoder();
+    hifitune::SegmentSynthesiser synthesiser (vocoder.get(), getSegmentCache(), &pool.getInferenceScheduler(), getArena());
+
+    for (const auto& regionState : regionStates)
+    {
+        const juce::Range<juce::int64> outputRange { regionState->outputStart.load(), regionState->outputEnd.load() };
+        const auto offset = regionState->trackOffset.load();
+        auto& track = regionState->getTrack();
+        std::optional<hifitune::SegmentSynthesiser::Source> source;
+        juce::uint64 inputsStamp = 0;
+
+        for (int w = 0; w < numWindows; ++w)
+        {
+            const auto& window = windows[(size_t) w];
+            const auto songRange = window.range.getIntersectionWith (outputRange);
+
+            if (songRange.isEmpty() || window.distance >= bestDistance)
+                continue;
+
+            const auto firstSegment = track.getSegmentIndexFor (songRange.getStart() + offset);
+            const auto lastSegment = track.getSegmentIndexFor (songRange.getEnd() - 1 + offset);
+
+            for (int i = firstSegment; i <= lastSegment; ++i)
+            {
+                const auto songStart = juce::jmax (songRange.getStart(), track.getSegmentRange (i).getStart() - offset);
+                const auto distance = window.distance + (songStart - window.range.getStart());
+
+                if (distance >= bestDistance)
+                    break;
+
+                if (track.isClaimed (i))
+                    continue;
+
+                if (! source.has_value())
+                {
+                    source = getSynthesiserSource (*regionState, track);
+                    inputsStamp = synthesiser.getInputsStamp (*source, numChannels);
+                }
+
+                // Once everything is rendered, an idle scan ends here for every segment
+                if (track.isKnownUpToDate (i, inputsStamp))
+                    continue;
+
+                const auto key = synthesiser.getSegmentKey (*source, track.getSegmentRange (i), numChannels);
+
+                if (track.needsUpdate (i, key))
+                {
+                    bestTrack = &track;
+                    bestSource = *source;
+                    bestSegment = i;
+                    bestKey = key;
+                    bestDistance = distance;
+                    break;
+                }
+
+                track.markUpToDate (i, inputsStamp, key);
+            }
+        }
+    }
+
+    if (bestTrack == nullptr)
+        return false;
+
+    if (! bestTrack->tryClaim (bestSegment, bestKey))
+        return true;
+
+    // Segments about to be heard go to the inference thread before speculative ones
+    return renderSegments (*bestTrack, bestSource, bestSegment, 1, synthesiser, bestDistance);
+}
+
+bool HiFiTunePlaybackRenderer::renderSegments (hifitune::RenderTrack& track, const hifitune::SegmentSynthesiser::Source& source,
+                                               int firstSegment, int numSegments, hifitune::SegmentSynthesiser& synthesiser,
+                                               juce::int64 priority)
+{
+    // The caller must have claimed all segments in the range
+    const hifitune::Instrumentation::ScopedTimer timer (hifitune::Instrumentation::EventType::segmentRender, numSegments);
+
+    std::vector<juce::Range<juce::int64>> ranges;
+
+    for (int i = firstSegment; i < firstSegment + numSegments; ++i)
+        ranges.push_back (track.getSegmentRange (i));
+
+    auto rendered = synthesiser.render (source, ranges, numChannels, priority);
+    bool allRendered = true;
+
+    for (int i = 0; i < numSegments; ++i)
+    {
+        if (rendered[(size_t) i] != nullptr)
+        {
+            track.publish (firstSegment + i, std::move (rendered[(size_t) i]));
+        }
+        else
+        {
+            track.releaseClaim (firstSegment + i);
+            allRendered = false;
+        }
+    }
+
+    return allRendered;
+}
+
+void HiFiTunePlaybackRenderer::renderSynchronously (const RegionState& regionState, hifitune::RenderTrack& track,
+                                                    juce::Range<juce::int64> trackRange)
+{
+    const auto vocoder = workerPool->waitForVocoder();
+    hifitune::SegmentSynthesiser synthesiser (vocoder.get(), getSegmentCache(), &workerPool->getInferenceScheduler(), getArena());
+    const auto source = getSynthesiserSource (regionState, track);
+
+    const auto firstNeeded = track.getSegmentIndexFor (trackRange.getStart());
+    const auto lastNeeded = track.getSegmentIndexFor (trackRange.getEnd() - 1);
+    const auto lastToRender = juce::jmin (track.getNumSegments() - 1, juce::jmax (lastNeeded, firstNeeded + offlineBatchSegments - 1));
+
+    auto getKey = [&] (int index) { return synthesiser.getSegmentKey (source, track.getSegmentRange (index), numChannels); };
+
+    for (int i = firstNeeded; i <= lastToRender;)
+    {
+        const auto key = getKey (i);
+
+        if (! track.needsUpdate (i, key))
+        {
+            ++i;
+            continue;
+        }
+
+        if (! track.tryClaim (i, key))
+        {
+            // A worker is already on it; wait for segments we need right now
+            if (i <= lastNeeded)
+                track.waitUntilUnclaimed (i);
+
+            ++i;
+            continue;
+        }
+
+        // Claim a run of consecutive segments, whose vocoder calls are batched
+        int numClaimed = 1;
+
+        while (i + numClaimed <= lastToRender && track.tryClaim (i + numClaimed, getKey (i + numClaimed)))
+            ++numClaimed;
+
+        renderSegments (track, source, i, numClaimed, synthesiser, hifitune::InferenceScheduler::immediatePriority);
+        i += numClaimed;
+    }
+}
+
+void HiFiTunePlaybackRenderer::renderOffline (RegionState& regionState, hifitune::RenderTrack& track, juce::Range<juce::int64> trackRange)
+{
+    const auto vocoder = workerPool->waitForVocoder();
+    hifitune::SegmentSynthesiser synthesiser (vocoder.get(), nullptr, &workerPool->getInferenceScheduler(), getArena());
+    const auto source = getSynthesiserSource (regionState, track);
+
+    const auto firstNeeded = track.getSegmentIndexFor (trackRange.getStart());
+    const auto lastNeeded = track.getSegmentIndexFor (trackRange.getEnd() - 1);
+    const auto lastToQueue = juce::jmin (track.getNumSegments() - 1, lastNeeded + offlineLookAheadSegments);
+
+    // Queue every segment not queued yet, each as its own job. A segment renders
+    // the same whichever thread renders it with whatever else, so the bounce
+    // matches playback exactly. With one job per core in flight, the
+    // InferenceScheduler combines them into large batches, run on all cores.
+    // Nothing goes through the SegmentCache: every segment is needed once.
+    for (auto i = juce::jmax (firstNeeded, regionState.offlineQueuedEnd); i <= lastToQueue; ++i)
+    {
+        const auto range = track.getSegmentRange (i);
+
+        if (! track.tryClaim (i, synthesiser.getSegmentKey (source, range, numChannels)))
+            continue;
+
+        const auto priority = range.getStart() - trackRange.getStart();
+
+        offlinePool->addJob ([this, &regionState, &track, i, priority]
+        {
+            const auto jobVocoder = workerPool->waitForVocoder();
+            hifitune::SegmentSynthesiser jobSynthesiser (jobVocoder.get(), nullptr, &workerPool->getInferenceScheduler(), getArena());
+            renderSegments (track, getSynthesiserSource (regionState, track), i, 1, jobSynthesiser, priority);
+        });
+    }
+
+    regionState.offlineQueuedEnd = juce::jmax (regionState.offlineQueuedEnd, lastToQueue + 1);
+
+    // Wait for the segments this block needs. Any that are neither rendered nor
+    // being rendered (the host jumped back, or a render failed) are done here.
+    for (int i = firstNeeded; i <= lastNeeded; ++i)
+    {
+        track.waitUntilUnclaimed (i);
+
+        const auto key = synthesiser.getSegmentKey (source, track.getSegmentRange (i), numChannels);
+
+        if (track.needsUpdate (i, key) && track.tryClaim (i, key))
+            renderSegments (track, source, i, 1, synthesiser, hifitune::InferenceScheduler::immediatePriority);
+    }
+}
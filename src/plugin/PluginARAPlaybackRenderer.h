@@ -12,14 +12,25 @@
 
 #include <juce_audio_processors/juce_audio_processors.h>
 
+#include "engine/PlayheadPredictor.h"
+#include "engine/RenderTrack.h"
+#include "engine/RenderWorkerPool.h"
+#include "engine/SegmentSynthesiser.h"
+
+class HiFiTuneAudioModification;
+class HiFiTuneDocumentController;
+
 //==============================================================================
 /**
 */
-class HiFiTunePlaybackRenderer  : public juce::ARAPlaybackRenderer
+class HiFiTunePlaybackRenderer  : public juce::ARAPlaybackRenderer,
+                                  private hifitune::RenderWorkerPool::Client,
+                                  private juce::ARAPlaybackRegion::Listener
 {
 public:
     //==============================================================================
     using juce::ARAPlaybackRenderer::ARAPlaybackRenderer;
+    ~HiFiTunePlaybackRenderer() override;
 
     //==============================================================================
     void prepareToPlay (double sampleRate,
@@ -34,12 +45,142 @@ public:
                        juce::AudioProcessor::Realtime realtime,
                        const juce::AudioPlayHead::PositionInfo& positionInfo) noexcept override;
 
+    //==============================================================================
+    /** Counts of played blocks for which rendering hadn't caught up, to help tune
+        the look-ahead.
+    */
+    struct PlaybackStatistics
+    {
+        juce::uint64 numBlocks = 0;         // blocks in which at least one region played
+        juce::uint64 numSilentBlocks = 0;   // ...with parts output as silence
+        juce::uint64 numDryBlocks = 0;      // ...with parts output dry instead of vocoded
+    };
+
+    PlaybackStatistics getPlaybackStatistics() const noexcept;
+    void resetPlaybackStatistics() noexcept;
+
+    /** Sets how far ahead of the playhead the render workers try to stay. */
+    void setLookAheadSeconds (double seconds) noexcept;
+
+    static constexpr double defaultLookAheadSeconds = 6.0;
+
+    /** The head and tail time of every playback region. Regions fade in and out
+        over twice this, centred on their borders, so that regions cut mid-note
+        don't click and regions meeting at a cut crossfade into each other.
+    */
+    static constexpr double regionFadeSeconds = 0.005;
+
+    /** How many segments past the current block a bounce keeps queued for
+        rendering on the offline threads.
+    */
+    static constexpr int offlineLookAheadSegments = 64;
+
+    /** Bytes of source audio kept per source for dry rendering, so that segments
+        rendered again after an edit don't have to ask the host for samples again.
+    */
+    static constexpr size_t sourceCacheBudget = (size_t) 16 << 20;
+
 private:
+    //==============================================================================
+    /** Sample access for one audio source, created on the message thread. */
+    struct SourceState
+    {
+        juce::ARAAudioSource* audioSource = nullptr;
+        std::unique_ptr<hifitune::SourceStream> stream;
+
+        // The host's changes to the samples, and the generation of the last one
+        // whose audio has been dropped from the stream
+        std::shared_ptr<hifitune::SampleChangeLog> changes;
+        std::atomic<juce::uint64> changesApplied { 0 };
+    };
+
+    /** What the workers and processBlock need to know about one playback region.
+        The placement is refreshed by processBlock and read by the workers.
+
+        A region plays its part of a RenderTrack, at song sample + trackOffset.
+        Unless it's stretched, that's the track of its audio modification, in
+        source samples and shared with the modification's other regions. A
+        region whose playback duration differs from its modification duration
+        plays its own track instead, in samples from the start of its head,
+        rendered through the time map.
+    */
+    struct RegionState
+    {
+        juce::ARAPlaybackRegion* playbackRegion = nullptr;
+        HiFiTuneAudioModification* audioModification = nullptr;
+        hifitune::RenderTrack* track = nullptr;
+        std::atomic<hifitune::RenderTrack*> stretchedTrack { nullptr };
+        SourceState* source = nullptr;
+
+        // Message thread only: the stretched track, and those it replaced when the
+        // region outgrew them, which the audio thread and the workers may still
+        // be using until we're released
+        std::vector<std::unique_ptr<hifitune::RenderTrack>> stretchedTracks;
+
+        // Song samples the region outputs, head and tail included
+        std::atomic<juce::int64> outputStart { 0 }, outputEnd { 0 }, trackOffset { 0 };
+
+        // The time map of the stretched track, see SegmentSynthesiser::Source
+        std::atomic<bool> isStretched { false };
+        std::atomic<double> sourceStart { 0.0 }, timeRatio { 1.0 };
+
+        // processBlock only: the lengths of the border fades
+        juce::int64 fadeInLength = 0, fadeOutLength = 0;
+
+        // Bounces only: segments before this have been queued on the offline threads
+        int offlineQueuedEnd = 0;
+
+        hifitune::RenderTrack& getTrack() const noexcept    { return isStretched.load() ? *stretchedTrack.load() : *track; }
+    };
+
+    RegionState* findRegionState (const juce::ARAPlaybackRegion*) const noexcept;
+    void updatePlacement (RegionState&) const noexcept;
+    void updateStretchedTrack (RegionState&);
+    hifitune::SegmentSynthesiser::Source getSynthesiserSource (const RegionState&, const hifitune::RenderTrack&) const;
+    hifitune::SegmentCache* getSegmentCache() const noexcept;
+    hifitune::DocumentArena* getArena() const noexcept;
+
+    // RenderWorkerPool::Client
+    bool renderNextSegment (hifitune::RenderWorkerPool&) override;
+
+    // ARAPlaybackRegion::Listener
+    void didUpdatePlaybackRegionProperties (juce::ARAPlaybackRegion*) override;
+
+    bool renderSegments (hifitune::RenderTrack&, const hifitune::SegmentSynthesiser::Source&,
+                         int firstSegment, int numSegments, hifitune::SegmentSynthesiser&, juce::int64 priority);
+    void renderSynchronously (const RegionState&, hifitune::RenderTrack&, juce::Range<juce::int64> trackRange);
+    void renderOffline (RegionState&, hifitune::RenderTrack&, juce::Range<juce::int64> trackRange);
+
+    void mixWithRegionFades (juce::AudioBuffer<float>& buffer, int startInBuffer, juce::Range<juce::int64> renderRange,
+                             const RegionState&, bool addToBuffer) noexcept;
+
     //==============================================================================
     double sampleRate = 44100.0;
     int maximumSamplesPerBlock = 4096;
     int numChannels = 1;
     bool useBufferedAudioSourceReader = true;
+    bool isBouncing = false;
+    int regionFadeLength = 0;
+
+    HiFiTuneDocumentController* documentController = nullptr;
+    std::map<juce::ARAAudioSource*, std::unique_ptr<SourceState>> sourceStates;
+    std::map<juce::ARAAudioModification*, std::unique_ptr<hifitune::RenderTrack>> renderTracks;
+    std::vector<std::unique_ptr<RegionState>> regionStates;
+
+    // Holds region audio that still needs its border fades applied
+    juce::AudioBuffer<float> fadeBuffer;
+
+    // Fed by processBlock, read by the render workers
+    hifitune::PlayheadPredictor playhead;
+    std::atomic<double> lookAheadSeconds { defaultLookAheadSeconds };
+
+    std::atomic<juce::uint64> numBlocks { 0 }, numSilentBlocks { 0 }, numDryBlocks { 0 };
+
+    juce::SharedResourcePointer<hifitune::RenderWorkerPool> workerPool;
+    bool isRegisteredWithWorkers = false;
+
+    // Renders segments ahead of a bounce, one per core
+    std::unique_ptr<juce::ThreadPool> offlinePool;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTunePlaybackRenderer)
 };
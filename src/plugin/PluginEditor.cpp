@@ -8,6 +8,8 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "PluginARADocumentController.h"
+#include "engine/Instrumentation.h"
 
 //==============================================================================
 HiFiTuneAudioProcessorEditor::HiFiTuneAudioProcessorEditor (HiFiTuneAudioProcessor& p)
@@ -20,11 +22,60 @@ HiFiTuneAudioProcessorEditor::HiFiTuneAudioProcessorEditor (HiFiTuneAudioProcess
    #if JucePlugin_Enable_ARA
     // ARA plugins must be resizable for proper view embedding
     setResizable (true, false);
+
+    if (auto* editorView = getARAEditorView())
+    {
+        auto* araDocumentController = editorView->getDocumentController();
+        overview.setDocument (juce::ARADocumentControllerSpecialisation::getSpecialisedDocumentController<HiFiTuneDocumentController> (araDocumentController),
+                              araDocumentController->getDocument<juce::ARADocument>());
+    }
    #endif
 
+    using hifitune::ModelQuality;
+
+    // Item IDs are the enum values plus one, as ComboBox reserves 0
+    qualityBox.addItem ("Best quality", (int) ModelQuality::best + 1);
+    qualityBox.addItem ("Balanced", (int) ModelQuality::balanced + 1);
+    qualityBox.addItem ("Fastest", (int) ModelQuality::fastest + 1);
+    qualityBox.setSelectedId ((int) workerPool->getInferenceScheduler().getModelQuality() + 1, juce::dontSendNotification);
+    qualityBox.setTooltip ("Picks a reduced-precision model where this CPU runs it faster");
+    qualityBox.onChange = [this]
+    {
+        // Playback keeps using the current model until the new one has loaded
+        auto& scheduler = workerPool->getInferenceScheduler();
+        scheduler.setModelQuality ((ModelQuality) (qualityBox.getSelectedId() - 1));
+        scheduler.preloadVocoder();
+    };
+
+    using hifitune::Instrumentation;
+
+    instrumentationToggle.setToggleState (Instrumentation::isEnabled(), juce::dontSendNotification);
+    instrumentationToggle.onClick = [this]
+    {
+        Instrumentation::setEnabled (instrumentationToggle.getToggleState());
+        updateInstrumentationView();
+    };
+
+    exportTraceButton.onClick = [this] { exportInstrumentation (true); };
+    exportCsvButton.onClick = [this] { exportInstrumentation (false); };
+
+    instrumentationView.setMultiLine (true);
+    instrumentationView.setReadOnly (true);
+    instrumentationView.setFont (juce::FontOptions (juce::Font::getDefaultMonospacedFontName(), 12.0f, juce::Font::plain));
+
+    addAndMakeVisible (qualityBox);
+    addAndMakeVisible (overview);
+    addAndMakeVisible (instrumentationToggle);
+    addAndMakeVisible (exportTraceButton);
+    addAndMakeVisible (exportCsvButton);
+    addAndMakeVisible (instrumentationView);
+
+    updateInstrumentationView();
+    startTimerHz (4);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (720, 520);
 }
 
 HiFiTuneAudioProcessorEditor::~HiFiTuneAudioProcessorEditor()
@@ -36,14 +87,95 @@ void HiFiTuneAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-
-    g.setColour (juce::Colours::white);
-    g.setFont (juce::FontOptions (15.0f));
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
 }
 
 void HiFiTuneAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto bounds = getLocalBounds().reduced (8);
+    auto buttons = bounds.removeFromTop (24);
+
+    qualityBox.setBounds (buttons.removeFromLeft (130));
+    buttons.removeFromLeft (8);
+    instrumentationToggle.setBounds (buttons.removeFromLeft (140));
+    exportCsvButton.setBounds (buttons.removeFromRight (110));
+    buttons.removeFromRight (8);
+    exportTraceButton.setBounds (buttons.removeFromRight (110));
+
+    bounds.removeFromTop (8);
+    instrumentationView.setBounds (bounds.removeFromBottom (juce::jmin (160, bounds.getHeight() / 3)));
+    bounds.removeFromBottom (8);
+    overview.setBounds (bounds);
+}
+
+//==============================================================================
+void HiFiTuneAudioProcessorEditor::timerCallback()
+{
+    overview.update();
+
+    if (hifitune::Instrumentation::isEnabled())
+        updateInstrumentationView();
+}
+
+void HiFiTuneAudioProcessorEditor::updateInstrumentationView()
+{
+    using hifitune::Instrumentation;
+
+    const auto summary = Instrumentation::getSummary();
+
+    if (summary.seconds <= 0.0)
+    {
+        instrumentationView.setText ("Turn on instrumentation to time the audio, render and inference threads.", false);
+        return;
+    }
+
+    juce::String text;
+    text << juce::String ("event").paddedRight (' ', 22)
+         << juce::String ("count").paddedLeft (' ', 10)
+         << juce::String ("mean us").paddedLeft (' ', 11)
+         << juce::String ("max us").paddedLeft (' ', 11)
+         << juce::String ("mean value").paddedLeft (' ', 12) << "\n";
+
+    for (int i = 0; i < Instrumentation::numEventTypes; ++i)
+    {
+        const auto& totals = summary.totals[(size_t) i];
+
+        text << juce::String (Instrumentation::getName ((Instrumentation::EventType) i)).paddedRight (' ', 22)
+             << juce::String ((juce::int64) totals.count).paddedLeft (' ', 10)
+             << juce::String (totals.meanMicroseconds, 1).paddedLeft (' ', 11)
+             << juce::String (totals.maxMicroseconds, 1).paddedLeft (' ', 11)
+             << juce::String (totals.meanValue, 1).paddedLeft (' ', 12) << "\n";
+    }
+
+    text << "\n" << juce::String (summary.seconds, 1) << " s collected, "
+         << (juce::int64) summary.numDropped << " events dropped";
+
+    instrumentationView.setText (text, false);
+}
+
+void HiFiTuneAudioProcessorEditor::exportInstrumentation (bool asChromeTrace)
+{
+    fileChooser = std::make_unique<juce::FileChooser> (asChromeTrace ? "Export Chrome trace" : "Export CSV",
+                                                       juce::File::getSpecialLocation (juce::File::userDocumentsDirectory)
+                                                           .getChildFile (asChromeTrace ? "HiFiTune trace.json" : "HiFiTune events.csv"),
+                                                       asChromeTrace ? "*.json" : "*.csv");
+
+    fileChooser->launchAsync (juce::FileBrowserComponent::saveMode | juce::FileBrowserComponent::canSelectFiles
+                                  | juce::FileBrowserComponent::warnAboutOverwriting,
+                              [asChromeTrace] (const juce::FileChooser& chooser)
+    {
+        const auto file = chooser.getResult();
+
+        if (file == juce::File())
+            return;
+
+        juce::FileOutputStream stream (file);
+
+        if (! stream.openedOk() || ! stream.setPosition (0) || ! stream.truncate().wasOk())
+            return;
+
+        if (asChromeTrace)
+            hifitune::Instrumentation::writeChromeTrace (stream);
+        else
+            hifitune::Instrumentation::writeCsv (stream);
+    });
 }
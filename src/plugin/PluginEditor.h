@@ -10,11 +10,14 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "PluginOverviewComponent.h"
+#include "engine/RenderWorkerPool.h"
 
 //==============================================================================
 /**
 */
-class HiFiTuneAudioProcessorEditor  : public juce::AudioProcessorEditor
+class HiFiTuneAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                      private juce::Timer
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorEditorARAExtension
                             #endif
@@ -28,9 +31,27 @@ public:
     void resized() override;
 
 private:
+    //==============================================================================
+    void timerCallback() override;
+    void updateInstrumentationView();
+    void exportInstrumentation (bool asChromeTrace);
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     HiFiTuneAudioProcessor& audioProcessor;
 
+    // Trades sound quality for inference speed, for every instance in the process
+    juce::SharedResourcePointer<hifitune::RenderWorkerPool> workerPool;
+    juce::ComboBox qualityBox;
+
+    // The waveform and pitch of every source in the document
+    HiFiTuneOverviewComponent overview;
+
+    // Shows where the audio and render threads spend their time
+    juce::ToggleButton instrumentationToggle { "Instrumentation" };
+    juce::TextButton exportTraceButton { "Export trace..." }, exportCsvButton { "Export CSV..." };
+    juce::TextEditor instrumentationView;
+    std::unique_ptr<juce::FileChooser> fileChooser;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTuneAudioProcessorEditor)
 };
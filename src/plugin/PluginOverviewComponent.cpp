@@ -0,0 +1,190 @@
+/*
+  ==============================================================================
+
+    This file contains the editor view drawing the waveform and pitch of each source.
+
+  ==============================================================================
+*/
+
+#include "PluginOverviewComponent.h"
+#include "PluginARADocumentController.h"
+
+namespace
+{
+    constexpr double minSecondsPerPixel = 1.0e-4;
+    constexpr double maxSecondsPerPixel = 10.0;
+
+    constexpr int maxRowHeight = 140;
+
+    // The range of notes a row shows, which covers most singing voices
+    constexpr float lowestNote = 36.0f, highestNote = 84.0f;
+}
+
+//==============================================================================
+void HiFiTuneOverviewComponent::setDocument (HiFiTuneDocumentController* controller, juce::ARADocument* documentToShow)
+{
+    documentController = controller;
+    document = documentToShow;
+    rows.clear();
+    update();
+    repaint();
+}
+
+void HiFiTuneOverviewComponent::update()
+{
+    std::vector<Row> newRows;
+
+    if (documentController != nullptr && document != nullptr)
+    {
+        auto& engine = documentController->getAnalysisEngine();
+
+        for (auto* audioSource : document->getAudioSources<juce::ARAAudioSource>())
+        {
+            Row row;
+            row.audioSource = audioSource;
+            row.name = juce::String::fromUTF8 (audioSource->getName() != nullptr ? audioSource->getName() : "");
+            row.sampleRate = audioSource->getSampleRate();
+
+            // A restored analysis shows up once its overview has been decoded
+            row.overview = engine.getOverview (audioSource);
+
+            newRows.push_back (std::move (row));
+        }
+    }
+
+    const auto isUnchanged = std::equal (rows.begin(), rows.end(), newRows.begin(), newRows.end(), [] (const Row& a, const Row& b)
+    {
+        return a.audioSource == b.audioSource && a.name == b.name && a.overview == b.overview;
+    });
+
+    if (! isUnchanged)
+    {
+        rows = std::move (newRows);
+        repaint();
+    }
+}
+
+//==============================================================================
+void HiFiTuneOverviewComponent::paint (juce::Graphics& g)
+{
+    g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId).darker (0.3f));
+
+    if (rows.empty())
+    {
+        g.setColour (juce::Colours::grey);
+        g.drawFittedText ("Audio sources show up here once they are added.", getLocalBounds().reduced (8), juce::Justification::centred, 2);
+        return;
+    }
+
+    const auto clip = g.getClipBounds();
+    const auto rowHeight = juce::jmin (maxRowHeight, getHeight() / (int) rows.size());
+
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const auto bounds = juce::Rectangle<int> (0, (int) i * rowHeight, getWidth(), rowHeight);
+
+        if (bounds.intersects (clip))
+            paintRow (g, rows[i], bounds.reduced (0, 1), { clip.getX(), clip.getRight() });
+    }
+}
+
+void HiFiTuneOverviewComponent::paintRow (juce::Graphics& g, const Row& row, juce::Rectangle<int> bounds, juce::Range<int> columns)
+{
+    g.setColour (juce::Colours::black.withAlpha (0.25f));
+    g.fillRect (bounds);
+
+    if (row.overview != nullptr && ! columns.isEmpty())
+    {
+        const auto numColumns = columns.getLength();
+        const auto samplesPerColumn = secondsPerPixel * row.sampleRate;
+        const auto firstSample = (startSeconds + columns.getStart() * secondsPerPixel) * row.sampleRate;
+
+        if (peakColumns.size() < (size_t) numColumns)
+        {
+            peakColumns.resize ((size_t) numColumns);
+            pitchColumns.resize ((size_t) numColumns);
+        }
+
+        row.overview->getPeaks (peakColumns.data(), numColumns, firstSample, samplesPerColumn);
+        row.overview->getPitch (pitchColumns.data(), numColumns, firstSample, samplesPerColumn);
+
+        const auto top = (float) bounds.getY(), height = (float) bounds.getHeight();
+        const auto centre = top + height * 0.5f;
+        const auto scale = height * 0.5f / hifitune::SourceOverview::Peak::fullScale;
+
+        juce::RectangleList<float> peakShape, rmsShape, pitchShape;
+
+        for (int i = 0; i < numColumns; ++i)
+        {
+            const auto x = (float) (columns.getStart() + i);
+            const auto& peak = peakColumns[(size_t) i];
+
+            if (peak.maxValue > peak.minValue)
+                peakShape.addWithoutMerging ({ x, centre - peak.maxValue * scale, 1.0f, (float) (peak.maxValue - peak.minValue) * scale });
+
+            if (peak.rms > 0)
+                rmsShape.addWithoutMerging ({ x, centre - peak.rms * scale, 1.0f, 2.0f * peak.rms * scale });
+
+            const auto& pitch = pitchColumns[(size_t) i];
+
+            if (pitch.isVoiced())
+            {
+                const auto toY = [&] (float note) { return top + height * (highestNote - note) / (highestNote - lowestNote); };
+                const auto highY = toY (pitch.highNote);
+                pitchShape.addWithoutMerging ({ x, highY - 1.0f, 1.0f, juce::jmax (2.0f, toY (pitch.lowNote) - highY + 1.0f) });
+            }
+        }
+
+        g.setColour (juce::Colours::steelblue.withAlpha (0.6f));
+        g.fillRectList (peakShape);
+        g.setColour (juce::Colours::lightsteelblue.withAlpha (0.6f));
+        g.fillRectList (rmsShape);
+
+        const juce::Graphics::ScopedSaveState state (g);
+        g.reduceClipRegion (bounds);
+        g.setColour (juce::Colours::orange);
+        g.fillRectList (pitchShape);
+    }
+
+    g.setColour (juce::Colours::white.withAlpha (0.8f));
+    g.drawText (row.overview != nullptr ? row.name : row.name + " (analysing)", bounds.reduced (6, 2), juce::Justification::topLeft);
+}
+
+//==============================================================================
+void HiFiTuneOverviewComponent::mouseDown (const juce::MouseEvent&)
+{
+    dragStartSeconds = startSeconds;
+}
+
+void HiFiTuneOverviewComponent::mouseDrag (const juce::MouseEvent& e)
+{
+    startSeconds = juce::jmax (0.0, dragStartSeconds - e.getDistanceFromDragStartX() * secondsPerPixel);
+    repaint();
+}
+
+void HiFiTuneOverviewComponent::mouseWheelMove (const juce::MouseEvent& e, const juce::MouseWheelDetails& wheel)
+{
+    if (! juce::exactlyEqual (wheel.deltaX, 0.0f))
+    {
+        startSeconds = juce::jmax (0.0, startSeconds - wheel.deltaX * 200.0 * secondsPerPixel);
+        repaint();
+    }
+
+    if (! juce::exactlyEqual (wheel.deltaY, 0.0f))
+        zoom (std::pow (2.0, -wheel.deltaY * 4.0), e.position.x);
+}
+
+void HiFiTuneOverviewComponent::mouseMagnify (const juce::MouseEvent& e, float scaleFactor)
+{
+    if (scaleFactor > 0.0f)
+        zoom (1.0 / scaleFactor, e.position.x);
+}
+
+void HiFiTuneOverviewComponent::zoom (double factor, float x)
+{
+    // Keeps the time under the mouse where it is
+    const auto anchor = startSeconds + x * secondsPerPixel;
+    secondsPerPixel = juce::jlimit (minSecondsPerPixel, maxSecondsPerPixel, secondsPerPixel * factor);
+    startSeconds = juce::jmax (0.0, anchor - x * secondsPerPixel);
+    repaint();
+}
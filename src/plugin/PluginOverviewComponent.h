@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    This file contains the editor view drawing the waveform and pitch of each source.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include "engine/SourceOverview.h"
+
+class HiFiTuneDocumentController;
+
+//==============================================================================
+/**
+    Draws one row per audio source of a document: its waveform, and the pitch
+    the analysis detected on top of it, on a shared time axis. The mouse wheel
+    (or a pinch) zooms around the mouse, and dragging scrolls.
+
+    Everything drawn comes from the SourceOverview of each source's analysis,
+    at the resolution that matches the zoom, so painting never reads source
+    audio or feature data, and costs the same at any zoom level. Sources
+    are listed straight away, and drawn once their analysis is available.
+*/
+class HiFiTuneOverviewComponent  : public juce::Component
+{
+public:
+    //==============================================================================
+    HiFiTuneOverviewComponent() = default;
+
+    /** Shows the audio sources of a document, or nothing if either is null. */
+    void setDocument (HiFiTuneDocumentController*, juce::ARADocument*);
+
+    /** Picks up added, removed and newly analysed sources. Call this regularly
+        on the message thread.
+    */
+    void update();
+
+    //==============================================================================
+    void paint (juce::Graphics&) override;
+
+    void mouseDown (const juce::MouseEvent&) override;
+    void mouseDrag (const juce::MouseEvent&) override;
+    void mouseWheelMove (const juce::MouseEvent&, const juce::MouseWheelDetails&) override;
+    void mouseMagnify (const juce::MouseEvent&, float scaleFactor) override;
+
+private:
+    //==============================================================================
+    struct Row
+    {
+        const juce::ARAAudioSource* audioSource = nullptr;
+        juce::String name;
+        double sampleRate = 44100.0;
+        std::shared_ptr<const hifitune::SourceOverview> overview;
+    };
+
+    void zoom (double factor, float x);
+    void paintRow (juce::Graphics&, const Row&, juce::Rectangle<int> bounds, juce::Range<int> columns);
+
+    HiFiTuneDocumentController* documentController = nullptr;
+    juce::ARADocument* document = nullptr;
+    std::vector<Row> rows;
+
+    double startSeconds = 0.0, secondsPerPixel = 0.01, dragStartSeconds = 0.0;
+
+    // Kept between paints, so that painting stops allocating once they are wide enough
+    std::vector<hifitune::SourceOverview::Peak> peakColumns;
+    std::vector<hifitune::SourceOverview::PitchRange> pitchColumns;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTuneOverviewComponent)
+};
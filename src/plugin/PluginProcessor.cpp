@@ -8,6 +8,7 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "engine/Instrumentation.h"
 
 //==============================================================================
 HiFiTuneAudioProcessor::HiFiTuneAudioProcessor()
@@ -22,6 +23,13 @@ HiFiTuneAudioProcessor::HiFiTuneAudioProcessor()
                        )
 #endif
 {
+    addParameter (liveCorrection = new juce::AudioParameterBool (juce::ParameterID { "liveCorrection", 1 }, "Live Correction", true));
+    addParameter (correctionAmount = new juce::AudioParameterFloat (juce::ParameterID { "correctionAmount", 1 }, "Correction Amount",
+                                                                    juce::NormalisableRange<float> (0.0f, 100.0f), 100.0f,
+                                                                    juce::AudioParameterFloatAttributes().withLabel ("%")));
+    addParameter (retuneTime = new juce::AudioParameterFloat (juce::ParameterID { "retuneTime", 1 }, "Retune Time",
+                                                              juce::NormalisableRange<float> (0.0f, 200.0f, 0.0f, 0.5f), 20.0f,
+                                                              juce::AudioParameterFloatAttributes().withLabel ("ms")));
 }
 
 HiFiTuneAudioProcessor::~HiFiTuneAudioProcessor()
@@ -63,7 +71,7 @@ bool HiFiTuneAudioProcessor::isMidiEffect() const
 
 double HiFiTuneAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return isUsingLiveCorrection() ? liveCorrector.getTailLengthSeconds() : 0.0;
 }
 
 int HiFiTuneAudioProcessor::getNumPrograms()
@@ -93,14 +101,29 @@ void HiFiTuneAudioProcessor::changeProgramName (int index, const juce::String& n
 //==============================================================================
 void HiFiTuneAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Use this method as the place to do any pre-playback
-    // initialisation that you need..
+    if (! isUsingLiveCorrection())
+    {
+        setLatencySamples (0);
+        return;
+    }
+
+    liveCorrector.prepare (sampleRate, samplesPerBlock, juce::jmax (getTotalNumInputChannels(), getTotalNumOutputChannels()));
+    setLatencySamples (liveCorrector.getLatencySamples());
 }
 
 void HiFiTuneAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    liveCorrector.release();
+}
+
+bool HiFiTuneAudioProcessor::isUsingLiveCorrection() const
+{
+    // Bound to ARA, the playback renderers do all the processing
+   #if JucePlugin_Enable_ARA
+    return ! isBoundToARA();
+   #else
+    return true;
+   #endif
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -129,9 +152,10 @@ bool HiFiTuneAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
 }
 #endif
 
-void HiFiTuneAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void HiFiTuneAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer&)
 {
     juce::ScopedNoDenormals noDenormals;
+    const hifitune::Instrumentation::ScopedTimer blockTimer (hifitune::Instrumentation::EventType::processorBlock, buffer.getNumSamples());
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -144,18 +168,10 @@ void HiFiTuneAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // This is the place where you'd normally do the guts of your plugin's
-    // audio processing...
-    // Make sure to reset the state if your inner loop is processing
-    // the samples and the outer loop is handling the channels.
-    // Alternatively, you can process the samples with the channels
-    // interleaved by keeping the same state.
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
-    {
-        auto* channelData = buffer.getWritePointer (channel);
-
-        // ..do something to the data...
-    }
+    liveCorrector.setEnabled (liveCorrection->get());
+    liveCorrector.setAmount (correctionAmount->get() / 100.0f);
+    liveCorrector.setRetuneTime (retuneTime->get());
+    liveCorrector.process (buffer);
 }
 
 //==============================================================================
@@ -172,15 +188,26 @@ juce::AudioProcessorEditor* HiFiTuneAudioProcessor::createEditor()
 //==============================================================================
 void HiFiTuneAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    juce::XmlElement state ("HiFiTune");
+
+    for (auto* parameter : getParameters())
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*> (parameter))
+            state.setAttribute (withID->getParameterID(), (double) parameter->getValue());
+
+    copyXmlToBinary (state, destData);
 }
 
 void HiFiTuneAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    const auto state = getXmlFromBinary (data, sizeInBytes);
+
+    if (state == nullptr || ! state->hasTagName ("HiFiTune"))
+        return;
+
+    for (auto* parameter : getParameters())
+        if (auto* withID = dynamic_cast<juce::AudioProcessorParameterWithID*> (parameter))
+            if (state->hasAttribute (withID->getParameterID()))
+                parameter->setValueNotifyingHost ((float) state->getDoubleAttribute (withID->getParameterID()));
 }
 
 //==============================================================================
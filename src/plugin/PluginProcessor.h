@@ -9,6 +9,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "engine/LiveCorrector.h"
 
 //==============================================================================
 /**
@@ -58,5 +59,18 @@ public:
 
 private:
     //==============================================================================
+    bool isUsingLiveCorrection() const;
+
+    // Streaming correction for when there's no ARA host to render edits, e.g.
+    // to monitor a take while recording it. Its latency is reported whatever the
+    // parameters, so that switching correction on and off never moves the audio,
+    // and includes the host's block size: monitoring needs blocks of 512 samples
+    // or less to stay under 20 ms.
+    hifitune::LiveCorrector liveCorrector;
+
+    juce::AudioParameterBool* liveCorrection;
+    juce::AudioParameterFloat* correctionAmount;
+    juce::AudioParameterFloat* retuneTime;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HiFiTuneAudioProcessor)
 };